@@ -0,0 +1,100 @@
+#include "FlatMap.hpp"
+#include "FlowId.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+
+using namespace flowstats;
+
+/**
+ * Previous FlowId hash, a sum of the components hashes
+ */
+struct SumFlowIdHash {
+    auto operator()(FlowId const& flowId) const -> size_t
+    {
+        return std::hash<IPv4>()(flowId.getIp(0)) + std::hash<IPv4>()(flowId.getIp(1))
+            + std::hash<uint16_t>()(flowId.getPort(0)) + std::hash<uint16_t>()(flowId.getPort(1))
+            + std::hash<uint8_t>()(flowId.getNetwork())
+            + std::hash<uint8_t>()(flowId.getTransport());
+    }
+};
+
+static auto generateFlows(size_t numberFlows) -> std::vector<FlowId>
+{
+    std::mt19937 rng(42);
+    std::vector<FlowId> flows;
+    flows.reserve(numberFlows);
+    for (size_t i = 0; i < numberFlows; ++i) {
+        std::array<IPv4, 2> ips = { IPv4(rng()), IPv4(rng()) };
+        std::array<Port, 2> ports = { Port(rng()), 443 };
+        flows.emplace_back(ports, ips, Transport::TCP);
+    }
+    return flows;
+}
+
+template <typename Map, typename Key = FlowId>
+static auto benchMap(char const* name, std::vector<Key> const& flows,
+    std::vector<uint32_t> const& lookups) -> void
+{
+    auto start = std::chrono::steady_clock::now();
+    Map map;
+    for (size_t i = 0; i < flows.size(); ++i) {
+        map.emplace(flows[i], i);
+    }
+    auto inserted = std::chrono::steady_clock::now();
+
+    uint64_t sum = 0;
+    for (auto index : lookups) {
+        auto it = map.find(flows[index]);
+        if (it != map.end()) {
+            sum += it->second;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double insertS = std::chrono::duration<double>(inserted - start).count();
+    double lookupS = std::chrono::duration<double>(end - inserted).count();
+    printf("%-20s %10zu flows: insert %8.2f Mops/s, lookup %8.2f Mops/s (%lu)\n",
+        name, flows.size(),
+        flows.size() / insertS / 1e6,
+        lookups.size() / lookupS / 1e6,
+        sum);
+}
+
+/**
+ * Compare lookups/s of the connection table against the previous
+ * std::unordered_map. Flows carry a 8 bytes value to fit 50M flows in
+ * memory, the table layout is what is measured.
+ */
+auto main(int argc, char* argv[]) -> int
+{
+    std::vector<size_t> sizes = { 1000000, 10000000, 50000000 };
+    if (argc > 1) {
+        sizes.clear();
+        for (int i = 1; i < argc; ++i) {
+            sizes.push_back(strtoul(argv[i], nullptr, 10));
+        }
+    }
+
+    for (auto numberFlows : sizes) {
+        auto flows = generateFlows(numberFlows);
+        std::mt19937 rng(7);
+        std::vector<uint32_t> lookups(10000000);
+        for (auto& lookup : lookups) {
+            lookup = rng() % numberFlows;
+        }
+        benchMap<std::unordered_map<FlowId, uint64_t, SumFlowIdHash>>("unordered_map (sum)", flows, lookups);
+        benchMap<std::unordered_map<FlowId, uint64_t>>("unordered_map", flows, lookups);
+        benchMap<FlatMap<FlowId, uint64_t>>("FlatMap", flows, lookups);
+
+        std::vector<FlowKeyV4> ipv4Keys;
+        ipv4Keys.reserve(flows.size());
+        for (auto const& flowId : flows) {
+            ipv4Keys.push_back(flowId.getIpv4Key());
+        }
+        benchMap<FlatMap<FlowKeyV4, uint64_t>>("FlatMap (ipv4 key)", ipv4Keys, lookups);
+    }
+    return 0;
+}
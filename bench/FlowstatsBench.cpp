@@ -0,0 +1,354 @@
+#include "Collector.hpp"
+#include "CollectorOutput.hpp"
+#include "DnsStatsCollector.hpp"
+#include "PacketClassifier.hpp"
+#include "PcapFileReader.hpp"
+#include "SslStatsCollector.hpp"
+#include "TcpStatsCollector.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fmt/format.h>
+#include <getopt.h>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+using namespace flowstats;
+
+/**
+ * Captured frame copied in memory, timestamps are rebased so that the
+ * frames of all pcaps follow each other
+ */
+struct PreloadedPacket {
+    pcap_pkthdr header;
+    std::vector<uint8_t> data;
+    size_t decoderIndex;
+};
+
+struct Corpus {
+    std::vector<PreloadedPacket> packets;
+    std::vector<PacketDecoder> decoders;
+    // Seconds between the first frame and the last one
+    time_t span = 0;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    uint64_t items;
+    double realSeconds;
+    double cpuSeconds;
+};
+
+time_t const corpusStart = 1600000000;
+
+static auto cpuSeconds() -> double
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Call fun until minSeconds elapsed, fun returns the number of items it
+ * processed
+ */
+template <typename Fun>
+static auto runBench(std::string name, double minSeconds, Fun fun) -> BenchResult
+{
+    BenchResult res = { std::move(name), 0, 0, 0, 0 };
+    auto start = std::chrono::steady_clock::now();
+    double cpuStart = cpuSeconds();
+    do {
+        res.items += fun(res.iterations);
+        res.iterations++;
+        res.realSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (res.realSeconds < minSeconds);
+    res.cpuSeconds = cpuSeconds() - cpuStart;
+    printf("%-45s %10lu iterations %12.0f ns/iteration %12.0f items/s\n",
+        res.name.c_str(), res.iterations,
+        res.realSeconds * 1e9 / res.iterations,
+        res.items / res.realSeconds);
+    return res;
+}
+
+static auto loadCorpus(std::vector<std::string> const& pcaps) -> Corpus
+{
+    Corpus corpus;
+    time_t nextStart = corpusStart;
+    for (auto const& pcap : pcaps) {
+        PcapFileReader reader(pcap);
+        if (!reader.open("")) {
+            continue;
+        }
+        corpus.decoders.emplace_back(reader.getLinkType());
+        pcap_pkthdr header;
+        uint8_t const* data;
+        time_t first = 0;
+        time_t last = nextStart;
+        while (reader.next(&header, &data)) {
+            if (header.ts.tv_sec == 0) {
+                break;
+            }
+            if (first == 0) {
+                first = header.ts.tv_sec;
+            }
+            header.ts.tv_sec = header.ts.tv_sec - first + nextStart;
+            last = std::max(last, header.ts.tv_sec);
+            corpus.packets.push_back({ header, std::vector<uint8_t>(data, data + header.caplen),
+                corpus.decoders.size() - 1 });
+        }
+        nextStart = last + 1;
+    }
+    corpus.span = nextStart - corpusStart;
+    return corpus;
+}
+
+/**
+ * Collectors sharing a configuration and an ip to fqdn mapping
+ */
+struct BenchCollectors {
+    explicit BenchCollectors(bool perIpAggr = false)
+        : ipToFqdn(conf)
+    {
+        conf.setDisplayUnknownFqdn(true);
+        conf.setPerIpAggr(perIpAggr);
+    }
+
+    ~BenchCollectors()
+    {
+        for (auto* collector : collectors) {
+            delete collector;
+        }
+    }
+
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn;
+    std::vector<Collector*> collectors;
+};
+
+/**
+ * Replay the corpus through the decoder and collectors like
+ * PktSource::processPacketSource does, each replay is shifted after the
+ * previous one so flows are created and timed out again
+ */
+static auto benchProcessPacket(std::string const& name, Corpus* corpus,
+    double minSeconds, std::vector<CollectorProtocol> const& protocols) -> BenchResult
+{
+    BenchCollectors bench;
+    for (auto protocol : protocols) {
+        switch (protocol) {
+        case DNS:
+            bench.collectors.push_back(new DnsStatsCollector(bench.conf, bench.displayConf, &bench.ipToFqdn));
+            break;
+        case SSL:
+            bench.collectors.push_back(new SslStatsCollector(bench.conf, bench.displayConf, &bench.ipToFqdn));
+            break;
+        case TCP:
+            bench.collectors.push_back(new TcpStatsCollector(bench.conf, bench.displayConf, &bench.ipToFqdn));
+            break;
+        }
+    }
+    time_t replaySpan = corpus->span + bench.conf.getTimeoutFlow() + 2;
+    PacketDispatcher dispatcher(bench.collectors);
+    return runBench(name, minSeconds, [&](uint64_t iteration) -> uint64_t {
+        time_t shift = iteration * replaySpan;
+        for (auto const& packet : corpus->packets) {
+            pcap_pkthdr header = packet.header;
+            header.ts.tv_sec += shift;
+            PacketView view;
+            if (!corpus->decoders[packet.decoderIndex].decode(header, packet.data.data(), &view)) {
+                continue;
+            }
+            dispatcher.dispatch(view, view.getFlowId());
+        }
+        return corpus->packets.size();
+    });
+}
+
+static auto synPacket(uint32_t index, uint32_t numberServers, timeval ts) -> PacketView
+{
+    PacketView view;
+    view.ts = ts;
+    view.frameSize = 74;
+    view.network = Network::IPV4;
+    view.transport = Transport::TCP;
+    // 10.0.0.0/8 clients, 172.16.0.0/12 servers
+    view.ips = { IPv4(htonl(0x0a000000 + index)), IPv4(htonl(0xac100000 + index % numberServers)) };
+    view.ports = { Port(1024 + index % 60000), 443 };
+    view.flags = Tins::TCP::SYN;
+    view.seq = index;
+    return view;
+}
+
+/**
+ * Open flows with a syn each, spread over the flow timeout
+ */
+static auto openFlows(TcpStatsCollector* collector, uint32_t numberFlows,
+    uint32_t numberServers, int timeoutFlow) -> void
+{
+    for (uint32_t i = 0; i < numberFlows; ++i) {
+        timeval ts = { corpusStart + time_t(i % timeoutFlow), 0 };
+        auto view = synPacket(i, numberServers, ts);
+        collector->processPacket(view, view.getFlowId());
+    }
+}
+
+/**
+ * Advance one second at a time until every flow timed out
+ */
+static auto benchAdvanceTick(uint32_t numberFlows) -> BenchResult
+{
+    BenchCollectors bench;
+    auto* collector = new TcpStatsCollector(bench.conf, bench.displayConf, &bench.ipToFqdn);
+    bench.collectors.push_back(collector);
+    int timeoutFlow = bench.conf.getTimeoutFlow();
+    openFlows(collector, numberFlows, 1024, timeoutFlow);
+
+    // Flows are only opened once, a single iteration is measured
+    time_t tick = corpusStart;
+    return runBench(fmt::format("advanceTick/{}_flows", numberFlows), 0,
+        [&](uint64_t) -> uint64_t {
+            for (int i = 0; i < 2 * timeoutFlow + 2; ++i) {
+                collector->advanceTick({ ++tick, 0 });
+            }
+            return numberFlows;
+        });
+}
+
+static auto benchOutputs(uint32_t numberAggregates, double minSeconds) -> std::vector<BenchResult>
+{
+    // Each server ip has its own aggregate
+    BenchCollectors bench(true);
+    auto* collector = new TcpStatsCollector(bench.conf, bench.displayConf, &bench.ipToFqdn);
+    bench.collectors.push_back(collector);
+    openFlows(collector, numberAggregates, numberAggregates, bench.conf.getTimeoutFlow());
+    collector->publishSnapshot();
+    auto snapshot = collector->getSnapshot();
+
+    std::vector<BenchResult> res;
+    CollectorOutput output;
+    res.push_back(runBench(fmt::format("outputStatus/{}_aggregates", numberAggregates), minSeconds,
+        [&](uint64_t) -> uint64_t {
+            collector->outputStatus(*snapshot, 0, &output, 0, SIZE_MAX);
+            return snapshot->getFlows().size();
+        }));
+    res.push_back(runBench(fmt::format("outputStatus/{}_aggregates/screen", numberAggregates), minSeconds,
+        [&](uint64_t) -> uint64_t {
+            collector->outputStatus(*snapshot, 0, &output, 0, 50);
+            return snapshot->getFlows().size();
+        }));
+    res.push_back(runBench(fmt::format("getStatsdMetrics/{}_aggregates", numberAggregates), minSeconds,
+        [&](uint64_t) -> uint64_t {
+            auto metrics = collector->getStatsdMetrics();
+            return snapshot->getFlows().size();
+        }));
+    return res;
+}
+
+/**
+ * Same layout as Google Benchmark json output, existing comparison
+ * tools can read it
+ */
+static auto writeJson(std::string const& fileName, std::vector<BenchResult> const& results) -> bool
+{
+    FILE* out = fopen(fileName.c_str(), "w");
+    if (out == nullptr) {
+        spdlog::error("Could not open {}", fileName);
+        return false;
+    }
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    fmt::memory_buffer buffer;
+    fmt::format_to(std::back_inserter(buffer),
+        "{{\n  \"context\": {{\n    \"date\": \"{}\",\n    \"executable\": \"flowstats_bench\",\n"
+        "    \"num_cpus\": {},\n    \"library_build_type\": \"{}\"\n  }},\n  \"benchmarks\": [\n",
+        date, std::thread::hardware_concurrency(),
+#ifdef NDEBUG
+        "release"
+#else
+        "debug"
+#endif
+    );
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto const& result = results[i];
+        fmt::format_to(std::back_inserter(buffer),
+            "    {{\n      \"name\": \"{}\",\n      \"run_type\": \"iteration\",\n"
+            "      \"iterations\": {},\n      \"real_time\": {:.1f},\n      \"cpu_time\": {:.1f},\n"
+            "      \"time_unit\": \"ns\",\n      \"items_per_second\": {:.1f}\n    }}{}\n",
+            result.name, result.iterations,
+            result.realSeconds * 1e9 / result.iterations,
+            result.cpuSeconds * 1e9 / result.iterations,
+            result.items / result.realSeconds,
+            i + 1 < results.size() ? "," : "");
+    }
+    fmt::format_to(std::back_inserter(buffer), "  ]\n}}\n");
+    fwrite(buffer.data(), 1, buffer.size(), out);
+    fclose(out);
+    return true;
+}
+
+static auto usage() -> void
+{
+    printf("flowstats_bench [-j output.json] [-m minSeconds] [pcap...]\n"
+           "    -j           : Write results as json to this file\n"
+           "    -m           : Minimum duration of each benchmark, 1s by default\n"
+           "Pcaps default to the test pcaps\n");
+    exit(0);
+}
+
+/**
+ * Measure packets/s through the collectors over pcaps preloaded in
+ * memory, flow expiry and the outputs of large aggregate tables
+ */
+auto main(int argc, char* argv[]) -> int
+{
+    std::string jsonFile;
+    double minSeconds = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:m:h")) != -1) {
+        switch (opt) {
+        case 'j':
+            jsonFile = optarg;
+            break;
+        case 'm':
+            minSeconds = strtod(optarg, nullptr);
+            break;
+        default:
+            usage();
+        }
+    }
+    std::vector<std::string> pcaps;
+    for (int i = optind; i < argc; ++i) {
+        pcaps.emplace_back(argv[i]);
+    }
+    if (pcaps.empty()) {
+        for (auto const* pcap : { "0_win.pcap", "6_sec_srt_extract.pcap", "dns_rcrds.pcap",
+                 "dns_simple.pcap", "https.pcap", "ipv6.pcap", "reuse_port.pcap",
+                 "ssl_alt_port.pcap", "ssl_simple.pcap", "tcp_simple.pcap", "testcom.pcap",
+                 "tls_stream_extract.pcap" }) {
+            pcaps.push_back(fmt::format("{}/{}", BENCH_PCAP_PATH, pcap));
+        }
+    }
+    spdlog::set_level(spdlog::level::warn);
+
+    auto corpus = loadCorpus(pcaps);
+    printf("Loaded %zu packets from %zu pcaps\n", corpus.packets.size(), pcaps.size());
+
+    std::vector<BenchResult> results;
+    results.push_back(benchProcessPacket("processPacket/all", &corpus, minSeconds, { DNS, SSL, TCP }));
+    results.push_back(benchProcessPacket("processPacket/tcp", &corpus, minSeconds, { TCP }));
+    results.push_back(benchProcessPacket("processPacket/dns", &corpus, minSeconds, { DNS }));
+    results.push_back(benchProcessPacket("processPacket/ssl", &corpus, minSeconds, { SSL }));
+    results.push_back(benchAdvanceTick(1000000));
+    for (auto& result : benchOutputs(100000, minSeconds)) {
+        results.push_back(std::move(result));
+    }
+
+    if (!jsonFile.empty() && !writeJson(jsonFile, results)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include "TrafficGenerator.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <spdlog/spdlog.h>
+
+#define EXIT_WITH_ERROR(reason, ...)                      \
+    do {                                                  \
+        printf("\nError: " reason "\n\n", ##__VA_ARGS__); \
+        printUsage();                                     \
+        exit(1);                                          \
+    } while (0)
+
+static struct option FlowGenOptions[] = {
+    { "output-file", required_argument, nullptr, 'o' },
+    { "ground-truth", required_argument, nullptr, 'g' },
+    { "seed", required_argument, nullptr, 's' },
+    { "duration", required_argument, nullptr, 'd' },
+    { "connection-rate", required_argument, nullptr, 'c' },
+    { "tls", required_argument, nullptr, 't' },
+    { "fqdns", required_argument, nullptr, 'n' },
+    { "clients", required_argument, nullptr, 'C' },
+    { "flow-duration", required_argument, nullptr, 'D' },
+    { "requests", required_argument, nullptr, 'r' },
+    { "connect-time", required_argument, nullptr, 'T' },
+    { "srt", required_argument, nullptr, 'S' },
+    { "request-size", required_argument, nullptr, 'Q' },
+    { "response-size", required_argument, nullptr, 'R' },
+    { "dns-rate", required_argument, nullptr, 'q' },
+    { "dns-aaaa", required_argument, nullptr, 'a' },
+    { "dns-tcp", required_argument, nullptr, 'p' },
+    { "dns-timeout", required_argument, nullptr, 'x' },
+    { "dns-time", required_argument, nullptr, 'm' },
+
+    { "verbose", no_argument, nullptr, 'v' },
+    { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 }
+};
+
+/**
+ * Print application usage
+ */
+static auto printUsage()
+{
+    printf("\nUsage: \n"
+           "----------------------\n"
+           "flowgen -o pcap_file [-g ground_truth.json] [options] -hv \n"
+           "\nOptions:\n\n"
+           "    -o           : The pcap file to write\n"
+           "    -g           : Json file receiving what flowstats should measure, stdout by default\n"
+           "    -s           : Seed, the same options and seed always give the same pcap. Default 1\n"
+           "    -d           : Seconds of traffic. Default 60\n"
+           "    -c           : New tcp connections per second. Default 1000\n"
+           "    -t           : Fraction of connections opened with a tls ClientHello. Default 0.5\n"
+           "    -n           : Number of fqdns, each with its own server ip. Default 1000\n"
+           "    -C           : Number of client ips. Default 1000\n"
+           "    -D           : Flow duration distribution in ms. Default exp:10000\n"
+           "    -r           : Requests per connection distribution. Default uniform:1:8\n"
+           "    -T           : Connect time distribution in ms. Default lognormal:20:0.5\n"
+           "    -S           : Server response time distribution in ms. Default lognormal:50:0.8\n"
+           "    -Q           : Request size in bytes. Default 200\n"
+           "    -R           : Response size in bytes. Default 1000\n"
+           "    -q           : Dns queries per second, on top of the resolution before\n"
+           "                   the first connection to each fqdn. Default 100\n"
+           "    -a           : Fraction of AAAA dns queries. Default 0.3\n"
+           "    -p           : Fraction of dns queries over tcp. Default 0.05\n"
+           "    -x           : Fraction of unanswered dns queries. Default 0.01\n"
+           "    -m           : Dns response time distribution in ms. Default exp:5\n"
+           "    -v           : Verbose log\n"
+           "    -h           : Displays this help message and exits\n"
+           "\nDistributions are const:value, uniform:min:max, exp:mean or lognormal:median:sigma.\n"
+           "Idle time between requests above the flow timeout of flowstats expires flows.\n\n");
+    exit(0);
+}
+
+static auto parseDistribution(char const* arg) -> flowstats::Distribution
+{
+    auto distribution = flowstats::Distribution::parse(arg);
+    if (!distribution.has_value()) {
+        EXIT_WITH_ERROR("Invalid distribution %s", arg);
+    }
+    return *distribution;
+}
+
+/**
+ * Write frames in the classic pcap format with microsecond timestamps
+ */
+static auto writePcap(flowstats::TrafficGenerator* generator, FILE* out) -> bool
+{
+    struct {
+        uint32_t magic = 0xa1b2c3d4;
+        uint16_t versionMajor = 2;
+        uint16_t versionMinor = 4;
+        int32_t thisZone = 0;
+        uint32_t sigFigs = 0;
+        uint32_t snapLen = 65535;
+        uint32_t linkType = DLT_EN10MB;
+    } fileHeader;
+    if (fwrite(&fileHeader, sizeof(fileHeader), 1, out) != 1) {
+        return false;
+    }
+
+    pcap_pkthdr header;
+    uint8_t const* data;
+    while (generator->next(&header, &data)) {
+        uint32_t record[4] = { uint32_t(header.ts.tv_sec), uint32_t(header.ts.tv_usec),
+            header.caplen, header.len };
+        if (fwrite(record, sizeof(record), 1, out) != 1
+            || fwrite(data, header.caplen, 1, out) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * main method of this utility
+ */
+auto main(int argc, char* argv[]) -> int
+{
+    flowstats::TrafficProfile profile;
+    std::string outputFile;
+    std::string groundTruthFile;
+
+    int optionIndex = 0;
+    int opt = 0;
+
+    while ((opt = getopt_long(argc, argv, "o:g:s:d:c:t:n:C:D:r:T:S:Q:R:q:a:p:x:m:vh",
+                FlowGenOptions, &optionIndex))
+        != -1) {
+        switch (opt) {
+        case 0:
+            break;
+        case 'o':
+            outputFile = optarg;
+            break;
+        case 'g':
+            groundTruthFile = optarg;
+            break;
+        case 's':
+            profile.seed = strtoull(optarg, nullptr, 10);
+            break;
+        case 'd':
+            profile.durationSeconds = atoi(optarg);
+            break;
+        case 'c':
+            profile.connectionRate = atof(optarg);
+            break;
+        case 't':
+            profile.tlsFraction = atof(optarg);
+            break;
+        case 'n':
+            profile.numberFqdns = atoi(optarg);
+            break;
+        case 'C':
+            profile.numberClients = atoi(optarg);
+            break;
+        case 'D':
+            profile.flowDuration = parseDistribution(optarg);
+            break;
+        case 'r':
+            profile.requestsPerFlow = parseDistribution(optarg);
+            break;
+        case 'T':
+            profile.connectTime = parseDistribution(optarg);
+            break;
+        case 'S':
+            profile.srt = parseDistribution(optarg);
+            break;
+        case 'Q':
+            profile.requestSize = atoi(optarg);
+            break;
+        case 'R':
+            profile.responseSize = atoi(optarg);
+            break;
+        case 'q':
+            profile.dnsRate = atof(optarg);
+            break;
+        case 'a':
+            profile.aaaaFraction = atof(optarg);
+            break;
+        case 'p':
+            profile.dnsTcpFraction = atof(optarg);
+            break;
+        case 'x':
+            profile.dnsTimeoutFraction = atof(optarg);
+            break;
+        case 'm':
+            profile.dnsResponseTime = parseDistribution(optarg);
+            break;
+        case 'v':
+            spdlog::set_level(spdlog::level::debug);
+            break;
+        case 'h':
+            printUsage();
+            break;
+        default:
+            printUsage();
+            exit(-1);
+        }
+    }
+
+    if (outputFile.empty()) {
+        EXIT_WITH_ERROR("No output pcap file was provided");
+    }
+
+    FILE* out = fopen(outputFile.c_str(), "wb");
+    if (out == nullptr) {
+        spdlog::error("Could not open {}", outputFile);
+        exit(-1);
+    }
+    setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+    flowstats::TrafficGenerator generator(profile);
+    auto start = std::chrono::steady_clock::now();
+    bool written = writePcap(&generator, out);
+    if (fclose(out) != 0 || !written) {
+        spdlog::error("Could not write {}", outputFile);
+        exit(-1);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const& groundTruth = generator.getGroundTruth();
+    spdlog::info("Wrote {} packets, {} bytes in {:.1f}s, {:.0f} packets/s",
+        groundTruth.packets, groundTruth.bytes, elapsed.count(),
+        groundTruth.packets / elapsed.count());
+
+    auto json = groundTruth.toJson(10);
+    if (groundTruthFile.empty()) {
+        fputs(json.c_str(), stdout);
+        return 0;
+    }
+    FILE* truthOut = fopen(groundTruthFile.c_str(), "w");
+    if (truthOut == nullptr) {
+        spdlog::error("Could not open {}", groundTruthFile);
+        exit(-1);
+    }
+    fputs(json.c_str(), truthOut);
+    fclose(truthOut);
+    return 0;
+}
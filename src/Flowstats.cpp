@@ -27,12 +27,20 @@ static struct option FlowStatsOptions[] = {
     { "max-results", required_argument, nullptr, 'm' },
     { "resolve-domains", required_argument, nullptr, 'd' },
     { "server-ports", required_argument, nullptr, 'k' },
+    { "threads", required_argument, nullptr, 't' },
+    { "ring-block-size", required_argument, nullptr, 'B' },
+    { "ring-blocks", required_argument, nullptr, 'N' },
+    { "fanout-group", required_argument, nullptr, 'F' },
+    { "percentile-error", required_argument, nullptr, 'e' },
+    { "dns-memory", required_argument, nullptr, 'D' },
+    { "statsd-summary", no_argument, nullptr, 's' },
 
     { "ignore-unknown-fqdn", no_argument, nullptr, 'u' },
     { "no-curses", no_argument, nullptr, 'n' },
     { "no-display", no_argument, nullptr, 'c' },
     { "verbose", no_argument, nullptr, 'v' },
     { "per-ip-aggr", no_argument, nullptr, 'w' },
+    { "mmap-ring", no_argument, nullptr, 'r' },
     { "list-interfaces", no_argument, nullptr, 'l' },
     { "help", no_argument, nullptr, 'h' },
     { nullptr, 0, nullptr, 0 }
@@ -47,11 +55,20 @@ static auto printUsage()
            "----------------------\n"
            "flowstats -f input_file -i iface [-m maxResults] [-a ddagentAddr] -hvl \n"
            "\nOptions:\n\n"
-           "    -f           : The input pcap/pcapng file to analyze\n"
+           "    -f           : The input pcap/pcapng file to analyze, optionally zstd or gzip compressed\n"
            "    -i           : The iface to capture\n"
            "    -a           : Address of the ddagent\n"
+           "    -s           : Send count, avg, p50, p95, p99 and max gauges instead of histogram values\n"
            "    -b           : Bpf filter to apply\n"
            "    -m           : Maximum number of result to display\n"
+           "    -e           : Relative error of percentiles, defaults to 0.01\n"
+           "    -t           : Number of capture workers, flows are sharded between them\n"
+           "    -r           : Capture with an AF_PACKET TPACKET_V3 mmap ring instead of libpcap, ethernet interfaces only\n"
+           "    -B           : Size in bytes of a ring block, multiple of the page size\n"
+           "    -N           : Number of ring blocks\n"
+           "    -F           : Join the PACKET_FANOUT group to share the interface with other flowstats\n"
+           "    -D           : Megabytes of pending dns queries per worker, the oldest are evicted past it.\n"
+           "                   The table doubles and briefly holds both arrays, the limit covers it. Default 600, 1.5M queries\n"
            "    -v           : Verbose log\n"
            "    -h           : Displays this help message and exits\n"
            "    -l           : Print the list of interfaces and exists\n\n");
@@ -74,7 +91,7 @@ auto main(int argc, char* argv[]) -> int
     int optionIndex = 0;
     int opt = 0;
 
-    while ((opt = getopt_long(argc, argv, "k:i:a:f:o:b:m:p:d:cnuwhvl", FlowStatsOptions,
+    while ((opt = getopt_long(argc, argv, "k:i:a:f:o:b:m:p:d:t:B:N:F:e:D:scnuwrhvl", FlowStatsOptions,
                 &optionIndex))
         != -1) {
         switch (opt) {
@@ -92,6 +109,27 @@ auto main(int argc, char* argv[]) -> int
         case 'm':
             displayConf.maxResults = atoi(optarg);
             break;
+        case 't':
+            conf.setWorkerThreads(std::max(1, atoi(optarg)));
+            break;
+        case 'e':
+            flowstats::Percentile::setRelativeError(atof(optarg));
+            break;
+        case 's':
+            conf.setStatsdMode(flowstats::StatsdSummary);
+            break;
+        case 'B':
+            conf.setRingBlockSize(atoi(optarg));
+            break;
+        case 'N':
+            conf.setRingBlockCount(std::max(1, atoi(optarg)));
+            break;
+        case 'F':
+            conf.setFanoutGroup(atoi(optarg));
+            break;
+        case 'D':
+            conf.setDnsTableBytes(size_t(std::max(1, atoi(optarg))) << 20);
+            break;
         case 'f':
             conf.setPcapFileName(optarg);
             break;
@@ -123,6 +161,9 @@ auto main(int argc, char* argv[]) -> int
         case 'w':
             conf.setPerIpAggr(true);
             break;
+        case 'r':
+            conf.setUseMmapRing(true);
+            break;
         case 'l':
             flowstats::listInterfaces();
             break;
@@ -137,17 +178,27 @@ auto main(int argc, char* argv[]) -> int
     }
 
     conf.setAgentConf(DogFood::Configure(agentAddr));
-    std::vector<flowstats::Collector*> collectors;
     conf.setDomainToServerPort(flowstats::getDomainToServerPort(initialServerPorts));
 
     flowstats::IpToFqdn ipToFqdn(conf, initialDomains, localhostIp);
 
-    collectors.push_back(
-        new flowstats::DnsStatsCollector(conf, displayConf, &ipToFqdn));
-    collectors.push_back(new flowstats::SslStatsCollector(conf,
-        displayConf, &ipToFqdn));
-    collectors.push_back(
-        new flowstats::TcpStatsCollector(conf, displayConf, &ipToFqdn));
+    auto createCollectors = [&]() {
+        std::vector<flowstats::Collector*> res;
+        res.push_back(
+            new flowstats::DnsStatsCollector(conf, displayConf, &ipToFqdn));
+        res.push_back(new flowstats::SslStatsCollector(conf,
+            displayConf, &ipToFqdn));
+        res.push_back(
+            new flowstats::TcpStatsCollector(conf, displayConf, &ipToFqdn));
+        return res;
+    };
+    std::vector<flowstats::Collector*> collectors = createCollectors();
+    for (int i = 1; i < conf.getWorkerThreads(); ++i) {
+        auto shards = createCollectors();
+        for (size_t j = 0; j < collectors.size(); ++j) {
+            collectors[j]->addShard(shards[j]);
+        }
+    }
 
     std::atomic_bool shouldStop = false;
     flowstats::Screen screen(&shouldStop, &displayConf, collectors);
@@ -158,7 +209,7 @@ auto main(int argc, char* argv[]) -> int
         pktSource.analyzePcapFile();
     } else {
         std::vector<Tins::IPv4Address> localIps = pktSource.getLocalIps();
-        ipToFqdn.updateFqdn("localhost", localIps, {});
+        ipToFqdn.updateFqdn(flowstats::internFqdn("localhost"), localIps, {});
         pktSource.analyzeLiveTraffic();
     }
 
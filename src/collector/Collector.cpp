@@ -1,8 +1,11 @@
 #include "Collector.hpp"
 #include "FlowId.hpp"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cassert>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <ostream>
@@ -11,60 +14,49 @@
 
 namespace flowstats {
 
-void Collector::sendMetrics()
+AggregatedSnapshot::AggregatedSnapshot(std::vector<std::shared_ptr<Flow const>> ownedFlows)
+    : ownedFlows(std::move(ownedFlows))
 {
-    auto agentConf = conf.getAgentConf();
-    if (!agentConf.has_value()) {
-        return;
-    }
-    std::vector<std::string> metrics = getStatsdMetrics();
-    for (auto& metric : metrics) {
-        SPDLOG_DEBUG("Sending {}", metric);
-        DogFood::Send(metric, agentConf.value());
+    flows.reserve(this->ownedFlows.size());
+    for (auto const& flow : this->ownedFlows) {
+        flows.push_back(flow.get());
     }
 }
 
-auto Collector::outputFlow(Flow const* flow,
-    std::vector<std::string>* keyLines,
-    std::vector<std::string>* valueLines,
-    int position) const -> void
+auto Collector::outputFlow(Flow const* flow, CollectorOutput* output) const -> void
 {
-    for (int j = FROM_CLIENT; j <= FROM_SERVER; ++j) {
-        auto direction = static_cast<Direction>(j);
-        std::map<Field, std::string> values;
-        flow->fillValues(&values, direction);
-        if (position == -1) {
-            keyLines->push_back(flowFormatter.outputKey(values));
-            valueLines->push_back(flowFormatter.outputValue(values));
-        } else {
-            keyLines->at(position) = flowFormatter.outputKey(values);
-            valueLines->at(position++) = flowFormatter.outputValue(values);
-        }
-    }
+    flowFormatter.outputRow(flow, FROM_CLIENT, output);
+    flowFormatter.outputRow(flow, FROM_SERVER, output);
 }
 
 auto Collector::fillOutputs(std::vector<Flow const*> const& aggregatedFlows,
-    std::vector<std::string>* keyLines,
-    std::vector<std::string>* valueLines)
+    CollectorOutput* output, size_t firstFlow, size_t numFlows)
 {
-    FlowFormatter flowFormatter = getFlowFormatter();
-
     totalFlow->resetFlow(true);
 
-    keyLines->resize(2);
-    valueLines->resize(2);
-
-    int i = 0;
+    std::vector<Flow const*> filteredFlows;
+    filteredFlows.reserve(aggregatedFlows.size());
     for (auto const* flow : aggregatedFlows) {
         if (flow->getFqdn().find(displayConf.filter) == std::string::npos) {
             continue;
         }
         totalFlow->addAggregatedFlow(flow);
-        if (i++ <= displayConf.maxResults) {
-            outputFlow(flow, keyLines, valueLines, -1);
-        }
+        filteredFlows.push_back(flow);
+    }
+    // Percentiles of the total don't depend on the order of the flows
+    totalFlow->mergePercentiles();
+
+    // Only the requested window of rows needs to be ordered
+    size_t displayed = std::min(filteredFlows.size(), size_t(std::max(displayConf.maxResults + 1, 0)));
+    size_t begin = std::min(firstFlow, displayed);
+    size_t end = begin + std::min(numFlows, displayed - begin);
+    sortFlows(&filteredFlows, begin, end);
+    output->setFlowWindow(begin, displayed);
+    // Totals are complete after the filtering pass, they go first
+    outputFlow(totalFlow, output);
+    for (size_t i = begin; i < end; ++i) {
+        outputFlow(filteredFlows[i], output);
     }
-    outputFlow(totalFlow, keyLines, valueLines, 0);
 }
 
 auto Collector::fillSortFields() -> void
@@ -89,90 +81,236 @@ auto Collector::getSortFun(Field field) const -> sortFlowFun
     switch (field) {
     case Field::FQDN:
         return &Flow::sortByFqdn;
+    default:
+        return nullptr;
+    }
+}
+
+auto Collector::getSortKeyFun(Field field) const -> sortKeyFun
+{
+    switch (field) {
     case Field::IP:
-        return &Flow::sortByIp;
+        return &Flow::sortKeyIp;
     case Field::PORT:
-        return &Flow::sortByPort;
+        return &Flow::sortKeyPort;
     case Field::BYTES_RATE:
-        return &Flow::sortByBytes;
+        return &Flow::sortKeyBytes;
     case Field::BYTES:
-        return &Flow::sortByTotalBytes;
+        return &Flow::sortKeyTotalBytes;
     case Field::PKTS_RATE:
-        return &Flow::sortByPackets;
+        return &Flow::sortKeyPackets;
     case Field::PKTS:
-        return &Flow::sortByTotalPackets;
+        return &Flow::sortKeyTotalPackets;
     default:
         return nullptr;
     }
 }
 
-auto Collector::mergePercentiles() -> void
+/**
+ * Add the flows of a shard to the merged flows of the same key, only the
+ * keys already present in merged are copied
+ */
+auto Collector::mergeAggregatedFlows(AggregatedMap* merged, AggregatedMap const& shardMap) -> void
+{
+    for (auto& pair : *merged) {
+        auto it = shardMap.find(pair.first);
+        if (it == shardMap.end()) {
+            continue;
+        }
+        if (pair.second == nullptr) {
+            pair.second = it->second->clone();
+        } else {
+            pair.second->addAggregatedFlow(it->second);
+        }
+    }
+}
+
+auto Collector::publishSnapshot() -> void
+{
+    // Keys modified in any shard are merged again from all the shards
+    AggregatedMap merged;
+    auto collectUnpublished = [&](Collector* shard) {
+        const TimedLock lock(&shard->dataMutex, getProtocol());
+        for (auto const& pair : shard->aggregatedMap) {
+            if (pair.second->takeUnpublished()) {
+                merged.emplace(pair.first, nullptr);
+            }
+        }
+    };
+    collectUnpublished(this);
+    for (auto* shard : shards) {
+        collectUnpublished(shard);
+    }
+    if (merged.empty() && snapshot != nullptr) {
+        return;
+    }
+
+    {
+        const TimedLock lock(&dataMutex, getProtocol());
+        mergeAggregatedFlows(&merged, aggregatedMap);
+    }
+    for (auto* shard : shards) {
+        const TimedLock lock(&shard->dataMutex, getProtocol());
+        mergeAggregatedFlows(&merged, shard->aggregatedMap);
+    }
+
+    for (auto const& pair : merged) {
+        pair.second->mergePercentiles();
+        publishedFlows[pair.first] = std::shared_ptr<Flow const>(pair.second);
+    }
+    std::vector<std::shared_ptr<Flow const>> flows;
+    flows.reserve(publishedFlows.size());
+    for (auto const& pair : publishedFlows) {
+        flows.push_back(pair.second);
+    }
+    std::shared_ptr<AggregatedSnapshot const> published = std::make_shared<AggregatedSnapshot>(std::move(flows));
+    std::atomic_store(&snapshot, published);
+}
+
+auto Collector::getSnapshot() const -> std::shared_ptr<AggregatedSnapshot const>
 {
-    for (auto& i : aggregatedMap) {
-        i.second->mergePercentiles();
+    auto res = std::atomic_load(&snapshot);
+    if (res == nullptr) {
+        return std::make_shared<AggregatedSnapshot>();
     }
+    return res;
 }
 
 auto Collector::resetMetrics() -> void
 {
-    const std::lock_guard<std::mutex> lock(dataMutex);
-    for (auto& pair : aggregatedMap) {
-        pair.second->resetFlow(false);
+    {
+        const TimedLock lock(&dataMutex, getProtocol());
+        for (auto& pair : aggregatedMap) {
+            if (!pair.second->takeUnreset()) {
+                continue;
+            }
+            // The cleared values still need to be published
+            pair.second->resetFlow(false);
+            pair.second->markUnpublished();
+        }
+    }
+    for (auto* shard : shards) {
+        shard->resetMetrics();
     }
 }
 
-auto Collector::getStatsdMetrics() const -> std::vector<std::string>
+auto Collector::getStatsdMetrics(AggregatedSnapshot const& snapshot,
+    StatsdMode mode) -> std::vector<std::string>
 {
     std::vector<std::string> res;
-    for (auto const& pair : aggregatedMap) {
-        auto const* val = pair.second;
-        auto statsdMetrics = val->getStatsdMetrics();
+    for (auto const* val : snapshot.getFlows()) {
+        auto statsdMetrics = val->getStatsdMetrics(mode);
         res.insert(res.end(), statsdMetrics.begin(), statsdMetrics.end());
     }
     return res;
 }
 
-auto Collector::outputStatus(int duration) -> CollectorOutput
+auto Collector::getStatsdMetrics() const -> std::vector<std::string>
+{
+    auto res = getStatsdMetrics(*getSnapshot(), conf.getStatsdMode());
+    auto collectorMetrics = getCollectorMetrics();
+    res.insert(res.end(), collectorMetrics.begin(), collectorMetrics.end());
+    return res;
+}
+
+auto Collector::outputStatus(AggregatedSnapshot const& snapshot, int duration,
+    CollectorOutput* output, size_t firstFlow, size_t numFlows) -> void
 {
-    std::vector<std::string> valueLines;
-    std::vector<std::string> keyLines;
+    output->clear(toString(), duration);
+    flowFormatter.outputHeaders(output);
 
-    FlowFormatter flowFormatter = getFlowFormatter();
-    auto pairHeaders = flowFormatter.outputHeaders();
+    SPDLOG_DEBUG("Got {} {} flows", snapshot.getFlows().size(), toString());
+    fillOutputs(snapshot.getFlows(), output, firstFlow, numFlows);
+}
 
-    const std::lock_guard<std::mutex> lock(dataMutex);
-    mergePercentiles();
-    std::vector<Flow const*> tempVector = getAggregatedFlows();
-    fillOutputs(tempVector, &keyLines, &valueLines);
-    return CollectorOutput(toString(), keyLines, valueLines,
-        pairHeaders.first, pairHeaders.second, duration);
+auto Collector::outputStatus(int duration, CollectorOutput* output) -> void
+{
+    auto currentSnapshot = getSnapshot();
+    outputStatus(*currentSnapshot, duration, output, 0, SIZE_MAX);
 }
 
-auto Collector::getAggregatedFlows() const -> std::vector<Flow const*>
+auto Collector::outputStatus(int duration) -> CollectorOutput
 {
-    std::vector<Flow const*> tempVector;
-    auto aggregatedMap = getAggregatedMap();
-    tempVector.reserve(aggregatedMap.size());
-    for (auto const& pair : aggregatedMap) {
-        tempVector.push_back(pair.second);
-    }
-    SPDLOG_INFO("Got {} {} flows", tempVector.size(), toString());
-    // TODO Merge percentiles?
-    auto sortFun = getSortFun(selectedSortField);
-    std::sort(tempVector.begin(), tempVector.end(),
-        [&](Flow const* left, Flow const* right) {
-            if (left == nullptr || right == nullptr) {
-                return false;
-            }
-            if (reversedSort) {
-                return sortFun(right, left);
-            } else {
-                return sortFun(left, right);
-            }
-        });
+    CollectorOutput output;
+    outputStatus(duration, &output);
+    return output;
+}
+
+auto Collector::getAggregatedFlows(AggregatedSnapshot const& snapshot) const -> std::vector<Flow const*>
+{
+    std::vector<Flow const*> tempVector = snapshot.getFlows();
+    sortFlows(&tempVector, tempVector.size());
     return tempVector;
 }
 
+/**
+ * Move the window [begin, end) of the ordering in place: two linear
+ * selections bound the window, only the window is then sorted
+ */
+template <typename It, typename Compare>
+static auto sortWindow(It first, It last, size_t begin, size_t end, Compare comp) -> void
+{
+    if (first + end < last) {
+        std::nth_element(first, first + end, last, comp);
+    }
+    if (begin > 0) {
+        std::nth_element(first, first + begin, first + end, comp);
+    }
+    std::sort(first + begin, first + end, comp);
+}
+
+auto Collector::sortFlows(std::vector<Flow const*>* flows, size_t limit) const -> void
+{
+    sortFlows(flows, 0, limit);
+}
+
+/**
+ * Numeric keys are extracted once per flow in a compact array. The
+ * window is selected in linear time and only its flows are sorted.
+ * Ties are broken on the flow address so that successive windows are
+ * slices of the same order.
+ */
+auto Collector::sortFlows(std::vector<Flow const*>* flows, size_t begin, size_t end) const -> void
+{
+    end = std::min(end, flows->size());
+    begin = std::min(begin, end);
+    auto keyFun = getSortKeyFun(selectedSortField);
+    if (keyFun == nullptr) {
+        auto sortFun = getSortFun(selectedSortField);
+        if (sortFun == nullptr) {
+            return;
+        }
+        sortWindow(flows->begin(), flows->end(), begin, end,
+            [&](Flow const* left, Flow const* right) {
+                if (reversedSort ? sortFun(right, left) : sortFun(left, right)) {
+                    return true;
+                }
+                if (reversedSort ? sortFun(left, right) : sortFun(right, left)) {
+                    return false;
+                }
+                return std::less<Flow const*>()(left, right);
+            });
+        return;
+    }
+
+    std::vector<std::pair<int64_t, Flow const*>> keyedFlows;
+    keyedFlows.reserve(flows->size());
+    for (auto const* flow : *flows) {
+        keyedFlows.emplace_back(keyFun(flow), flow);
+    }
+    auto compareKeys = [&](std::pair<int64_t, Flow const*> const& left,
+                           std::pair<int64_t, Flow const*> const& right) {
+        if (left.first != right.first) {
+            return reversedSort ? right.first < left.first : left.first < right.first;
+        }
+        return std::less<Flow const*>()(left.second, right.second);
+    };
+    sortWindow(keyedFlows.begin(), keyedFlows.end(), begin, end, compareKeys);
+    for (size_t i = 0; i < keyedFlows.size(); ++i) {
+        (*flows)[i] = keyedFlows[i].second;
+    }
+}
+
 auto collectorProtocolToString(CollectorProtocol proto) -> std::string
 {
 #define ENUM_TEXT(p) \
@@ -193,6 +331,9 @@ Collector::~Collector()
     for (auto const& pair : aggregatedMap) {
         delete pair.second;
     }
+    for (auto* shard : shards) {
+        delete shard;
+    }
 }
 
 } // namespace flowstats
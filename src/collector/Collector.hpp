@@ -6,9 +6,11 @@
 #include "DogFood.hpp"
 #include "Flow.hpp"
 #include "FlowFormatter.hpp"
+#include "InternalStats.hpp"
 #include "Utils.hpp"
 #include <fmt/format.h>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sys/time.h>
 
@@ -21,6 +23,29 @@ enum CollectorProtocol {
 };
 auto collectorProtocolToString(CollectorProtocol proto) -> std::string;
 
+using AggregatedMap = std::unordered_map<AggregatedKey, Flow*, std::hash<AggregatedKey>>;
+
+/**
+ * Copy of the aggregated flows of all shards with merged percentiles,
+ * published once per interval. Flows are never modified once published
+ * so readers share them without holding the data mutex, and unchanged
+ * flows are shared between successive snapshots.
+ */
+class AggregatedSnapshot {
+public:
+    AggregatedSnapshot() = default;
+    explicit AggregatedSnapshot(std::vector<std::shared_ptr<Flow const>> ownedFlows);
+    AggregatedSnapshot(AggregatedSnapshot const&) = delete;
+    auto operator=(AggregatedSnapshot const&) -> AggregatedSnapshot& = delete;
+    virtual ~AggregatedSnapshot() = default;
+
+    [[nodiscard]] auto getFlows() const -> std::vector<Flow const*> const& { return flows; };
+
+private:
+    std::vector<std::shared_ptr<Flow const>> ownedFlows;
+    std::vector<Flow const*> flows;
+};
+
 class Collector {
 public:
     Collector(FlowstatsConfiguration const& conf, DisplayConfiguration const& displayConf)
@@ -28,19 +53,36 @@ public:
         , displayConf(displayConf) {};
     virtual ~Collector();
 
-    virtual auto processPacket(Tins::Packet const& pdu,
-        FlowId const& flowId,
-        Tins::IP const* ip,
-        Tins::IPv6 const* ipv6,
-        Tins::TCP const* tcp,
-        Tins::UDP const* udp) -> void
+    virtual auto processPacket(PacketView const& packet,
+        FlowId const& flowId) -> void
         = 0;
     virtual auto advanceTick(timeval now) -> void {};
     auto resetMetrics() -> void;
 
+    /**
+     * Copy the aggregated flows of all shards modified since the last
+     * publication and publish them with the unchanged ones for the
+     * display and statsd readers. Data locks are only held for the copy.
+     */
+    auto publishSnapshot() -> void;
+    [[nodiscard]] auto getSnapshot() const -> std::shared_ptr<AggregatedSnapshot const>;
+
+    /**
+     * Statsd metrics of the flows of the current snapshot and of the
+     * collector itself
+     */
     [[nodiscard]] auto getStatsdMetrics() const -> std::vector<std::string>;
-    auto sendMetrics() -> void;
-    auto mergePercentiles() -> void;
+    /**
+     * Statsd metrics of the flows of a published snapshot, safe to call
+     * from any thread
+     */
+    [[nodiscard]] static auto getStatsdMetrics(AggregatedSnapshot const& snapshot,
+        StatsdMode mode) -> std::vector<std::string>;
+    /**
+     * Metrics of the collector not derived from its flows, read when the
+     * snapshot is published
+     */
+    [[nodiscard]] virtual auto getCollectorMetrics() const -> std::vector<std::string> { return {}; };
 
     [[nodiscard]] virtual auto toString() const -> std::string = 0;
     [[nodiscard]] virtual auto getProtocol() const -> CollectorProtocol = 0;
@@ -48,9 +90,25 @@ public:
     [[nodiscard]] auto getDisplayPairs() const { return displayPairs; };
     [[nodiscard]] auto getSortFields() const { return sortFields; };
     typedef bool (*sortFlowFun)(Flow const*, Flow const*);
+    typedef int64_t (*sortKeyFun)(Flow const*);
+    /**
+     * Comparator for fields without a numeric sort key
+     */
     [[nodiscard]] virtual auto getSortFun(Field field) const -> sortFlowFun;
+    [[nodiscard]] virtual auto getSortKeyFun(Field field) const -> sortKeyFun;
 
     [[nodiscard]] auto outputStatus(int duration) -> CollectorOutput;
+    /**
+     * Refill an existing output, its buffers are reused between refreshes
+     */
+    auto outputStatus(int duration, CollectorOutput* output) -> void;
+    /**
+     * Only format the total and the sorted flows in
+     * [firstFlow, firstFlow + numFlows), the number of flows which could
+     * be displayed is reported in the output
+     */
+    auto outputStatus(AggregatedSnapshot const& snapshot, int duration,
+        CollectorOutput* output, size_t firstFlow, size_t numFlows) -> void;
 
     auto updateDisplayType(int displayIndex) -> void { flowFormatter.setDisplayValues(displayPairs[displayIndex].second); };
 
@@ -66,19 +124,35 @@ public:
         reversedSort = reversed;
     };
 
-    [[nodiscard]] auto getAggregatedMap() const { return aggregatedMap; }
+    [[nodiscard]] auto getAggregatedMap() const -> AggregatedMap const& { return aggregatedMap; }
     [[nodiscard]] auto getAggregatedMap() { return &aggregatedMap; }
-    [[nodiscard]] auto getAggregatedFlows() const -> std::vector<Flow const*>;
+    [[nodiscard]] auto getAggregatedFlows(AggregatedSnapshot const& snapshot) const -> std::vector<Flow const*>;
+
+    /**
+     * Order the first limit flows by the selected sort field, the other
+     * ones are left in unspecified order
+     */
+    auto sortFlows(std::vector<Flow const*>* flows, size_t limit) const -> void;
+    /**
+     * Place the flows ranked in [begin, end) at their sorted position,
+     * flows outside this window are left in unspecified order
+     */
+    auto sortFlows(std::vector<Flow const*>* flows, size_t begin, size_t end) const -> void;
+
+    /**
+     * Shards are collectors of the same type fed by other capture
+     * workers. Their aggregated flows are merged with ours on output.
+     * Ownership of the shard is transferred.
+     */
+    auto addShard(Collector* shard) -> void { shards.push_back(shard); };
+    [[nodiscard]] auto getShard(int index) -> Collector* { return index == 0 ? this : shards.at(index - 1); };
+    [[nodiscard]] auto getShards() const -> std::vector<Collector*> const& { return shards; };
 
 protected:
     auto fillOutputs(std::vector<Flow const*> const& aggregatedFlows,
-        std::vector<std::string>* keyLines,
-        std::vector<std::string>* valueLines);
+        CollectorOutput* output, size_t firstFlow, size_t numFlows);
 
-    auto outputFlow(Flow const* flow,
-        std::vector<std::string>* keyLines,
-        std::vector<std::string>* valueLines,
-        int position) const -> void;
+    auto outputFlow(Flow const* flow, CollectorOutput* output) const -> void;
 
     [[nodiscard]] auto getDataMutex() -> std::mutex* { return &dataMutex; };
     [[nodiscard]] auto getFlowFormatter() -> FlowFormatter& { return flowFormatter; };
@@ -92,6 +166,8 @@ protected:
     auto setTotalFlow(Flow* flow) -> void { totalFlow = flow; };
 
 private:
+    static auto mergeAggregatedFlows(AggregatedMap* merged, AggregatedMap const& shardMap) -> void;
+
     std::mutex dataMutex;
     FlowFormatter flowFormatter;
     FlowstatsConfiguration const& conf;
@@ -101,6 +177,10 @@ private:
     std::vector<Field> sortFields;
     Field selectedSortField = Field::FQDN;
     bool reversedSort = false;
-    std::unordered_map<AggregatedKey, Flow*, std::hash<AggregatedKey>> aggregatedMap;
+    AggregatedMap aggregatedMap;
+    std::vector<Collector*> shards;
+    std::shared_ptr<AggregatedSnapshot const> snapshot;
+    // Merged flows of the last snapshot, only used by the publisher
+    std::unordered_map<AggregatedKey, std::shared_ptr<Flow const>, std::hash<AggregatedKey>> publishedFlows;
 };
 } // namespace flowstats
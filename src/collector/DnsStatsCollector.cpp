@@ -1,15 +1,21 @@
 #include "DnsStatsCollector.hpp"
 #include "PduUtils.hpp"
 #include "PrintHelper.hpp"
-#include <tins/rawpdu.h>
+#include <cstring>
 
 namespace flowstats {
 
+/**
+ * Seconds before an unanswered query is aggregated as a timeout
+ */
+time_t const dnsQueryTimeout = 5;
+
 DnsStatsCollector::DnsStatsCollector(FlowstatsConfiguration const& conf,
     DisplayConfiguration const& displayConf,
     IpToFqdn* ipToFqdn)
     : Collector { conf, displayConf }
     , ipToFqdn(ipToFqdn)
+    , transactions(conf.getDnsTableBytes())
 {
     getFlowFormatter().setDisplayKeys({ Field::FQDN, Field::IP, Field::PORT, Field::PROTO, Field::TYPE, Field::DIR });
     setDisplayPairs({
@@ -34,113 +40,143 @@ auto DnsStatsCollector::isDnsPort(uint16_t port) -> bool
     return false;
 }
 
-auto DnsStatsCollector::isPossibleDns(Tins::TCP const* tcp, Tins::UDP const* udp) -> bool
+auto DnsStatsCollector::isPossibleDns(PacketView const& packet) -> bool
 {
-    auto ports = getPorts(tcp, udp);
-    if (isDnsPort(ports[0])) {
+    if (isDnsPort(packet.ports[0])) {
         return true;
     }
-    if (isDnsPort(ports[1])) {
+    if (isDnsPort(packet.ports[1])) {
         return true;
     }
 
     return false;
 }
 
-auto DnsStatsCollector::processPacket(Tins::Packet const& packet,
-    FlowId const& flowId,
-    Tins::IP const*,
-    Tins::IPv6 const*,
-    Tins::TCP const* tcp,
-    Tins::UDP const* udp) -> void
+auto DnsStatsCollector::isPossibleResponse(PacketView const& packet) -> bool
 {
-    auto const* pdu = packet.pdu();
-    if (pdu == nullptr) {
-        return;
+    // QR bit of the header flags, it is read at the same offset when
+    // the payload is parsed
+    return isPossibleDns(packet) && packet.payloadSize > 2
+        && (packet.payload[2] & 0x80) != 0;
+}
+
+auto DnsStatsCollector::mayUpdateIpToFqdn(PacketView const& packet) const -> bool
+{
+    if (!isPossibleResponse(packet)) {
+        return false;
+    }
+    DnsMessage dns;
+    if (!dns.parse(packet.payload, packet.payloadSize) || !dns.isResponse()) {
+        return false;
+    }
+    // Responses without a question are mapped to the name of their query
+    std::optional<FqdnId> fqdnId;
+    if (dns.hasQuestion()) {
+        fqdnId = internFqdn(dns.getQname());
+    }
+    DnsAnswer answer;
+    while (dns.nextAnswer(&answer)) {
+        if (answer.type == Tins::DNS::A && answer.rdataSize == Tins::IPv4Address::address_size) {
+            uint32_t ip;
+            memcpy(&ip, answer.rdata, sizeof(ip));
+            if (!fqdnId.has_value() || !ipToFqdn->isMapped(*fqdnId, Tins::IPv4Address(ip), packet.ts.tv_sec, answer.ttl)) {
+                return true;
+            }
+        } else if (answer.type == Tins::DNS::AAAA && answer.rdataSize == Tins::IPv6Address::address_size) {
+            if (!fqdnId.has_value() || !ipToFqdn->isMapped(*fqdnId, Tins::IPv6Address(answer.rdata), packet.ts.tv_sec, answer.ttl)) {
+                return true;
+            }
+        }
     }
-    if (!isPossibleDns(tcp, udp)) {
+    return false;
+}
+
+auto DnsStatsCollector::processPacket(PacketView const& packet,
+    FlowId const& flowId) -> void
+{
+    if (packet.payloadSize == 0) {
         return;
     }
-
-    auto const* rawPdu = pdu->find_pdu<Tins::RawPDU>();
-    if (rawPdu == nullptr) {
+    DnsMessage dns;
+    if (!dns.parse(packet.payload, packet.payloadSize)) {
+        SPDLOG_DEBUG("Malformed dns message: {}", flowId.toString());
         return;
     }
-    auto dns = rawPdu->to<Tins::DNS>();
 
-    if (dns.type() == Tins::DNS::QUERY) {
+    if (!dns.isResponse()) {
         newDnsQuery(packet, flowId, dns);
         return;
     }
 
-    auto it = transactionIdToDnsFlow.find(dns.id());
-    if (it != transactionIdToDnsFlow.end()) {
-        DnsFlow* flow = &it->second;
-        newDnsResponse(packet, dns, flow);
+    auto* flow = transactions.find(flowId, dns.getId());
+    if (flow != nullptr) {
+        newDnsResponse(packet, &dns, flow);
     }
 }
 
-auto DnsStatsCollector::updateIpToFqdn(Tins::DNS const& dns, std::string const& fqdn) -> void
+auto DnsStatsCollector::updateIpToFqdn(PacketView const& packet,
+    DnsMessage* dns, FqdnId fqdnId) -> void
 {
-    auto answers = dns.answers();
-    std::vector<Tins::IPv4Address> ips;
-    std::vector<Tins::IPv6Address> ipv6;
-    for (auto const& answer : answers) {
-        if (answer.query_type() == Tins::DNS::A) {
-            ips.emplace_back(Tins::IPv4Address(answer.data()));
-        } else if (answer.query_type() == Tins::DNS::AAAA) {
-            ipv6.emplace_back(Tins::IPv6Address(answer.data()));
+    DnsAnswer answer;
+    while (dns->nextAnswer(&answer)) {
+        if (answer.type == Tins::DNS::A && answer.rdataSize == Tins::IPv4Address::address_size) {
+            uint32_t ip;
+            memcpy(&ip, answer.rdata, sizeof(ip));
+            ipToFqdn->updateFqdn(fqdnId, Tins::IPv4Address(ip),
+                packet.ts.tv_sec, answer.ttl);
+        } else if (answer.type == Tins::DNS::AAAA && answer.rdataSize == Tins::IPv6Address::address_size) {
+            ipToFqdn->updateFqdn(fqdnId, Tins::IPv6Address(answer.rdata),
+                packet.ts.tv_sec, answer.ttl);
         }
     }
-
-    ipToFqdn->updateFqdn(fqdn, ips, ipv6);
 }
 
-auto DnsStatsCollector::newDnsQuery(Tins::Packet const& packet, FlowId const& flowId, Tins::DNS const& dns) -> void
+auto DnsStatsCollector::newDnsQuery(PacketView const& packet, FlowId const& flowId, DnsMessage const& dns) -> void
 {
-    auto queries = dns.queries();
-    if (queries.size() == 0) {
-        SPDLOG_DEBUG("No queries in {}", dns.id());
+    if (!dns.hasQuestion()) {
+        SPDLOG_DEBUG("No queries in {}", dns.getId());
         return;
     }
-    auto firstQuery = queries.at(0);
-    if (firstQuery.dname().empty()) {
-        SPDLOG_DEBUG("Empty query in dns tid {}", dns.id());
+    if (dns.getQname().empty()) {
+        SPDLOG_DEBUG("Empty query in dns tid {}", dns.getId());
         return;
     }
-    DnsFlow flow(packet, flowId, dns);
-    transactionIdToDnsFlow[dns.id()] = std::move(flow);
+    transactions.insert(dns.getId(), DnsFlow(packet, flowId, dns));
 }
 
-auto DnsStatsCollector::newDnsResponse(Tins::Packet const& packet,
-    Tins::DNS const& dns, DnsFlow* flow) -> void
+auto DnsStatsCollector::newDnsResponse(PacketView const& packet,
+    DnsMessage* dns, DnsFlow* flow) -> void
 {
-    flow->processDnsResponse(packet, dns);
+    flow->processDnsResponse(packet, *dns);
     addFlowToAggregation(flow);
-    updateIpToFqdn(dns, flow->getFqdn());
-    transactionIdToDnsFlow.erase(dns.id());
+    // Answers to another name than the query's are not mapped
+    if (!dns->hasQuestion() || internFqdn(dns->getQname()) == flow->getFqdnId()) {
+        updateIpToFqdn(packet, dns, flow->getFqdnId());
+    }
+    transactions.erase(flow->getFlowId(), dns->getId());
 }
 
 auto DnsStatsCollector::addFlowToAggregation(DnsFlow const* flow) -> void
 {
     auto dnsType = flow->getType();
-    auto fqdn = flow->getFqdn();
-    auto key = AggregatedKey::aggregatedDnsKey(fqdn, dnsType, flow->getTransport());
+    auto fqdnId = flow->getFqdnId();
+    auto key = AggregatedKey::aggregatedDnsKey(fqdnId, dnsType, flow->getTransport());
 
-    const std::lock_guard<std::mutex> lock(*getDataMutex());
+    const TimedLock lock(getDataMutex(), getProtocol());
     auto* aggregatedMap = getAggregatedMap();
     auto it = aggregatedMap->find(key);
     AggregatedDnsFlow* aggregatedFlow;
     if (it == aggregatedMap->end()) {
-        SPDLOG_DEBUG("Create new dns aggregation for {} {} {}", fqdn,
+        SPDLOG_DEBUG("Create new dns aggregation for {} {} {}", flow->getFqdn(),
             dnsTypeToString(dnsType), flow->getTransport()._to_string());
-        aggregatedFlow = new AggregatedDnsFlow(flow->getFlowId(), fqdn, dnsType);
+        aggregatedFlow = new AggregatedDnsFlow(flow->getFlowId(), fqdnId, dnsType);
         aggregatedMap->emplace(key, aggregatedFlow);
     } else {
         assert(it->first == key);
         aggregatedFlow = dynamic_cast<AggregatedDnsFlow*>(it->second);
     }
     aggregatedFlow->addFlow(flow);
+    aggregatedFlow->markModified();
 }
 
 auto DnsStatsCollector::advanceTick(timeval now) -> void
@@ -152,53 +188,57 @@ auto DnsStatsCollector::advanceTick(timeval now) -> void
     lastTick = now.tv_sec;
 
     // Timeout ongoing dns queries
-    std::vector<uint16_t> toErase;
-    for (auto& pair : transactionIdToDnsFlow) {
-        DnsFlow& flow = pair.second;
-        time_t delta_time = now.tv_sec - flow.getStartTv().tv_sec;
-        SPDLOG_DEBUG("Flow {}, delta {}, hasResponse {}", flow.getFqdn(),
-            delta_time, flow.getHasResponse());
-        if (delta_time > 5) {
-            addFlowToAggregation(&flow);
-            toErase.push_back(pair.first);
-        }
-    }
-    for (auto& key : toErase) {
-        transactionIdToDnsFlow.erase(key);
+    transactions.expire(now.tv_sec - dnsQueryTimeout, [&](DnsFlow* flow) {
+        SPDLOG_DEBUG("Flow {} timed out", flow->getFqdn());
+        addFlowToAggregation(flow);
+    });
+}
+
+auto DnsStatsCollector::getEvictedQueries() const -> uint64_t
+{
+    uint64_t evicted = transactions.getEvicted();
+    for (auto const* shard : getShards()) {
+        evicted += dynamic_cast<DnsStatsCollector const*>(shard)->transactions.getEvicted();
     }
+    return evicted;
+}
+
+auto DnsStatsCollector::getCollectorMetrics() const -> std::vector<std::string>
+{
+    return { DogFood::Metric("flowstats.dns.evictedQueries", getEvictedQueries(), DogFood::Gauge) };
 }
 
-auto DnsStatsCollector::getSortFun(Field field) const -> sortFlowFun
+auto DnsStatsCollector::getSortKeyFun(Field field) const -> sortKeyFun
 {
-    auto sortFun = Collector::getSortFun(field);
-    if (sortFun != nullptr) {
-        return sortFun;
+    auto keyFun = Collector::getSortKeyFun(field);
+    if (keyFun != nullptr) {
+        return keyFun;
     }
     switch (field) {
     case Field::PROTO:
-        return &AggregatedDnsFlow::sortByProto;
+        return &AggregatedDnsFlow::sortKeyProto;
     case Field::TYPE:
-        return &AggregatedDnsFlow::sortByType;
+        return &AggregatedDnsFlow::sortKeyType;
     case Field::REQ:
-        return &AggregatedDnsFlow::sortByRequest;
+        return &AggregatedDnsFlow::sortKeyRequest;
     case Field::REQ_RATE:
-        return &AggregatedDnsFlow::sortByRequestRate;
+        return &AggregatedDnsFlow::sortKeyRequestRate;
     case Field::TIMEOUTS:
-        return &AggregatedDnsFlow::sortByTimeout;
+        return &AggregatedDnsFlow::sortKeyTimeout;
     case Field::TIMEOUTS_RATE:
-        return &AggregatedDnsFlow::sortByTimeoutRate;
+        return &AggregatedDnsFlow::sortKeyTimeoutRate;
     case Field::SRT:
-        return &AggregatedDnsFlow::sortBySrt;
+        return &AggregatedDnsFlow::sortKeySrt;
     case Field::SRT_RATE:
-        return &AggregatedDnsFlow::sortBySrtRate;
+        return &AggregatedDnsFlow::sortKeySrtRate;
     case Field::SRT_P95:
-        return &AggregatedDnsFlow::sortBySrtP95;
+        return &AggregatedDnsFlow::sortKeySrtP95;
     case Field::SRT_P99:
-        return &AggregatedDnsFlow::sortBySrtP99;
+        return &AggregatedDnsFlow::sortKeySrtP99;
     case Field::SRT_MAX:
-        return &AggregatedDnsFlow::sortBySrtMax;
+        return &AggregatedDnsFlow::sortKeySrtMax;
     case Field::RCRD_AVG:
-        return &AggregatedDnsFlow::sortByRcrdAvg;
+        return &AggregatedDnsFlow::sortKeyRcrdAvg;
     default:
         return nullptr;
     }
@@ -5,6 +5,7 @@
 #include "Collector.hpp"
 #include "Configuration.hpp"
 #include "DnsFlow.hpp"
+#include "DnsTransactionTable.hpp"
 #include "IpToFqdn.hpp"
 #include "Utils.hpp"
 
@@ -16,31 +17,51 @@ public:
         DisplayConfiguration const& displayConf,
         IpToFqdn* ipToFqdn);
 
-    auto processPacket(Tins::Packet const& packet,
-        FlowId const& flowId,
-        Tins::IP const* ip,
-        Tins::IPv6 const* ipv6,
-        Tins::TCP const* tcp,
-        Tins::UDP const* udp) -> void override;
+    auto processPacket(PacketView const& packet,
+        FlowId const& flowId) -> void override;
     auto advanceTick(timeval now) -> void override;
 
     [[nodiscard]] auto toString() const -> std::string override { return "DnsStatsCollector"; }
     [[nodiscard]] auto getProtocol() const -> CollectorProtocol override { return DNS; };
+    [[nodiscard]] auto getCollectorMetrics() const -> std::vector<std::string> override;
+
+    [[nodiscard]] auto getTransactions() const -> DnsTransactionTable const& { return transactions; }
+    /**
+     * Pending queries evicted unanswered because the transaction table
+     * was full, summed over the shards
+     */
+    [[nodiscard]] auto getEvictedQueries() const -> uint64_t;
+
+    /**
+     * Dns port on either side, the classifier only hands these packets
+     * to the collector
+     */
+    [[nodiscard]] static auto isPossibleDns(PacketView const& packet) -> bool;
+    /**
+     * Responses may update the ip to fqdn mapping read by every
+     * collector, queries never do
+     */
+    [[nodiscard]] static auto isPossibleResponse(PacketView const& packet) -> bool;
+    /**
+     * False when processing the packet leaves the ip to fqdn mapping
+     * unchanged: it is not a response, or every address it answers is
+     * already mapped to its question with the same expiry
+     */
+    [[nodiscard]] auto mayUpdateIpToFqdn(PacketView const& packet) const -> bool;
 
 private:
-    auto isDnsPort(uint16_t port) -> bool;
-    auto isPossibleDns(Tins::TCP const* tcp, Tins::UDP const* udp) -> bool;
+    static auto isDnsPort(uint16_t port) -> bool;
 
-    auto newDnsQuery(Tins::Packet const& packet,
+    auto newDnsQuery(PacketView const& packet,
         FlowId const& flowId,
-        Tins::DNS const& dns) -> void;
-    auto newDnsResponse(Tins::Packet const& packet, Tins::DNS const& dns, DnsFlow* flow) -> void;
-    auto updateIpToFqdn(Tins::DNS const& dns, std::string const& fqdn) -> void;
+        DnsMessage const& dns) -> void;
+    auto newDnsResponse(PacketView const& packet, DnsMessage* dns, DnsFlow* flow) -> void;
+    auto updateIpToFqdn(PacketView const& packet, DnsMessage* dns, FqdnId fqdnId) -> void;
     auto addFlowToAggregation(DnsFlow const* flow) -> void;
-    [[nodiscard]] auto getSortFun(Field field) const -> sortFlowFun override;
+    [[nodiscard]] auto getSortKeyFun(Field field) const -> sortKeyFun override;
 
     IpToFqdn* ipToFqdn;
-    std::map<uint16_t, DnsFlow> transactionIdToDnsFlow;
+    DnsTransactionTable transactions;
     time_t lastTick = 0;
 };
 } // namespace flowstats
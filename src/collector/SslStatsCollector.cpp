@@ -1,12 +1,12 @@
 #include "SslStatsCollector.hpp"
 #include "SslProto.hpp"
 #include <fmt/format.h>
-#include <tins/rawpdu.h>
 
 namespace flowstats {
 
 SslStatsCollector::SslStatsCollector(FlowstatsConfiguration const& conf, DisplayConfiguration const& displayConf, IpToFqdn* ipToFqdn)
     : Collector { conf, displayConf }
+    , unknownFlows(ipToFqdn, conf.getTimeoutFlow())
     , ipToFqdn(ipToFqdn)
 {
     if (conf.getPerIpAggr()) {
@@ -24,41 +24,48 @@ SslStatsCollector::SslStatsCollector(FlowstatsConfiguration const& conf, Display
     updateDisplayType(0);
 };
 
-auto SslStatsCollector::lookupSslFlow(FlowId const& flowId) -> SslFlow*
+auto SslStatsCollector::lookupSslFlow(PacketView const& packet, FlowId const& flowId) -> SslFlow*
 {
-    auto it = hashToSslFlow.find(flowId);
-    if (it != hashToSslFlow.end()) {
-        return &it->second;
+    auto* sslFlow = hashToSslFlow.find(flowId);
+    if (sslFlow != nullptr) {
+        return sslFlow;
     }
 
-    auto fqdnOpt = ipToFqdn->getFlowFqdn(flowId.getIp(!flowId.getDirection()));
+    // Either ip may be looked up depending on the packet direction
+    auto ipDir = static_cast<Direction>(!packet.getDirection());
+    if (unknownFlows.isUnknown(flowId, ipDir, packet.ts.tv_sec)) {
+        return nullptr;
+    }
+    auto ip = flowId.getIp(ipDir);
+    auto version = ipToFqdn->getMappingVersion(ip);
+    auto fqdnOpt = ipToFqdn->getFlowFqdn(ip, packet.ts.tv_sec);
     if (!fqdnOpt.has_value()) {
+        unknownFlows.addUnknown(flowId, ipDir, version, packet.ts.tv_sec);
         return nullptr;
     }
 
-    auto const* fqdn = fqdnOpt->data();
+    auto fqdnId = *fqdnOpt;
     // TODO dectect server port
-    auto aggregatedFlows = lookupAggregatedFlows(flowId, fqdn, FROM_SERVER);
+    auto aggregatedFlows = lookupAggregatedFlows(flowId, fqdnId, FROM_SERVER);
     SPDLOG_DEBUG("Create ssl flow {}", flowId.toString());
-    auto sslFlow = SslFlow(flowId, fqdn, aggregatedFlows);
-    auto res = hashToSslFlow.insert({ flowId, sslFlow });
-    return &res.first->second;
+    return hashToSslFlow.emplace(flowId, flowId, fqdnId, aggregatedFlows);
 }
 
-auto SslStatsCollector::lookupAggregatedFlows(FlowId const& flowId, std::string const& fqdn, Direction srvDir) -> std::vector<AggregatedSslFlow*>
+auto SslStatsCollector::lookupAggregatedFlows(FlowId const& flowId, FqdnId fqdnId, Direction srvDir) -> std::vector<AggregatedSslFlow*>
 {
     std::vector<AggregatedSslFlow*> subflows;
     IPv4 ipSrvInt = 0;
     if (getFlowstatsConfiguration().getPerIpAggr()) {
         ipSrvInt = flowId.getIp(srvDir);
     }
-    auto tcpKey = AggregatedKey(fqdn, ipSrvInt, {}, flowId.getPort(srvDir));
+    auto tcpKey = AggregatedKey(fqdnId, ipSrvInt, {}, flowId.getPort(srvDir));
     AggregatedSslFlow* aggregatedFlow;
 
+    const TimedLock lock(getDataMutex(), getProtocol());
     auto* aggregatedMap = getAggregatedMap();
     auto it = aggregatedMap->find(tcpKey);
     if (it == aggregatedMap->end()) {
-        aggregatedFlow = new AggregatedSslFlow(flowId, fqdn);
+        aggregatedFlow = new AggregatedSslFlow(flowId, fqdnId);
         aggregatedMap->insert({ tcpKey, aggregatedFlow });
     } else {
         aggregatedFlow = dynamic_cast<AggregatedSslFlow*>(it->second);
@@ -68,53 +75,49 @@ auto SslStatsCollector::lookupAggregatedFlows(FlowId const& flowId, std::string
     return subflows;
 }
 
-auto SslStatsCollector::processPacket(Tins::Packet const& packet,
-    FlowId const& flowId,
-    Tins::IP const*,
-    Tins::IPv6 const*,
-    Tins::TCP const* tcp,
-    Tins::UDP const*) -> void
+auto SslStatsCollector::processPacket(PacketView const& packet,
+    FlowId const& flowId) -> void
 {
-    if (tcp == nullptr) {
-        return;
-    }
-
-    auto const* rawData = tcp->find_pdu<Tins::RawPDU>();
-    if (rawData == nullptr) {
-        return;
-    }
-    auto payload = rawData->payload();
-    auto cursor = Cursor(payload);
+    // Only payload segments of flows classified as ssl are dispatched
+    auto cursor = Cursor(packet.payload, packet.payloadSize);
     if (checkValidSsl(&cursor) == false) {
         return;
     }
 
-    auto* sslFlow = lookupSslFlow(flowId);
+    auto* sslFlow = lookupSslFlow(packet, flowId);
     if (sslFlow == nullptr) {
         return;
     }
-    auto direction = flowId.getDirection();
+    auto direction = packet.getDirection();
+    // Packets and connections are also added to the aggregated flows
+    const TimedLock lock(getDataMutex(), getProtocol());
     sslFlow->addPacket(packet, direction);
+    sslFlow->updateFlow(packet, direction);
+    for (auto* aggregatedFlow : sslFlow->getAggregatedFlows()) {
+        aggregatedFlow->markModified();
+    }
+}
 
-    const std::lock_guard<std::mutex> lock(*getDataMutex());
-    sslFlow->updateFlow(packet, direction, *tcp);
+auto SslStatsCollector::advanceTick(timeval now) -> void
+{
+    unknownFlows.advanceTick(now.tv_sec);
 }
 
-auto SslStatsCollector::getSortFun(Field field) const -> sortFlowFun
+auto SslStatsCollector::getSortKeyFun(Field field) const -> sortKeyFun
 {
-    auto sortFun = Collector::getSortFun(field);
-    if (sortFun != nullptr) {
-        return sortFun;
+    auto keyFun = Collector::getSortKeyFun(field);
+    if (keyFun != nullptr) {
+        return keyFun;
     }
     switch (field) {
     case Field::CONN:
-        return AggregatedSslFlow::sortByConnections;
+        return AggregatedSslFlow::sortKeyConnections;
     case Field::CONN_RATE:
-        return AggregatedSslFlow::sortByConnectionRate;
+        return AggregatedSslFlow::sortKeyConnectionRate;
     case Field::CT_P95:
-        return AggregatedSslFlow::sortByConnectionP95;
+        return AggregatedSslFlow::sortKeyConnectionP95;
     case Field::CT_P99:
-        return AggregatedSslFlow::sortByConnectionP99;
+        return AggregatedSslFlow::sortKeyConnectionP99;
     default:
         return nullptr;
     }
@@ -3,9 +3,11 @@
 #include "AggregatedKeys.hpp"
 #include "AggregatedSslFlow.hpp"
 #include "Collector.hpp"
+#include "FlowTable.hpp"
 #include "IpToFqdn.hpp"
 #include "PrintHelper.hpp"
 #include "SslFlow.hpp"
+#include "UnknownFqdnCache.hpp"
 #include <algorithm>
 #include <arpa/inet.h>
 #include <iostream>
@@ -18,23 +20,22 @@ class SslStatsCollector : public Collector {
 public:
     SslStatsCollector(FlowstatsConfiguration const& conf, DisplayConfiguration const& displayConf, IpToFqdn* ipToFqdn);
 
-    auto processPacket(Tins::Packet const& packet,
-        FlowId const& flowId,
-        Tins::IP const* ip,
-        Tins::IPv6 const* ipv6,
-        Tins::TCP const* tcp,
-        Tins::UDP const* udp) -> void override;
+    auto processPacket(PacketView const& packet,
+        FlowId const& flowId) -> void override;
+    auto advanceTick(timeval now) -> void override;
 
     [[nodiscard]] auto getProtocol() const -> CollectorProtocol override { return SSL; };
     [[nodiscard]] auto toString() const -> std::string override { return "SslStatsCollector"; }
 
-    [[nodiscard]] auto getSslFlow() const { return hashToSslFlow; }
+    [[nodiscard]] auto getSslFlow() const -> FlowTable<SslFlow> const& { return hashToSslFlow; }
+    [[nodiscard]] auto getUnknownFlows() const -> UnknownFqdnCache const& { return unknownFlows; }
 
 private:
-    std::unordered_map<FlowId, SslFlow, std::hash<FlowId>> hashToSslFlow;
-    [[nodiscard]] auto getSortFun(Field field) const -> sortFlowFun override;
-    auto lookupSslFlow(FlowId const& flowId) -> SslFlow*;
-    auto lookupAggregatedFlows(FlowId const& flowId, std::string const& fqdn, Direction srvDir) -> std::vector<AggregatedSslFlow*>;
+    FlowTable<SslFlow> hashToSslFlow;
+    UnknownFqdnCache unknownFlows;
+    [[nodiscard]] auto getSortKeyFun(Field field) const -> sortKeyFun override;
+    auto lookupSslFlow(PacketView const& packet, FlowId const& flowId) -> SslFlow*;
+    auto lookupAggregatedFlows(FlowId const& flowId, FqdnId fqdnId, Direction srvDir) -> std::vector<AggregatedSslFlow*>;
     IpToFqdn* ipToFqdn;
 };
 } // namespace flowstats
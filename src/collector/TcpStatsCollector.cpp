@@ -11,6 +11,7 @@ TcpStatsCollector::TcpStatsCollector(FlowstatsConfiguration const& conf,
     DisplayConfiguration const& displayConf,
     IpToFqdn* ipToFqdn)
     : Collector { conf, displayConf }
+    , unknownFlows(ipToFqdn, conf.getTimeoutFlow())
     , ipToFqdn(ipToFqdn)
 {
     if (conf.getPerIpAggr()) {
@@ -30,10 +31,10 @@ TcpStatsCollector::TcpStatsCollector(FlowstatsConfiguration const& conf,
     updateDisplayType(0);
 };
 
-auto TcpStatsCollector::detectServer(Tins::TCP const& tcp, FlowId const& flowId) -> Direction
+auto TcpStatsCollector::detectServer(PacketView const& packet, FlowId const& flowId) -> Direction
 {
-    auto const flags = tcp.flags();
-    auto direction = flowId.getDirection();
+    auto const flags = packet.flags;
+    auto direction = packet.getDirection();
     if (flags & Tins::TCP::SYN) {
         if (flags & Tins::TCP::ACK) {
             auto srvPort = flowId.getPort(direction);
@@ -67,40 +68,47 @@ auto TcpStatsCollector::detectServer(Tins::TCP const& tcp, FlowId const& flowId)
     return static_cast<Direction>(!direction);
 }
 
-auto TcpStatsCollector::lookupTcpFlow(Tins::TCP const& tcp,
+auto TcpStatsCollector::lookupTcpFlow(PacketView const& packet,
     FlowId const& flowId) -> TcpFlow*
 {
-    auto it = hashToTcpFlow.find(flowId);
-    if (it != hashToTcpFlow.end()) {
-        return &it->second;
+    auto* tcpFlow = hashToTcpFlow.find(flowId);
+    if (tcpFlow != nullptr) {
+        return tcpFlow;
+    }
+    if (unknownFlows.isUnknown(flowId, packet.ts.tv_sec)) {
+        return nullptr;
     }
 
-    auto srvDir = detectServer(tcp, flowId);
-    std::optional<std::string> fqdnOpt = {};
+    auto srvDir = detectServer(packet, flowId);
+    std::optional<FqdnId> fqdnOpt = {};
+    MappingVersion version;
     if (flowId.getNetwork() == +Network::IPV4) {
         auto ipSrv = flowId.getIp(srvDir);
         SPDLOG_DEBUG("Detected srvDir {}, looking for fqdn of ip {}", srvDir, ipSrv);
-        fqdnOpt = ipToFqdn->getFlowFqdn(ipSrv);
+        version = ipToFqdn->getMappingVersion(ipSrv);
+        fqdnOpt = ipToFqdn->getFlowFqdn(ipSrv, packet.ts.tv_sec);
     } else {
         auto ipSrv = flowId.getIpv6(srvDir);
         SPDLOG_DEBUG("Detected srvDir {}, looking for fqdn of ip {}", srvDir, ipSrv.to_string());
-        fqdnOpt = ipToFqdn->getFlowFqdn(ipSrv);
+        version = ipToFqdn->getMappingVersion(ipSrv);
+        fqdnOpt = ipToFqdn->getFlowFqdn(ipSrv, packet.ts.tv_sec);
     }
 
     if (!fqdnOpt.has_value()) {
+        unknownFlows.addUnknown(flowId, srvDir, version, packet.ts.tv_sec);
         return nullptr;
     }
 
-    auto const* fqdn = fqdnOpt->data();
-    auto aggregatedTcpFlows = lookupAggregatedFlows(flowId, fqdn, srvDir);
-    auto tcpFlow = TcpFlow(flowId, srvDir, aggregatedTcpFlows);
-    SPDLOG_DEBUG("Create tcp flow {}, fqdn {}", flowId.toString(), fqdn);
-    auto res = hashToTcpFlow.emplace(flowId, tcpFlow);
-    return &res.first->second;
+    auto fqdnId = *fqdnOpt;
+    auto aggregatedTcpFlows = lookupAggregatedFlows(flowId, fqdnId, srvDir);
+    SPDLOG_DEBUG("Create tcp flow {}, fqdn {}", flowId.toString(), fqdnToString(fqdnId));
+    tcpFlow = hashToTcpFlow.emplace(flowId, flowId, srvDir, aggregatedTcpFlows);
+    flowExpiry.schedule(flowId, packet.ts.tv_sec + getFlowstatsConfiguration().getTimeoutFlow() + 1);
+    return tcpFlow;
 }
 
 auto TcpStatsCollector::lookupAggregatedFlows(FlowId const& flowId,
-    std::string const& fqdn,
+    FqdnId fqdnId,
     Direction srvDir) -> std::vector<AggregatedTcpFlow*>
 {
     Tins::IPv4Address ipSrvInt = {};
@@ -110,12 +118,12 @@ auto TcpStatsCollector::lookupAggregatedFlows(FlowId const& flowId,
     auto srvPort = flowId.getPort(srvDir);
     AggregatedTcpFlow* aggregatedFlow;
     // TODO Handle ipv6
-    auto tcpKey = AggregatedKey(fqdn, ipSrvInt, {}, srvPort);
-    const std::lock_guard<std::mutex> lock(*getDataMutex());
+    auto tcpKey = AggregatedKey(fqdnId, ipSrvInt, {}, srvPort);
+    const TimedLock lock(getDataMutex(), getProtocol());
     auto* aggregatedMap = getAggregatedMap();
     auto it = aggregatedMap->find(tcpKey);
     if (it == aggregatedMap->end()) {
-        aggregatedFlow = new AggregatedTcpFlow(flowId, fqdn, srvDir);
+        aggregatedFlow = new AggregatedTcpFlow(flowId, fqdnId, srvDir);
         aggregatedMap->emplace(tcpKey, aggregatedFlow);
         SPDLOG_DEBUG("Create aggregated tcp flow for {}", flowId.toString());
     } else {
@@ -126,131 +134,148 @@ auto TcpStatsCollector::lookupAggregatedFlows(FlowId const& flowId,
     return aggregatedFlows;
 }
 
-auto TcpStatsCollector::processPacket(Tins::Packet const& packet,
-    FlowId const& flowId,
-    Tins::IP const* ip,
-    Tins::IPv6 const* ipv6,
-    Tins::TCP const* tcp,
-    Tins::UDP const*) -> void
+auto TcpStatsCollector::processPacket(PacketView const& packet,
+    FlowId const& flowId) -> void
 {
-    if (tcp == nullptr) {
+    if (packet.transport != +Transport::TCP) {
         return;
     }
 
-    auto* tcpFlow = lookupTcpFlow(*tcp, flowId);
+    auto* tcpFlow = lookupTcpFlow(packet, flowId);
     if (tcpFlow == nullptr) {
         return;
     }
 
-    auto direction = flowId.getDirection();
+    auto direction = packet.getDirection();
     tcpFlow->addPacket(packet, direction);
 
+    // Aggregated flows are also read and reset by the snapshot publication
+    const TimedLock lock(getDataMutex(), getProtocol());
     for (auto* subflow : tcpFlow->getAggregatedFlows()) {
         subflow->addPacket(packet, direction);
-        subflow->updateFlow(packet, flowId, *tcp);
+        subflow->updateFlow(packet, direction);
+        subflow->markModified();
     }
 
-    tcpFlow->updateFlow(packet, direction, ip, ipv6, *tcp);
+    tcpFlow->updateFlow(packet, direction);
 }
 
-auto TcpStatsCollector::advanceTick(timeval now) -> void
+/**
+ * Timeout the flow if it was idle for too long. Return the next
+ * deadline of the flow, 0 when it was removed.
+ */
+auto TcpStatsCollector::checkFlowTimeout(FlowId const& flowId, timeval now) -> time_t
 {
-    if (now.tv_sec <= lastTick) {
-        return;
+    auto* tcpFlow = hashToTcpFlow.find(flowId);
+    if (tcpFlow == nullptr) {
+        return 0;
     }
-    std::vector<FlowId> toTimeout;
-    lastTick = now.tv_sec;
-    SPDLOG_DEBUG("Advance tick to {}", now.tv_sec);
-    for (auto it : hashToTcpFlow) {
-        TcpFlow& flow = it.second;
-        auto lastPacketTime = flow.getLastPacketTime();
-        SPDLOG_DEBUG("Check flow {} for timeouts, now {}, lastPacketTime {} {}",
-            flow.getFlowId().toString(), now.tv_sec,
-            lastPacketTime[0].tv_sec, lastPacketTime[1].tv_sec);
-        if (lastPacketTime[FROM_CLIENT].tv_sec == 0
-            && lastPacketTime[FROM_SERVER].tv_sec == 0) {
-            continue;
-        }
-        std::array<uint32_t, 2> deltas = { 0, 0 };
-        for (int i = 0; i < 2; ++i) {
-            if (lastPacketTime[i].tv_sec > 0) {
-                deltas[i] = getTimevalDeltaS(lastPacketTime[i], now);
-            }
+    TcpFlow& flow = *tcpFlow;
+    auto lastPacketTime = flow.getLastPacketTime();
+    uint32_t timeoutFlow = getFlowstatsConfiguration().getTimeoutFlow();
+    SPDLOG_DEBUG("Check flow {} for timeouts, now {}, lastPacketTime {} {}",
+        flow.getFlowId().toString(), now.tv_sec,
+        lastPacketTime[0].tv_sec, lastPacketTime[1].tv_sec);
+    if (lastPacketTime[FROM_CLIENT].tv_sec == 0
+        && lastPacketTime[FROM_SERVER].tv_sec == 0) {
+        return now.tv_sec + timeoutFlow + 1;
+    }
+    std::array<uint32_t, 2> deltas = { 0, 0 };
+    for (int i = 0; i < 2; ++i) {
+        if (lastPacketTime[i].tv_sec > 0) {
+            deltas[i] = getTimevalDeltaS(lastPacketTime[i], now);
         }
-        uint32_t maxDelta = std::max(deltas[0], deltas[1]);
-        SPDLOG_DEBUG("flow.{}, maxDelta: {}", flow.getFlowId().toString(), maxDelta);
-        uint32_t timeoutFlow = getFlowstatsConfiguration().getTimeoutFlow();
-        if (maxDelta > timeoutFlow) {
-            SPDLOG_DEBUG("Timeout flow {}, now {}, maxDelta {} > {}",
-                flow.getFlowId().toString(), now.tv_sec, maxDelta, timeoutFlow);
-            toTimeout.push_back(it.first);
+    }
+    uint32_t maxDelta = std::max(deltas[0], deltas[1]);
+    SPDLOG_DEBUG("flow.{}, maxDelta: {}", flow.getFlowId().toString(), maxDelta);
+    if (maxDelta > timeoutFlow) {
+        SPDLOG_DEBUG("Timeout flow {}, now {}, maxDelta {} > {}",
+            flow.getFlowId().toString(), now.tv_sec, maxDelta, timeoutFlow);
+        {
+            const TimedLock lock(getDataMutex(), getProtocol());
             flow.timeoutFlow();
+            for (auto* subflow : flow.getAggregatedFlows()) {
+                subflow->markModified();
+            }
         }
+        hashToTcpFlow.erase(flowId);
+        return 0;
     }
-    for (auto i : toTimeout) {
-        hashToTcpFlow.erase(i);
+    return now.tv_sec + (timeoutFlow - maxDelta) + 1;
+}
+
+auto TcpStatsCollector::advanceTick(timeval now) -> void
+{
+    if (now.tv_sec <= lastTick) {
+        return;
     }
+    lastTick = now.tv_sec;
+    SPDLOG_DEBUG("Advance tick to {}", now.tv_sec);
+    flowExpiry.advance(now.tv_sec, [&](FlowId const& flowId) {
+        return checkFlowTimeout(flowId, now);
+    });
+    unknownFlows.advanceTick(now.tv_sec);
 }
 
-auto TcpStatsCollector::getSortFun(Field field) const -> sortFlowFun
+auto TcpStatsCollector::getSortKeyFun(Field field) const -> sortKeyFun
 {
-    auto sortFun = Collector::getSortFun(field);
-    if (sortFun != nullptr) {
-        return sortFun;
+    auto keyFun = Collector::getSortKeyFun(field);
+    if (keyFun != nullptr) {
+        return keyFun;
     }
     switch (field) {
     case Field::SRT:
-        return &AggregatedTcpFlow::sortBySrt;
+        return &AggregatedTcpFlow::sortKeySrt;
     case Field::SRT_RATE:
-        return &AggregatedTcpFlow::sortBySrtRate;
+        return &AggregatedTcpFlow::sortKeySrtRate;
     case Field::REQ:
-        return &AggregatedTcpFlow::sortByRequest;
+        return &AggregatedTcpFlow::sortKeyRequest;
     case Field::REQ_RATE:
-        return &AggregatedTcpFlow::sortByRequestRate;
+        return &AggregatedTcpFlow::sortKeyRequestRate;
     case Field::SYN:
-        return &AggregatedTcpFlow::sortBySyn;
+        return &AggregatedTcpFlow::sortKeySyn;
     case Field::SYNACK:
-        return &AggregatedTcpFlow::sortBySynAck;
+        return &AggregatedTcpFlow::sortKeySynAck;
     case Field::ZWIN:
-        return &AggregatedTcpFlow::sortByZwin;
+        return &AggregatedTcpFlow::sortKeyZwin;
     case Field::RST:
-        return &AggregatedTcpFlow::sortByRst;
+        return &AggregatedTcpFlow::sortKeyRst;
     case Field::FIN:
-        return &AggregatedTcpFlow::sortByFin;
+        return &AggregatedTcpFlow::sortKeyFin;
     case Field::ACTIVE_CONNECTIONS:
-        return &AggregatedTcpFlow::sortByActiveConnections;
+        return &AggregatedTcpFlow::sortKeyActiveConnections;
     case Field::FAILED_CONNECTIONS:
-        return &AggregatedTcpFlow::sortByFailedConnections;
+        return &AggregatedTcpFlow::sortKeyFailedConnections;
     case Field::CONN:
-        return &AggregatedTcpFlow::sortByConnections;
+        return &AggregatedTcpFlow::sortKeyConnections;
     case Field::CONN_RATE:
-        return &AggregatedTcpFlow::sortByConnectionRate;
+        return &AggregatedTcpFlow::sortKeyConnectionRate;
     case Field::CLOSE:
-        return &AggregatedTcpFlow::sortByClose;
+        return &AggregatedTcpFlow::sortKeyClose;
     case Field::CLOSE_RATE:
-        return &AggregatedTcpFlow::sortByCloseRate;
+        return &AggregatedTcpFlow::sortKeyCloseRate;
 
     case Field::MTU:
-        return &AggregatedTcpFlow::sortByMtu;
+        return &AggregatedTcpFlow::sortKeyMtu;
 
     case Field::CT_P95:
-        return &AggregatedTcpFlow::sortByCtP95;
+        return &AggregatedTcpFlow::sortKeyCtP95;
     case Field::CT_P99:
-        return &AggregatedTcpFlow::sortByCtP99;
+        return &AggregatedTcpFlow::sortKeyCtP99;
 
     case Field::SRT_P95:
-        return &AggregatedTcpFlow::sortBySrtP95;
+        return &AggregatedTcpFlow::sortKeySrtP95;
     case Field::SRT_P99:
-        return &AggregatedTcpFlow::sortBySrtP99;
+        return &AggregatedTcpFlow::sortKeySrtP99;
     case Field::SRT_MAX:
-        return &AggregatedTcpFlow::sortBySrtMax;
+        return &AggregatedTcpFlow::sortKeySrtMax;
 
     case Field::DS_P95:
-        return &AggregatedTcpFlow::sortByDsP95;
+        return &AggregatedTcpFlow::sortKeyDsP95;
     case Field::DS_P99:
-        return &AggregatedTcpFlow::sortByDsP99;
+        return &AggregatedTcpFlow::sortKeyDsP99;
     case Field::DS_MAX:
-        return &AggregatedTcpFlow::sortByDsMax;
+        return &AggregatedTcpFlow::sortKeyDsMax;
     default:
         return nullptr;
     }
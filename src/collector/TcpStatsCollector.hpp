@@ -2,8 +2,11 @@
 
 #include "AggregatedTcpFlow.hpp"
 #include "Collector.hpp"
+#include "ExpiryWheel.hpp"
+#include "FlowTable.hpp"
 #include "IpToFqdn.hpp"
 #include "TcpFlow.hpp"
+#include "UnknownFqdnCache.hpp"
 
 namespace flowstats {
 
@@ -13,34 +16,34 @@ public:
         DisplayConfiguration const& displayConf,
         IpToFqdn* ipToFqdn);
 
-    auto processPacket(Tins::Packet const& packet,
-        FlowId const& flowId,
-        Tins::IP const* ip,
-        Tins::IPv6 const* ipv6,
-        Tins::TCP const* tcp,
-        Tins::UDP const* udp) -> void override;
+    auto processPacket(PacketView const& packet,
+        FlowId const& flowId) -> void override;
 
     auto advanceTick(timeval now) -> void override;
 
     [[nodiscard]] auto getProtocol() const -> CollectorProtocol override { return TCP; };
     [[nodiscard]] auto toString() const -> std::string override { return "TcpStatsCollector"; }
 
-    [[nodiscard]] auto getTcpFlow() const { return hashToTcpFlow; }
+    [[nodiscard]] auto getTcpFlow() const -> FlowTable<TcpFlow> const& { return hashToTcpFlow; }
+    [[nodiscard]] auto getUnknownFlows() const -> UnknownFqdnCache const& { return unknownFlows; }
 
 private:
     typedef std::array<int, 65536> portArray;
-    std::unordered_map<FlowId, TcpFlow, std::hash<FlowId>> hashToTcpFlow;
+    FlowTable<TcpFlow> hashToTcpFlow;
+    ExpiryWheel<FlowId> flowExpiry;
+    UnknownFqdnCache unknownFlows;
     portArray srvPortsCounter = {};
 
     std::vector<std::pair<TcpFlow*, std::vector<AggregatedTcpFlow*>>> openingTcpFlow;
-    auto lookupTcpFlow(Tins::TCP const& tcpLayer,
+    auto lookupTcpFlow(PacketView const& packet,
         FlowId const& flowId) -> TcpFlow*;
-    auto lookupAggregatedFlows(FlowId const& flowId, std::string const& fqdn, Direction srvDir) -> std::vector<AggregatedTcpFlow*>;
-    [[nodiscard]] auto detectServer(Tins::TCP const& tcp, FlowId const& flowId) -> Direction;
-    [[nodiscard]] auto getSortFun(Field field) const -> sortFlowFun override;
+    auto lookupAggregatedFlows(FlowId const& flowId, FqdnId fqdnId, Direction srvDir) -> std::vector<AggregatedTcpFlow*>;
+    [[nodiscard]] auto detectServer(PacketView const& packet, FlowId const& flowId) -> Direction;
+    [[nodiscard]] auto getSortKeyFun(Field field) const -> sortKeyFun override;
 
     void timeoutOpeningConnections(timeval now);
     void timeoutFlows(timeval now);
+    auto checkFlowTimeout(FlowId const& flowId, timeval now) -> time_t;
 
     int lastTick = 0;
     IpToFqdn* ipToFqdn;
@@ -6,90 +6,112 @@
 
 namespace flowstats {
 
-auto AggregatedDnsFlow::getTopClientIps() const -> std::vector<std::pair<int, int>>
+auto AggregatedDnsFlow::formatTopClientIps(fmt::memory_buffer* out) const -> void
 {
-    int size = std::min(5, static_cast<int>(sourceIps.size()));
-    std::vector<std::pair<int, int>> topIps(size);
-    std::partial_sort_copy(sourceIps.begin(), sourceIps.end(),
+    std::array<std::pair<int, int>, maxTopClientIps> topIps;
+    auto last = std::partial_sort_copy(sourceIps.begin(), sourceIps.end(),
         topIps.begin(), topIps.end(),
         [](std::pair<int, int> const& l,
             std::pair<int, int> const& r) {
             return l.second > r.second;
         });
-    return topIps;
-}
-
-auto AggregatedDnsFlow::getTopClientIpsStr() const -> std::string
-{
-    auto topIps = getTopClientIps();
-    std::vector<std::string> topIpsStr;
-    topIpsStr.reserve(topIps.size());
-    for (auto& pair : topIps) {
-        topIpsStr.push_back(fmt::format("{:<3} {:<" STR(IP_SIZE) "}",
-            prettyFormatNumber(pair.second),
-            Tins::IPv4Address(pair.first).to_string()));
+    for (auto it = topIps.begin(); it != last; ++it) {
+        if (it != topIps.begin()) {
+            out->push_back(' ');
+        }
+        size_t start = out->size();
+        prettyFormatNumber(it->second, out);
+        padTo(out, start + 3);
+        out->push_back(' ');
+        start = out->size();
+        formatIpv4(it->first, out);
+        padTo(out, start + IP_SIZE);
     }
-    return fmt::format("{}", fmt::join(topIpsStr, " "));
 }
 
-auto AggregatedDnsFlow::fillValues(std::map<Field, std::string>* ptrValues,
-    Direction direction) const -> void
+auto AggregatedDnsFlow::formatField(Field field, Direction direction,
+    fmt::memory_buffer* out) const -> bool
 {
-    Flow::fillValues(ptrValues, direction);
-    auto& values = *ptrValues;
-    auto fqdn = getFqdn();
-    if (fqdn == "Total") {
-        if (direction == FROM_SERVER) {
-            return;
+    auto const& fqdn = getFqdn();
+    if (direction == FROM_SERVER) {
+        // Long fqdns continue on the server line
+        if (field == +Field::FQDN && fqdn.size() > FQDN_SIZE) {
+            appendString(out, std::string_view(fqdn).substr(FQDN_SIZE));
+            return true;
         }
-        values[Field::FQDN] = fqdn;
-        values[Field::IP] = "-";
-        values[Field::PORT] = "-";
-        values[Field::PROTO] = "-";
-        values[Field::TYPE] = "-";
-
-        values[Field::TIMEOUTS_RATE] = std::to_string(timeouts);
-        values[Field::TIMEOUTS] = std::to_string(totalTimeouts);
-        values[Field::REQ] = prettyFormatNumber(totalQueries);
-        values[Field::REQ_RATE] = prettyFormatNumber(queries);
-
-        values[Field::SRT] = prettyFormatNumber(totalSrt);
-        values[Field::SRT_RATE] = prettyFormatNumber(numSrt);
-        values[Field::SRT_P95] = srts.getPercentileStr(0.95);
-        values[Field::SRT_P99] = srts.getPercentileStr(0.99);
-
-        values[Field::TRUNC] = std::to_string(totalTruncated);
-        values[Field::RCRD_AVG] = "-";
-
-        values[Field::TOP_CLIENT_IPS] = getTopClientIpsStr();
-        return;
+        return Flow::formatField(field, direction, out);
     }
 
-    if (direction == FROM_CLIENT) {
-        values[Field::FQDN] = fqdn;
-        values[Field::PROTO] = getTransport()._to_string();
-        values[Field::TYPE] = dnsTypeToString(dnsType);
-        values[Field::IP] = getSrvIp();
-        values[Field::TIMEOUTS_RATE] = std::to_string(timeouts);
-        values[Field::TIMEOUTS] = std::to_string(totalTimeouts);
-        values[Field::PORT] = std::to_string(getSrvPort());
-        values[Field::REQ] = prettyFormatNumber(totalQueries);
-        values[Field::REQ_RATE] = prettyFormatNumber(queries);
-        values[Field::TOP_CLIENT_IPS] = getTopClientIpsStr();
-
-        values[Field::SRT] = prettyFormatNumber(totalSrt);
-        values[Field::SRT_RATE] = prettyFormatNumber(numSrt);
-        values[Field::SRT_P95] = srts.getPercentileStr(0.95);
-        values[Field::SRT_P99] = srts.getPercentileStr(0.99);
-
-        values[Field::TRUNC] = std::to_string(totalTruncated);
-        if (totalQueries > 0) {
-            values[Field::RCRD_AVG] = std::to_string(totalRecords / totalQueries);
+    bool isTotal = fqdn == "Total";
+    switch (field) {
+    case Field::FQDN:
+        appendString(out, fqdn);
+        return true;
+    case Field::IP:
+        if (isTotal) {
+            out->push_back('-');
+        } else {
+            formatSrvIp(out);
+        }
+        return true;
+    case Field::PORT:
+        if (isTotal) {
+            out->push_back('-');
+        } else {
+            appendValue(out, getSrvPort());
+        }
+        return true;
+    case Field::PROTO:
+        appendString(out, isTotal ? "-" : getTransport()._to_string());
+        return true;
+    case Field::TYPE:
+        appendString(out, isTotal ? "-" : dnsTypeToString(dnsType));
+        return true;
+
+    case Field::TIMEOUTS_RATE:
+        appendValue(out, timeouts);
+        return true;
+    case Field::TIMEOUTS:
+        appendValue(out, totalTimeouts);
+        return true;
+    case Field::REQ:
+        prettyFormatNumber(totalQueries, out);
+        return true;
+    case Field::REQ_RATE:
+        prettyFormatNumber(queries, out);
+        return true;
+    case Field::TOP_CLIENT_IPS:
+        formatTopClientIps(out);
+        return true;
+
+    case Field::SRT:
+        prettyFormatNumber(totalSrt, out);
+        return true;
+    case Field::SRT_RATE:
+        prettyFormatNumber(numSrt, out);
+        return true;
+    case Field::SRT_P95:
+        srts.formatPercentile(0.95, out);
+        return true;
+    case Field::SRT_P99:
+        srts.formatPercentile(0.99, out);
+        return true;
+
+    case Field::TRUNC:
+        appendValue(out, totalTruncated);
+        return true;
+    case Field::RCRD_AVG:
+        if (isTotal) {
+            out->push_back('-');
+            return true;
         }
-    } else {
-        if (fqdn.size() > FQDN_SIZE) {
-            values[Field::FQDN] = fqdn.substr(FQDN_SIZE);
+        if (totalQueries == 0) {
+            return false;
         }
+        appendValue(out, totalRecords / totalQueries);
+        return true;
+    default:
+        return Flow::formatField(field, direction, out);
     }
 }
 
@@ -141,7 +163,7 @@ auto AggregatedDnsFlow::addAggregatedFlow(Flow const* flow) -> void
     numSrt += dnsFlow->numSrt;
 }
 
-auto AggregatedDnsFlow::getStatsdMetrics() const -> std::vector<std::string>
+auto AggregatedDnsFlow::getStatsdMetrics(StatsdMode mode) const -> std::vector<std::string>
 {
     std::vector<std::string> lst;
     DogFood::Tags tags = DogFood::Tags({
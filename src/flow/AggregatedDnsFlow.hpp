@@ -12,108 +12,100 @@ struct AggregatedDnsFlow : Flow {
     AggregatedDnsFlow()
         : Flow("Total") {};
 
-    AggregatedDnsFlow(FlowId const& flowId, std::string const& fqdn,
+    AggregatedDnsFlow(FlowId const& flowId, FqdnId fqdnId,
         enum Tins::DNS::QueryType dnsType)
-        : Flow(flowId, fqdn)
+        : Flow(flowId, fqdnId)
         , dnsType(dnsType) {};
 
     auto resetFlow(bool resetTotal) -> void override;
     auto operator<(AggregatedDnsFlow const& b) { return queries < b.queries; }
-    auto fillValues(std::map<Field, std::string>* values,
-        Direction direction) const -> void override;
+    auto formatField(Field field, Direction direction,
+        fmt::memory_buffer* out) const -> bool override;
     auto addFlow(Flow const* flow) -> void override;
     auto addAggregatedFlow(Flow const* flow) -> void override;
     auto mergePercentiles() -> void override { srts.merge(); }
+    [[nodiscard]] auto clone() const -> Flow* override { return new AggregatedDnsFlow(*this); };
 
-    [[nodiscard]] auto getStatsdMetrics() const -> std::vector<std::string> override;
+    [[nodiscard]] auto getStatsdMetrics(StatsdMode mode) const -> std::vector<std::string> override;
 
-    [[nodiscard]] static auto sortByRequest(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyRequest(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->totalQueries < bCast->totalQueries;
+        return aCast->totalQueries;
     }
 
-    [[nodiscard]] static auto sortByRequestRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyRequestRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->srts.getCount() < bCast->srts.getCount();
+        return aCast->srts.getCount();
     }
 
-    [[nodiscard]] static auto sortByTimeout(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyTimeout(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->totalTimeouts < bCast->totalTimeouts;
+        return aCast->totalTimeouts;
     }
 
-    [[nodiscard]] static auto sortByTimeoutRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyTimeoutRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->timeouts < bCast->timeouts;
+        return aCast->timeouts;
     }
 
-    [[nodiscard]] static auto sortByProto(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyProto(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->getFlowId().getTransport() < bCast->getFlowId().getTransport();
+        return aCast->getFlowId().getTransport()._to_integral();
     }
 
-    [[nodiscard]] static auto sortByType(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyType(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->dnsType < bCast->dnsType;
+        return aCast->dnsType;
     }
 
-    [[nodiscard]] static auto sortBySrt(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrt(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->totalSrt < bCast->totalSrt;
+        return aCast->totalSrt;
     }
 
-    [[nodiscard]] static auto sortBySrtRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->numSrt < bCast->numSrt;
+        return aCast->numSrt;
     }
 
-    [[nodiscard]] static auto sortBySrtP95(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtP95(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->srts.getPercentile(0.95) < bCast->srts.getPercentile(0.95);
+        return aCast->srts.getPercentile(0.95);
     }
 
-    [[nodiscard]] static auto sortBySrtP99(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtP99(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->srts.getPercentile(0.99) < bCast->srts.getPercentile(0.99);
+        return aCast->srts.getPercentile(0.99);
     }
 
-    [[nodiscard]] static auto sortBySrtMax(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtMax(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->srts.getPercentile(1) < bCast->srts.getPercentile(1);
+        return aCast->srts.getPercentile(1);
     }
 
-    [[nodiscard]] static auto sortByRcrdAvg(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyRcrdAvg(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedDnsFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedDnsFlow const*>(b);
-        return aCast->totalRecords / aCast->totalQueries < bCast->totalRecords / bCast->totalQueries;
+        if (aCast->totalQueries == 0) {
+            return 0;
+        }
+        return aCast->totalRecords / aCast->totalQueries;
     }
 
 private:
-    [[nodiscard]] auto getTopClientIps() const -> std::vector<std::pair<int, int>>;
-    [[nodiscard]] auto getTopClientIpsStr() const -> std::string;
+    static int const maxTopClientIps = 5;
+    auto formatTopClientIps(fmt::memory_buffer* out) const -> void;
 
     enum Tins::DNS::QueryType dnsType = Tins::DNS::QueryType::A;
 
@@ -9,45 +9,52 @@ namespace flowstats {
 
 class AggregatedKey {
 public:
-    AggregatedKey(std::string const& fqdn,
+    AggregatedKey(FqdnId fqdnId,
         IPv4 ip,
         IPv6 ipv6,
         Port port,
         Tins::DNS::QueryType dnsType = Tins::DNS::A,
         Transport transport = Transport::TCP)
-        : fqdn(fqdn)
+        : fqdnId(fqdnId)
         , ip(ip)
         , ipv6(ipv6)
         , port(port)
         , dnsType(dnsType)
         , transport(transport) {};
 
-    static auto aggregatedIpv4TcpKey(std::string const& fqdn,
+    static auto aggregatedIpv4TcpKey(std::string_view fqdn,
         IPv4 ip,
         Port port)
     {
-        return AggregatedKey(fqdn, ip, {}, port);
+        return AggregatedKey(internFqdn(fqdn), ip, {}, port);
     }
 
-    static auto aggregatedIpv6TcpKey(std::string const& fqdn,
+    static auto aggregatedIpv6TcpKey(std::string_view fqdn,
         IPv6 ipv6,
         Port port)
     {
-        return AggregatedKey(fqdn, 0, ipv6, port);
+        return AggregatedKey(internFqdn(fqdn), IPv4(), ipv6, port);
     }
 
-    static auto aggregatedDnsKey(std::string const& fqdn,
+    static auto aggregatedDnsKey(FqdnId fqdnId,
         Tins::DNS::QueryType dnsType,
         Transport transport)
     {
-        return AggregatedKey(fqdn, 0, {}, 0, dnsType, transport);
+        return AggregatedKey(fqdnId, IPv4(), {}, 0, dnsType, transport);
+    }
+
+    static auto aggregatedDnsKey(std::string_view fqdn,
+        Tins::DNS::QueryType dnsType,
+        Transport transport)
+    {
+        return aggregatedDnsKey(internFqdn(fqdn), dnsType, transport);
     }
 
     virtual ~AggregatedKey() = default;
 
     auto operator<(AggregatedKey const& b) const -> bool
     {
-        return fqdn < b.fqdn
+        return fqdnId < b.fqdnId
             && ip < b.ip
             && ipv6 < b.ipv6
             && port < b.port
@@ -57,7 +64,7 @@ public:
 
     auto operator==(AggregatedKey const& b) const -> bool
     {
-        return fqdn == b.fqdn
+        return fqdnId == b.fqdnId
             && ip == b.ip
             && ipv6 == b.ipv6
             && port == b.port
@@ -67,16 +74,14 @@ public:
 
     [[nodiscard]] auto hash() const
     {
-        return std::hash<std::string>()(fqdn)
-            + std::hash<flowstats::IPv4>()(ip)
-            + std::hash<flowstats::IPv6>()(ipv6)
-            + std::hash<uint16_t>()(port)
-            + std::hash<uint16_t>()(dnsType)
-            + std::hash<uint16_t>()(transport);
+        uint64_t fqdnAndPort = (uint64_t(fqdnId) << 32) | (uint64_t(port) << 16)
+            | (uint64_t(dnsType & 0xff) << 8) | uint64_t(transport);
+        return mixHash(mixHash(fqdnAndPort ^ uint32_t(ip))
+            + std::hash<flowstats::IPv6>()(ipv6));
     };
 
 private:
-    std::string fqdn;
+    FqdnId fqdnId;
     IPv4 ip;
     IPv6 ipv6;
     Port port;
@@ -2,22 +2,40 @@
 
 namespace flowstats {
 
-auto AggregatedSslFlow::fillValues(std::map<Field, std::string>* ptrValues,
-    Direction direction) const -> void
+auto AggregatedSslFlow::formatField(Field field, Direction direction,
+    fmt::memory_buffer* out) const -> bool
 {
-    Flow::fillValues(ptrValues, direction);
-
-    if (direction == FROM_CLIENT) {
-        auto& values = *ptrValues;
-        values[Field::FQDN] = getFqdn();
-        values[Field::IP] = getSrvIp();
-        values[Field::PORT] = std::to_string(getSrvPort());
-        values[Field::DOMAIN] = domain;
-
-        values[Field::CONN] = prettyFormatNumber(totalConnections);
-        values[Field::CONN_RATE] = prettyFormatNumber(numConnections);
-        values[Field::CT_P95] = connections.getPercentileStr(0.95);
-        values[Field::CT_P99] = connections.getPercentileStr(0.99);
+    if (direction != FROM_CLIENT) {
+        return Flow::formatField(field, direction, out);
+    }
+    switch (field) {
+    case Field::FQDN:
+        appendString(out, getFqdn());
+        return true;
+    case Field::IP:
+        formatSrvIp(out);
+        return true;
+    case Field::PORT:
+        appendValue(out, getSrvPort());
+        return true;
+    case Field::DOMAIN:
+        appendString(out, domain);
+        return true;
+
+    case Field::CONN:
+        prettyFormatNumber(totalConnections, out);
+        return true;
+    case Field::CONN_RATE:
+        prettyFormatNumber(numConnections, out);
+        return true;
+    case Field::CT_P95:
+        connections.formatPercentile(0.95, out);
+        return true;
+    case Field::CT_P99:
+        connections.formatPercentile(0.99, out);
+        return true;
+    default:
+        return Flow::formatField(field, direction, out);
     }
 }
 
@@ -32,6 +50,16 @@ void AggregatedSslFlow::resetFlow(bool resetTotal)
     }
 }
 
+auto AggregatedSslFlow::addAggregatedFlow(Flow const* flow) -> void
+{
+    Flow::addFlow(flow);
+
+    auto const* sslFlow = dynamic_cast<const AggregatedSslFlow*>(flow);
+    numConnections += sslFlow->numConnections;
+    totalConnections += sslFlow->totalConnections;
+    connections.addPoints(sslFlow->connections);
+}
+
 auto AggregatedSslFlow::addConnection(int delta) -> void
 {
     connections.addPoint(delta);
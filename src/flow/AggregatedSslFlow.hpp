@@ -10,43 +10,41 @@ public:
     AggregatedSslFlow()
         : Flow("Total") {};
 
-    AggregatedSslFlow(FlowId const& flowId, std::string const& fqdn)
-        : Flow(flowId, fqdn) {};
+    AggregatedSslFlow(FlowId const& flowId, FqdnId fqdnId)
+        : Flow(flowId, fqdnId) {};
 
-    auto fillValues(std::map<Field, std::string>* map, Direction direction) const -> void override;
+    auto formatField(Field field, Direction direction, fmt::memory_buffer* out) const -> bool override;
     auto resetFlow(bool resetTotal) -> void override;
+    auto addAggregatedFlow(Flow const* flow) -> void override;
+    auto mergePercentiles() -> void override { connections.merge(); };
+    [[nodiscard]] auto clone() const -> Flow* override { return new AggregatedSslFlow(*this); };
     auto setDomain(std::string _domain) -> void { domain = std::move(_domain); }
     auto addConnection(int delta) -> void;
-    auto merge() -> void { connections.merge(); };
 
     [[nodiscard]] auto getDomain() const { return domain; }
 
-    [[nodiscard]] static auto sortByConnections(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyConnections(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedSslFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedSslFlow const*>(b);
-        return aCast->totalConnections < bCast->totalConnections;
+        return aCast->totalConnections;
     }
 
-    [[nodiscard]] static auto sortByConnectionRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyConnectionRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedSslFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedSslFlow const*>(b);
-        return aCast->numConnections < bCast->numConnections;
+        return aCast->numConnections;
     }
 
-    [[nodiscard]] static auto sortByConnectionP95(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyConnectionP95(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedSslFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedSslFlow const*>(b);
-        return aCast->connections.getPercentile(.95) < bCast->connections.getPercentile(.95);
+        return aCast->connections.getPercentile(.95);
     }
 
-    [[nodiscard]] static auto sortByConnectionP99(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyConnectionP99(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedSslFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedSslFlow const*>(b);
-        return aCast->connections.getPercentile(.99) < bCast->connections.getPercentile(.99);
+        return aCast->connections.getPercentile(.99);
     }
 
 private:
@@ -10,65 +10,117 @@ AggregatedTcpFlow::~AggregatedTcpFlow()
     requestSizes.resetAndShrink();
 }
 
-auto AggregatedTcpFlow::updateFlow(Tins::Packet const& packet,
-    FlowId const& flowId,
-    Tins::TCP const& tcp) -> void
+auto AggregatedTcpFlow::updateFlow(PacketView const& packet,
+    Direction direction) -> void
 {
-    auto direction = flowId.getDirection();
-    if (tcp.has_flags(Tins::TCP::RST)) {
+    if (packet.hasFlags(Tins::TCP::RST)) {
         rsts[direction]++;
     }
 
-    if (tcp.window() == 0 && !tcp.has_flags(Tins::TCP::RST)) {
+    if (packet.window == 0 && !packet.hasFlags(Tins::TCP::RST)) {
         zeroWins[direction]++;
     }
 
-    if (tcp.has_flags(Tins::TCP::SYN | Tins::TCP::ACK)) {
+    if (packet.hasFlags(Tins::TCP::SYN | Tins::TCP::ACK)) {
         synacks[direction]++;
-    } else if (tcp.has_flags(Tins::TCP::SYN)) {
+    } else if (packet.hasFlags(Tins::TCP::SYN)) {
         syns[direction]++;
-    } else if (tcp.has_flags(Tins::TCP::FIN)) {
+    } else if (packet.hasFlags(Tins::TCP::FIN)) {
         fins[direction]++;
     }
-    mtu[direction] = std::max(mtu[direction],
-        packet.pdu()->advertised_size());
+    mtu[direction] = std::max(mtu[direction], packet.frameSize);
 }
 
-auto AggregatedTcpFlow::fillValues(std::map<Field, std::string>* ptrValues,
-    Direction direction) const -> void
+auto AggregatedTcpFlow::formatField(Field field, Direction direction,
+    fmt::memory_buffer* out) const -> bool
 {
-    Flow::fillValues(ptrValues, direction);
-    auto& values = *ptrValues;
-    values[Field::SYN] = std::to_string(syns[direction]);
-    values[Field::SYNACK] = std::to_string(synacks[direction]);
-    values[Field::FIN] = std::to_string(fins[direction]);
-    values[Field::ZWIN] = std::to_string(zeroWins[direction]);
-    values[Field::RST] = std::to_string(rsts[direction]);
-    values[Field::MTU] = std::to_string(mtu[direction]);
-
-    if (direction == FROM_CLIENT) {
-        values[Field::ACTIVE_CONNECTIONS] = std::to_string(activeConnections);
-        values[Field::FAILED_CONNECTIONS] = std::to_string(failedConnections);
-        values[Field::CLOSE] = std::to_string(totalCloses);
-        values[Field::CONN] = prettyFormatNumber(totalConnections);
-        values[Field::CT_P95] = connections.getPercentileStr(0.95);
-        values[Field::CT_P99] = connections.getPercentileStr(0.99);
-
-        values[Field::SRT] = prettyFormatNumber(totalSrts);
-        values[Field::SRT_P95] = srts.getPercentileStr(0.95);
-        values[Field::SRT_P99] = srts.getPercentileStr(0.99);
-
-        values[Field::DS_P95] = prettyFormatBytes(requestSizes.getPercentile(0.95));
-        values[Field::DS_P99] = prettyFormatBytes(requestSizes.getPercentile(0.99));
-        values[Field::DS_MAX] = prettyFormatBytes(requestSizes.getPercentile(1));
-
-        values[Field::FQDN] = getFqdn();
-        values[Field::IP] = getSrvIp();
-        values[Field::PORT] = std::to_string(getSrvPort());
-
-        values[Field::CONN_RATE] = std::to_string(numConnections);
-        values[Field::CLOSE_RATE] = std::to_string(closes);
-        values[Field::SRT_RATE] = prettyFormatNumber(numSrts);
+    switch (field) {
+    case Field::SYN:
+        appendValue(out, syns[direction]);
+        return true;
+    case Field::SYNACK:
+        appendValue(out, synacks[direction]);
+        return true;
+    case Field::FIN:
+        appendValue(out, fins[direction]);
+        return true;
+    case Field::ZWIN:
+        appendValue(out, zeroWins[direction]);
+        return true;
+    case Field::RST:
+        appendValue(out, rsts[direction]);
+        return true;
+    case Field::MTU:
+        appendValue(out, mtu[direction]);
+        return true;
+    default:
+        break;
+    }
+
+    if (direction != FROM_CLIENT) {
+        return Flow::formatField(field, direction, out);
+    }
+    switch (field) {
+    case Field::ACTIVE_CONNECTIONS:
+        appendValue(out, activeConnections);
+        return true;
+    case Field::FAILED_CONNECTIONS:
+        appendValue(out, failedConnections);
+        return true;
+    case Field::CLOSE:
+        appendValue(out, totalCloses);
+        return true;
+    case Field::CONN:
+        prettyFormatNumber(totalConnections, out);
+        return true;
+    case Field::CT_P95:
+        connections.formatPercentile(0.95, out);
+        return true;
+    case Field::CT_P99:
+        connections.formatPercentile(0.99, out);
+        return true;
+
+    case Field::SRT:
+        prettyFormatNumber(totalSrts, out);
+        return true;
+    case Field::SRT_P95:
+        srts.formatPercentile(0.95, out);
+        return true;
+    case Field::SRT_P99:
+        srts.formatPercentile(0.99, out);
+        return true;
+
+    case Field::DS_P95:
+        prettyFormatBytes(requestSizes.getPercentile(0.95), out);
+        return true;
+    case Field::DS_P99:
+        prettyFormatBytes(requestSizes.getPercentile(0.99), out);
+        return true;
+    case Field::DS_MAX:
+        prettyFormatBytes(requestSizes.getPercentile(1), out);
+        return true;
+
+    case Field::FQDN:
+        appendString(out, getFqdn());
+        return true;
+    case Field::IP:
+        formatSrvIp(out);
+        return true;
+    case Field::PORT:
+        appendValue(out, getSrvPort());
+        return true;
+
+    case Field::CONN_RATE:
+        appendValue(out, numConnections);
+        return true;
+    case Field::CLOSE_RATE:
+        appendValue(out, closes);
+        return true;
+    case Field::SRT_RATE:
+        prettyFormatNumber(numSrts, out);
+        return true;
+    default:
+        return Flow::formatField(field, direction, out);
     }
 }
 
@@ -79,6 +131,7 @@ auto AggregatedTcpFlow::addAggregatedFlow(Flow const* flow) -> void
     auto const* tcpFlow = dynamic_cast<const AggregatedTcpFlow*>(flow);
     for (int i = 0; i <= FROM_SERVER; ++i) {
         syns[i] += tcpFlow->syns[i];
+        synacks[i] += tcpFlow->synacks[i];
         fins[i] += tcpFlow->fins[i];
         rsts[i] += tcpFlow->rsts[i];
         zeroWins[i] += tcpFlow->zeroWins[i];
@@ -170,20 +223,41 @@ auto AggregatedTcpFlow::closeConnection() -> void
     activeConnections--;
 };
 
-auto AggregatedTcpFlow::getStatsdMetrics() const -> std::vector<std::string>
+/**
+ * Export a distribution either as sampled histogram values or as
+ * locally computed summary gauges
+ */
+static auto addDistributionMetrics(std::vector<std::string>* lst,
+    std::string const& name, Percentile const& perc,
+    DogFood::Tags const& tags, StatsdMode mode) -> void
+{
+    if (perc.getCount() == 0) {
+        return;
+    }
+    if (mode == StatsdHistogram) {
+        // A value seen n times is sent once with a 1/n sample rate
+        perc.forEachBucket([&](uint32_t value, uint32_t count) {
+            lst->push_back(DogFood::Metric(name, value,
+                DogFood::Histogram, 1.0 / count, tags));
+        });
+        return;
+    }
+    lst->push_back(DogFood::Metric(name + ".count", perc.getCount(), DogFood::Counter, 1, tags));
+    lst->push_back(DogFood::Metric(name + ".avg", perc.getMean(), DogFood::Gauge, 1, tags));
+    lst->push_back(DogFood::Metric(name + ".p50", perc.getPercentile(0.5), DogFood::Gauge, 1, tags));
+    lst->push_back(DogFood::Metric(name + ".p95", perc.getPercentile(0.95), DogFood::Gauge, 1, tags));
+    lst->push_back(DogFood::Metric(name + ".p99", perc.getPercentile(0.99), DogFood::Gauge, 1, tags));
+    lst->push_back(DogFood::Metric(name + ".max", perc.getPercentile(1), DogFood::Gauge, 1, tags));
+}
+
+auto AggregatedTcpFlow::getStatsdMetrics(StatsdMode mode) const -> std::vector<std::string>
 {
     std::vector<std::string> lst;
     DogFood::Tags tags = DogFood::Tags({ { "fqdn", getFqdn() },
         { "ip", getSrvIp() },
         { "port", std::to_string(getSrvPort()) } });
-    for (auto& i : srts.getPoints()) {
-        lst.push_back(DogFood::Metric("flowstats.tcp.srt", i,
-            DogFood::Histogram, 1, tags));
-    }
-    for (auto& i : connections.getPoints()) {
-        lst.push_back(DogFood::Metric("flowstats.tcp.ct", i,
-            DogFood::Histogram, 1, tags));
-    }
+    addDistributionMetrics(&lst, "flowstats.tcp.srt", srts, tags, mode);
+    addDistributionMetrics(&lst, "flowstats.tcp.ct", connections, tags, mode);
     if (activeConnections) {
         lst.push_back(DogFood::Metric("flowstats.tcp.activeConnections", activeConnections, DogFood::Counter, 1, tags));
     }
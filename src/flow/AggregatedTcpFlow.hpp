@@ -12,11 +12,11 @@ struct AggregatedTcpFlow : Flow {
     AggregatedTcpFlow()
         : Flow("Total") {};
 
-    AggregatedTcpFlow(FlowId const& flowId, std::string const& fqdn)
-        : Flow(flowId, fqdn) {};
+    AggregatedTcpFlow(FlowId const& flowId, FqdnId fqdnId)
+        : Flow(flowId, fqdnId) {};
 
-    AggregatedTcpFlow(FlowId const& flowId, std::string const& fqdn, uint8_t srvDir)
-        : Flow(flowId, fqdn, srvDir) {};
+    AggregatedTcpFlow(FlowId const& flowId, FqdnId fqdnId, uint8_t srvDir)
+        : Flow(flowId, fqdnId, srvDir) {};
 
     ~AggregatedTcpFlow() override;
 
@@ -25,195 +25,170 @@ struct AggregatedTcpFlow : Flow {
         return syns[0] < b.syns[0];
     }
 
-    auto updateFlow(Tins::Packet const& packet, FlowId const& flowId,
-        Tins::TCP const& tcpLayer) -> void;
+    auto updateFlow(PacketView const& packet, Direction direction) -> void;
 
     auto resetFlow(bool resetTotal) -> void override;
-    auto fillValues(std::map<Field, std::string>* map,
-        Direction direction) const -> void override;
+    auto formatField(Field field, Direction direction,
+        fmt::memory_buffer* out) const -> bool override;
     auto addAggregatedFlow(Flow const* flow) -> void override;
 
     auto mergePercentiles() -> void override;
+    [[nodiscard]] auto clone() const -> Flow* override { return new AggregatedTcpFlow(*this); };
     auto failConnection() -> void;
     auto closeConnection() -> void;
     auto openConnection(int connectionTime) -> void;
     auto ongoingConnection() -> void;
     auto addSrt(int srt, int dataSize) -> void;
-    [[nodiscard]] auto getStatsdMetrics() const -> std::vector<std::string> override;
+    [[nodiscard]] auto getStatsdMetrics(StatsdMode mode) const -> std::vector<std::string> override;
 
-    [[nodiscard]] static auto sortByMtu(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyMtu(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->mtu[0] + aCast->mtu[1] < bCast->mtu[0] + bCast->mtu[1];
+        return aCast->mtu[0] + aCast->mtu[1];
     }
 
-    [[nodiscard]] static auto sortBySrt(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrt(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->numSrts < bCast->numSrts;
+        return aCast->numSrts;
     }
 
-    [[nodiscard]] static auto sortBySrtRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->srts.getCount() < bCast->srts.getCount();
+        return aCast->srts.getCount();
     }
 
-    [[nodiscard]] static auto sortByRequest(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyRequest(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->totalSrts < bCast->totalSrts;
+        return aCast->totalSrts;
     }
 
-    [[nodiscard]] static auto sortByRequestRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyRequestRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->srts.getCount() < bCast->srts.getCount();
+        return aCast->srts.getCount();
     }
 
-    [[nodiscard]] static auto sortBySyn(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySyn(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->syns < bCast->syns;
+        return packPair(aCast->syns);
     }
 
-    [[nodiscard]] static auto sortBySynAck(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySynAck(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->synacks < bCast->synacks;
+        return packPair(aCast->synacks);
     }
 
-    [[nodiscard]] static auto sortByZwin(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyZwin(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->zeroWins < bCast->zeroWins;
+        return packPair(aCast->zeroWins);
     }
 
-    [[nodiscard]] static auto sortByRst(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyRst(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->rsts < bCast->rsts;
+        return packPair(aCast->rsts);
     }
 
-    [[nodiscard]] static auto sortByFin(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyFin(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->fins < bCast->fins;
+        return packPair(aCast->fins);
     }
 
-    [[nodiscard]] static auto sortByActiveConnections(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyActiveConnections(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->activeConnections < bCast->activeConnections;
+        return aCast->activeConnections;
     }
 
-    [[nodiscard]] static auto sortByFailedConnections(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyFailedConnections(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->failedConnections < bCast->failedConnections;
+        return aCast->failedConnections;
     }
 
-    [[nodiscard]] static auto sortByConnectionRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyConnectionRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->numConnections < bCast->numConnections;
+        return aCast->numConnections;
     }
 
-    [[nodiscard]] static auto sortByConnections(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyConnections(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->totalConnections < bCast->totalConnections;
+        return aCast->totalConnections;
     }
 
-    [[nodiscard]] static auto sortByCtP95(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyCtP95(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->connections.getPercentile(0.95) < bCast->connections.getPercentile(0.95);
+        return aCast->connections.getPercentile(0.95);
     }
 
-    [[nodiscard]] static auto sortByCtP99(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyCtP99(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->connections.getPercentile(0.99) < bCast->connections.getPercentile(0.99);
+        return aCast->connections.getPercentile(0.99);
     }
 
-    [[nodiscard]] static auto sortByCtMax(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyCtMax(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->connections.getPercentile(1) < bCast->connections.getPercentile(1);
+        return aCast->connections.getPercentile(1);
     }
 
-    [[nodiscard]] static auto sortBySrtP95(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtP95(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->srts.getPercentile(0.95) < bCast->srts.getPercentile(0.95);
+        return aCast->srts.getPercentile(0.95);
     }
 
-    [[nodiscard]] static auto sortBySrtP99(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtP99(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->srts.getPercentile(0.99) < bCast->srts.getPercentile(0.99);
+        return aCast->srts.getPercentile(0.99);
     }
 
-    [[nodiscard]] static auto sortBySrtMax(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeySrtMax(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->srts.getPercentile(1) < bCast->srts.getPercentile(1);
+        return aCast->srts.getPercentile(1);
     }
 
-    [[nodiscard]] static auto sortByDsP95(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyDsP95(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->requestSizes.getPercentile(0.95) < bCast->requestSizes.getPercentile(0.95);
+        return aCast->requestSizes.getPercentile(0.95);
     }
 
-    [[nodiscard]] static auto sortByDsP99(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyDsP99(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->requestSizes.getPercentile(0.99) < bCast->requestSizes.getPercentile(0.99);
+        return aCast->requestSizes.getPercentile(0.99);
     }
 
-    [[nodiscard]] static auto sortByDsMax(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyDsMax(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->requestSizes.getPercentile(1) < bCast->requestSizes.getPercentile(1);
+        return aCast->requestSizes.getPercentile(1);
     }
 
-    [[nodiscard]] static auto sortByClose(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyClose(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->totalCloses < bCast->totalCloses;
+        return aCast->totalCloses;
     }
 
-    [[nodiscard]] static auto sortByCloseRate(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyCloseRate(Flow const* a) -> int64_t
     {
         auto const* aCast = static_cast<AggregatedTcpFlow const*>(a);
-        auto const* bCast = static_cast<AggregatedTcpFlow const*>(b);
-        return aCast->closes < bCast->closes;
+        return aCast->closes;
     }
 
 private:
@@ -2,33 +2,31 @@
 
 namespace flowstats {
 
-DnsFlow::DnsFlow(Tins::Packet const& packet, FlowId const& flowId,
-    Tins::DNS const& dns)
+DnsFlow::DnsFlow(PacketView const& packet, FlowId const& flowId,
+    DnsMessage const& dns)
     : Flow(flowId)
 {
     addPacket(packet, FROM_CLIENT);
-    startTv = packetToTimeval(packet);
-    auto queries = dns.queries();
-    auto firstQuery = queries.at(0);
-    type = firstQuery.query_type();
-    fqdn = firstQuery.dname();
+    startTv = packet.ts;
+    type = dns.getQtype();
+    setFqdnId(internFqdn(dns.getQname()));
     hasResponse = false;
 }
 
-auto DnsFlow::processDnsResponse(Tins::Packet const& packet,
-    Tins::DNS const& dns) -> void
+auto DnsFlow::processDnsResponse(PacketView const& packet,
+    DnsMessage const& dns) -> void
 {
     addPacket(packet, FROM_SERVER);
-    endTv = packetToTimeval(packet);
+    endTv = packet.ts;
     hasResponse = true;
-    truncated = dns.truncated();
-    numberRecords = dns.answers_count();
-    responseCode = dns.rcode();
-    SPDLOG_DEBUG("Dns tid {}, {}, {} finished, {}", dns.id(),
-        getTransport()._to_string(), fqdn, numberRecords);
+    truncated = dns.isTruncated();
+    numberRecords = dns.getAnswerCount();
+    responseCode = dns.getRcode();
+    SPDLOG_DEBUG("Dns tid {}, {}, {} finished, {}", dns.getId(),
+        getTransport()._to_string(), getFqdn(), numberRecords);
 }
 
-auto dnsTypeToString(Tins::DNS::QueryType dnsType) -> std::string
+auto dnsTypeToString(Tins::DNS::QueryType dnsType) -> char const*
 {
 #define ENUM_TEXT(p)                \
     case (Tins::DNS::QueryType::p): \
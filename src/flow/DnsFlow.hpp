@@ -1,5 +1,6 @@
 #pragma once
 
+#include "DnsProto.hpp"
 #include "Flow.hpp"
 #include <enum.h>
 #include <tins/dns.h>
@@ -10,12 +11,11 @@ class DnsFlow : public Flow {
 
 public:
     DnsFlow() = default;
-    DnsFlow(const Tins::Packet& packet, FlowId const& flowId,
-        Tins::DNS const& dns);
+    DnsFlow(PacketView const& packet, FlowId const& flowId,
+        DnsMessage const& dns);
 
-    auto processDnsResponse(Tins::Packet const& packet, Tins::DNS const& dns) -> void;
+    auto processDnsResponse(PacketView const& packet, DnsMessage const& dns) -> void;
 
-    [[nodiscard]] auto getFqdn() const { return fqdn; };
     [[nodiscard]] auto getTruncated() const { return truncated; };
     [[nodiscard]] auto getHasResponse() const { return hasResponse; };
     [[nodiscard]] auto getType() const { return type; };
@@ -25,7 +25,6 @@ public:
     [[nodiscard]] auto getStartTv() const { return startTv; };
 
 private:
-    std::string fqdn = "";
     bool hasResponse = false;
     bool truncated = false;
     enum Tins::DNS::QueryType type = Tins::DNS::A;
@@ -36,5 +35,5 @@ private:
     timeval endTv = {};
 };
 
-auto dnsTypeToString(Tins::DNS::QueryType queryType) -> std::string;
+auto dnsTypeToString(Tins::DNS::QueryType queryType) -> char const*;
 } // namespace flowstats
@@ -0,0 +1,159 @@
+#include "DnsProto.hpp"
+#include <cstring>
+
+namespace flowstats {
+
+#define DNS_HEADER_SIZE 12
+#define DNS_QUESTION_FIELDS_SIZE 4
+#define DNS_RECORD_FIELDS_SIZE 10
+
+/**
+ * Compression pointers followed in a single name
+ */
+int const dnsMaxPointers = 16;
+
+static auto readUint16(uint8_t const* data) -> uint16_t
+{
+    return uint16_t((data[0] << 8) | data[1]);
+}
+
+static auto readUint32(uint8_t const* data) -> uint32_t
+{
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16)
+        | (uint32_t(data[2]) << 8) | data[3];
+}
+
+auto readDnsName(uint8_t const* data, uint32_t size, uint32_t* offset,
+    std::array<char, dnsMaxNameSize>* out, size_t* outSize) -> bool
+{
+    uint32_t pos = *offset;
+    size_t nameSize = 0;
+    int pointers = 0;
+    bool jumped = false;
+    while (true) {
+        if (pos >= size) {
+            return false;
+        }
+        uint8_t labelSize = data[pos];
+        if (labelSize == 0) {
+            if (!jumped) {
+                *offset = pos + 1;
+            }
+            break;
+        }
+        if ((labelSize & 0xc0) == 0xc0) {
+            if (pos + 1 >= size) {
+                return false;
+            }
+            uint32_t target = readUint16(data + pos) & 0x3fff;
+            if (!jumped) {
+                *offset = pos + 2;
+            }
+            // Backward pointers can't loop
+            if (target >= pos || ++pointers > dnsMaxPointers) {
+                return false;
+            }
+            jumped = true;
+            pos = target;
+            continue;
+        }
+        if ((labelSize & 0xc0) != 0 || pos + 1 + labelSize > size) {
+            return false;
+        }
+        size_t separator = nameSize > 0 ? 1 : 0;
+        if (nameSize + separator + labelSize > dnsMaxNameSize) {
+            return false;
+        }
+        if (separator) {
+            (*out)[nameSize++] = '.';
+        }
+        memcpy(out->data() + nameSize, data + pos + 1, labelSize);
+        nameSize += labelSize;
+        pos += 1 + labelSize;
+    }
+    *outSize = nameSize;
+    return true;
+}
+
+auto skipDnsName(uint8_t const* data, uint32_t size, uint32_t* offset) -> bool
+{
+    uint32_t pos = *offset;
+    while (pos < size) {
+        uint8_t labelSize = data[pos];
+        if (labelSize == 0) {
+            *offset = pos + 1;
+            return true;
+        }
+        if ((labelSize & 0xc0) == 0xc0) {
+            if (pos + 2 > size) {
+                return false;
+            }
+            *offset = pos + 2;
+            return true;
+        }
+        if ((labelSize & 0xc0) != 0) {
+            return false;
+        }
+        pos += 1 + labelSize;
+    }
+    return false;
+}
+
+auto DnsMessage::parse(uint8_t const* newData, uint32_t newSize) -> bool
+{
+    data = newData;
+    size = newSize;
+    if (size < DNS_HEADER_SIZE) {
+        return false;
+    }
+    id = readUint16(data);
+    flags = readUint16(data + 2);
+    questionCount = readUint16(data + 4);
+    answerCount = readUint16(data + 6);
+    qnameSize = 0;
+    qtype = 0;
+    remainingAnswers = 0;
+
+    uint32_t offset = DNS_HEADER_SIZE;
+    for (uint16_t i = 0; i < questionCount; ++i) {
+        bool valid = i == 0
+            ? readDnsName(data, size, &offset, &qname, &qnameSize)
+            : skipDnsName(data, size, &offset);
+        if (!valid || offset + DNS_QUESTION_FIELDS_SIZE > size) {
+            return false;
+        }
+        if (i == 0) {
+            qtype = readUint16(data + offset);
+        }
+        offset += DNS_QUESTION_FIELDS_SIZE;
+    }
+    nextAnswerOffset = offset;
+    remainingAnswers = answerCount;
+    return true;
+}
+
+auto DnsMessage::nextAnswer(DnsAnswer* answer) -> bool
+{
+    if (remainingAnswers == 0) {
+        return false;
+    }
+    uint32_t offset = nextAnswerOffset;
+    if (!skipDnsName(data, size, &offset) || offset + DNS_RECORD_FIELDS_SIZE > size) {
+        remainingAnswers = 0;
+        return false;
+    }
+    answer->type = readUint16(data + offset);
+    answer->ttl = readUint32(data + offset + 4);
+    answer->rdataSize = readUint16(data + offset + 8);
+    offset += DNS_RECORD_FIELDS_SIZE;
+    if (offset + answer->rdataSize > size) {
+        remainingAnswers = 0;
+        return false;
+    }
+    answer->rdata = data + offset;
+    nextAnswerOffset = offset + answer->rdataSize;
+    remainingAnswers--;
+    return true;
+}
+
+} // namespace flowstats
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <tins/dns.h>
+
+namespace flowstats {
+
+/**
+ * Longest name in its text form, longer names are malformed
+ */
+size_t const dnsMaxNameSize = 255;
+
+/**
+ * Resource record of the answer section, rdata points in the message
+ */
+struct DnsAnswer {
+    uint16_t type = 0;
+    uint32_t ttl = 0;
+    uint8_t const* rdata = nullptr;
+    uint16_t rdataSize = 0;
+};
+
+/**
+ * Dns message read in place from the wire format. Only the header, the
+ * first question and the answer records are read, the question name is
+ * decompressed in a fixed buffer so nothing is allocated. The message
+ * data must outlive the parsed message.
+ */
+class DnsMessage {
+public:
+    /**
+     * Read the header and the questions, false on a malformed message
+     */
+    auto parse(uint8_t const* data, uint32_t size) -> bool;
+
+    /**
+     * Read the next answer record, false after the last one or on a
+     * malformed record
+     */
+    auto nextAnswer(DnsAnswer* answer) -> bool;
+
+    [[nodiscard]] auto getId() const -> uint16_t { return id; }
+    [[nodiscard]] auto isResponse() const -> bool { return (flags & 0x8000) != 0; }
+    [[nodiscard]] auto isTruncated() const -> bool { return (flags & 0x0200) != 0; }
+    [[nodiscard]] auto getRcode() const -> uint8_t { return flags & 0x000f; }
+    [[nodiscard]] auto getAnswerCount() const -> uint16_t { return answerCount; }
+    [[nodiscard]] auto hasQuestion() const -> bool { return questionCount > 0; }
+    [[nodiscard]] auto getQname() const -> std::string_view { return { qname.data(), qnameSize }; }
+    [[nodiscard]] auto getQtype() const -> Tins::DNS::QueryType { return Tins::DNS::QueryType(qtype); }
+
+private:
+    uint8_t const* data = nullptr;
+    uint32_t size = 0;
+    uint16_t id = 0;
+    uint16_t flags = 0;
+    uint16_t questionCount = 0;
+    uint16_t answerCount = 0;
+
+    uint32_t nextAnswerOffset = 0;
+    uint16_t remainingAnswers = 0;
+
+    uint16_t qtype = 0;
+    size_t qnameSize = 0;
+    std::array<char, dnsMaxNameSize> qname;
+};
+
+/**
+ * Decompress the name at offset in out, offset is moved after the name
+ * in the message. Pointers have to go backward and the name has to fit
+ * in dnsMaxNameSize.
+ */
+[[nodiscard]] auto readDnsName(uint8_t const* data, uint32_t size, uint32_t* offset,
+    std::array<char, dnsMaxNameSize>* out, size_t* outSize) -> bool;
+
+/**
+ * Move offset after the name without following pointers
+ */
+[[nodiscard]] auto skipDnsName(uint8_t const* data, uint32_t size, uint32_t* offset) -> bool;
+
+} // namespace flowstats
@@ -0,0 +1,172 @@
+#include "DnsTransactionTable.hpp"
+
+namespace flowstats {
+
+size_t const initialTransactionCapacity = 64;
+
+DnsTransactionTable::DnsTransactionTable(size_t maxBytes)
+    : slots(initialTransactionCapacity)
+    , mask(initialTransactionCapacity - 1)
+    , maxCapacity(initialTransactionCapacity)
+{
+    // Growing to twice the capacity holds 3 times its memory
+    while (maxCapacity * 3 * sizeof(Slot) <= maxBytes) {
+        maxCapacity *= 2;
+    }
+    maxEntries = maxCapacity * 3 / 4;
+}
+
+auto DnsTransactionTable::hashKey(FlowId const& flowId, uint16_t id) -> uint32_t
+{
+    return uint32_t(mixHash(flowId.hash() ^ id));
+}
+
+auto DnsTransactionTable::findSlot(FlowId const& flowId, uint16_t id, uint32_t hash) const -> uint32_t
+{
+    // The load factor stays under 3/4, there is always an empty slot
+    for (uint32_t index = hash & mask; slots[index].used; index = (index + 1) & mask) {
+        auto const& slot = slots[index];
+        if (slot.hash == hash && slot.id == id && slot.flow.getFlowId() == flowId) {
+            return index;
+        }
+    }
+    return noSlot;
+}
+
+auto DnsTransactionTable::find(FlowId const& flowId, uint16_t id) -> DnsFlow*
+{
+    auto index = findSlot(flowId, id, hashKey(flowId, id));
+    if (index == noSlot) {
+        return nullptr;
+    }
+    return &slots[index].flow;
+}
+
+auto DnsTransactionTable::insert(uint16_t id, DnsFlow&& flow) -> void
+{
+    auto hash = hashKey(flow.getFlowId(), id);
+    auto existing = findSlot(flow.getFlowId(), id, hash);
+    if (existing != noSlot) {
+        eraseSlot(existing);
+    }
+
+    if (numberEntries >= maxEntries) {
+        if (evicted.load(std::memory_order_relaxed) == 0) {
+            spdlog::warn("Dns transaction table full with {} pending queries, evicting the oldest",
+                numberEntries);
+        }
+        evicted.fetch_add(1, std::memory_order_relaxed);
+        eraseSlot(oldest);
+    } else if ((numberEntries + 1) * 4 > slots.size() * 3) {
+        grow();
+    }
+    insertSlot(hash, id, std::move(flow));
+}
+
+auto DnsTransactionTable::erase(FlowId const& flowId, uint16_t id) -> void
+{
+    auto index = findSlot(flowId, id, hashKey(flowId, id));
+    if (index != noSlot) {
+        eraseSlot(index);
+    }
+}
+
+auto DnsTransactionTable::insertSlot(uint32_t hash, uint16_t id, DnsFlow&& flow) -> void
+{
+    uint32_t index = hash & mask;
+    while (slots[index].used) {
+        index = (index + 1) & mask;
+    }
+    auto& slot = slots[index];
+    slot.hash = hash;
+    slot.id = id;
+    slot.used = true;
+    slot.flow = std::move(flow);
+    slot.older = newest;
+    slot.newer = noSlot;
+    if (newest != noSlot) {
+        slots[newest].newer = index;
+    } else {
+        oldest = index;
+    }
+    newest = index;
+    numberEntries++;
+}
+
+auto DnsTransactionTable::unlink(uint32_t index) -> void
+{
+    auto const& slot = slots[index];
+    if (slot.older != noSlot) {
+        slots[slot.older].newer = slot.newer;
+    } else {
+        oldest = slot.newer;
+    }
+    if (slot.newer != noSlot) {
+        slots[slot.newer].older = slot.older;
+    } else {
+        newest = slot.older;
+    }
+}
+
+/**
+ * Point the neighbours of an entry moved from one slot to another to
+ * its new slot
+ */
+auto DnsTransactionTable::relink(uint32_t from, uint32_t to) -> void
+{
+    auto const& slot = slots[to];
+    if (slot.older != noSlot) {
+        slots[slot.older].newer = to;
+    } else if (oldest == from) {
+        oldest = to;
+    }
+    if (slot.newer != noSlot) {
+        slots[slot.newer].older = to;
+    } else if (newest == from) {
+        newest = to;
+    }
+}
+
+/**
+ * Entries following the erased slot are shifted back when the hole is
+ * between their home slot and their slot, no tombstone is left
+ */
+auto DnsTransactionTable::eraseSlot(uint32_t index) -> void
+{
+    unlink(index);
+    numberEntries--;
+    uint32_t hole = index;
+    for (uint32_t next = (hole + 1) & mask; slots[next].used; next = (next + 1) & mask) {
+        uint32_t home = slots[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots[hole] = std::move(slots[next]);
+            relink(next, hole);
+            hole = next;
+        }
+    }
+    slots[hole].used = false;
+}
+
+/**
+ * Double the array, entries are inserted back from the oldest so the
+ * expiry order is kept
+ */
+auto DnsTransactionTable::grow() -> void
+{
+    if (slots.size() >= maxCapacity) {
+        return;
+    }
+    auto previousSlots = std::move(slots);
+    auto previousOldest = oldest;
+    slots = std::vector<Slot>(previousSlots.size() * 2);
+    mask = uint32_t(slots.size() - 1);
+    oldest = noSlot;
+    newest = noSlot;
+    numberEntries = 0;
+    for (auto index = previousOldest; index != noSlot; index = previousSlots[index].newer) {
+        auto& slot = previousSlots[index];
+        insertSlot(slot.hash, slot.id, std::move(slot.flow));
+    }
+}
+
+} // namespace flowstats
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "DnsFlow.hpp"
+#include <atomic>
+#include <vector>
+
+namespace flowstats {
+
+/**
+ * Pending dns queries keyed on their flow, which holds the client ip
+ * and port and the server ip and port, and on the transaction id.
+ *
+ * Entries live in a single linear probing array and are chained from
+ * the oldest to the newest query. Every query has the same timeout, so
+ * this order is also the expiry order and expiring only touches due
+ * queries. The array grows up to the memory limit, past it the oldest
+ * pending query is evicted to make room and counted as evicted. The
+ * limit covers the growth transient, when the doubled array is filled
+ * while the previous one is still held.
+ */
+class DnsTransactionTable {
+public:
+    explicit DnsTransactionTable(size_t maxBytes);
+
+    /**
+     * Add the query, replacing a pending query of the same flow and id.
+     * The query becomes the newest one.
+     */
+    auto insert(uint16_t id, DnsFlow&& flow) -> void;
+    [[nodiscard]] auto find(FlowId const& flowId, uint16_t id) -> DnsFlow*;
+    auto erase(FlowId const& flowId, uint16_t id) -> void;
+
+    /**
+     * Remove the queries started before the given second, oldest first
+     */
+    template <typename Fun>
+    auto expire(time_t startedBefore, Fun onExpired) -> void
+    {
+        while (oldest != noSlot && slots[oldest].flow.getStartTv().tv_sec < startedBefore) {
+            onExpired(&slots[oldest].flow);
+            eraseSlot(oldest);
+        }
+    }
+
+    [[nodiscard]] auto size() const { return numberEntries; }
+    [[nodiscard]] auto getMaxEntries() const { return maxEntries; }
+    [[nodiscard]] auto getEvicted() const { return evicted.load(std::memory_order_relaxed); }
+
+private:
+    static uint32_t const noSlot = UINT32_MAX;
+
+    struct Slot {
+        uint32_t hash = 0;
+        uint16_t id = 0;
+        bool used = false;
+        uint32_t older = noSlot;
+        uint32_t newer = noSlot;
+        DnsFlow flow;
+    };
+
+    [[nodiscard]] static auto hashKey(FlowId const& flowId, uint16_t id) -> uint32_t;
+    [[nodiscard]] auto findSlot(FlowId const& flowId, uint16_t id, uint32_t hash) const -> uint32_t;
+    auto insertSlot(uint32_t hash, uint16_t id, DnsFlow&& flow) -> void;
+    auto eraseSlot(uint32_t index) -> void;
+    auto unlink(uint32_t index) -> void;
+    auto relink(uint32_t from, uint32_t to) -> void;
+    auto grow() -> void;
+
+    std::vector<Slot> slots;
+    uint32_t mask = 0;
+    uint32_t oldest = noSlot;
+    uint32_t newest = noSlot;
+    size_t numberEntries = 0;
+    size_t maxCapacity;
+    size_t maxEntries;
+    std::atomic<uint64_t> evicted = 0;
+};
+
+} // namespace flowstats
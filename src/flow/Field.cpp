@@ -2,28 +2,31 @@
 
 namespace flowstats {
 
-auto fieldToFormat(Field field) -> char const*
+/**
+ * Column width of a field, values are truncated or padded to it
+ */
+auto fieldToWidth(Field field) -> size_t
 {
     switch (field) {
     case Field::FQDN:
-        return "{:<42.42} ";
+        return FQDN_SIZE;
     case Field::TRUNC:
     case Field::TYPE:
     case Field::DIR:
-        return "{:<6.6} ";
+        return 6;
     case Field::DOMAIN:
-        return "{:<34.34} ";
+        return 34;
     case Field::BYTES:
-        return "{:<10.10} ";
+        return 10;
     case Field::TOP_CLIENT_IPS:
-        return "{:<60.60} ";
+        return 60;
     case Field::IP:
-        return "{:<16.16} ";
+        return IP_SIZE;
     case Field::PORT:
     case Field::PROTO:
-        return "{:<5.5} ";
+        return 5;
     default:
-        return "{:<8.8} ";
+        return 8;
     }
 }
 
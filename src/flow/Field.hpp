@@ -1,10 +1,10 @@
 #pragma once
 #include "enum.h"
+#include <cstddef>
 
 namespace flowstats {
 #define FQDN_SIZE 42
 #define IP_SIZE 16
-#define LEFT_ALIGN(size) "{:<" STR(size) "." STR(size) "} "
 
 BETTER_ENUM(Field, char,
     DIR,
@@ -57,6 +57,6 @@ BETTER_ENUM(Field, char,
 
 auto fieldToSortable(Field field) -> bool;
 auto fieldToHeader(Field field) -> char const*;
-auto fieldToFormat(Field field) -> char const*;
+auto fieldToWidth(Field field) -> size_t;
 
 } // namespace flowstats
@@ -3,29 +3,53 @@
 
 namespace flowstats {
 
-auto Flow::addPacket(Tins::Packet const& packet,
+auto Flow::addPacket(PacketView const& packet,
     Direction const direction) -> void
 {
     packets[direction]++;
-    bytes[direction] += packet.pdu()->advertised_size();
+    bytes[direction] += packet.frameSize;
     totalPackets[direction]++;
-    totalBytes[direction] += packet.pdu()->advertised_size();
-    auto tv = packetToTimeval(packet);
+    totalBytes[direction] += packet.frameSize;
     if (start.tv_sec == 0) {
-        start = tv;
+        start = packet.ts;
     }
-    end = tv;
+    end = packet.ts;
 }
 
 auto Flow::fillValues(std::map<Field, std::string>* ptrValues,
     Direction direction) const -> void
 {
-    auto& values = *ptrValues;
-    values[Field::PKTS_RATE] = prettyFormatNumber(packets[direction]);
-    values[Field::BYTES_RATE] = prettyFormatBytes(bytes[direction]);
-    values[Field::PKTS] = prettyFormatNumber(totalPackets[direction]);
-    values[Field::BYTES] = prettyFormatBytes(totalBytes[direction]);
-    values[Field::DIR] = directionToString(static_cast<Direction>(direction));
+    fmt::memory_buffer cell;
+    for (auto field : Field::_values()) {
+        cell.clear();
+        if (formatField(field, direction, &cell)) {
+            (*ptrValues)[field] = to_string(cell);
+        }
+    }
+}
+
+auto Flow::formatField(Field field, Direction direction,
+    fmt::memory_buffer* out) const -> bool
+{
+    switch (field) {
+    case Field::PKTS_RATE:
+        prettyFormatNumber(packets[direction], out);
+        return true;
+    case Field::BYTES_RATE:
+        prettyFormatBytes(bytes[direction], out);
+        return true;
+    case Field::PKTS:
+        prettyFormatNumber(totalPackets[direction], out);
+        return true;
+    case Field::BYTES:
+        prettyFormatBytes(totalBytes[direction], out);
+        return true;
+    case Field::DIR:
+        appendString(out, direction == FROM_CLIENT ? "C->S" : "S->C");
+        return true;
+    default:
+        return false;
+    }
 }
 
 auto Flow::addFlow(Flow const* flow) -> void
@@ -2,9 +2,11 @@
 
 #include "Field.hpp"
 #include "FlowId.hpp"
+#include "FqdnTable.hpp"
 #include <map>
 #include <string>
-#include <tins/packet.h>
+#include <utility>
+#include "PacketView.hpp"
 
 namespace flowstats {
 
@@ -16,14 +18,14 @@ public:
     {
     }
 
-    explicit Flow(std::string fqdn)
-        : fqdn(std::move(fqdn))
+    explicit Flow(std::string_view fqdn)
+        : fqdnId(internFqdn(fqdn))
     {
     }
 
-    explicit Flow(FlowId flowId, std::string fqdn = "", uint8_t srvPos = 1)
+    explicit Flow(FlowId flowId, FqdnId fqdnId = emptyFqdnId, uint8_t srvPos = 1)
         : flowId(std::move(flowId))
-        , fqdn(std::move(fqdn))
+        , fqdnId(fqdnId)
         , srvPos(srvPos)
     {
     }
@@ -37,18 +39,40 @@ public:
 
     auto setSrvPos(uint8_t pos) { srvPos = pos; };
 
-    virtual auto addPacket(Tins::Packet const& packet,
+    virtual auto addPacket(PacketView const& packet,
         Direction const direction) -> void;
     virtual auto addFlow(Flow const* flow) -> void;
     virtual auto addAggregatedFlow(Flow const* flow) -> void;
     virtual auto resetFlow(bool resetTotal) -> void;
-    virtual auto fillValues(std::map<Field, std::string>* map,
+    auto fillValues(std::map<Field, std::string>* map,
         Direction direction) const -> void;
-    virtual auto mergePercentiles() -> void {};
-    [[nodiscard]] virtual auto getStatsdMetrics() const -> std::vector<std::string> { return {}; };
 
-    [[nodiscard]] auto getFlowId() const { return flowId; };
-    [[nodiscard]] auto getFqdn() const { return fqdn; };
+    /**
+     * Append the value of a field to out, returns false without writing
+     * anything when the flow has no value for this field and direction
+     */
+    virtual auto formatField(Field field, Direction direction,
+        fmt::memory_buffer* out) const -> bool;
+    virtual auto mergePercentiles() -> void {};
+    [[nodiscard]] virtual auto clone() const -> Flow* { return new Flow(*this); };
+    [[nodiscard]] virtual auto getStatsdMetrics(StatsdMode mode) const -> std::vector<std::string> { return {}; };
+
+    /**
+     * Aggregated flows are flagged under the collector data lock when
+     * modified, publication and reset skip the flows left untouched
+     */
+    auto markModified() -> void
+    {
+        unpublished = true;
+        unreset = true;
+    };
+    auto markUnpublished() -> void { unpublished = true; };
+    auto takeUnpublished() -> bool { return std::exchange(unpublished, false); };
+    auto takeUnreset() -> bool { return std::exchange(unreset, false); };
+
+    [[nodiscard]] auto getFlowId() const -> FlowId const& { return flowId; };
+    [[nodiscard]] auto getFqdn() const -> std::string const& { return fqdnToString(fqdnId); };
+    [[nodiscard]] auto getFqdnId() const { return fqdnId; };
     [[nodiscard]] auto getSrvPos() const { return srvPos; }
     [[nodiscard]] auto getPackets() const { return packets; };
     [[nodiscard]] auto getTotalBytes() const { return totalBytes; };
@@ -59,51 +83,72 @@ public:
     [[nodiscard]] auto getPort(uint8_t pos) const { return flowId.getPort(pos); }
     [[nodiscard]] auto getSrvPort() const { return flowId.getPort(srvPos); }
     [[nodiscard]] auto getSrvIp() const -> std::string { return ipv4ToString(flowId.getIp(srvPos)); }
+    auto formatSrvIp(fmt::memory_buffer* out) const -> void { formatIpv4(flowId.getIp(srvPos), out); }
     [[nodiscard]] auto getCltIp() const -> IPv4 { return flowId.getIp(!srvPos); }
     [[nodiscard]] auto getCltIpInt() const { return flowId.getIp(!srvPos); }
     [[nodiscard]] auto getSrvIpInt() const { return flowId.getIp(srvPos); }
 
     [[nodiscard]] static auto sortByFqdn(Flow const* a, Flow const* b) -> bool
     {
+        if (a->fqdnId == b->fqdnId) {
+            return false;
+        }
+        auto const& aFqdn = a->getFqdn();
+        auto const& bFqdn = b->getFqdn();
         return std::lexicographical_compare(
-            a->fqdn.begin(), a->fqdn.end(),
-            b->fqdn.begin(), b->fqdn.end(),
+            aFqdn.begin(), aFqdn.end(),
+            bFqdn.begin(), bFqdn.end(),
             caseInsensitiveComp);
     }
 
-    [[nodiscard]] static auto sortByIp(Flow const* a, Flow const* b) -> bool
+    /**
+     * Sort keys are extracted once per flow and refresh, flows are
+     * ordered by comparing the keys
+     */
+    [[nodiscard]] static auto sortKeyIp(Flow const* a) -> int64_t
+    {
+        return uint32_t(a->getSrvIpInt());
+    }
+
+    [[nodiscard]] static auto sortKeyPort(Flow const* a) -> int64_t
     {
-        return a->getSrvIpInt() < b->getSrvIpInt();
+        return a->getSrvPort();
     }
 
-    [[nodiscard]] static auto sortByPort(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyBytes(Flow const* a) -> int64_t
     {
-        return a->getSrvPort() < b->getSrvPort();
+        return int64_t(a->bytes[0]) + a->bytes[1];
     }
 
-    [[nodiscard]] static auto sortByBytes(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyTotalBytes(Flow const* a) -> int64_t
     {
-        return a->bytes[0] + a->bytes[1] < b->bytes[0] + b->bytes[1];
+        return int64_t(a->totalBytes[0]) + a->totalBytes[1];
     }
 
-    [[nodiscard]] static auto sortByTotalBytes(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyPackets(Flow const* a) -> int64_t
     {
-        return a->totalBytes[0] + a->totalBytes[1] < b->totalBytes[0] + b->totalBytes[1];
+        return int64_t(a->packets[0]) + a->packets[1];
     }
 
-    [[nodiscard]] static auto sortByPackets(Flow const* a, Flow const* b) -> bool
+    [[nodiscard]] static auto sortKeyTotalPackets(Flow const* a) -> int64_t
     {
-        return a->packets[0] + a->packets[1] < b->packets[0] + b->packets[1];
+        return int64_t(a->totalPackets[0]) + a->totalPackets[1];
     }
 
-    [[nodiscard]] static auto sortByTotalPackets(Flow const* a, Flow const* b) -> bool
+protected:
+    /**
+     * Sort key ordering a pair of counters lexicographically
+     */
+    [[nodiscard]] static auto packPair(std::array<int, 2> const& pair) -> int64_t
     {
-        return a->totalPackets[0] + a->totalPackets[1] < b->totalPackets[0] + b->totalPackets[1];
+        return (int64_t(pair[0]) << 32) | uint32_t(pair[1]);
     }
 
+    auto setFqdnId(FqdnId id) -> void { fqdnId = id; };
+
 private:
     FlowId flowId;
-    std::string fqdn;
+    FqdnId fqdnId = emptyFqdnId;
     uint8_t srvPos = 1;
     timeval start = {};
     timeval end = {};
@@ -112,5 +157,8 @@ private:
     std::array<int, 2> bytes = {};
     std::array<int, 2> totalPackets = {};
     std::array<int, 2> totalBytes = {};
+
+    bool unpublished = true;
+    bool unreset = true;
 };
 } // namespace flowstats
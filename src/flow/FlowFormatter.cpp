@@ -1,56 +1,50 @@
 #include "FlowFormatter.hpp"
+#include "Flow.hpp"
 #include <fmt/format.h>
 
-#include <utility>
-
-#include <utility>
-
 namespace flowstats {
 
-auto FlowFormatter::outputKey(std::map<Field,
-    std::string> const& values) const -> std::string
+/**
+ * Append a cell truncated or padded to the width of its column
+ */
+static auto appendCell(std::string_view cell, size_t width, std::string* out) -> void
 {
-    fmt::memory_buffer keyBuf;
-    for (auto const& el : displayKeys) {
-        auto it = values.find(el);
-        if (it == values.end()) {
-            fmt::format_to(keyBuf, fieldToFormat(el), "");
-        } else {
-            fmt::format_to(keyBuf, fieldToFormat(el), it->second);
-        }
-    }
-    return to_string(keyBuf);
+    cell = cell.substr(0, width);
+    out->append(cell);
+    out->append(width - cell.size() + 1, ' ');
 }
 
-auto FlowFormatter::outputValue(std::map<Field,
-    std::string> const& values) const -> std::string
+static auto appendCells(Flow const* flow, Direction direction,
+    std::vector<Field> const& fields, std::string* out) -> void
 {
-    fmt::memory_buffer valueBuf;
-    for (auto const& el : displayValues) {
-        auto it = values.find(el);
-        if (it == values.end()) {
-            fmt::format_to(valueBuf, fieldToFormat(el), "");
-        } else {
-            fmt::format_to(valueBuf, fieldToFormat(el), it->second);
-        }
+    fmt::memory_buffer cell;
+    for (auto const& el : fields) {
+        cell.clear();
+        flow->formatField(el, direction, &cell);
+        appendCell(std::string_view(cell.data(), cell.size()), fieldToWidth(el), out);
     }
-    return to_string(valueBuf);
 }
 
-auto FlowFormatter::outputHeaders() const -> std::pair<std::string, std::string>
+auto FlowFormatter::outputRow(Flow const* flow, Direction direction,
+    CollectorOutput* output) const -> void
+{
+    appendCells(flow, direction, displayKeys, output->getKeyBuffer());
+    appendCells(flow, direction, displayValues, output->getValueBuffer());
+    output->endRow();
+}
+
+auto FlowFormatter::outputHeaders(CollectorOutput* output) const -> void
 {
-    fmt::memory_buffer keyBuf;
+    std::string keyHeaders;
     for (auto const& el : displayKeys) {
-        fmt::format_to(keyBuf, fieldToFormat(el), fieldToHeader(el));
+        appendCell(fieldToHeader(el), fieldToWidth(el), &keyHeaders);
     }
-    auto keyHeaders = to_string(keyBuf);
 
-    fmt::memory_buffer valueBuf;
+    std::string valueHeaders;
     for (auto const& el : displayValues) {
-        fmt::format_to(valueBuf, fieldToFormat(el), fieldToHeader(el));
+        appendCell(fieldToHeader(el), fieldToWidth(el), &valueHeaders);
     }
-    auto valueHeaders = to_string(valueBuf);
-    return std::pair(keyHeaders, valueHeaders);
+    output->setHeaders(keyHeaders, valueHeaders);
 }
 
 } // namespace flowstats
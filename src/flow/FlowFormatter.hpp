@@ -1,22 +1,27 @@
 #pragma once
 
+#include "CollectorOutput.hpp"
 #include "Configuration.hpp"
 #include "Field.hpp"
 #include "Utils.hpp"
-#include <map>
 #include <string>
 #include <vector>
 
 namespace flowstats {
 
+class Flow;
+
 struct FlowFormatter {
 
     FlowFormatter() = default;
     virtual ~FlowFormatter() = default;
 
-    [[nodiscard]] auto outputKey(std::map<Field, std::string> const& values) const -> std::string;
-    [[nodiscard]] auto outputValue(std::map<Field, std::string> const& values) const -> std::string;
-    [[nodiscard]] auto outputHeaders() const -> std::pair<std::string, std::string>;
+    /**
+     * Append the displayed fields of a flow direction as a new row of
+     * the output. Only the displayed columns are formatted.
+     */
+    auto outputRow(Flow const* flow, Direction direction, CollectorOutput* output) const -> void;
+    auto outputHeaders(CollectorOutput* output) const -> void;
 
     [[nodiscard]] auto getDisplayKeys() const { return displayKeys; };
     auto setDisplayKeys(std::vector<Field> const& keys) { displayKeys = keys; };
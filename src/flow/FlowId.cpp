@@ -3,130 +3,97 @@
 
 namespace flowstats {
 
-FlowId::FlowId(Tins::IP const* ip, Tins::IPv6 const* ipv6,
-    Tins::TCP const* tcp, Tins::UDP const* udp)
+auto FlowId::packetDirection(std::array<Port, 2> const& pktPorts,
+    std::array<IPv4, 2> const& pktIps) -> Direction
 {
-    std::array<Port, 2> pktPorts;
-    auto transport = Transport::TCP;
-    if (tcp) {
-        pktPorts = { tcp->sport(), tcp->dport() };
-    } else {
-        pktPorts = { udp->sport(), udp->dport() };
-        transport = Transport::UDP;
+    if (pktPorts[0] != pktPorts[1]) {
+        return pktPorts[0] < pktPorts[1] ? FROM_SERVER : FROM_CLIENT;
     }
-
-    if (ipv6) {
-        std::array<IPv6, 2> pktIps = { ipv6->src_addr(), ipv6->dst_addr() };
-        *this = FlowId(pktPorts, pktIps, Network::IPV6, transport);
-    } else {
-        std::array<IPv4, 2> pktIps = { ip->src_addr(), ip->dst_addr() };
-        *this = FlowId(pktPorts, pktIps, Network::IPV4, transport);
-    }
-}
-
-FlowId::FlowId(Tins::IPv6 const& ip, Tins::TCP const& tcp)
-{
-    std::array<Port, 2> pktPorts = { tcp.sport(), tcp.dport() };
-    std::array<IPv6, 2> pktIps = { ip.src_addr(), ip.dst_addr() };
-    *this = FlowId(pktPorts, pktIps, Network::IPV6, Transport::TCP);
+    return uint32_t(pktIps[0]) < uint32_t(pktIps[1]) ? FROM_SERVER : FROM_CLIENT;
 }
 
-FlowId::FlowId(Tins::IP const& ip, Tins::TCP const& tcp)
+auto FlowId::packetDirection(std::array<Port, 2> const& pktPorts,
+    std::array<IPv6, 2> const& pktIps) -> Direction
 {
-    std::array<Port, 2> pktPorts = { tcp.sport(), tcp.dport() };
-    std::array<IPv4, 2> pktIps = { ip.src_addr(), ip.dst_addr() };
-    *this = FlowId(pktPorts, pktIps, Network::IPV4, Transport::TCP);
-}
-
-FlowId::FlowId(Tins::IPv6 const& ip, Tins::UDP const& udp)
-{
-    std::array<Port, 2> pktPorts = { udp.sport(), udp.dport() };
-    std::array<IPv6, 2> pktIps = { ip.src_addr(), ip.dst_addr() };
-    *this = FlowId(pktPorts, pktIps, Network::IPV6, Transport::UDP);
+    if (pktPorts[0] != pktPorts[1]) {
+        return pktPorts[0] < pktPorts[1] ? FROM_SERVER : FROM_CLIENT;
+    }
+    return pktIps[0] < pktIps[1] ? FROM_SERVER : FROM_CLIENT;
 }
 
-FlowId::FlowId(Tins::IP const& ip, Tins::UDP const& udp)
+FlowId::FlowId(std::array<Port, 2> pktPorts,
+    std::array<IPv4, 2> pktIps,
+    Transport transport)
+    : ipv4Key { uint8_t(Network::IPV4), uint8_t(transport._to_integral()), {}, {} }
 {
-    std::array<Port, 2> pktPorts = { udp.sport(), udp.dport() };
-    std::array<IPv4, 2> pktIps = { ip.src_addr(), ip.dst_addr() };
-    *this = FlowId(pktPorts, pktIps, Network::IPV4, Transport::UDP);
+    auto direction = packetDirection(pktPorts, pktIps);
+    ipv4Key.ips[0] = uint32_t(pktIps[0 + direction]);
+    ipv4Key.ips[1] = uint32_t(pktIps[1 - direction]);
+    ipv4Key.ports[0] = pktPorts[0 + direction];
+    ipv4Key.ports[1] = pktPorts[1 - direction];
 }
 
-FlowId::FlowId(FlowId&& flowId) noexcept
+FlowId::FlowId(std::array<Port, 2> pktPorts,
+    std::array<IPv6, 2> pktIps,
+    Transport transport)
+    : ipv6Key { uint8_t(Network::IPV6), uint8_t(transport._to_integral()), {}, {} }
 {
-    transport = flowId.transport;
-    network = flowId.network;
-    direction = flowId.direction;
-    ip.ipv6 = flowId.ip.ipv6;
-    ports = flowId.ports;
+    auto direction = packetDirection(pktPorts, pktIps);
+    memcpy(ipv6Key.ips[0].data(), &*pktIps[0 + direction].begin(), IPv6::address_size);
+    memcpy(ipv6Key.ips[1].data(), &*pktIps[1 - direction].begin(), IPv6::address_size);
+    ipv6Key.ports[0] = pktPorts[0 + direction];
+    ipv6Key.ports[1] = pktPorts[1 - direction];
 }
 
-auto FlowId::operator=(FlowId&& flowId) noexcept -> FlowId&
+auto FlowId::getIp(uint8_t pos) const -> IPv4
 {
-    if (this == &flowId) {
-        return *this;
+    if (getNetwork() != +Network::IPV4) {
+        return IPv4();
     }
-    transport = flowId.transport;
-    network = flowId.network;
-    direction = flowId.direction;
-    ip = flowId.ip;
-    ports = flowId.ports;
-    return *this;
-}
-
-auto FlowId::operator=(FlowId const& flowId) noexcept -> FlowId&
-{
-    transport = flowId.transport;
-    network = flowId.network;
-    direction = flowId.direction;
-    ip = flowId.ip;
-    ports[0] = flowId.ports[0];
-    ports[1] = flowId.ports[1];
-    return *this;
+    return IPv4(ipv4Key.ips[pos]);
 }
 
-FlowId::FlowId(FlowId const& flowId)
+auto FlowId::getIpv6(uint8_t pos) const -> IPv6
 {
-    *this = flowId;
+    if (getNetwork() != +Network::IPV6) {
+        return IPv6();
+    }
+    return IPv6(reinterpret_cast<uint8_t const*>(ipv6Key.ips[pos].data()));
 }
 
-FlowId::FlowId(std::array<uint16_t, 2> pktPorts,
-    std::array<IPv4, 2> pktIps,
-    Network network, Transport transport)
-    : network(network)
-    , transport(transport)
+/**
+ * Ips and ports are already in canonical order, both directions of a
+ * flow hash the same without a symmetric hash
+ */
+auto FlowKeyV4::hash() const -> size_t
 {
-    if (pktPorts[0] < pktPorts[1]) {
-        direction = FROM_SERVER;
-    }
-    ip.ipv4[0] = pktIps[0 + direction];
-    ip.ipv4[1] = pktIps[1 - direction];
-    ports[0] = pktPorts[0 + direction];
-    ports[1] = pktPorts[1 - direction];
+    uint64_t portsAndProto = (uint64_t(ports[0]) << 32) | (uint64_t(ports[1]) << 16)
+        | (uint64_t(network) << 8) | uint64_t(transport);
+    uint64_t ipsWord = (uint64_t(ips[0]) << 32) | ips[1];
+    return mixHash(mixHash(portsAndProto) ^ ipsWord);
 }
 
-FlowId::FlowId(std::array<uint16_t, 2> pktPorts,
-    std::array<IPv6, 2> pktIps,
-    Network network, Transport transport)
-    : network(network)
-    , transport(transport)
+auto FlowKeyV6::hash() const -> size_t
 {
-    if (pktPorts[0] < pktPorts[1]) {
-        direction = FROM_SERVER;
+    uint64_t portsAndProto = (uint64_t(ports[0]) << 32) | (uint64_t(ports[1]) << 16)
+        | (uint64_t(network) << 8) | uint64_t(transport);
+    uint64_t hash = mixHash(portsAndProto);
+    for (auto const& ip : ips) {
+        hash = mixHash(hash ^ ip[0]);
+        hash = mixHash(hash ^ ip[1]);
     }
-    ip.ipv6[0] = pktIps[0 + direction];
-    ip.ipv6[1] = pktIps[1 - direction];
-    ports[0] = pktPorts[0 + direction];
-    ports[1] = pktPorts[1 - direction];
+    return hash;
 }
 
 auto FlowId::toString() const -> std::string
 {
-    if (network == +Network::IPV4) {
+    if (getNetwork() == +Network::IPV4) {
         return fmt::format("{}:{} -> {}:{}",
-            ipv4ToString(ip.ipv4[direction]), ports[direction],
-            ipv4ToString(ip.ipv4[!direction]), ports[!direction]);
+            ipv4ToString(ipv4Key.ips[0]), ipv4Key.ports[0],
+            ipv4ToString(ipv4Key.ips[1]), ipv4Key.ports[1]);
     }
-    return "";
+    return fmt::format("[{}]:{} -> [{}]:{}",
+        getIpv6(0).to_string(), ipv6Key.ports[0],
+        getIpv6(1).to_string(), ipv6Key.ports[1]);
 }
 } // namespace flowstats
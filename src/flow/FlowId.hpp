@@ -2,6 +2,8 @@
 #include "Utils.hpp"
 #include "enum.h"
 #include <arpa/inet.h>
+#include <array>
+#include <cstring>
 #include <sstream>
 #include <tins/ip.h>
 #include <tins/ipv6.h>
@@ -16,91 +18,102 @@ using IPv6 = Tins::IPv6Address;
 BETTER_ENUM(Transport, char, TCP, UDP);
 BETTER_ENUM(Network, char, IPV6, IPV4);
 
-struct FlowId {
-
-    FlowId() = default;
+/**
+ * Canonical keys of a flow. The endpoint with the highest port, then
+ * the highest ip, is stored first so both directions of a flow share
+ * the same key. Network, transport and ports are the common initial
+ * sequence of both keys.
+ */
+struct FlowKeyV4 {
+    uint8_t network;
+    uint8_t transport;
+    std::array<Port, 2> ports;
+    std::array<uint32_t, 2> ips;
+
+    [[nodiscard]] auto hash() const -> size_t;
+    auto operator==(FlowKeyV4 const& b) const -> bool
+    {
+        return ips == b.ips && ports == b.ports && transport == b.transport;
+    }
+};
+static_assert(sizeof(FlowKeyV4) == 16, "FlowKeyV4 should fit in 16 bytes");
 
-    FlowId(FlowId&& flowId) noexcept;
-    auto operator=(FlowId&& other) noexcept -> FlowId&;
+struct FlowKeyV6 {
+    uint8_t network;
+    uint8_t transport;
+    std::array<Port, 2> ports;
+    // Addresses in network order, copied in 64 bits words
+    std::array<std::array<uint64_t, 2>, 2> ips;
 
-    FlowId(FlowId const& flowId);
-    auto operator=(FlowId const& other) noexcept -> FlowId&;
+    [[nodiscard]] auto hash() const -> size_t;
+    auto operator==(FlowKeyV6 const& b) const -> bool
+    {
+        return ips == b.ips && ports == b.ports && transport == b.transport;
+    }
+};
+static_assert(sizeof(FlowKeyV6) == 40, "FlowKeyV6 should fit in 40 bytes");
+
+/**
+ * Key of a flow of either network. Direction of a packet is not part
+ * of the key, it is derived from the packet with packetDirection.
+ */
+class FlowId {
+public:
+    FlowId()
+        : ipv4Key { uint8_t(Network::IPV4), uint8_t(Transport::TCP), {}, {} }
+    {
+    }
 
-    FlowId(std::array<uint16_t, 2> ports, std::array<IPv4, 2> pktIps,
-        Network network, Transport transport);
-    FlowId(std::array<uint16_t, 2> ports, std::array<IPv6, 2> pktIps,
-        Network network, Transport transport);
+    FlowId(std::array<Port, 2> pktPorts, std::array<IPv4, 2> pktIps,
+        Transport transport);
+    FlowId(std::array<Port, 2> pktPorts, std::array<IPv6, 2> pktIps,
+        Transport transport);
 
-    FlowId(Tins::IP const* ip, Tins::IPv6 const* ipv6,
-        Tins::TCP const* tcp, Tins::UDP const* udp);
-    FlowId(Tins::IPv6 const& ip, Tins::TCP const& tcp);
-    FlowId(Tins::IP const& ip, Tins::TCP const& tcp);
-    FlowId(Tins::IPv6 const& ip, Tins::UDP const& udp);
-    FlowId(Tins::IP const& ip, Tins::UDP const& udp);
+    /**
+     * FROM_CLIENT when the packet source is the first endpoint of the
+     * canonical key, FROM_SERVER otherwise
+     */
+    [[nodiscard]] static auto packetDirection(std::array<Port, 2> const& pktPorts,
+        std::array<IPv4, 2> const& pktIps) -> Direction;
+    [[nodiscard]] static auto packetDirection(std::array<Port, 2> const& pktPorts,
+        std::array<IPv6, 2> const& pktIps) -> Direction;
 
     [[nodiscard]] auto toString() const -> std::string;
-    [[nodiscard]] auto getIp(uint8_t pos) const { return ip.ipv4[pos]; };
-    [[nodiscard]] auto getIpv6(uint8_t pos) const { return ip.ipv6[pos]; };
+    [[nodiscard]] auto getIp(uint8_t pos) const -> IPv4;
+    [[nodiscard]] auto getIpv6(uint8_t pos) const -> IPv6;
 
-    [[nodiscard]] auto getPorts() const { return ports; };
-    [[nodiscard]] auto getPort(uint8_t pos) const { return ports[pos]; };
-    [[nodiscard]] auto getNetwork() const { return network; };
-    [[nodiscard]] auto getTransport() const { return transport; };
-    [[nodiscard]] auto getDirection() const { return direction; };
+    [[nodiscard]] auto getPorts() const { return ipv4Key.ports; };
+    [[nodiscard]] auto getPort(uint8_t pos) const { return ipv4Key.ports[pos]; };
+    [[nodiscard]] auto getNetwork() const { return Network::_from_integral_unchecked(ipv4Key.network); };
+    [[nodiscard]] auto getTransport() const { return Transport::_from_integral_unchecked(ipv4Key.transport); };
 
-    [[nodiscard]] auto hash() const
-    {
-        size_t ipHash = 0;
-        if (network == +Network::IPV4) {
-            ipHash = std::hash<IPv4>()(ip.ipv4[0]) + std::hash<IPv4>()(ip.ipv4[1]);
-        } else {
-            ipHash = std::hash<IPv6>()(ip.ipv6[0]) + std::hash<IPv6>()(ip.ipv6[1]);
-        }
-        return ipHash
-            + std::hash<uint16_t>()(ports[0]) + std::hash<uint16_t>()(ports[1])
-            + std::hash<uint8_t>()(network)
-            + std::hash<uint8_t>()(transport);
-    };
+    [[nodiscard]] auto getIpv4Key() const -> FlowKeyV4 const& { return ipv4Key; };
+    [[nodiscard]] auto getIpv6Key() const -> FlowKeyV6 const& { return ipv6Key; };
 
-    auto operator<(FlowId const& b) const -> bool
+    [[nodiscard]] auto hash() const -> size_t
     {
-        bool ipRes = false;
-        if (network == +Network::IPV4) {
-            ipRes = ip.ipv4 < b.ip.ipv4;
-        } else {
-            ipRes = ip.ipv6 < b.ip.ipv6;
+        if (getNetwork() == +Network::IPV4) {
+            return ipv4Key.hash();
         }
-
-        return ipRes
-            && ports < b.ports
-            && network < b.network
-            && transport < b.transport;
+        return ipv6Key.hash();
     }
 
     auto operator==(FlowId const& b) const -> bool
     {
-        bool ipRes = false;
-        if (network == +Network::IPV4) {
-            ipRes = ip.ipv4 == b.ip.ipv4;
-        } else {
-            ipRes = ip.ipv6 == b.ip.ipv6;
+        if (ipv4Key.network != b.ipv4Key.network) {
+            return false;
         }
-        return ipRes
-            && ports == b.ports
-            && network == b.network
-            && transport == b.transport;
+        if (getNetwork() == +Network::IPV4) {
+            return ipv4Key == b.ipv4Key;
+        }
+        return ipv6Key == b.ipv6Key;
     }
 
 private:
-    union IP {
-        std::array<IPv4, 2> ipv4;
-        std::array<IPv6, 2> ipv6;
-        IP() { memset(this, 0, sizeof(IP)); }
-    } ip;
-    std::array<Port, 2> ports = {};
-    Network network = Network::IPV4;
-    Transport transport = Transport::TCP;
-    Direction direction = FROM_CLIENT;
+    union {
+        FlowKeyV4 ipv4Key;
+        FlowKeyV6 ipv6Key;
+    };
 };
 } // namespace flowstats
 
@@ -114,4 +127,20 @@ struct hash<flowstats::FlowId> {
     }
 };
 
+template <>
+struct hash<flowstats::FlowKeyV4> {
+    auto operator()(const flowstats::FlowKeyV4& key) const -> size_t
+    {
+        return key.hash();
+    }
+};
+
+template <>
+struct hash<flowstats::FlowKeyV6> {
+    auto operator()(const flowstats::FlowKeyV6& key) const -> size_t
+    {
+        return key.hash();
+    }
+};
+
 } // namespace std
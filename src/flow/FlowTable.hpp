@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FlatMap.hpp"
+#include "FlowId.hpp"
+
+namespace flowstats {
+
+/**
+ * Connection table split by network. Ipv4 flows are keyed on their 16
+ * bytes key and don't pay for the size of ipv6 addresses.
+ */
+template <typename Value>
+class FlowTable {
+public:
+    auto find(FlowId const& flowId) -> Value*
+    {
+        if (flowId.getNetwork() == +Network::IPV4) {
+            return findIn(&ipv4Flows, flowId.getIpv4Key());
+        }
+        return findIn(&ipv6Flows, flowId.getIpv6Key());
+    }
+
+    template <typename... Args>
+    auto emplace(FlowId const& flowId, Args&&... args) -> Value*
+    {
+        if (flowId.getNetwork() == +Network::IPV4) {
+            auto res = ipv4Flows.emplace(flowId.getIpv4Key(), std::forward<Args>(args)...);
+            return &res.first->second;
+        }
+        auto res = ipv6Flows.emplace(flowId.getIpv6Key(), std::forward<Args>(args)...);
+        return &res.first->second;
+    }
+
+    auto erase(FlowId const& flowId) -> size_t
+    {
+        if (flowId.getNetwork() == +Network::IPV4) {
+            return ipv4Flows.erase(flowId.getIpv4Key());
+        }
+        return ipv6Flows.erase(flowId.getIpv6Key());
+    }
+
+    [[nodiscard]] auto size() const { return ipv4Flows.size() + ipv6Flows.size(); }
+    [[nodiscard]] auto empty() const { return size() == 0; }
+
+    [[nodiscard]] auto getIpv4Flows() const -> FlatMap<FlowKeyV4, Value> const& { return ipv4Flows; }
+    [[nodiscard]] auto getIpv6Flows() const -> FlatMap<FlowKeyV6, Value> const& { return ipv6Flows; }
+
+private:
+    template <typename Map, typename Key>
+    static auto findIn(Map* map, Key const& key) -> Value*
+    {
+        auto it = map->find(key);
+        if (it == map->end()) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    FlatMap<FlowKeyV4, Value> ipv4Flows;
+    FlatMap<FlowKeyV6, Value> ipv6Flows;
+};
+
+} // namespace flowstats
@@ -1,7 +1,7 @@
 #include "IpToFqdn.hpp"
 #include <arpa/inet.h>
-#include <fmt/ostream.h>
-#include <iostream>
+#include <cstdio>
+#include <cstring>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -12,6 +12,7 @@ IpToFqdn::IpToFqdn(FlowstatsConfiguration const& flowstatsConfiguration,
     std::vector<std::string> const& initialDomains,
     std::string const& localhostIp)
     : conf(flowstatsConfiguration)
+    , unknownFqdnId(internFqdn("Unknown"))
 {
     std::map<uint32_t, std::string> ipToFqdn;
     ipToFqdn[Tins::IPv4Address("127.0.0.1")] = "localhost";
@@ -58,60 +59,111 @@ auto IpToFqdn::resolveDomains(const std::vector<std::string>& initialDomains,
     }
 }
 
-auto IpToFqdn::updateDnsCache() -> void
+/**
+ * Seconds a dns answer stays mapped after its ttl. Clients commonly keep
+ * connections, and their resolved address, past the advertised ttl.
+ */
+uint32_t const fqdnTtlGrace = 60;
+
+auto IpToFqdn::toIpv6Key(Tins::IPv6Address const& ip) -> Ipv6Key
 {
-    for (auto i : ipToFqdn) {
-        fmt::print(ipv4CacheFile, "{} {}",
-            i.first,
-            i.second);
-    }
+    Ipv6Key key;
+    memcpy(key.data(), &*ip.begin(), Tins::IPv6Address::address_size);
+    return key;
 }
 
-auto IpToFqdn::updateFqdn(std::string fqdn,
+auto IpToFqdn::updateFqdn(FqdnId fqdnId,
     std::vector<Tins::IPv4Address> const& ips,
     std::vector<Tins::IPv6Address> const& ipv6) -> void
 {
-    const std::lock_guard<std::mutex> lock(mutex);
     for (auto const& ip : ips) {
-        SPDLOG_DEBUG("Fqdn mapping {} -> {}", ip.to_string(), fqdn);
-        ipToFqdn[ip] = fqdn;
+        SPDLOG_DEBUG("Fqdn mapping {} -> {}", ip.to_string(), fqdnToString(fqdnId));
+        ipToFqdn.update(uint32_t(ip), fqdnId, ipToFqdn.neverExpire, 0);
+        bumpMappingVersion(IpHash()(uint32_t(ip)));
     }
     for (auto const& ip : ipv6) {
-        SPDLOG_DEBUG("Fqdn mapping {} -> {}", ip.to_string(), fqdn);
-        ipv6ToFqdn[ip] = fqdn;
+        SPDLOG_DEBUG("Fqdn mapping {} -> {}", ip.to_string(), fqdnToString(fqdnId));
+        auto key = toIpv6Key(ip);
+        ipv6ToFqdn.update(key, fqdnId, ipv6ToFqdn.neverExpire, 0);
+        bumpMappingVersion(IpHash()(key));
     }
 }
 
-auto IpToFqdn::getFlowFqdn(Tins::IPv4Address ipv4) -> std::optional<std::string>
+auto IpToFqdn::updateFqdn(FqdnId fqdnId, Tins::IPv4Address ip,
+    time_t now, uint32_t ttl) -> void
 {
-    std::optional<std::string> fqdn;
-    const std::lock_guard<std::mutex> lock(mutex);
-    auto it = ipToFqdn.find(ipv4);
-    if (it == ipToFqdn.end()) {
-        if (conf.getDisplayUnknownFqdn() == false) {
-            return {};
-        }
-        fqdn = "Unknown";
-        return fqdn;
+    SPDLOG_DEBUG("Fqdn mapping {} -> {}, ttl {}", ip.to_string(), fqdnToString(fqdnId), ttl);
+    if (ipToFqdn.update(uint32_t(ip), fqdnId, uint32_t(now + ttl + fqdnTtlGrace), now)) {
+        bumpMappingVersion(IpHash()(uint32_t(ip)));
     }
-    fqdn = it->second;
-    return fqdn;
 }
 
-auto IpToFqdn::getFlowFqdn(Tins::IPv6Address ipv6) -> std::optional<std::string>
+auto IpToFqdn::updateFqdn(FqdnId fqdnId, Tins::IPv6Address const& ip,
+    time_t now, uint32_t ttl) -> void
 {
-    std::optional<std::string> fqdn;
-    const std::lock_guard<std::mutex> lock(mutex);
-    auto it = ipv6ToFqdn.find(ipv6);
-    if (it == ipv6ToFqdn.end()) {
-        if (conf.getDisplayUnknownFqdn() == false) {
-            return {};
-        }
-        fqdn = "Unknown";
-        return fqdn;
+    SPDLOG_DEBUG("Fqdn mapping {} -> {}, ttl {}", ip.to_string(), fqdnToString(fqdnId), ttl);
+    auto key = toIpv6Key(ip);
+    if (ipv6ToFqdn.update(key, fqdnId, uint32_t(now + ttl + fqdnTtlGrace), now)) {
+        bumpMappingVersion(IpHash()(key));
     }
-    fqdn = it->second;
-    return fqdn;
+}
+
+auto IpToFqdn::isMapped(FqdnId fqdnId, Tins::IPv4Address ip,
+    time_t now, uint32_t ttl) const -> bool
+{
+    return ipToFqdn.hasEntry(uint32_t(ip), fqdnId, uint32_t(now + ttl + fqdnTtlGrace));
+}
+
+auto IpToFqdn::isMapped(FqdnId fqdnId, Tins::IPv6Address const& ip,
+    time_t now, uint32_t ttl) const -> bool
+{
+    return ipv6ToFqdn.hasEntry(toIpv6Key(ip), fqdnId, uint32_t(now + ttl + fqdnTtlGrace));
+}
+
+/**
+ * Only new mappings change the version, refreshed mappings were already
+ * found by lookups
+ */
+auto IpToFqdn::bumpMappingVersion(size_t hash) -> void
+{
+    mappingVersions[hash & (mappingBuckets - 1)].fetch_add(1, std::memory_order_release);
+}
+
+auto IpToFqdn::versionOfBucket(size_t hash) const -> MappingVersion
+{
+    auto bucket = uint32_t(hash & (mappingBuckets - 1));
+    return { bucket, mappingVersions[bucket].load(std::memory_order_acquire) };
+}
+
+auto IpToFqdn::getMappingVersion(Tins::IPv4Address ipv4) const -> MappingVersion
+{
+    return versionOfBucket(IpHash()(uint32_t(ipv4)));
+}
+
+auto IpToFqdn::getMappingVersion(Tins::IPv6Address const& ipv6) const -> MappingVersion
+{
+    return versionOfBucket(IpHash()(toIpv6Key(ipv6)));
+}
+
+auto IpToFqdn::lookupResult(std::optional<uint32_t> fqdnId) const -> std::optional<FqdnId>
+{
+    if (fqdnId.has_value()) {
+        return *fqdnId;
+    }
+    if (conf.getDisplayUnknownFqdn() == false) {
+        return {};
+    }
+    return unknownFqdnId;
+}
+
+auto IpToFqdn::getFlowFqdn(Tins::IPv4Address ipv4, time_t now) const -> std::optional<FqdnId>
+{
+    return lookupResult(ipToFqdn.find(uint32_t(ipv4), now));
+}
+
+auto IpToFqdn::getFlowFqdn(Tins::IPv6Address ipv6, time_t now) const -> std::optional<FqdnId>
+{
+    return lookupResult(ipv6ToFqdn.find(toIpv6Key(ipv6), now));
 }
 
 } // namespace flowstats
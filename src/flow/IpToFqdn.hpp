@@ -1,10 +1,13 @@
 #pragma once
 
 #include "Configuration.hpp"
+#include "ExpiringIndex.hpp"
+#include "FqdnTable.hpp"
+#include "Utils.hpp"
+#include <array>
+#include <atomic>
 #include <cstdint> // for uint16_t, uint32_t
-#include <fstream>
 #include <map> // for map
-#include <mutex> // for mutex
 #include <string> // for string, allocator
 #include <tins/ip_address.h>
 #include <tins/ipv6_address.h>
@@ -12,6 +15,14 @@
 
 namespace flowstats {
 
+/**
+ * Version of the mappings of a bucket of ips
+ */
+struct MappingVersion {
+    uint32_t bucket = 0;
+    uint32_t version = 0;
+};
+
 class IpToFqdn {
 public:
     IpToFqdn(FlowstatsConfiguration const& flowstatsConfiguration,
@@ -19,22 +30,70 @@ public:
         std::string const& localhostIp = "");
     virtual ~IpToFqdn() = default;
 
-    auto getFlowFqdn(Tins::IPv4Address ipv4) -> std::optional<std::string>;
-    auto getFlowFqdn(Tins::IPv6Address ipv6) -> std::optional<std::string>;
-    auto updateFqdn(std::string fqdn,
+    /**
+     * Lookups don't take any lock and can run concurrently with dns
+     * updates. Mappings older than now are ignored.
+     */
+    auto getFlowFqdn(Tins::IPv4Address ipv4, time_t now) const -> std::optional<FqdnId>;
+    auto getFlowFqdn(Tins::IPv6Address ipv6, time_t now) const -> std::optional<FqdnId>;
+
+    /**
+     * Map ips to a fqdn without expiry
+     */
+    auto updateFqdn(FqdnId fqdnId,
         std::vector<Tins::IPv4Address> const& ips,
         std::vector<Tins::IPv6Address> const& ipv6) -> void;
 
+    /**
+     * Map an ip from a dns answer, the mapping ages out after the
+     * record ttl plus a grace period
+     */
+    auto updateFqdn(FqdnId fqdnId, Tins::IPv4Address ip, time_t now, uint32_t ttl) -> void;
+    auto updateFqdn(FqdnId fqdnId, Tins::IPv6Address const& ip, time_t now, uint32_t ttl) -> void;
+
+    /**
+     * Return true when updating the mapping with this dns answer would
+     * change nothing
+     */
+    [[nodiscard]] auto isMapped(FqdnId fqdnId, Tins::IPv4Address ip, time_t now, uint32_t ttl) const -> bool;
+    [[nodiscard]] auto isMapped(FqdnId fqdnId, Tins::IPv6Address const& ip, time_t now, uint32_t ttl) const -> bool;
+
+    /**
+     * Lookups which found no fqdn can be cached with the version taken
+     * before them. The version changes when the ip, or another ip of
+     * its bucket, gets mapped.
+     */
+    [[nodiscard]] auto getMappingVersion(Tins::IPv4Address ipv4) const -> MappingVersion;
+    [[nodiscard]] auto getMappingVersion(Tins::IPv6Address const& ipv6) const -> MappingVersion;
+    [[nodiscard]] auto isCurrent(MappingVersion version) const -> bool
+    {
+        return mappingVersions[version.bucket].load(std::memory_order_acquire) == version.version;
+    }
+
 private:
+    static size_t const mappingBuckets = 16384;
+
+    using Ipv6Key = std::array<uint64_t, 2>;
+
+    struct IpHash {
+        auto operator()(uint32_t ip) const -> size_t { return mixHash(ip); }
+        auto operator()(Ipv6Key const& ip) const -> size_t
+        {
+            return mixHash(mixHash(ip[0]) ^ ip[1]);
+        }
+    };
+
     FlowstatsConfiguration const& conf;
 
-    std::mutex mutex;
-    std::map<Tins::IPv4Address, std::string> ipToFqdn;
-    std::map<Tins::IPv6Address, std::string> ipv6ToFqdn;
-    std::ofstream ipv4CacheFile;
-    std::ofstream ipv6CacheFile;
+    FqdnId unknownFqdnId;
+    ExpiringIndex<uint32_t, IpHash> ipToFqdn;
+    ExpiringIndex<Ipv6Key, IpHash> ipv6ToFqdn;
+    std::array<std::atomic<uint32_t>, mappingBuckets> mappingVersions = {};
 
-    auto updateDnsCache() -> void;
+    static auto toIpv6Key(Tins::IPv6Address const& ip) -> Ipv6Key;
+    auto bumpMappingVersion(size_t hash) -> void;
+    auto versionOfBucket(size_t hash) const -> MappingVersion;
+    auto lookupResult(std::optional<uint32_t> fqdnId) const -> std::optional<FqdnId>;
     auto resolveDomains(const std::vector<std::string>& initialDomains,
         std::map<uint32_t, std::string> ipToFqdn) -> void;
     auto resolveDns(std::string const& domain) -> std::vector<std::string>;
@@ -0,0 +1,369 @@
+#include "PacketView.hpp"
+#include <cstring>
+#include <sys/socket.h>
+#include <tins/ethernetII.h>
+#include <tins/ip.h>
+#include <tins/ipv6.h>
+#include <tins/loopback.h>
+#include <tins/rawpdu.h>
+#include <tins/sll.h>
+#include <tins/tcp.h>
+#include <tins/udp.h>
+
+namespace flowstats {
+
+#define ETHERNET_HEADER_SIZE 14
+#define ETHERNET_MIN_FRAME_SIZE 60
+#define VLAN_HEADER_SIZE 4
+#define SLL_HEADER_SIZE 16
+#define LOOPBACK_HEADER_SIZE 4
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_ARP 0x0806
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+#define ETHERTYPE_QINQ_OLD 0x9100
+#define ETHERTYPE_IPV6 0x86dd
+
+#define IPV4_MIN_HEADER_SIZE 20
+#define IPV6_HEADER_SIZE 40
+#define TCP_MIN_HEADER_SIZE 20
+#define UDP_HEADER_SIZE 8
+
+#define IP_PROTO_HOPOPTS 0
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+#define IP_PROTO_ROUTING 43
+#define IP_PROTO_FRAGMENT 44
+#define IP_PROTO_DSTOPTS 60
+
+static auto readUint16(uint8_t const* data) -> uint16_t
+{
+    return (data[0] << 8) | data[1];
+}
+
+static auto readUint32(uint8_t const* data) -> uint32_t
+{
+    return (uint32_t(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+auto PacketView::getFlowId() const -> FlowId
+{
+    if (network == +Network::IPV4) {
+        return FlowId(ports, ips, transport);
+    }
+    return FlowId(ports, ipv6s, transport);
+}
+
+/**
+ * Direction of the packet relative to the canonical order of its FlowId
+ */
+auto PacketView::getDirection() const -> Direction
+{
+    if (network == +Network::IPV4) {
+        return FlowId::packetDirection(ports, ips);
+    }
+    return FlowId::packetDirection(ports, ipv6s);
+}
+
+auto PacketDecoder::decode(pcap_pkthdr const& header, uint8_t const* data,
+    PacketView* view) -> bool
+{
+    view->ts = header.ts;
+    auto status = decodeRaw(data, header.caplen, view);
+    if (status == DecodeStatus::Decoded) {
+        return true;
+    }
+    if (status == DecodeStatus::Ignored) {
+        return false;
+    }
+    return decodeFallback(data, header.caplen, view);
+}
+
+auto PacketDecoder::decodeRaw(uint8_t const* data, uint32_t size,
+    PacketView* view) const -> DecodeStatus
+{
+    uint32_t offset = 0;
+    uint16_t etherType = 0;
+    auto status = decodeLinkLayer(data, size, &offset, &etherType);
+    if (status != DecodeStatus::Decoded) {
+        return status;
+    }
+
+    if (etherType == ETHERTYPE_IPV4) {
+        status = decodeIpv4(data + offset, size - offset, view);
+    } else if (etherType == ETHERTYPE_IPV6) {
+        status = decodeIpv6(data + offset, size - offset, view);
+    } else if (etherType == ETHERTYPE_ARP) {
+        return DecodeStatus::Ignored;
+    } else {
+        return DecodeStatus::Unsupported;
+    }
+    if (status != DecodeStatus::Decoded) {
+        return status;
+    }
+
+    // decodeIpv4/6 stored the advertised ip size in frameSize
+    view->frameSize += offset;
+    if (linkType == DLT_EN10MB) {
+        view->frameSize = std::max(view->frameSize, uint32_t(ETHERNET_MIN_FRAME_SIZE));
+    }
+    return DecodeStatus::Decoded;
+}
+
+auto PacketDecoder::decodeLinkLayer(uint8_t const* data, uint32_t size,
+    uint32_t* offset, uint16_t* etherType) const -> DecodeStatus
+{
+    switch (linkType) {
+    case DLT_EN10MB: {
+        if (size < ETHERNET_HEADER_SIZE) {
+            return DecodeStatus::Ignored;
+        }
+        uint32_t pos = ETHERNET_HEADER_SIZE;
+        uint16_t type = readUint16(data + ETHERNET_HEADER_SIZE - 2);
+        while (type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ || type == ETHERTYPE_QINQ_OLD) {
+            if (size < pos + VLAN_HEADER_SIZE) {
+                return DecodeStatus::Ignored;
+            }
+            type = readUint16(data + pos + 2);
+            pos += VLAN_HEADER_SIZE;
+        }
+        *offset = pos;
+        *etherType = type;
+        return DecodeStatus::Decoded;
+    }
+    case DLT_LINUX_SLL:
+        if (size < SLL_HEADER_SIZE) {
+            return DecodeStatus::Ignored;
+        }
+        *offset = SLL_HEADER_SIZE;
+        *etherType = readUint16(data + SLL_HEADER_SIZE - 2);
+        return DecodeStatus::Decoded;
+    case DLT_NULL: {
+        if (size < LOOPBACK_HEADER_SIZE) {
+            return DecodeStatus::Ignored;
+        }
+        uint32_t family;
+        memcpy(&family, data, sizeof(family));
+        *offset = LOOPBACK_HEADER_SIZE;
+        *etherType = family == AF_INET ? ETHERTYPE_IPV4 : ETHERTYPE_IPV6;
+        return DecodeStatus::Decoded;
+    }
+    case DLT_RAW:
+#ifdef DLT_IPV4
+    case DLT_IPV4:
+    case DLT_IPV6:
+#endif
+        if (size < 1) {
+            return DecodeStatus::Ignored;
+        }
+        *offset = 0;
+        *etherType = (data[0] >> 4) == 4 ? ETHERTYPE_IPV4 : ETHERTYPE_IPV6;
+        return DecodeStatus::Decoded;
+    default:
+        return DecodeStatus::Unsupported;
+    }
+}
+
+auto PacketDecoder::decodeIpv4(uint8_t const* data, uint32_t size,
+    PacketView* view) const -> DecodeStatus
+{
+    if (size < IPV4_MIN_HEADER_SIZE || (data[0] >> 4) != 4) {
+        return DecodeStatus::Ignored;
+    }
+    uint32_t headerSize = (data[0] & 0x0f) * 4;
+    if (headerSize < IPV4_MIN_HEADER_SIZE || size < headerSize) {
+        return DecodeStatus::Ignored;
+    }
+    // Non first fragments have no transport header
+    if ((readUint16(data + 6) & 0x1fff) != 0) {
+        return DecodeStatus::Ignored;
+    }
+    // Total length is 0 with TSO, trust the capture in this case
+    uint32_t totalLength = readUint16(data + 2);
+    uint32_t ipSize = size;
+    uint32_t advertisedSize = size;
+    if (totalLength != 0) {
+        advertisedSize = std::max(totalLength, headerSize);
+        ipSize = std::min(advertisedSize, size);
+    }
+
+    uint32_t srcIp;
+    uint32_t dstIp;
+    memcpy(&srcIp, data + 12, sizeof(srcIp));
+    memcpy(&dstIp, data + 16, sizeof(dstIp));
+    view->network = Network::IPV4;
+    view->ips = { IPv4(srcIp), IPv4(dstIp) };
+    view->frameSize = advertisedSize;
+    return decodeTransport(data[9], data + headerSize, ipSize - headerSize,
+        advertisedSize - headerSize, view);
+}
+
+auto PacketDecoder::decodeIpv6(uint8_t const* data, uint32_t size,
+    PacketView* view) const -> DecodeStatus
+{
+    if (size < IPV6_HEADER_SIZE || (data[0] >> 4) != 6) {
+        return DecodeStatus::Ignored;
+    }
+    uint32_t payloadLength = readUint16(data + 4);
+    uint32_t ipSize = size;
+    uint32_t advertisedSize = size;
+    if (payloadLength != 0) {
+        advertisedSize = payloadLength + IPV6_HEADER_SIZE;
+        ipSize = std::min(advertisedSize, size);
+    }
+
+    uint8_t nextHeader = data[6];
+    uint32_t offset = IPV6_HEADER_SIZE;
+    while (nextHeader == IP_PROTO_HOPOPTS || nextHeader == IP_PROTO_ROUTING
+        || nextHeader == IP_PROTO_DSTOPTS) {
+        if (ipSize < offset + 8) {
+            return DecodeStatus::Ignored;
+        }
+        nextHeader = data[offset];
+        offset += (data[offset + 1] + 1) * 8;
+    }
+    if (nextHeader == IP_PROTO_FRAGMENT) {
+        return DecodeStatus::Unsupported;
+    }
+    if (ipSize < offset) {
+        return DecodeStatus::Ignored;
+    }
+
+    view->network = Network::IPV6;
+    view->ipv6s = { IPv6(data + 8), IPv6(data + 24) };
+    view->frameSize = advertisedSize;
+    return decodeTransport(nextHeader, data + offset, ipSize - offset,
+        advertisedSize - offset, view);
+}
+
+auto PacketDecoder::decodeTransport(uint8_t proto, uint8_t const* data, uint32_t size,
+    uint32_t advertisedSize, PacketView* view) const -> DecodeStatus
+{
+    uint32_t headerSize;
+    if (proto == IP_PROTO_TCP) {
+        if (size < TCP_MIN_HEADER_SIZE) {
+            return DecodeStatus::Ignored;
+        }
+        headerSize = (data[12] >> 4) * 4;
+        if (headerSize < TCP_MIN_HEADER_SIZE || size < headerSize) {
+            return DecodeStatus::Ignored;
+        }
+        view->transport = Transport::TCP;
+        view->seq = readUint32(data + 4);
+        view->ackSeq = readUint32(data + 8);
+        view->flags = data[13];
+        view->window = readUint16(data + 14);
+    } else if (proto == IP_PROTO_UDP) {
+        if (size < UDP_HEADER_SIZE) {
+            return DecodeStatus::Ignored;
+        }
+        headerSize = UDP_HEADER_SIZE;
+        view->transport = Transport::UDP;
+        view->seq = 0;
+        view->ackSeq = 0;
+        view->flags = 0;
+        view->window = 0;
+    } else {
+        return DecodeStatus::Ignored;
+    }
+    view->ports = { readUint16(data), readUint16(data + 2) };
+    view->payload = data + headerSize;
+    view->payloadSize = size - headerSize;
+    view->advertisedPayloadSize = advertisedSize - headerSize;
+    return DecodeStatus::Decoded;
+}
+
+auto PacketDecoder::pduFromLinkType(uint8_t const* data, uint32_t size) const -> Tins::PDU*
+{
+    switch (linkType) {
+    case DLT_EN10MB:
+        return new Tins::EthernetII(data, size);
+    case DLT_LINUX_SLL:
+        return new Tins::SLL(data, size);
+    case DLT_NULL:
+        return new Tins::Loopback(data, size);
+    case DLT_RAW:
+        if (size > 0 && (data[0] >> 4) == 6) {
+            return new Tins::IPv6(data, size);
+        }
+        return new Tins::IP(data, size);
+    default:
+        return nullptr;
+    }
+}
+
+auto PacketDecoder::decodeFallback(uint8_t const* data, uint32_t size,
+    PacketView* view) -> bool
+{
+    try {
+        fallbackPdu.reset(pduFromLinkType(data, size));
+    } catch (Tins::malformed_packet const&) {
+        fallbackPdu.reset();
+    }
+    if (fallbackPdu == nullptr) {
+        return false;
+    }
+    return fillPacketView(*fallbackPdu, view);
+}
+
+/**
+ * Fill the view from a libtins PDU chain. Payload points inside the
+ * pdu which needs to outlive the view.
+ */
+auto fillPacketView(Tins::PDU const& pdu, PacketView* view) -> bool
+{
+    auto const* ip = pdu.find_pdu<Tins::IP>();
+    auto const* ipv6 = pdu.find_pdu<Tins::IPv6>();
+    Tins::PDU const* ipPdu = ip;
+    if (ip != nullptr) {
+        view->network = Network::IPV4;
+        view->ips = { ip->src_addr(), ip->dst_addr() };
+    } else if (ipv6 != nullptr) {
+        ipPdu = ipv6;
+        view->network = Network::IPV6;
+        view->ipv6s = { ipv6->src_addr(), ipv6->dst_addr() };
+    } else {
+        return false;
+    }
+
+    auto const* tcp = ipPdu->find_pdu<Tins::TCP>();
+    auto const* udp = ipPdu->find_pdu<Tins::UDP>();
+    if (tcp != nullptr) {
+        view->transport = Transport::TCP;
+        view->ports = { tcp->sport(), tcp->dport() };
+        view->seq = tcp->seq();
+        view->ackSeq = tcp->ack_seq();
+        view->flags = tcp->flags();
+        view->window = tcp->window();
+    } else if (udp != nullptr) {
+        view->transport = Transport::UDP;
+        view->ports = { udp->sport(), udp->dport() };
+        view->seq = 0;
+        view->ackSeq = 0;
+        view->flags = 0;
+        view->window = 0;
+    } else {
+        return false;
+    }
+
+    view->frameSize = pdu.advertised_size();
+    auto const* rawPdu = ipPdu->find_pdu<Tins::RawPDU>();
+    if (rawPdu == nullptr) {
+        view->payload = nullptr;
+        view->payloadSize = 0;
+    } else {
+        view->payload = rawPdu->payload().data();
+        view->payloadSize = rawPdu->payload_size();
+    }
+    uint32_t transportHeaderSize = tcp != nullptr ? tcp->header_size() : udp->header_size();
+    uint32_t headersSize = ipPdu->header_size() + transportHeaderSize;
+    view->advertisedPayloadSize = view->payloadSize;
+    if (ipPdu->advertised_size() > headersSize) {
+        view->advertisedPayloadSize = std::max(view->payloadSize,
+            ipPdu->advertised_size() - headersSize);
+    }
+    return true;
+}
+
+} // namespace flowstats
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "FlowId.hpp"
+#include <memory>
+#include <pcap/pcap.h>
+#include <sys/time.h>
+#include <tins/pdu.h>
+
+namespace flowstats {
+
+/**
+ * Decoded headers of a captured frame. Payload points inside the
+ * capture buffer and is only valid until the next packet is read.
+ */
+struct PacketView {
+    timeval ts = {};
+    // Size of the frame as advertised by its headers
+    uint32_t frameSize = 0;
+
+    Network network = Network::IPV4;
+    Transport transport = Transport::TCP;
+    std::array<IPv4, 2> ips = {};
+    std::array<IPv6, 2> ipv6s = {};
+    std::array<Port, 2> ports = {};
+
+    // Tcp header, only set with Transport::TCP
+    uint32_t seq = 0;
+    uint32_t ackSeq = 0;
+    uint16_t window = 0;
+    uint8_t flags = 0;
+
+    // Transport payload, limited to the captured bytes
+    uint8_t const* payload = nullptr;
+    uint32_t payloadSize = 0;
+    // Payload size from the ip length, larger than payloadSize on
+    // truncated captures
+    uint32_t advertisedPayloadSize = 0;
+
+    [[nodiscard]] auto hasFlags(uint8_t checkFlags) const { return (flags & checkFlags) == checkFlags; };
+    [[nodiscard]] auto getFlowId() const -> FlowId;
+    [[nodiscard]] auto getDirection() const -> Direction;
+};
+
+enum class DecodeStatus {
+    Decoded,
+    Ignored,
+    Unsupported,
+};
+
+/**
+ * Parse link, network and transport headers in place from the raw
+ * capture buffer. Encapsulations unknown to the fast path are handed
+ * to libtins.
+ */
+class PacketDecoder {
+public:
+    explicit PacketDecoder(int linkType = DLT_EN10MB)
+        : linkType(linkType) {};
+
+    [[nodiscard]] auto decode(pcap_pkthdr const& header, uint8_t const* data,
+        PacketView* view) -> bool;
+    [[nodiscard]] auto decodeRaw(uint8_t const* data, uint32_t size,
+        PacketView* view) const -> DecodeStatus;
+
+private:
+    auto decodeLinkLayer(uint8_t const* data, uint32_t size,
+        uint32_t* offset, uint16_t* etherType) const -> DecodeStatus;
+    auto decodeIpv4(uint8_t const* data, uint32_t size,
+        PacketView* view) const -> DecodeStatus;
+    auto decodeIpv6(uint8_t const* data, uint32_t size,
+        PacketView* view) const -> DecodeStatus;
+    auto decodeTransport(uint8_t proto, uint8_t const* data, uint32_t size,
+        uint32_t advertisedSize, PacketView* view) const -> DecodeStatus;
+
+    auto decodeFallback(uint8_t const* data, uint32_t size,
+        PacketView* view) -> bool;
+    [[nodiscard]] auto pduFromLinkType(uint8_t const* data, uint32_t size) const -> Tins::PDU*;
+
+    int linkType;
+    // Keeps the payload of the last libtins decoded packet alive
+    std::unique_ptr<Tins::PDU> fallbackPdu;
+};
+
+auto fillPacketView(Tins::PDU const& pdu, PacketView* view) -> bool;
+
+} // namespace flowstats
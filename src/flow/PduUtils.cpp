@@ -2,20 +2,14 @@
 
 namespace flowstats {
 
-auto getTcpPayloadSize(Tins::IP const* ip, Tins::IPv6 const* ipv6,
-    Tins::TCP const& tcp) -> uint32_t
+auto getTcpPayloadSize(PacketView const& packet) -> uint32_t
 {
-    if (ip) {
-        return ip->advertised_size() - ip->header_size() - tcp.header_size();
-    } else if (ipv6) {
-        return ipv6->advertised_size() - ipv6->header_size() - tcp.header_size();
-    }
-    return 0;
+    return packet.advertisedPayloadSize;
 }
 
-auto Cursor::checkSize(uint32_t size) -> bool
+auto Cursor::checkSize(uint32_t checkedSize) -> bool
 {
-    if (payload.size() - index < size) {
+    if (size - index < checkedSize) {
         return false;
     }
     return true;
@@ -65,10 +59,7 @@ auto Cursor::readString(int n) -> std::optional<std::string>
     if (checkSize(n) == false) {
         return {};
     }
-    std::string res(n, 'x');
-    for (int i = 0; i < n; ++i) {
-        res[i] = payload[index + i];
-    }
+    std::string res(reinterpret_cast<char const*>(payload + index), n);
     index += n;
     return res;
 }
@@ -110,15 +101,4 @@ auto Cursor::skipUint32() -> bool
     return skip(4);
 }
 
-auto getPorts(Tins::TCP const* tcp, Tins::UDP const* udp) -> std::array<int, 2>
-{
-    if (tcp) {
-        return { tcp->sport(), tcp->dport() };
-    }
-    if (udp) {
-        return { udp->sport(), udp->dport() };
-    }
-    return {};
-}
-
 } // namespace flowstats
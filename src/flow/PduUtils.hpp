@@ -1,23 +1,20 @@
 #pragma once
 
-#include <tins/ip.h>
-#include <tins/ipv6.h>
-#include <tins/tcp.h>
-#include <tins/udp.h>
+#include "PacketView.hpp"
+#include <optional>
 
 namespace flowstats {
 
-auto getTcpPayloadSize(Tins::IP const* ip,
-    Tins::IPv6 const* ipv6,
-    Tins::TCP const& tcp) -> uint32_t;
+auto getTcpPayloadSize(PacketView const& packet) -> uint32_t;
 
 class Cursor {
 public:
-    explicit Cursor(std::vector<uint8_t> const& payload)
-        : payload(payload) {};
+    Cursor(uint8_t const* payload, uint32_t size)
+        : payload(payload)
+        , size(size) {};
     virtual ~Cursor() = default;
 
-    auto remainingBytes() -> uint32_t { return payload.size() - index; };
+    auto remainingBytes() -> uint32_t { return size - index; };
 
     [[nodiscard]] auto readUint8() -> std::optional<uint8_t>;
     [[nodiscard]] auto readUint16() -> std::optional<uint16_t>;
@@ -34,10 +31,9 @@ public:
     [[nodiscard]] auto checkSize(uint32_t size) -> bool;
 
 private:
-    std::vector<uint8_t> const& payload;
-    int index = 0;
+    uint8_t const* payload;
+    uint32_t size;
+    uint32_t index = 0;
 };
 
-auto getPorts(Tins::TCP const* tcp, Tins::UDP const* udp) -> std::array<int, 2>;
-
 } // namespace flowstats
@@ -1,10 +1,9 @@
 #include "SslFlow.hpp"
 #include "SslProto.hpp"
-#include <tins/rawpdu.h>
 
 namespace flowstats {
 
-void SslFlow::processHandshake(Tins::Packet const& packet,
+void SslFlow::processHandshake(PacketView const& packet,
     Cursor* cursor)
 {
     if (checkSslHandshake(cursor) == false) {
@@ -28,7 +27,7 @@ void SslFlow::processHandshake(Tins::Packet const& packet,
         return;
     }
 
-    startHandshake = packetToTimeval(packet);
+    startHandshake = packet.ts;
     SPDLOG_DEBUG("Start ssl connection at {}", timevalInMs(startHandshake));
 
     // Random
@@ -57,7 +56,7 @@ void SslFlow::processHandshake(Tins::Packet const& packet,
     }
 }
 
-auto SslFlow::addPacket(Tins::Packet const& packet, Direction const direction) -> void
+auto SslFlow::addPacket(PacketView const& packet, Direction const direction) -> void
 {
     Flow::addPacket(packet, direction);
     for (auto& subflow : aggregatedFlows) {
@@ -65,19 +64,16 @@ auto SslFlow::addPacket(Tins::Packet const& packet, Direction const direction) -
     }
 }
 
-void SslFlow::updateFlow(Tins::Packet const& packet, Direction direction,
-    Tins::TCP const& tcp)
+void SslFlow::updateFlow(PacketView const& packet, Direction direction)
 {
     if (connectionEstablished) {
         return;
     }
 
-    auto const* rawData = tcp.find_pdu<Tins::RawPDU>();
-    if (rawData == nullptr) {
+    if (packet.payloadSize == 0) {
         return;
     }
-    auto payload = rawData->payload();
-    auto cursor = Cursor(payload);
+    auto cursor = Cursor(packet.payload, packet.payloadSize);
     if (direction == FROM_CLIENT) {
         processHandshake(packet, &cursor);
         return;
@@ -88,7 +84,7 @@ void SslFlow::updateFlow(Tins::Packet const& packet, Direction direction,
             return;
         }
         connectionEstablished = true;
-        uint32_t delta = getTimevalDeltaMs(startHandshake, packetToTimeval(packet));
+        uint32_t delta = getTimevalDeltaMs(startHandshake, packet.ts);
         for (auto* aggregatedSslFlow : aggregatedFlows) {
             aggregatedSslFlow->addConnection(delta);
         }
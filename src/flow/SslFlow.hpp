@@ -12,18 +12,19 @@ public:
     SslFlow()
         : Flow() {};
     SslFlow(FlowId const& flowId,
-        std::string const& fqdn,
+        FqdnId fqdnId,
         std::vector<AggregatedSslFlow*> _aggregatedFlows)
-        : Flow(flowId, fqdn)
+        : Flow(flowId, fqdnId)
         , aggregatedFlows(std::move(_aggregatedFlows)) {};
 
-    void updateFlow(Tins::Packet const& packet, Direction direction,
-        Tins::TCP const& sslLayer);
+    void updateFlow(PacketView const& packet, Direction direction);
 
-    auto addPacket(Tins::Packet const& packet, Direction const direction) -> void override;
+    auto addPacket(PacketView const& packet, Direction const direction) -> void override;
+
+    [[nodiscard]] auto getAggregatedFlows() const -> std::vector<AggregatedSslFlow*> const& { return aggregatedFlows; }
 
 private:
-    void processHandshake(Tins::Packet const& packet, Cursor* cursor);
+    void processHandshake(PacketView const& packet, Cursor* cursor);
 
     std::vector<AggregatedSslFlow*> aggregatedFlows;
     std::string domain = "";
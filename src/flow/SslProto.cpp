@@ -45,6 +45,19 @@ auto checkValidSsl(Cursor* cursor) -> bool
     return true;
 }
 
+auto checkSslRecordStart(Cursor* cursor) -> bool
+{
+    auto recordType = cursor->readUint8();
+    if (checkRecordType(recordType) == false) {
+        return false;
+    }
+    auto sslVersion = cursor->readUint16();
+    if (checkValidSslVersion(sslVersion) == false) {
+        return false;
+    }
+    return cursor->skipUint16();
+}
+
 auto getSslDomainFromSni(Cursor* cursor) -> std::optional<std::string>
 {
     auto listLength = cursor->readUint16();
@@ -35,6 +35,11 @@ enum SSLRecordType {
 
 [[nodiscard]] auto getSslDomainFromExtension(Cursor* cursor) -> std::optional<std::string>;
 [[nodiscard]] auto checkValidSsl(Cursor* cursor) -> bool;
+/**
+ * Known record type and ssl3 to tls1.2 version, the record may span
+ * several segments
+ */
+[[nodiscard]] auto checkSslRecordStart(Cursor* cursor) -> bool;
 [[nodiscard]] auto checkValidSslVersion(std::optional<uint16_t> sslVersion) -> bool;
 [[nodiscard]] auto checkSslHandshake(Cursor* cursor) -> bool;
 [[nodiscard]] auto checkSslChangeCipherSpec(Cursor* cursor) -> bool;
@@ -38,25 +38,22 @@ auto TcpFlow::closeConnection() -> void
     lastPayloadTime = {};
 }
 
-auto TcpFlow::nextSeqnum(Tins::TCP const& tcp, int tcpPayloadSize) -> uint32_t
+auto TcpFlow::nextSeqnum(PacketView const& packet, int tcpPayloadSize) -> uint32_t
 {
-    return tcp.seq() + tcpPayloadSize + tcp.has_flags(Tins::TCP::SYN) + tcp.has_flags(Tins::TCP::FIN);
+    return packet.seq + tcpPayloadSize + packet.hasFlags(Tins::TCP::SYN) + packet.hasFlags(Tins::TCP::FIN);
 }
 
-auto TcpFlow::updateFlow(Tins::Packet const& packet, Direction direction,
-    Tins::IP const* ip,
-    Tins::IPv6 const* ipv6,
-    Tins::TCP const& tcp) -> void
+auto TcpFlow::updateFlow(PacketView const& packet, Direction direction) -> void
 {
-    auto const flags = tcp.flags();
-    timeval tv = packetToTimeval(packet);
+    auto const flags = packet.flags;
+    timeval tv = packet.ts;
 
-    int tcpPayloadSize = getTcpPayloadSize(ip, ipv6, tcp);
+    int tcpPayloadSize = getTcpPayloadSize(packet);
     lastPacketTime[direction] = tv;
-    uint32_t nextSeq = std::max(seqNum[direction], nextSeqnum(tcp, tcpPayloadSize));
+    uint32_t nextSeq = std::max(seqNum[direction], nextSeqnum(packet, tcpPayloadSize));
     SPDLOG_DEBUG("Update flow {}, nextSeq {}, ts {}ms, direction {}, tcp {}, payload {}",
         getFlowId().toString(), nextSeq, timevalInMs(tv), direction,
-        tcpToString(tcp), tcpPayloadSize);
+        tcpToString(packet), tcpPayloadSize);
 
     auto currentDirection = static_cast<Direction>(direction == getSrvPort());
     if (flags & Tins::TCP::SYN) {
@@ -67,7 +64,7 @@ auto TcpFlow::updateFlow(Tins::Packet const& packet, Direction direction,
             directionToString(currentDirection), getSrvPort(), timevalInMs(tv));
     }
 
-    if (!opened && flags & Tins::TCP::ACK && tcp.ack_seq() == seqNum[!direction]
+    if (!opened && flags & Tins::TCP::ACK && packet.ackSeq == seqNum[!direction]
         && synAcked[direction] == false) {
         SPDLOG_DEBUG("syn acked for direction {}", directionToString(currentDirection));
         synAcked[direction] = true;
@@ -84,7 +81,7 @@ auto TcpFlow::updateFlow(Tins::Packet const& packet, Direction direction,
         }
     }
 
-    uint32_t ackNumber = tcp.ack_seq();
+    uint32_t ackNumber = packet.ackSeq;
     if (seqNum[!direction] > 0 && ackNumber > seqNum[!direction]) {
         SPDLOG_DEBUG("Got a gap, ack {}, expected seqNum {}", ackNumber, seqNum[!direction]);
         gap++;
@@ -115,7 +112,7 @@ auto TcpFlow::updateFlow(Tins::Packet const& packet, Direction direction,
         }
     }
 
-    if (!tcp.has_flags(Tins::TCP::SYN) && !tcp.has_flags(Tins::TCP::RST) && !opened && !opening && seqNum[!direction] == ackNumber) {
+    if (!packet.hasFlags(Tins::TCP::SYN) && !packet.hasFlags(Tins::TCP::RST) && !opened && !opening && seqNum[!direction] == ackNumber) {
         SPDLOG_DEBUG("Detected ongoing conversation");
         opened = true;
         for (auto& aggregatedFlow : aggregatedFlows) {
@@ -123,15 +120,15 @@ auto TcpFlow::updateFlow(Tins::Packet const& packet, Direction direction,
         }
     }
 
-    if (tcp.has_flags(Tins::TCP::FIN)) {
-        uint32_t nextSeq = nextSeqnum(tcp, tcpPayloadSize);
+    if (packet.hasFlags(Tins::TCP::FIN)) {
+        uint32_t nextSeq = nextSeqnum(packet, tcpPayloadSize);
         SPDLOG_DEBUG("Got fin for direction {}, ts {}ms, nextSeq {}, ack {}",
-            directionToString(currentDirection), timevalInMs(tv), nextSeq, tcp.ack_seq());
+            directionToString(currentDirection), timevalInMs(tv), nextSeq, packet.ackSeq);
         finSeqnum[direction] = nextSeq;
     }
 
-    if (tcp.has_flags(Tins::TCP::ACK)
-        && tcp.ack_seq() == finSeqnum[!direction]
+    if (packet.hasFlags(Tins::TCP::ACK)
+        && packet.ackSeq == finSeqnum[!direction]
         && finAcked[direction] == false) {
         finAcked[direction] = true;
         if (finAcked[!direction]) {
@@ -139,19 +136,19 @@ auto TcpFlow::updateFlow(Tins::Packet const& packet, Direction direction,
         }
     }
 
-    if (tcp.has_flags(Tins::TCP::RST) && closed == false) {
+    if (packet.hasFlags(Tins::TCP::RST) && closed == false) {
         closeConnection();
     }
 
-    if (tcp.has_flags(Tins::TCP::SYN) && opening == false) {
+    if (packet.hasFlags(Tins::TCP::SYN) && opening == false) {
         opening = true;
     }
 }
 
-auto TcpFlow::tcpToString(Tins::TCP const& tcp) -> std::string
+auto TcpFlow::tcpToString(PacketView const& packet) -> std::string
 {
     std::string tcpFlag;
-    auto flags = tcp.flags();
+    auto flags = packet.flags;
     if (flags & Tins::TCP::SYN) {
         if (flags & Tins::TCP::ACK) {
             tcpFlag = "[SYN, ACK], ";
@@ -170,8 +167,8 @@ auto TcpFlow::tcpToString(Tins::TCP const& tcp) -> std::string
         tcpFlag = "[RST], ";
     }
     return fmt::format("{}seq={}, ack={}, opened={}",
-        tcpFlag, tcp.seq(),
-        tcp.ack_seq(),
+        tcpFlag, packet.seq,
+        packet.ackSeq,
         opened);
 }
 } // namespace flowstats
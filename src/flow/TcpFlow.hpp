@@ -14,26 +14,23 @@ public:
     TcpFlow(FlowId flowId,
         uint8_t srvPos,
         std::vector<AggregatedTcpFlow*> _aggregatedFlows)
-        : Flow(flowId, "", srvPos)
+        : Flow(flowId, emptyFqdnId, srvPos)
         , aggregatedFlows(std::move(_aggregatedFlows))
     {
     }
 
-    auto updateFlow(Tins::Packet const& packet, Direction direction,
-        Tins::IP const* ip,
-        Tins::IPv6 const* ipv6,
-        Tins::TCP const& tcp) -> void;
+    auto updateFlow(PacketView const& packet, Direction direction) -> void;
     auto closeConnection() -> void;
     auto timeoutFlow() -> void;
 
-    [[nodiscard]] auto getAggregatedFlows() const { return aggregatedFlows; }
+    [[nodiscard]] auto getAggregatedFlows() const -> std::vector<AggregatedTcpFlow*> const& { return aggregatedFlows; }
     [[nodiscard]] auto getLastPacketTime() const { return lastPacketTime; }
     [[nodiscard]] auto getGap() const { return gap; }
 
 private:
     std::vector<AggregatedTcpFlow*> aggregatedFlows;
-    auto tcpToString(Tins::TCP const& hdr) -> std::string;
-    auto nextSeqnum(Tins::TCP const& tcp, int payloadSize) -> uint32_t;
+    auto tcpToString(PacketView const& packet) -> std::string;
+    auto nextSeqnum(PacketView const& packet, int payloadSize) -> uint32_t;
 
     std::array<uint32_t, 2> seqNum = {};
     std::array<uint32_t, 2> finSeqnum = {};
@@ -0,0 +1,78 @@
+#include "UnknownFqdnCache.hpp"
+
+namespace flowstats {
+
+/**
+ * A side mapped since its failed lookup is no longer unknown
+ */
+auto UnknownFqdnCache::checkSide(UnknownFlow* unknownFlow, Direction ipDir) -> bool
+{
+    if (!unknownFlow->unknown[ipDir]) {
+        return false;
+    }
+    if (!ipToFqdn->isCurrent(unknownFlow->versions[ipDir])) {
+        unknownFlow->unknown[ipDir] = false;
+        return false;
+    }
+    return true;
+}
+
+auto UnknownFqdnCache::isUnknown(FlowId const& flowId, Direction ipDir, time_t now) -> bool
+{
+    auto* unknownFlow = flows.find(flowId);
+    if (unknownFlow == nullptr || !checkSide(unknownFlow, ipDir)) {
+        return false;
+    }
+    unknownFlow->lastPacket = now;
+    return true;
+}
+
+auto UnknownFqdnCache::isUnknown(FlowId const& flowId, time_t now) -> bool
+{
+    auto* unknownFlow = flows.find(flowId);
+    if (unknownFlow == nullptr
+        || !(checkSide(unknownFlow, FROM_CLIENT) || checkSide(unknownFlow, FROM_SERVER))) {
+        return false;
+    }
+    unknownFlow->lastPacket = now;
+    return true;
+}
+
+auto UnknownFqdnCache::addUnknown(FlowId const& flowId, Direction ipDir,
+    MappingVersion version, time_t now) -> void
+{
+    auto* unknownFlow = flows.find(flowId);
+    if (unknownFlow == nullptr) {
+        unknownFlow = flows.emplace(flowId);
+        flowExpiry.schedule(flowId, now + timeoutFlow + 1);
+    }
+    unknownFlow->versions[ipDir] = version;
+    unknownFlow->unknown[ipDir] = true;
+    unknownFlow->lastPacket = now;
+}
+
+/**
+ * Drop the flow if it was idle for too long. Return the next deadline
+ * of the flow, 0 when it was removed.
+ */
+auto UnknownFqdnCache::checkFlowTimeout(FlowId const& flowId, time_t now) -> time_t
+{
+    auto* unknownFlow = flows.find(flowId);
+    if (unknownFlow == nullptr) {
+        return 0;
+    }
+    if (now - unknownFlow->lastPacket > timeoutFlow) {
+        flows.erase(flowId);
+        return 0;
+    }
+    return unknownFlow->lastPacket + timeoutFlow + 1;
+}
+
+auto UnknownFqdnCache::advanceTick(time_t now) -> void
+{
+    flowExpiry.advance(now, [&](FlowId const& flowId) {
+        return checkFlowTimeout(flowId, now);
+    });
+}
+
+} // namespace flowstats
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ExpiryWheel.hpp"
+#include "FlowTable.hpp"
+#include "IpToFqdn.hpp"
+
+namespace flowstats {
+
+/**
+ * Negative cache of the flows whose server ip had no fqdn. Later
+ * packets of these flows are dropped after a single probe instead of
+ * detecting the server and looking up its fqdn again.
+ *
+ * Both ips of a flow are cached separately since the looked up side
+ * may change with the packet. A cached ip is stale once a dns answer
+ * maps it, which is checked with the mapping version taken before the
+ * failed lookup. Flows idle for the flow timeout are dropped.
+ */
+class UnknownFqdnCache {
+public:
+    UnknownFqdnCache(IpToFqdn const* ipToFqdn, int timeoutFlow)
+        : ipToFqdn(ipToFqdn)
+        , timeoutFlow(timeoutFlow) {};
+
+    /**
+     * True when the ip of the side ipDir of the flow had no fqdn and
+     * wasn't mapped since
+     */
+    [[nodiscard]] auto isUnknown(FlowId const& flowId, Direction ipDir, time_t now) -> bool;
+    /**
+     * Same on any side, for collectors looking up a single ip per flow
+     */
+    [[nodiscard]] auto isUnknown(FlowId const& flowId, time_t now) -> bool;
+    auto addUnknown(FlowId const& flowId, Direction ipDir, MappingVersion version, time_t now) -> void;
+    auto advanceTick(time_t now) -> void;
+
+    [[nodiscard]] auto size() const { return flows.size(); }
+
+private:
+    struct UnknownFlow {
+        std::array<MappingVersion, 2> versions = {};
+        std::array<bool, 2> unknown = {};
+        time_t lastPacket = 0;
+    };
+
+    auto checkSide(UnknownFlow* unknownFlow, Direction ipDir) -> bool;
+    auto checkFlowTimeout(FlowId const& flowId, time_t now) -> time_t;
+
+    IpToFqdn const* ipToFqdn;
+    int timeoutFlow;
+    FlowTable<UnknownFlow> flows;
+    ExpiryWheel<FlowId> flowExpiry;
+};
+
+} // namespace flowstats
@@ -0,0 +1,213 @@
+#include "MmapRing.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace flowstats {
+
+auto MmapRing::open(std::string const& iface, std::string const& bpfFilter) -> bool
+{
+    // A zero protocol receives nothing until bind, a socket opened with
+    // ETH_P_ALL would queue unfiltered packets from every interface
+    fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0) {
+        spdlog::error("Could not open packet socket: \"{}\"", strerror(errno));
+        return false;
+    }
+    // Filter is attached before bind sets the protocol so no unfiltered
+    // packet reaches the ring
+    return setupRing()
+        && attachFilter(bpfFilter)
+        && bindInterface(iface)
+        && joinFanout();
+}
+
+auto MmapRing::setupRing() -> bool
+{
+    if (ringConf.blockSize % getpagesize() != 0
+        || ringConf.blockSize % ringConf.frameSize != 0) {
+        spdlog::error("Ring block size {} should be a multiple of the page size {} and frame size {}",
+            ringConf.blockSize, getpagesize(), ringConf.frameSize);
+        return false;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        spdlog::error("Could not set TPACKET_V3: \"{}\"", strerror(errno));
+        return false;
+    }
+
+    tpacket_req3 req = {};
+    req.tp_block_size = ringConf.blockSize;
+    req.tp_block_nr = ringConf.blockCount;
+    req.tp_frame_size = ringConf.frameSize;
+    req.tp_frame_nr = (ringConf.blockSize / ringConf.frameSize) * ringConf.blockCount;
+    req.tp_retire_blk_tov = ringConf.blockTimeout;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        spdlog::error("Could not setup rx ring of {} blocks of {} bytes: \"{}\"",
+            ringConf.blockCount, ringConf.blockSize, strerror(errno));
+        return false;
+    }
+
+    ringSize = size_t(ringConf.blockSize) * ringConf.blockCount;
+    void* mapping = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        spdlog::error("Could not map rx ring: \"{}\"", strerror(errno));
+        ringSize = 0;
+        return false;
+    }
+    ring = static_cast<uint8_t*>(mapping);
+    return true;
+}
+
+auto MmapRing::attachFilter(std::string const& bpfFilter) -> bool
+{
+    if (bpfFilter.empty()) {
+        return true;
+    }
+    // Compile with libpcap, the classic bpf program layout is the same
+    // as the kernel's socket filter
+    pcap_t* dead = pcap_open_dead(DLT_EN10MB, 65535);
+    bpf_program program;
+    if (pcap_compile(dead, &program, bpfFilter.c_str(), 1, PCAP_NETMASK_UNKNOWN) < 0) {
+        spdlog::error("Could not compile bpf filter \"{}\": \"{}\"",
+            bpfFilter, pcap_geterr(dead));
+        pcap_close(dead);
+        return false;
+    }
+    sock_fprog fprog = {};
+    fprog.len = program.bf_len;
+    fprog.filter = reinterpret_cast<sock_filter*>(program.bf_insns);
+    int res = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+    pcap_freecode(&program);
+    pcap_close(dead);
+    if (res < 0) {
+        spdlog::error("Could not attach bpf filter: \"{}\"", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+auto MmapRing::bindInterface(std::string const& iface) -> bool
+{
+    // Frames are decoded and filtered as ethernet, "any" and tun or raw ip
+    // devices deliver other link layers
+    if (!isEthernetInterface(iface)) {
+        spdlog::error("Mmap ring capture needs an ethernet interface, {} is not one", iface);
+        return false;
+    }
+    sockaddr_ll addr = {};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_nametoindex(iface.c_str());
+    packet_mreq mreq = {};
+    mreq.mr_ifindex = addr.sll_ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        spdlog::warn("Could not enable promiscuous mode on {}: \"{}\"",
+            iface, strerror(errno));
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        spdlog::error("Could not bind to {}: \"{}\"", iface, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+auto MmapRing::isEthernetInterface(std::string const& iface) const -> bool
+{
+    ifreq ifr = {};
+    if (iface.size() >= sizeof(ifr.ifr_name)) {
+        return false;
+    }
+    strncpy(ifr.ifr_name, iface.c_str(), sizeof(ifr.ifr_name) - 1);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+        spdlog::error("Unknown interface {}: \"{}\"", iface, strerror(errno));
+        return false;
+    }
+    // Loopback frames carry an ethernet header with null addresses
+    return ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER
+        || ifr.ifr_hwaddr.sa_family == ARPHRD_LOOPBACK;
+}
+
+auto MmapRing::joinFanout() -> bool
+{
+    if (ringConf.fanoutGroup == 0) {
+        return true;
+    }
+    // Hash fanout keeps both directions of a flow on the same socket
+    uint32_t fanoutArg = ringConf.fanoutGroup
+        | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanoutArg, sizeof(fanoutArg)) < 0) {
+        spdlog::error("Could not join fanout group {}: \"{}\"",
+            ringConf.fanoutGroup, strerror(errno));
+        return false;
+    }
+    SPDLOG_INFO("Joined fanout group {}", ringConf.fanoutGroup);
+    return true;
+}
+
+auto MmapRing::nextBlock(int timeoutMs) -> tpacket_block_desc*
+{
+    auto* block = reinterpret_cast<tpacket_block_desc*>(
+        ring + size_t(currentBlock) * ringConf.blockSize);
+    if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+        pollfd pfd = {};
+        pfd.fd = fd;
+        pfd.events = POLLIN | POLLERR;
+        int res = poll(&pfd, 1, timeoutMs);
+        if (res < 0 && errno != EINTR) {
+            spdlog::error("Poll on packet socket failed: \"{}\"", strerror(errno));
+            hasError = true;
+            return nullptr;
+        }
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            return nullptr;
+        }
+    }
+    return block;
+}
+
+auto MmapRing::releaseBlock(tpacket_block_desc* block) -> void
+{
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    currentBlock = (currentBlock + 1) % ringConf.blockCount;
+}
+
+auto MmapRing::getCaptureStatus() -> CaptureStat
+{
+    tpacket_stats_v3 stats = {};
+    socklen_t len = sizeof(stats);
+    if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+        totalRecv += stats.tp_packets;
+        totalDrop += stats.tp_drops;
+    }
+    pcap_stat pcapStat = {};
+    pcapStat.ps_recv = totalRecv;
+    pcapStat.ps_drop = totalDrop;
+    return CaptureStat(pcapStat);
+}
+
+MmapRing::~MmapRing()
+{
+    if (ring != nullptr) {
+        munmap(ring, ringSize);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+} // namespace flowstats
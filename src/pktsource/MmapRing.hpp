@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Configuration.hpp"
+#include "Stats.hpp"
+#include <linux/if_packet.h>
+#include <pcap/pcap.h>
+#include <string>
+
+namespace flowstats {
+
+/**
+ * AF_PACKET socket with a TPACKET_V3 rx ring. The kernel fills whole
+ * blocks of packets in a shared mapping, packets are read in place
+ * without any copy or syscall per packet.
+ */
+class MmapRing {
+public:
+    explicit MmapRing(MmapRingConfiguration const& ringConf)
+        : ringConf(ringConf) {};
+    virtual ~MmapRing();
+
+    [[nodiscard]] auto open(std::string const& iface, std::string const& bpfFilter) -> bool;
+    [[nodiscard]] auto getCaptureStatus() -> CaptureStat;
+
+    /**
+     * Wait up to timeoutMs for the next block and call fun on each
+     * of its packets. Return false on socket error.
+     */
+    template <typename Fun>
+    auto readBlock(int timeoutMs, Fun fun) -> bool
+    {
+        auto* block = nextBlock(timeoutMs);
+        if (block == nullptr) {
+            return !hasError;
+        }
+        auto numPkts = block->hdr.bh1.num_pkts;
+        auto const* pkt = reinterpret_cast<tpacket3_hdr const*>(
+            reinterpret_cast<uint8_t const*>(block) + block->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < numPkts; ++i) {
+            pcap_pkthdr header;
+            header.ts.tv_sec = pkt->tp_sec;
+            header.ts.tv_usec = pkt->tp_nsec / 1000;
+            header.caplen = pkt->tp_snaplen;
+            header.len = pkt->tp_len;
+            fun(header, reinterpret_cast<uint8_t const*>(pkt) + pkt->tp_mac);
+            pkt = reinterpret_cast<tpacket3_hdr const*>(
+                reinterpret_cast<uint8_t const*>(pkt) + pkt->tp_next_offset);
+        }
+        releaseBlock(block);
+        return true;
+    }
+
+private:
+    auto setupRing() -> bool;
+    auto attachFilter(std::string const& bpfFilter) -> bool;
+    auto bindInterface(std::string const& iface) -> bool;
+    auto isEthernetInterface(std::string const& iface) const -> bool;
+    auto joinFanout() -> bool;
+
+    auto nextBlock(int timeoutMs) -> tpacket_block_desc*;
+    auto releaseBlock(tpacket_block_desc* block) -> void;
+
+    MmapRingConfiguration ringConf;
+    int fd = -1;
+    uint8_t* ring = nullptr;
+    size_t ringSize = 0;
+    uint32_t currentBlock = 0;
+    bool hasError = false;
+
+    // PACKET_STATISTICS resets counters on each read
+    unsigned int totalRecv = 0;
+    unsigned int totalDrop = 0;
+};
+
+} // namespace flowstats
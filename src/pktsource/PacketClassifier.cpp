@@ -0,0 +1,140 @@
+#include "PacketClassifier.hpp"
+#include "DnsStatsCollector.hpp"
+#include "InternalStats.hpp"
+#include "SslProto.hpp"
+#include <spdlog/spdlog.h>
+#include <tins/tcp.h>
+
+namespace flowstats {
+
+auto PacketClassifier::classify(PacketView const& packet, FlowId const& flowId) -> ProtocolMask
+{
+    ProtocolMask mask = 0;
+    if (DnsStatsCollector::isPossibleDns(packet)) {
+        mask |= protocolBit(DNS);
+    }
+    if (packet.transport == +Transport::TCP) {
+        mask |= protocolBit(TCP);
+        if (isSslFlow(packet, flowId)) {
+            mask |= protocolBit(SSL);
+        }
+    }
+    return mask;
+}
+
+auto PacketClassifier::isSslFlow(PacketView const& packet, FlowId const& flowId) -> bool
+{
+    bool isSyn = packet.hasFlags(Tins::TCP::SYN);
+    if (packet.payloadSize == 0 && !isSyn) {
+        return false;
+    }
+
+    auto* flowClass = flows.find(flowId);
+    if (flowClass == nullptr) {
+        if (packet.payloadSize == 0) {
+            return false;
+        }
+        flowClass = flows.emplace(flowId);
+        flowExpiry.schedule(flowId, packet.ts.tv_sec + classifiedFlowTimeout + 1);
+    } else if (isSyn) {
+        // New connection on the ports of a cached flow
+        *flowClass = FlowClass();
+    }
+    flowClass->lastPacket = packet.ts.tv_sec;
+    if (packet.payloadSize == 0) {
+        return false;
+    }
+
+    if (flowClass->sslState == SslState::Probing) {
+        auto cursor = Cursor(packet.payload, packet.payloadSize);
+        if (checkSslRecordStart(&cursor)) {
+            flowClass->sslState = SslState::Ssl;
+        } else if (++flowClass->probedSegments >= sslProbeSegments) {
+            SPDLOG_DEBUG("Flow {} is not ssl", flowId.toString());
+            flowClass->sslState = SslState::NotSsl;
+        }
+    } else if (flowClass->sslState == SslState::Ssl && packet.getDirection() == FROM_SERVER) {
+        // The connection time is measured on this segment, later ones
+        // skip the ssl collector
+        auto cursor = Cursor(packet.payload, packet.payloadSize);
+        if (checkSslChangeCipherSpec(&cursor)) {
+            SPDLOG_DEBUG("Flow {} ssl handshake done", flowId.toString());
+            flowClass->sslState = SslState::SslDone;
+            return true;
+        }
+    }
+    return flowClass->sslState == SslState::Ssl;
+}
+
+/**
+ * Drop the flow if it was idle for too long. Return the next deadline
+ * of the flow, 0 when it was removed.
+ */
+auto PacketClassifier::checkFlowTimeout(FlowId const& flowId, time_t now) -> time_t
+{
+    auto* flowClass = flows.find(flowId);
+    if (flowClass == nullptr) {
+        return 0;
+    }
+    if (now - flowClass->lastPacket > classifiedFlowTimeout) {
+        flows.erase(flowId);
+        return 0;
+    }
+    return flowClass->lastPacket + classifiedFlowTimeout + 1;
+}
+
+auto PacketClassifier::advanceTick(time_t now) -> void
+{
+    flowExpiry.advance(now, [&](FlowId const& flowId) {
+        return checkFlowTimeout(flowId, now);
+    });
+}
+
+PacketDispatcher::PacketDispatcher(std::vector<Collector*> const& collectors)
+{
+    dispatchList.reserve(collectors.size());
+    for (auto* collector : collectors) {
+        dispatchList.push_back({ collector, collector->getProtocol() });
+    }
+}
+
+auto PacketDispatcher::dispatch(PacketView const& packet, FlowId const& flowId) -> void
+{
+    // Collectors only act once per second, ticks in between are skipped
+    if (packet.ts.tv_sec != lastTick) {
+        advanceTick(packet.ts);
+    }
+    processPacket(packet, flowId);
+}
+
+auto PacketDispatcher::advanceTick(timeval now) -> void
+{
+    lastTick = now.tv_sec;
+    classifier.advanceTick(now.tv_sec);
+    for (auto const& entry : dispatchList) {
+        StageTimer timer(Stage::AdvanceTick, entry.protocol, true);
+        entry.collector->advanceTick(now);
+    }
+}
+
+auto PacketDispatcher::processPacket(PacketView const& packet, FlowId const& flowId) -> void
+{
+    ProtocolMask mask;
+    {
+        StageTimer timer(Stage::Classify, pipelineComponent);
+        mask = classifier.classify(packet, flowId);
+    }
+    for (auto const& entry : dispatchList) {
+        if ((mask & protocolBit(entry.protocol)) == 0) {
+            continue;
+        }
+        try {
+            StageTimer timer(Stage::ProcessPacket, entry.protocol);
+            entry.collector->processPacket(packet, flowId);
+        } catch (const Tins::malformed_packet&) {
+            SPDLOG_INFO("Malformed packet: {}", flowId.toString());
+        }
+    }
+}
+
+} // namespace flowstats
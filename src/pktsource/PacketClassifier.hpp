@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Collector.hpp"
+#include "ExpiryWheel.hpp"
+#include "FlowTable.hpp"
+#include "PacketView.hpp"
+
+namespace flowstats {
+
+/**
+ * One bit per CollectorProtocol, set when the collectors of this
+ * protocol have to see the packet
+ */
+using ProtocolMask = uint8_t;
+
+inline auto protocolBit(CollectorProtocol protocol) -> ProtocolMask
+{
+    return ProtocolMask(1 << protocol);
+}
+
+/**
+ * Payload segments of a flow checked for a tls record header before
+ * it is classified as not tls. Captures started mid stream may miss the
+ * handshake and only see record headers on later segments.
+ */
+uint8_t const sslProbeSegments = 8;
+
+/**
+ * Seconds a classified flow stays cached without packets
+ */
+time_t const classifiedFlowTimeout = 60;
+
+/**
+ * Decide once per packet which collectors it concerns. Dns is
+ * recognised on its ports and every tcp packet goes to the tcp
+ * collector. Tls is decided per flow on the record headers at the start
+ * of its first payload segments and cached, segments of flows known not
+ * to be tls are never parsed again. Tls flows are demoted once the
+ * server change cipher spec completing their handshake was dispatched,
+ * the ssl collector has nothing left to measure on them. Cached flows
+ * are dropped when idle and reset when a syn reuses their ports.
+ */
+class PacketClassifier {
+public:
+    [[nodiscard]] auto classify(PacketView const& packet, FlowId const& flowId) -> ProtocolMask;
+    auto advanceTick(time_t now) -> void;
+
+    [[nodiscard]] auto getClassifiedFlows() const { return flows.size(); }
+
+private:
+    enum class SslState : uint8_t {
+        Probing,
+        Ssl,
+        NotSsl,
+        // Handshake done, the encrypted traffic isn't dispatched anymore
+        SslDone,
+    };
+
+    struct FlowClass {
+        SslState sslState = SslState::Probing;
+        uint8_t probedSegments = 0;
+        time_t lastPacket = 0;
+    };
+
+    [[nodiscard]] auto isSslFlow(PacketView const& packet, FlowId const& flowId) -> bool;
+    auto checkFlowTimeout(FlowId const& flowId, time_t now) -> time_t;
+
+    FlowTable<FlowClass> flows;
+    ExpiryWheel<FlowId> flowExpiry;
+};
+
+/**
+ * Feed the collectors of a capture worker with the packets classified
+ * for their protocol. The classifier cache is owned by the dispatcher,
+ * each worker has its own.
+ */
+class PacketDispatcher {
+public:
+    explicit PacketDispatcher(std::vector<Collector*> const& collectors);
+
+    /**
+     * Advance the tick on a new second and process the packet
+     */
+    auto dispatch(PacketView const& packet, FlowId const& flowId) -> void;
+    auto advanceTick(timeval now) -> void;
+    /**
+     * Hand the packet to the collectors of the protocols it was
+     * classified for, in the collectors order
+     */
+    auto processPacket(PacketView const& packet, FlowId const& flowId) -> void;
+
+    [[nodiscard]] auto getClassifier() const -> PacketClassifier const& { return classifier; }
+
+private:
+    struct DispatchEntry {
+        Collector* collector;
+        CollectorProtocol protocol;
+    };
+
+    std::vector<DispatchEntry> dispatchList;
+    PacketClassifier classifier;
+    time_t lastTick = 0;
+};
+
+} // namespace flowstats
@@ -0,0 +1,70 @@
+#include "PacketRing.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace flowstats {
+
+PacketRing::PacketRing(size_t capacityBytes)
+{
+    capacity = 4096;
+    while (capacity < capacityBytes) {
+        capacity *= 2;
+    }
+    mask = capacity - 1;
+    buffer.reset(new uint8_t[capacity]);
+}
+
+auto PacketRing::push(pcap_pkthdr const& header, uint8_t const* data) -> bool
+{
+    // Records stay 8 bytes aligned so a wrap marker always fits
+    size_t recordSize = (sizeof(RecordHeader) + header.caplen + 7) & ~size_t(7);
+    uint64_t currentHead = head.load(std::memory_order_relaxed);
+    size_t offset = currentHead & mask;
+    size_t contiguous = capacity - offset;
+    size_t needed = recordSize <= contiguous ? recordSize : contiguous + recordSize;
+
+    if (currentHead + needed - cachedTail > capacity) {
+        cachedTail = tail.load(std::memory_order_acquire);
+        if (currentHead + needed - cachedTail > capacity) {
+            droppedPackets.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    if (recordSize > contiguous) {
+        reinterpret_cast<RecordHeader*>(&buffer[offset])->size = wrapMarker;
+        currentHead += contiguous;
+        offset = 0;
+    }
+    auto* record = reinterpret_cast<RecordHeader*>(&buffer[offset]);
+    record->size = recordSize;
+    record->caplen = header.caplen;
+    record->len = header.len;
+    record->tvSec = header.ts.tv_sec;
+    record->tvUsec = header.ts.tv_usec;
+    memcpy(&buffer[offset + sizeof(RecordHeader)], data, header.caplen);
+    currentHead += recordSize;
+    head.store(currentHead, std::memory_order_release);
+
+    // The cached tail lags behind the consumer, only a fresh one gives
+    // the real occupancy
+    size_t used = currentHead - tail.load(std::memory_order_acquire);
+    if (used > highWater.load(std::memory_order_relaxed)) {
+        highWater.store(used, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+auto PacketRing::takeHighWater() -> size_t
+{
+    return highWater.exchange(0, std::memory_order_relaxed);
+}
+
+auto PacketRing::getUsedBytes() const -> size_t
+{
+    uint64_t currentTail = tail.load(std::memory_order_acquire);
+    uint64_t currentHead = head.load(std::memory_order_acquire);
+    return currentHead > currentTail ? currentHead - currentTail : 0;
+}
+
+} // namespace flowstats
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <pcap/pcap.h>
+
+namespace flowstats {
+
+/**
+ * Preallocated single producer, single consumer ring of captured
+ * frames. Frames are copied with their pcap header in variable sized
+ * records, a record which doesn't fit before the end of the buffer is
+ * preceded by a wrap marker and written at its start.
+ *
+ * The producer never blocks: a frame which doesn't fit is dropped and
+ * counted. The consumer releases the space of a drained batch once all
+ * its frames were processed.
+ */
+class PacketRing {
+public:
+    explicit PacketRing(size_t capacityBytes);
+    PacketRing(PacketRing const&) = delete;
+    auto operator=(PacketRing const&) -> PacketRing& = delete;
+    virtual ~PacketRing() = default;
+
+    /**
+     * Copy a frame in the ring, return false when it was dropped
+     */
+    auto push(pcap_pkthdr const& header, uint8_t const* data) -> bool;
+
+    /**
+     * Call fun on up to maxPackets frames, return the number of frames
+     * processed
+     */
+    template <typename Fun>
+    auto drain(size_t maxPackets, Fun fun) -> size_t
+    {
+        uint64_t currentTail = tail.load(std::memory_order_relaxed);
+        uint64_t currentHead = head.load(std::memory_order_acquire);
+        size_t processed = 0;
+        while (currentTail != currentHead && processed < maxPackets) {
+            size_t offset = currentTail & mask;
+            auto const* record = reinterpret_cast<RecordHeader const*>(&buffer[offset]);
+            if (record->size == wrapMarker) {
+                currentTail += capacity - offset;
+                continue;
+            }
+            pcap_pkthdr header = {};
+            header.ts.tv_sec = record->tvSec;
+            header.ts.tv_usec = record->tvUsec;
+            header.caplen = record->caplen;
+            header.len = record->len;
+            fun(header, &buffer[offset + sizeof(RecordHeader)]);
+            currentTail += record->size;
+            processed++;
+        }
+        tail.store(currentTail, std::memory_order_release);
+        return processed;
+    }
+
+    [[nodiscard]] auto getCapacity() const { return capacity; }
+    [[nodiscard]] auto getUsedBytes() const -> size_t;
+    [[nodiscard]] auto getHighWater() const -> size_t { return highWater.load(std::memory_order_relaxed); }
+    /**
+     * Return the highest occupancy since the last call and start a new
+     * interval
+     */
+    auto takeHighWater() -> size_t;
+    [[nodiscard]] auto getDroppedPackets() const -> uint64_t { return droppedPackets.load(std::memory_order_relaxed); }
+
+private:
+    static uint32_t const wrapMarker = 0;
+
+    struct RecordHeader {
+        // Size of the record with its padding, wrapMarker at a wrap
+        uint32_t size;
+        uint32_t caplen;
+        uint32_t len;
+        uint32_t tvUsec;
+        int64_t tvSec;
+    };
+
+    size_t capacity;
+    size_t mask;
+    std::unique_ptr<uint8_t[]> buffer;
+
+    alignas(64) std::atomic<uint64_t> head = 0;
+    // Producer side copy of the tail, refreshed when the ring looks full
+    uint64_t cachedTail = 0;
+    std::atomic<size_t> highWater = 0;
+    std::atomic<uint64_t> droppedPackets = 0;
+
+    alignas(64) std::atomic<uint64_t> tail = 0;
+};
+
+} // namespace flowstats
@@ -0,0 +1,244 @@
+#include "PcapAnalyzer.hpp"
+#include "DnsStatsCollector.hpp"
+#include "InternalStats.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace flowstats {
+
+size_t const offlineBatchSize = 512;
+/**
+ * Maximum number of batches waiting for a worker. Past this, the
+ * reader waits for the worker, no frame is dropped offline.
+ */
+size_t const maxQueuedBatches = 64;
+
+/**
+ * Decoded frame handed to a worker. Frames stay mapped, only payloads
+ * decoded by libtins are copied and the view is pointed to the copy
+ * before dispatch.
+ */
+struct QueuedPacket {
+    PacketView view;
+    FlowId flowId;
+    std::vector<uint8_t> payload;
+};
+
+struct OfflineItem {
+    QueuedPacket packet;
+    // Ticks are sent to every worker and carry no frame
+    bool isTick = false;
+};
+using OfflineBatch = std::vector<OfflineItem>;
+
+class PcapAnalyzer::OfflineWorker {
+public:
+    explicit OfflineWorker(std::vector<Collector*> const& collectors)
+        : dispatcher(collectors)
+    {
+        pending.reserve(offlineBatchSize);
+        workerThread = std::thread(&OfflineWorker::workerLoop, this);
+    }
+
+    ~OfflineWorker()
+    {
+        waitIdle();
+        {
+            const std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        workerThread.join();
+    }
+
+    auto add(OfflineItem&& item) -> void
+    {
+        pending.push_back(std::move(item));
+        if (pending.size() >= offlineBatchSize) {
+            flush();
+        }
+    }
+
+    /**
+     * Hand the pending batch to the worker, wait for room in its queue
+     */
+    auto flush() -> void
+    {
+        if (pending.empty()) {
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return queue.size() < maxQueuedBatches; });
+            queue.push_back(std::move(pending));
+        }
+        queueCondition.notify_all();
+        pending = OfflineBatch();
+        pending.reserve(offlineBatchSize);
+    }
+
+    auto waitIdle() -> void
+    {
+        flush();
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueCondition.wait(lock, [this] { return queue.empty() && !busy; });
+    }
+
+    /**
+     * Only used by the reader while the worker is idle
+     */
+    [[nodiscard]] auto getDispatcher() -> PacketDispatcher* { return &dispatcher; }
+
+private:
+    auto workerLoop() -> void
+    {
+        OfflineBatch batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                batch = std::move(queue.front());
+                queue.pop_front();
+                busy = true;
+            }
+            queueCondition.notify_all();
+            for (auto& item : batch) {
+                if (item.isTick) {
+                    dispatcher.advanceTick(item.packet.view.ts);
+                    continue;
+                }
+                if (!item.packet.payload.empty()) {
+                    item.packet.view.payload = item.packet.payload.data();
+                }
+                dispatcher.processPacket(item.packet.view, item.packet.flowId);
+            }
+            batch.clear();
+            {
+                const std::lock_guard<std::mutex> lock(queueMutex);
+                busy = false;
+            }
+            queueCondition.notify_all();
+        }
+    }
+
+    PacketDispatcher dispatcher;
+    std::thread workerThread;
+    // Only touched by the reader
+    OfflineBatch pending;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<OfflineBatch> queue;
+    bool busy = false;
+    bool stopping = false;
+};
+
+PcapAnalyzer::PcapAnalyzer(std::vector<Collector*> const& collectors, int numberWorkers)
+    : collectors(collectors)
+    , dispatcher(collectors)
+{
+    if (numberWorkers <= 1) {
+        return;
+    }
+    for (auto* collector : collectors) {
+        if (auto* dns = dynamic_cast<DnsStatsCollector*>(collector)) {
+            dnsCollector = dns;
+        }
+    }
+    for (int i = 0; i < numberWorkers; ++i) {
+        std::vector<Collector*> workerCollectors;
+        workerCollectors.reserve(collectors.size());
+        for (auto* collector : collectors) {
+            workerCollectors.push_back(collector->getShard(i));
+        }
+        workers.push_back(new OfflineWorker(workerCollectors));
+    }
+}
+
+auto PcapAnalyzer::waitWorkers() -> void
+{
+    for (auto* worker : workers) {
+        worker->waitIdle();
+    }
+}
+
+auto PcapAnalyzer::analyze(PcapFileReader* reader,
+    std::function<void(timeval)> const& onSecond) -> uint64_t
+{
+    PacketDecoder decoder(reader->getLinkType());
+    uint64_t numberPackets = 0;
+    time_t lastTick = 0;
+    pcap_pkthdr header;
+    uint8_t const* data;
+    while (reader->next(&header, &data)) {
+        if (header.ts.tv_sec == 0) {
+            break;
+        }
+        numberPackets++;
+        internalStats().addPackets(1);
+        PacketView view;
+        {
+            StageTimer timer(Stage::Decode, pipelineComponent);
+            if (!decoder.decode(header, data, &view)) {
+                continue;
+            }
+        }
+
+        auto flowId = view.getFlowId();
+        bool newSecond = view.ts.tv_sec > lastTick;
+        if (newSecond) {
+            lastTick = view.ts.tv_sec;
+        }
+        if (workers.empty()) {
+            dispatcher.dispatch(view, flowId);
+            if (newSecond) {
+                onSecond(header.ts);
+            }
+            continue;
+        }
+
+        // Timeouts of every worker fire on the same frames as with a
+        // single thread
+        if (newSecond) {
+            for (auto* worker : workers) {
+                worker->add({ { view, FlowId(), {} }, true });
+            }
+        }
+
+        // Both directions of a flow are handled by the same worker
+        auto* worker = workers[flowId.hash() % workers.size()];
+        if (dnsCollector != nullptr && dnsCollector->mayUpdateIpToFqdn(view)) {
+            waitWorkers();
+            worker->getDispatcher()->processPacket(view, flowId);
+        } else {
+            // Frames stay mapped, only payloads decoded by libtins
+            // need a copy
+            QueuedPacket packet { view, flowId, {} };
+            if (view.payloadSize > 0 && !reader->contains(view.payload)) {
+                packet.payload.assign(view.payload, view.payload + view.payloadSize);
+            }
+            worker->add({ std::move(packet), false });
+        }
+        // The callback reads the collectors of every worker
+        if (newSecond) {
+            waitWorkers();
+            onSecond(header.ts);
+        }
+    }
+    waitWorkers();
+    return numberPackets;
+}
+
+PcapAnalyzer::~PcapAnalyzer()
+{
+    for (auto* worker : workers) {
+        delete worker;
+    }
+}
+
+} // namespace flowstats
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Collector.hpp"
+#include "PacketClassifier.hpp"
+#include "PcapFileReader.hpp"
+#include <functional>
+#include <sys/time.h>
+
+namespace flowstats {
+
+class DnsStatsCollector;
+
+/**
+ * Offline analysis of a capture file. The calling thread reads and
+ * decodes frames in place and dispatches them by flow hash to workers,
+ * each feeding its own shard of every collector. Shards are merged in
+ * order when snapshots are published.
+ *
+ * Results are the same as with a single thread: every worker sees the
+ * same ticks, and dns responses which change the ip to fqdn mapping
+ * read by all workers are processed once every frame read before them
+ * was.
+ */
+class PcapAnalyzer {
+public:
+    PcapAnalyzer(std::vector<Collector*> const& collectors, int numberWorkers);
+    PcapAnalyzer(PcapAnalyzer const&) = delete;
+    auto operator=(PcapAnalyzer const&) -> PcapAnalyzer& = delete;
+    virtual ~PcapAnalyzer();
+
+    /**
+     * Process every frame of the reader and wait for the workers.
+     * onSecond is called with the timestamp of the first decoded frame
+     * of each second, once every frame up to it was processed. Return
+     * the number of frames read.
+     */
+    auto analyze(PcapFileReader* reader,
+        std::function<void(timeval)> const& onSecond) -> uint64_t;
+
+private:
+    class OfflineWorker;
+
+    auto waitWorkers() -> void;
+
+    std::vector<Collector*> const& collectors;
+    // Checks which dns responses need every worker to be idle
+    DnsStatsCollector const* dnsCollector = nullptr;
+    // Only used without workers
+    PacketDispatcher dispatcher;
+    std::vector<OfflineWorker*> workers;
+};
+
+} // namespace flowstats
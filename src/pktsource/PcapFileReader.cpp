@@ -0,0 +1,391 @@
+#include "PcapFileReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace flowstats {
+
+uint32_t const pcapMagic = 0xa1b2c3d4;
+uint32_t const pcapNanoMagic = 0xa1b23c4d;
+size_t const pcapFileHeaderSize = 24;
+size_t const pcapRecordHeaderSize = 16;
+
+uint32_t const pcapngSectionHeader = 0x0a0d0d0a;
+uint32_t const pcapngByteOrderMagic = 0x1a2b3c4d;
+uint32_t const pcapngInterface = 1;
+uint32_t const pcapngPacket = 2;
+uint32_t const pcapngSimplePacket = 3;
+uint32_t const pcapngEnhancedPacket = 6;
+uint16_t const pcapngOptionEnd = 0;
+uint16_t const pcapngOptionTsResol = 9;
+uint64_t const usecPerSecond = 1000000;
+/**
+ * Larger records are treated as corrupted instead of being buffered
+ */
+uint32_t const maxRecordSize = 16 << 20;
+
+/**
+ * Link types stored in files mostly share their value with the DLT
+ * ones, raw ip is the exception
+ */
+static auto linkTypeToDlt(uint32_t fileLinkType) -> int
+{
+    uint32_t const linkTypeRaw = 101;
+    fileLinkType &= 0x0fffffff;
+    if (fileLinkType == linkTypeRaw) {
+        return DLT_RAW;
+    }
+    return int(fileLinkType);
+}
+
+static auto load32(uint8_t const* ptr) -> uint32_t
+{
+    uint32_t res;
+    memcpy(&res, ptr, sizeof(res));
+    return res;
+}
+
+auto PcapFileReader::read16(uint8_t const* ptr) const -> uint16_t
+{
+    uint16_t res;
+    memcpy(&res, ptr, sizeof(res));
+    return swapped ? __builtin_bswap16(res) : res;
+}
+
+auto PcapFileReader::read32(uint8_t const* ptr) const -> uint32_t
+{
+    uint32_t res = load32(ptr);
+    return swapped ? __builtin_bswap32(res) : res;
+}
+
+auto PcapFileReader::open(std::string const& bpfFilter) -> bool
+{
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        spdlog::error("Could not open {}: \"{}\"", fileName, strerror(errno));
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || fileStat.st_size == 0) {
+        spdlog::error("Could not read {}: empty or unreadable file", fileName);
+        close(fd);
+        return false;
+    }
+    size = size_t(fileStat.st_size);
+    void* res = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (res == MAP_FAILED) {
+        spdlog::error("Could not map {}: \"{}\"", fileName, strerror(errno));
+        size = 0;
+        return false;
+    }
+    mapping = static_cast<uint8_t const*>(res);
+    madvise(res, size, MADV_SEQUENTIAL);
+
+    auto compression = detectCompression(mapping, size);
+    if (compression != Compression::None) {
+        SPDLOG_INFO("Decompressing {} while reading it", fileName);
+        decompressor = new StreamDecompressor(mapping, size, compression, chunkSize);
+    }
+    return parseFileHeader() && compileFilter(bpfFilter);
+}
+
+auto PcapFileReader::peek(size_t at, size_t bytes) -> uint8_t const*
+{
+    if (decompressor == nullptr) {
+        if (at + bytes > size - position) {
+            return nullptr;
+        }
+        return mapping + position + at;
+    }
+    while (windowEnd - windowStart < at + bytes) {
+        if (!fillWindow()) {
+            return nullptr;
+        }
+    }
+    return window.data() + windowStart + at;
+}
+
+auto PcapFileReader::consume(size_t bytes) -> void
+{
+    position += bytes;
+    if (decompressor != nullptr) {
+        windowStart += bytes;
+    }
+}
+
+/**
+ * Append the next decompressed chunk after the unconsumed bytes, which
+ * are moved to the start of the window
+ */
+auto PcapFileReader::fillWindow() -> bool
+{
+    if (!decompressor->read(&chunk)) {
+        return false;
+    }
+    size_t pending = windowEnd - windowStart;
+    if (windowStart > 0) {
+        memmove(window.data(), window.data() + windowStart, pending);
+        windowStart = 0;
+        windowEnd = pending;
+    }
+    if (window.size() < pending + chunk.size) {
+        window.resize(pending + chunk.size);
+    }
+    memcpy(window.data() + windowEnd, chunk.data.get(), chunk.size);
+    windowEnd += chunk.size;
+    return true;
+}
+
+auto PcapFileReader::parseFileHeader() -> bool
+{
+    uint8_t const* fileHeader = peek(0, pcapFileHeaderSize);
+    if (fileHeader == nullptr) {
+        spdlog::error("{} is too small to be a capture file", fileName);
+        return false;
+    }
+    uint32_t magic = load32(fileHeader);
+    if (magic == pcapMagic || magic == pcapNanoMagic
+        || magic == __builtin_bswap32(pcapMagic)
+        || magic == __builtin_bswap32(pcapNanoMagic)) {
+        swapped = magic != pcapMagic && magic != pcapNanoMagic;
+        nanoSeconds = magic == pcapNanoMagic || magic == __builtin_bswap32(pcapNanoMagic);
+        linkType = linkTypeToDlt(read32(fileHeader + 20));
+        consume(pcapFileHeaderSize);
+        return true;
+    }
+    if (magic != pcapngSectionHeader) {
+        spdlog::error("{} is neither a pcap nor a pcapng file", fileName);
+        return false;
+    }
+
+    // The filter is compiled for the link type of the first interface,
+    // which is described before any packet
+    isPcapng = true;
+    size_t blockOffset = 0;
+    while (linkType < 0) {
+        uint8_t const* block = peek(blockOffset, 12);
+        if (block == nullptr) {
+            break;
+        }
+        uint32_t type = load32(block);
+        if (type == pcapngSectionHeader) {
+            swapped = load32(block + 8) != pcapngByteOrderMagic;
+        } else {
+            type = read32(block);
+        }
+        uint32_t length = read32(block + 4);
+        if (type == pcapngInterface && length >= 20) {
+            linkType = linkTypeToDlt(read16(block + 8));
+        }
+        if (length < 12 || length > maxRecordSize) {
+            break;
+        }
+        blockOffset += length;
+    }
+    if (linkType < 0) {
+        spdlog::error("No interface description in {}", fileName);
+        return false;
+    }
+    return true;
+}
+
+auto PcapFileReader::compileFilter(std::string const& bpfFilter) -> bool
+{
+    if (bpfFilter.empty()) {
+        return true;
+    }
+    filterHandle = pcap_open_dead(linkType, 65535);
+    if (pcap_compile(filterHandle, &filter, bpfFilter.c_str(), 1, PCAP_NETMASK_UNKNOWN) < 0) {
+        spdlog::error("Could not compile bpf filter \"{}\": \"{}\"",
+            bpfFilter, pcap_geterr(filterHandle));
+        pcap_close(filterHandle);
+        filterHandle = nullptr;
+        return false;
+    }
+    return true;
+}
+
+auto PcapFileReader::next(pcap_pkthdr* header, uint8_t const** data) -> bool
+{
+    while (isPcapng ? nextPcapngRecord(header, data) : nextPcapRecord(header, data)) {
+        if (filterHandle == nullptr || pcap_offline_filter(&filter, header, *data) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto PcapFileReader::nextPcapRecord(pcap_pkthdr* header, uint8_t const** data) -> bool
+{
+    uint8_t const* record = peek(0, pcapRecordHeaderSize);
+    if (record == nullptr) {
+        return false;
+    }
+    uint32_t capLen = read32(record + 8);
+    if (capLen > maxRecordSize) {
+        spdlog::warn("Invalid record of {} bytes at offset {} of {}", capLen, position, fileName);
+        return false;
+    }
+    record = peek(0, pcapRecordHeaderSize + capLen);
+    if (record == nullptr) {
+        spdlog::warn("Truncated record at offset {} of {}", position, fileName);
+        return false;
+    }
+    header->ts.tv_sec = read32(record);
+    header->ts.tv_usec = nanoSeconds ? read32(record + 4) / 1000 : read32(record + 4);
+    header->caplen = capLen;
+    header->len = read32(record + 12);
+    *data = record + pcapRecordHeaderSize;
+    consume(pcapRecordHeaderSize + capLen);
+    return true;
+}
+
+/**
+ * Parse blocks up to the next packet of an interface with the file
+ * link type. Section and interface blocks update the reader state,
+ * other blocks are skipped.
+ */
+auto PcapFileReader::nextPcapngRecord(pcap_pkthdr* header, uint8_t const** data) -> bool
+{
+    while (true) {
+        uint8_t const* block = peek(0, 12);
+        if (block == nullptr) {
+            return false;
+        }
+        // The section header type reads the same in both byte orders
+        uint32_t type = load32(block);
+        if (type == pcapngSectionHeader) {
+            uint32_t byteOrder = load32(block + 8);
+            if (byteOrder != pcapngByteOrderMagic && byteOrder != __builtin_bswap32(pcapngByteOrderMagic)) {
+                spdlog::warn("Invalid section header at offset {} of {}", position, fileName);
+                return false;
+            }
+            swapped = byteOrder != pcapngByteOrderMagic;
+            interfaces.clear();
+        } else {
+            type = read32(block);
+        }
+
+        uint32_t length = read32(block + 4);
+        if (length < 12 || length % 4 != 0 || length > maxRecordSize) {
+            spdlog::warn("Invalid block of {} bytes at offset {} of {}", length, position, fileName);
+            return false;
+        }
+        block = peek(0, length);
+        if (block == nullptr) {
+            spdlog::warn("Truncated block at offset {} of {}", position, fileName);
+            return false;
+        }
+        uint8_t const* body = block + 8;
+        size_t bodySize = length - 12;
+        consume(length);
+
+        if (type == pcapngInterface) {
+            parseInterface(body, bodySize);
+            continue;
+        }
+
+        uint32_t interfaceId;
+        uint64_t ts = 0;
+        uint32_t capLen;
+        uint32_t len;
+        size_t dataOffset;
+        if (type == pcapngEnhancedPacket && bodySize >= 20) {
+            interfaceId = read32(body);
+            ts = (uint64_t(read32(body + 4)) << 32) | read32(body + 8);
+            capLen = read32(body + 12);
+            len = read32(body + 16);
+            dataOffset = 20;
+        } else if (type == pcapngPacket && bodySize >= 20) {
+            interfaceId = read16(body);
+            ts = (uint64_t(read32(body + 4)) << 32) | read32(body + 8);
+            capLen = read32(body + 12);
+            len = read32(body + 16);
+            dataOffset = 20;
+        } else if (type == pcapngSimplePacket && bodySize >= 4 && !interfaces.empty()) {
+            // Simple packets have no timestamp nor captured length
+            interfaceId = 0;
+            len = read32(body);
+            capLen = std::min<size_t>(len, bodySize - 4);
+            if (interfaces[0].snapLen != 0) {
+                capLen = std::min(capLen, interfaces[0].snapLen);
+            }
+            dataOffset = 4;
+        } else {
+            continue;
+        }
+
+        if (interfaceId >= interfaces.size() || capLen > bodySize - dataOffset) {
+            SPDLOG_DEBUG("Skipping invalid packet block at offset {}", position - length);
+            continue;
+        }
+        auto const& iface = interfaces[interfaceId];
+        if (iface.linkType != linkType) {
+            continue;
+        }
+        setTimestamp(iface, ts, header);
+        header->caplen = capLen;
+        header->len = len;
+        *data = body + dataOffset;
+        return true;
+    }
+}
+
+auto PcapFileReader::parseInterface(uint8_t const* body, size_t bodySize) -> void
+{
+    if (bodySize < 8) {
+        return;
+    }
+    Interface iface = { linkTypeToDlt(read16(body)), read32(body + 4), usecPerSecond };
+    uint8_t const* option = body + 8;
+    uint8_t const* end = body + bodySize;
+    while (option + 4 <= end) {
+        uint16_t code = read16(option);
+        uint16_t optionLen = read16(option + 2);
+        if (code == pcapngOptionEnd) {
+            break;
+        }
+        if (code == pcapngOptionTsResol && optionLen >= 1 && option + 4 < end) {
+            // Negative power of 2 when the high bit is set, of 10 otherwise
+            uint8_t resolution = option[4];
+            uint8_t exponent = resolution & 0x7f;
+            if (resolution & 0x80) {
+                iface.tsUnits = uint64_t(1) << std::min<uint8_t>(exponent, 63);
+            } else {
+                iface.tsUnits = 1;
+                for (uint8_t i = 0; i < std::min<uint8_t>(exponent, 19); ++i) {
+                    iface.tsUnits *= 10;
+                }
+            }
+        }
+        option += 4 + ((optionLen + 3) & ~3);
+    }
+    interfaces.push_back(iface);
+}
+
+auto PcapFileReader::setTimestamp(Interface const& iface, uint64_t ts, pcap_pkthdr* header) const -> void
+{
+    header->ts.tv_sec = time_t(ts / iface.tsUnits);
+    uint64_t fraction = ts % iface.tsUnits;
+    header->ts.tv_usec = suseconds_t((unsigned __int128)fraction * usecPerSecond / iface.tsUnits);
+}
+
+PcapFileReader::~PcapFileReader()
+{
+    delete decompressor;
+    if (filterHandle != nullptr) {
+        pcap_freecode(&filter);
+        pcap_close(filterHandle);
+    }
+    if (mapping != nullptr) {
+        munmap(const_cast<uint8_t*>(mapping), size);
+    }
+}
+
+} // namespace flowstats
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "StreamDecompressor.hpp"
+#include <cstdint>
+#include <pcap/pcap.h>
+#include <string>
+#include <vector>
+
+namespace flowstats {
+
+/**
+ * Reader of pcap and pcapng capture files. The file is mapped and its
+ * records are parsed in place, frames returned by next point inside
+ * the mapping and stay valid as long as the reader.
+ *
+ * Zstd and gzip compressed files are decompressed on a helper thread
+ * and records are parsed from a reused window. Their frames are only
+ * valid until the next call to next.
+ *
+ * Only interfaces with the link type of the first one are read, like
+ * libpcap does for a single pcapng section.
+ */
+class PcapFileReader {
+public:
+    explicit PcapFileReader(std::string fileName, size_t chunkSize = decompressedChunkSize)
+        : fileName(std::move(fileName))
+        , chunkSize(chunkSize) {};
+    PcapFileReader(PcapFileReader const&) = delete;
+    auto operator=(PcapFileReader const&) -> PcapFileReader& = delete;
+    virtual ~PcapFileReader();
+
+    [[nodiscard]] auto open(std::string const& bpfFilter) -> bool;
+
+    /**
+     * Fill the header and data of the next frame matching the filter,
+     * return false at the end of the file or on a truncated record
+     */
+    auto next(pcap_pkthdr* header, uint8_t const** data) -> bool;
+
+    [[nodiscard]] auto getLinkType() const { return linkType; }
+    /**
+     * Whether a pointer stays valid as long as the reader
+     */
+    [[nodiscard]] auto contains(uint8_t const* ptr) const -> bool
+    {
+        return decompressor == nullptr && ptr >= mapping && ptr < mapping + size;
+    }
+
+private:
+    struct Interface {
+        int linkType;
+        uint32_t snapLen;
+        // Timestamp units per second
+        uint64_t tsUnits;
+    };
+
+    /**
+     * Bytes [at, at + bytes) after the current position, nullptr when
+     * the file ends before
+     */
+    auto peek(size_t at, size_t bytes) -> uint8_t const*;
+    auto consume(size_t bytes) -> void;
+    auto fillWindow() -> bool;
+
+    auto parseFileHeader() -> bool;
+    auto compileFilter(std::string const& bpfFilter) -> bool;
+    auto nextPcapRecord(pcap_pkthdr* header, uint8_t const** data) -> bool;
+    auto nextPcapngRecord(pcap_pkthdr* header, uint8_t const** data) -> bool;
+    auto parseInterface(uint8_t const* body, size_t bodySize) -> void;
+    auto setTimestamp(Interface const& iface, uint64_t ts, pcap_pkthdr* header) const -> void;
+
+    [[nodiscard]] auto read16(uint8_t const* ptr) const -> uint16_t;
+    [[nodiscard]] auto read32(uint8_t const* ptr) const -> uint32_t;
+
+    std::string fileName;
+    size_t chunkSize;
+    uint8_t const* mapping = nullptr;
+    size_t size = 0;
+    // Offset in the decompressed file
+    size_t position = 0;
+
+    StreamDecompressor* decompressor = nullptr;
+    DecompressedChunk chunk;
+    std::vector<uint8_t> window;
+    size_t windowStart = 0;
+    size_t windowEnd = 0;
+
+    bool isPcapng = false;
+    bool swapped = false;
+    bool nanoSeconds = false;
+    int linkType = -1;
+    std::vector<Interface> interfaces;
+
+    pcap_t* filterHandle = nullptr;
+    bpf_program filter = {};
+};
+
+} // namespace flowstats
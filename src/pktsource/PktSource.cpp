@@ -1,12 +1,18 @@
 #include "PktSource.hpp"
+#include "InternalStats.hpp"
 #include "Utils.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
-#include <tins/ipv6.h>
+#include <iterator>
 #include <tins/network_interface.h>
 #include <utility>
 
 namespace flowstats {
 
+size_t const captureRingBytes = 64 << 20;
+size_t const ringBatchSize = 256;
+
 /**
  * Go over all interfaces and output their names
  */
@@ -36,6 +42,27 @@ auto PktSource::getLocalIps() -> std::vector<Tins::IPv4Address>
 
 auto PktSource::getCaptureStatus() -> std::optional<CaptureStat>
 {
+    std::optional<CaptureStat> res;
+    {
+        const std::lock_guard<std::mutex> lock(captureStatMutex);
+        res = captureStat;
+    }
+    if (res.has_value() && packetRing != nullptr) {
+        res->setRingStat(packetRing->getUsedBytes(), packetRing->takeHighWater(),
+            packetRing->getCapacity(), packetRing->getDroppedPackets());
+    }
+    return res;
+}
+
+/**
+ * Only called from the capture thread, pcap handles and mmap ring
+ * statistics are not shared with the processing thread
+ */
+auto PktSource::readCaptureStatus() -> std::optional<CaptureStat>
+{
+    if (mmapRing != nullptr) {
+        return mmapRing->getCaptureStatus();
+    }
     if (liveDevice == nullptr) {
         return {};
     }
@@ -66,74 +93,135 @@ auto PktSource::updateScreen(timeval currentTime) -> void
 {
     if (lastUpdate.tv_sec < currentTime.tv_sec) {
         lastUpdate = currentTime;
+        std::vector<std::pair<CollectorProtocol, std::shared_ptr<AggregatedSnapshot const>>> snapshots;
+        std::vector<std::string> metrics;
+        for (auto* collector : collectors) {
+            auto protocol = collector->getProtocol();
+            {
+                StageTimer timer(Stage::PublishSnapshot, protocol, true);
+                collector->publishSnapshot();
+            }
+            {
+                StageTimer timer(Stage::ResetMetrics, protocol, true);
+                collector->resetMetrics();
+            }
+            if (metricsSender != nullptr) {
+                snapshots.emplace_back(protocol, collector->getSnapshot());
+                auto collectorMetrics = collector->getCollectorMetrics();
+                std::move(collectorMetrics.begin(), collectorMetrics.end(),
+                    std::back_inserter(metrics));
+            }
+        }
+        internalStats().publish();
+        if (metricsSender != nullptr) {
+            auto internalMetrics = internalStats().getStatsdMetrics();
+            std::move(internalMetrics.begin(), internalMetrics.end(),
+                std::back_inserter(metrics));
+            // Published snapshots are immutable, flow metrics are
+            // formatted by the sender thread
+            metricsSender->enqueue([snapshots = std::move(snapshots), metrics = std::move(metrics),
+                                       mode = conf.getStatsdMode()]() {
+                auto res = metrics;
+                for (auto const& [protocol, snapshot] : snapshots) {
+                    StageTimer timer(Stage::StatsdMetrics, protocol, true);
+                    auto flowMetrics = Collector::getStatsdMetrics(*snapshot, mode);
+                    std::move(flowMetrics.begin(), flowMetrics.end(), std::back_inserter(res));
+                }
+                return res;
+            });
+        }
         auto captureStatus = getCaptureStatus();
         screen->updateDisplay(currentTime, true, captureStatus);
+    }
+}
+
+/**
+ * Spawn one worker per configured thread, each fed with its own shard
+ * of every collector. Nothing is started in single threaded mode.
+ */
+auto PktSource::startWorkers(int linkType) -> void
+{
+    int numberWorkers = conf.getWorkerThreads();
+    if (numberWorkers <= 1) {
+        return;
+    }
+    SPDLOG_INFO("Starting {} capture workers", numberWorkers);
+    for (int i = 0; i < numberWorkers; ++i) {
+        std::vector<Collector*> workerCollectors;
+        workerCollectors.reserve(collectors.size());
         for (auto* collector : collectors) {
-            collector->sendMetrics();
-            collector->resetMetrics();
+            workerCollectors.push_back(collector->getShard(i));
         }
+        auto* worker = new PktWorker(workerCollectors, linkType);
+        worker->start();
+        workers.push_back(worker);
     }
 }
 
-auto PktSource::processPacketSource(Tins::Packet const& packet) -> void
+auto PktSource::stopWorkers() -> void
 {
-    auto const* pdu = packet.pdu();
-    Tins::IP const* ip = pdu->find_pdu<Tins::IP>();
-    Tins::IPv6 const* ipv6 = nullptr;
-    Tins::PDU const* ipPdu;
-    if (ip == nullptr) {
-        ipv6 = pdu->find_pdu<Tins::IPv6>();
-        if (ipv6 == nullptr) {
-            return;
+    for (auto* worker : workers) {
+        worker->stop();
+        if (worker->getDroppedPackets() > 0) {
+            spdlog::warn("Worker dropped {} packets", worker->getDroppedPackets());
         }
-        ipPdu = ipv6;
-    } else {
-        ipPdu = ip;
+        delete worker;
     }
-    auto const* tcp = ipPdu->find_pdu<Tins::TCP>();
-    Tins::UDP const* udp = nullptr;
-    if (tcp == nullptr) {
-        udp = ipPdu->find_pdu<Tins::UDP>();
-        if (udp == nullptr) {
+    workers.clear();
+}
+
+auto PktSource::processPacketSource(pcap_pkthdr const& header, uint8_t const* data) -> void
+{
+    internalStats().addPackets(1);
+    PacketView view;
+    {
+        StageTimer timer(Stage::Decode, pipelineComponent);
+        if (!packetDecoder.decode(header, data, &view)) {
             return;
         }
     }
 
-    auto flowId = FlowId(ip, ipv6, tcp, udp);
-    timeval pktTs = packetToTimeval(packet);
-    for (auto* collector : collectors) {
-        collector->advanceTick(pktTs);
-        try {
-            collector->processPacket(packet, flowId, ip, ipv6, tcp, udp);
-        } catch (const Tins::malformed_packet&) {
-            SPDLOG_INFO("Malformed packet: {}", packet);
+    auto flowId = view.getFlowId();
+    if (workers.empty()) {
+        dispatcher.dispatch(view, flowId);
+    } else {
+        // FlowId is the same for both directions, the whole
+        // conversation is handled by the same worker. Workers decode
+        // the frame again from their own ring.
+        if (header.ts.tv_sec != lastWorkerTick) {
+            // Workers without packets in this second still expire
+            // their flows
+            lastWorkerTick = header.ts.tv_sec;
+            for (auto* worker : workers) {
+                worker->enqueueTick(header.ts);
+            }
         }
+        auto workerIndex = flowId.hash() % workers.size();
+        workers[workerIndex]->enqueue(header, data);
     }
-    auto ts = packet.timestamp();
-    updateScreen({ ts.seconds(), ts.microseconds() / 1000 });
+    updateScreen(header.ts);
 }
 
 /**
- * analysis pcap file
+ * analysis pcap file, frames are dispatched to one worker per
+ * configured thread
  */
 auto PktSource::analyzePcapFile()
     -> int
 {
-    auto* reader = new Tins::FileSniffer(conf.getPcapFileName(), conf.getBpfFilter());
-    if (reader == nullptr) {
+    PcapFileReader reader(conf.getPcapFileName());
+    if (!reader.open(conf.getBpfFilter())) {
         return 1;
     }
-
-    for (auto packet : *reader) {
-        if (packet.timestamp().seconds() == 0) {
-            break;
-        }
-        processPacketSource(packet);
-    }
-    delete reader;
+    SPDLOG_INFO("Analyzing {} with {} workers", conf.getPcapFileName(),
+        std::max(conf.getWorkerThreads(), 1));
+    PcapAnalyzer analyzer(collectors, conf.getWorkerThreads());
+    auto numberPackets = analyzer.analyze(&reader, [this](timeval ts) { updateScreen(ts); });
+    SPDLOG_INFO("Processed {} packets", numberPackets);
 
     for (auto* collector : collectors) {
         collector->resetMetrics();
+        collector->publishSnapshot();
     }
     if (screen->getDisplayConf()->noCurses) {
         return 0;
@@ -146,28 +234,174 @@ auto PktSource::analyzePcapFile()
     return 0;
 }
 
+/**
+ * analysis live traffic from an AF_PACKET mmap ring
+ */
+auto PktSource::analyzeMmapRing() -> int
+{
+    auto const& ringConf = conf.getMmapRingConf();
+    SPDLOG_INFO("Start mmap ring capture with {} blocks of {} bytes, filter {}",
+        ringConf.blockCount, ringConf.blockSize, conf.getBpfFilter());
+    mmapRing = new MmapRing(ringConf);
+    if (!mmapRing->open(conf.getInterfaceName(), conf.getBpfFilter())) {
+        delete mmapRing;
+        mmapRing = nullptr;
+        return -1;
+    }
+    packetDecoder = PacketDecoder(DLT_EN10MB);
+    startWorkers(DLT_EN10MB);
+    packetRing = new PacketRing(captureRingBytes);
+    captureThread = std::thread(&PktSource::captureMmapRing, this);
+    processPacketRing();
+
+    SPDLOG_INFO("Stop capture");
+    stopWorkers();
+    if (packetRing->getDroppedPackets() > 0) {
+        spdlog::warn("Capture ring dropped {} packets", packetRing->getDroppedPackets());
+    }
+    delete packetRing;
+    packetRing = nullptr;
+    delete mmapRing;
+    mmapRing = nullptr;
+    SPDLOG_INFO("Stopping screen");
+    screen->StopDisplay();
+    return 0;
+}
+
+/**
+ * Refresh the published capture stats once per second
+ */
+auto PktSource::pollCaptureStatus() -> void
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    if (now.tv_sec < nextCaptureStatPoll.tv_sec) {
+        return;
+    }
+    nextCaptureStatPoll.tv_sec = now.tv_sec + 1;
+    auto status = readCaptureStatus();
+    const std::lock_guard<std::mutex> lock(captureStatMutex);
+    captureStat = status;
+}
+
+auto PktSource::captureLive(pcap_t* handle) -> void
+{
+    pcap_pkthdr* header;
+    uint8_t const* data;
+    while (!shouldStop->load()) {
+        int res = pcap_next_ex(handle, &header, &data);
+        if (res < 0) {
+            break;
+        }
+        // A read timeout gives a chance to check for stop
+        if (res == 1) {
+            packetRing->push(*header, data);
+        }
+        pollCaptureStatus();
+    }
+    captureDone.store(true, std::memory_order_release);
+}
+
+auto PktSource::captureMmapRing() -> void
+{
+    auto const& ringConf = conf.getMmapRingConf();
+    auto pushPacket = [this](pcap_pkthdr const& header, uint8_t const* data) {
+        packetRing->push(header, data);
+    };
+    while (!shouldStop->load()) {
+        if (!mmapRing->readBlock(ringConf.blockTimeout, pushPacket)) {
+            break;
+        }
+        pollCaptureStatus();
+    }
+    captureDone.store(true, std::memory_order_release);
+}
+
+/**
+ * Drain the packet ring in batches until the capture thread is done
+ * and every captured frame was processed
+ */
+auto PktSource::processPacketRing() -> void
+{
+    auto processPacket = [this](pcap_pkthdr const& header, uint8_t const* data) {
+        processPacketSource(header, data);
+    };
+    while (true) {
+        bool captureRunning = !captureDone.load(std::memory_order_acquire);
+        if (packetRing->drain(ringBatchSize, processPacket) > 0) {
+            continue;
+        }
+        if (!captureRunning) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    captureThread.join();
+    captureDone.store(false);
+}
+
 /**
  * analysis live traffic
  */
 auto PktSource::analyzeLiveTraffic() -> int
 {
+    if (conf.getUseMmapRing()) {
+        return analyzeMmapRing();
+    }
     SPDLOG_INFO("Start live traffic capture with filter {}",
         conf.getBpfFilter());
     liveDevice = getLiveDevice();
     if (liveDevice == nullptr) {
         return -1;
     }
-    for (const auto& packet : *liveDevice) {
-        if (shouldStop->load()) {
-            break;
-        }
-        processPacketSource(packet);
-    }
+    auto* handle = liveDevice->get_pcap_handle();
+    packetDecoder = PacketDecoder(pcap_datalink(handle));
+    startWorkers(pcap_datalink(handle));
+    packetRing = new PacketRing(captureRingBytes);
+    captureThread = std::thread(&PktSource::captureLive, this, handle);
+    processPacketRing();
 
     SPDLOG_INFO("Stop capture");
     liveDevice->stop_sniff();
+    stopWorkers();
+    if (packetRing->getDroppedPackets() > 0) {
+        spdlog::warn("Capture ring dropped {} packets", packetRing->getDroppedPackets());
+    }
+    delete packetRing;
+    packetRing = nullptr;
     SPDLOG_INFO("Stopping screen");
     screen->StopDisplay();
     return 0;
 }
+
+PktSource::PktSource(Screen* screen,
+    FlowstatsConfiguration const& conf,
+    const std::vector<Collector*>& collectors,
+    std::atomic_bool* shouldStop)
+    : screen(screen)
+    , conf(conf)
+    , collectors(collectors)
+    , shouldStop(shouldStop)
+    , dispatcher(collectors)
+{
+    lastPcapStat.ps_recv = 0;
+    if (conf.getAgentConf().has_value()) {
+        metricsSender = new MetricsSender(conf.getAgentConf().value());
+        metricsSender->start();
+    }
+}
+
+PktSource::~PktSource()
+{
+    stopWorkers();
+    if (metricsSender != nullptr) {
+        if (metricsSender->getDroppedBatches() > 0) {
+            spdlog::warn("Metrics sender dropped {} batches", metricsSender->getDroppedBatches());
+        }
+        if (metricsSender->getDroppedDatagrams() > 0) {
+            spdlog::warn("Metrics sender dropped {} datagrams", metricsSender->getDroppedDatagrams());
+        }
+        delete metricsSender;
+    }
+}
 } // namespace flowstats
@@ -2,8 +2,17 @@
 
 #include "Collector.hpp"
 #include "Configuration.hpp"
+#include "MetricsSender.hpp"
+#include "MmapRing.hpp"
+#include "PacketClassifier.hpp"
+#include "PacketRing.hpp"
+#include "PcapAnalyzer.hpp"
+#include "PktWorker.hpp"
 #include "Screen.hpp"
 #include "Stats.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <tins/ip_address.h>
 #include <tins/sniffer.h>
 
@@ -16,15 +25,8 @@ public:
     PktSource(Screen* screen,
         FlowstatsConfiguration const& conf,
         const std::vector<Collector*>& collectors,
-        std::atomic_bool* shouldStop)
-        : screen(screen)
-        , conf(conf)
-        , collectors(collectors)
-        , shouldStop(shouldStop)
-    {
-        lastPcapStat.ps_recv = 0;
-    };
-    virtual ~PktSource() = default;
+        std::atomic_bool* shouldStop);
+    virtual ~PktSource();
 
     auto updateScreen(timeval currentTime) -> void;
     [[nodiscard]] auto getCaptureStatus() -> std::optional<CaptureStat>;
@@ -34,7 +36,20 @@ public:
     auto analyzePcapFile() -> int;
 
 private:
-    auto processPacketSource(Tins::Packet const& packet) -> void;
+    auto processPacketSource(pcap_pkthdr const& header, uint8_t const* data) -> void;
+    auto analyzeMmapRing() -> int;
+
+    /**
+     * Capture threads only copy frames in the packet ring, the calling
+     * thread decodes and processes them until the capture stops
+     */
+    auto captureLive(pcap_t* handle) -> void;
+    auto captureMmapRing() -> void;
+    auto processPacketRing() -> void;
+    auto readCaptureStatus() -> std::optional<CaptureStat>;
+    auto pollCaptureStatus() -> void;
+    auto startWorkers(int linkType) -> void;
+    auto stopWorkers() -> void;
 
     Screen* screen;
     FlowstatsConfiguration const& conf;
@@ -46,6 +61,23 @@ private:
 
     auto getLiveDevice() -> Tins::Sniffer*;
     Tins::Sniffer* liveDevice = nullptr;
+    MmapRing* mmapRing = nullptr;
+    MetricsSender* metricsSender = nullptr;
+
+    PacketRing* packetRing = nullptr;
+    std::thread captureThread;
+    std::atomic_bool captureDone = false;
+    // Capture stats are read by the capture thread and published here
+    std::mutex captureStatMutex;
+    std::optional<CaptureStat> captureStat;
+    timespec nextCaptureStatPoll = {};
+
+    PacketDecoder packetDecoder;
+    // Only used without workers
+    PacketDispatcher dispatcher;
+    std::vector<PktWorker*> workers;
+    // Second of the last tick sent to every worker
+    time_t lastWorkerTick = 0;
 };
 
 } // namespace flowstats
@@ -0,0 +1,81 @@
+#include "PktWorker.hpp"
+#include "InternalStats.hpp"
+#include <chrono>
+
+namespace flowstats {
+
+size_t const workerRingBytes = 16 << 20;
+size_t const workerBatchSize = 256;
+
+PktWorker::PktWorker(std::vector<Collector*> const& collectors, int linkType)
+    : dispatcher(collectors)
+    , decoder(linkType)
+    , ring(workerRingBytes)
+{
+}
+
+auto PktWorker::start() -> void
+{
+    workerThread = std::thread(&PktWorker::workerLoop, this);
+}
+
+auto PktWorker::stop() -> void
+{
+    stopping.store(true, std::memory_order_release);
+    if (workerThread.joinable()) {
+        workerThread.join();
+    }
+}
+
+auto PktWorker::enqueue(pcap_pkthdr const& header, uint8_t const* data) -> void
+{
+    ring.push(header, data);
+}
+
+auto PktWorker::enqueueTick(timeval now) -> void
+{
+    // Captured frames are never empty, an empty one marks a tick
+    pcap_pkthdr header = {};
+    header.ts = now;
+    uint8_t const empty = 0;
+    ring.push(header, &empty);
+}
+
+/**
+ * Drain the ring in batches until stopped and every queued frame was
+ * processed
+ */
+auto PktWorker::workerLoop() -> void
+{
+    auto processPacket = [this](pcap_pkthdr const& header, uint8_t const* data) {
+        if (header.caplen == 0) {
+            dispatcher.advanceTick(header.ts);
+            return;
+        }
+        PacketView view;
+        {
+            StageTimer timer(Stage::Decode, pipelineComponent);
+            if (!decoder.decode(header, data, &view)) {
+                return;
+            }
+        }
+        dispatcher.dispatch(view, view.getFlowId());
+    };
+    while (true) {
+        bool running = !stopping.load(std::memory_order_acquire);
+        if (ring.drain(workerBatchSize, processPacket) > 0) {
+            continue;
+        }
+        if (!running) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+PktWorker::~PktWorker()
+{
+    stop();
+}
+
+} // namespace flowstats
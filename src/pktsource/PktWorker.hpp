@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Collector.hpp"
+#include "PacketClassifier.hpp"
+#include "PacketRing.hpp"
+#include <atomic>
+#include <thread>
+
+namespace flowstats {
+
+/**
+ * Capture worker fed with the frames of its flows. Frames are copied
+ * in a preallocated ring by the capture thread and decoded again by
+ * the worker, nothing is allocated per packet.
+ */
+class PktWorker {
+public:
+    PktWorker(std::vector<Collector*> const& collectors, int linkType);
+    PktWorker(PktWorker const&) = delete;
+    auto operator=(PktWorker const&) -> PktWorker& = delete;
+    virtual ~PktWorker();
+
+    auto start() -> void;
+    /**
+     * Wait for the worker to process every queued frame
+     */
+    auto stop() -> void;
+    /**
+     * Copy a frame in the worker ring, it is dropped when the ring is
+     * full
+     */
+    auto enqueue(pcap_pkthdr const& header, uint8_t const* data) -> void;
+    /**
+     * Queue a tick of the collectors after the frames already queued
+     */
+    auto enqueueTick(timeval now) -> void;
+
+    [[nodiscard]] auto getDroppedPackets() const -> uint64_t { return ring.getDroppedPackets(); };
+
+private:
+    auto workerLoop() -> void;
+
+    PacketDispatcher dispatcher;
+    PacketDecoder decoder;
+    PacketRing ring;
+    std::thread workerThread;
+    std::atomic_bool stopping = false;
+};
+
+} // namespace flowstats
@@ -0,0 +1,174 @@
+#include "StreamDecompressor.hpp"
+#include <algorithm>
+#include <climits>
+#include <spdlog/spdlog.h>
+
+namespace flowstats {
+
+/**
+ * Chunks filled ahead of the reader
+ */
+size_t const numberChunks = 4;
+
+auto detectCompression(uint8_t const* data, size_t size) -> Compression
+{
+    if (size >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd) {
+        return Compression::Zstd;
+    }
+    if (size >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+        return Compression::Gzip;
+    }
+    return Compression::None;
+}
+
+StreamDecompressor::StreamDecompressor(uint8_t const* input, size_t inputSize,
+    Compression compression, size_t chunkSize)
+    : input(input)
+    , inputSize(inputSize)
+    , compression(compression)
+    , chunkSize(chunkSize)
+{
+    if (compression == Compression::Zstd) {
+        zstdStream = ZSTD_createDStream();
+        ZSTD_initDStream(zstdStream);
+    } else {
+        // Only accept a gzip header
+        inflateInit2(&gzipStream, 16 + MAX_WBITS);
+    }
+    for (size_t i = 0; i < numberChunks; ++i) {
+        freeChunks.push_back({ std::make_unique<uint8_t[]>(chunkSize), 0 });
+    }
+    decompressThread = std::thread(&StreamDecompressor::decompressLoop, this);
+}
+
+auto StreamDecompressor::read(DecompressedChunk* chunk) -> bool
+{
+    std::unique_lock<std::mutex> lock(chunkMutex);
+    if (chunk->data != nullptr) {
+        freeChunks.push_back(std::move(*chunk));
+        chunkCondition.notify_all();
+    }
+    chunkCondition.wait(lock, [this] { return done || !filledChunks.empty(); });
+    if (filledChunks.empty()) {
+        *chunk = DecompressedChunk();
+        return false;
+    }
+    *chunk = std::move(filledChunks.front());
+    filledChunks.pop_front();
+    chunkCondition.notify_all();
+    return true;
+}
+
+auto StreamDecompressor::decompressLoop() -> void
+{
+    while (!finished) {
+        DecompressedChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(chunkMutex);
+            chunkCondition.wait(lock, [this] { return stopping || !freeChunks.empty(); });
+            if (stopping) {
+                return;
+            }
+            chunk = std::move(freeChunks.back());
+            freeChunks.pop_back();
+        }
+        if (compression == Compression::Zstd) {
+            fillZstd(&chunk);
+        } else {
+            fillGzip(&chunk);
+        }
+        {
+            const std::lock_guard<std::mutex> lock(chunkMutex);
+            if (chunk.size > 0) {
+                filledChunks.push_back(std::move(chunk));
+            } else {
+                freeChunks.push_back(std::move(chunk));
+            }
+            done = finished;
+        }
+        chunkCondition.notify_all();
+    }
+}
+
+/**
+ * Fill the chunk until it is full or the stream ends. A stream ends
+ * when the whole input was consumed and nothing more is flushed.
+ */
+auto StreamDecompressor::fillZstd(DecompressedChunk* chunk) -> void
+{
+    ZSTD_inBuffer in = { input, inputSize, inputOffset };
+    ZSTD_outBuffer out = { chunk->data.get(), chunkSize, 0 };
+    while (out.pos < out.size) {
+        size_t previousOut = out.pos;
+        size_t previousIn = in.pos;
+        size_t res = ZSTD_decompressStream(zstdStream, &out, &in);
+        if (ZSTD_isError(res)) {
+            spdlog::error("Could not decompress zstd stream: \"{}\"", ZSTD_getErrorName(res));
+            finished = true;
+            break;
+        }
+        if (out.pos == previousOut && in.pos == previousIn) {
+            if (!zstdFrameDone) {
+                spdlog::warn("Truncated zstd stream");
+            }
+            finished = true;
+            break;
+        }
+        // 0 once a frame is fully decoded and flushed
+        zstdFrameDone = res == 0;
+    }
+    inputOffset = in.pos;
+    chunk->size = out.pos;
+}
+
+auto StreamDecompressor::fillGzip(DecompressedChunk* chunk) -> void
+{
+    gzipStream.next_out = chunk->data.get();
+    gzipStream.avail_out = uInt(chunkSize);
+    while (gzipStream.avail_out > 0) {
+        uInt availIn = uInt(std::min<size_t>(inputSize - inputOffset, UINT_MAX));
+        uInt availOut = gzipStream.avail_out;
+        gzipStream.next_in = const_cast<Bytef*>(input + inputOffset);
+        gzipStream.avail_in = availIn;
+        int res = inflate(&gzipStream, Z_NO_FLUSH);
+        inputOffset += availIn - gzipStream.avail_in;
+        if (res == Z_STREAM_END) {
+            // Members of a concatenated file are read in turn
+            if (inputOffset == inputSize) {
+                finished = true;
+                break;
+            }
+            inflateReset(&gzipStream);
+            continue;
+        }
+        if (res != Z_OK && res != Z_BUF_ERROR) {
+            spdlog::error("Could not decompress gzip stream: \"{}\"",
+                gzipStream.msg != nullptr ? gzipStream.msg : zError(res));
+            finished = true;
+            break;
+        }
+        if (gzipStream.avail_out == availOut && gzipStream.avail_in == availIn) {
+            spdlog::warn("Truncated gzip stream");
+            finished = true;
+            break;
+        }
+    }
+    chunk->size = chunkSize - gzipStream.avail_out;
+}
+
+StreamDecompressor::~StreamDecompressor()
+{
+    {
+        const std::lock_guard<std::mutex> lock(chunkMutex);
+        stopping = true;
+    }
+    chunkCondition.notify_all();
+    decompressThread.join();
+    if (zstdStream != nullptr) {
+        ZSTD_freeDStream(zstdStream);
+    } else {
+        inflateEnd(&gzipStream);
+    }
+}
+
+} // namespace flowstats
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace flowstats {
+
+enum class Compression {
+    None,
+    Zstd,
+    Gzip,
+};
+
+/**
+ * Compression of a file, detected from its magic number
+ */
+auto detectCompression(uint8_t const* data, size_t size) -> Compression;
+
+size_t const decompressedChunkSize = 1 << 20;
+
+struct DecompressedChunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size = 0;
+};
+
+/**
+ * Decompress a zstd or gzip buffer on a helper thread. A fixed set of
+ * chunks is filled in turn and handed in order to the reader, which
+ * gives each chunk back once consumed. Concatenated frames or members
+ * are read as a single stream.
+ */
+class StreamDecompressor {
+public:
+    StreamDecompressor(uint8_t const* input, size_t inputSize,
+        Compression compression, size_t chunkSize = decompressedChunkSize);
+    StreamDecompressor(StreamDecompressor const&) = delete;
+    auto operator=(StreamDecompressor const&) -> StreamDecompressor& = delete;
+    virtual ~StreamDecompressor();
+
+    /**
+     * Give back the consumed chunk and swap it with the next
+     * decompressed one, return false at the end of the stream
+     */
+    auto read(DecompressedChunk* chunk) -> bool;
+
+private:
+    auto decompressLoop() -> void;
+    auto fillZstd(DecompressedChunk* chunk) -> void;
+    auto fillGzip(DecompressedChunk* chunk) -> void;
+
+    uint8_t const* input;
+    size_t inputSize;
+    size_t inputOffset = 0;
+    Compression compression;
+    size_t chunkSize;
+    // Only touched by the helper thread
+    bool finished = false;
+    ZSTD_DStream* zstdStream = nullptr;
+    bool zstdFrameDone = false;
+    z_stream gzipStream = {};
+
+    std::thread decompressThread;
+    std::mutex chunkMutex;
+    std::condition_variable chunkCondition;
+    std::vector<DecompressedChunk> freeChunks;
+    std::deque<DecompressedChunk> filledChunks;
+    bool done = false;
+    bool stopping = false;
+};
+
+} // namespace flowstats
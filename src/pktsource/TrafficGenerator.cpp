@@ -0,0 +1,740 @@
+#include "TrafficGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fmt/format.h>
+#include <numeric>
+#include <tuple>
+
+namespace flowstats {
+
+namespace {
+    uint32_t const resolverIp = 0x0affff35; // 10.255.255.53
+    uint32_t const connectionClientNet = 0x0a000001; // 10.0.0.1
+    uint32_t const dnsClientNet = 0x0a800001; // 10.128.0.1
+    uint32_t const serverNet = 0xac100001; // 172.16.0.1
+    uint32_t const dnsTtl = 86400;
+    // Time before a client gives up on an unanswered query over tcp
+    uint32_t const dnsTimeoutMs = 5000;
+    uint32_t const maxRequests = 30000;
+    uint32_t const maxMessageSize = 1400;
+    size_t const ethernetSize = 14;
+    size_t const ipSize = 20;
+    size_t const tcpSize = 20;
+    size_t const udpSize = 8;
+    // ChangeCipherSpec and an encrypted Finished record
+    uint32_t const serverHandshakeSize = 6 + 5 + 40;
+
+    uint8_t const tcpFin = 0x01;
+    uint8_t const tcpSyn = 0x02;
+    uint8_t const tcpPsh = 0x08;
+    uint8_t const tcpAck = 0x10;
+
+    auto splitmix(uint64_t x) -> uint64_t
+    {
+        x += 0x9e3779b97f4a7c15;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    auto write16(uint8_t* out, uint16_t value) -> void
+    {
+        out[0] = value >> 8;
+        out[1] = value & 0xff;
+    }
+
+    auto write32(uint8_t* out, uint32_t value) -> void
+    {
+        write16(out, value >> 16);
+        write16(out + 2, value & 0xffff);
+    }
+
+    auto checksumAdd(uint32_t sum, uint8_t const* data, size_t size) -> uint32_t
+    {
+        for (size_t i = 0; i + 1 < size; i += 2) {
+            sum += (data[i] << 8) | data[i + 1];
+        }
+        if (size % 2) {
+            sum += data[size - 1] << 8;
+        }
+        return sum;
+    }
+
+    auto checksumFold(uint32_t sum) -> uint16_t
+    {
+        while (sum >> 16) {
+            sum = (sum & 0xffff) + (sum >> 16);
+        }
+        return ~sum & 0xffff;
+    }
+
+    auto usToMs(uint64_t timeUs) -> uint64_t
+    {
+        return timeUs / 1000 * 1000;
+    }
+} // namespace
+
+auto Distribution::parse(std::string const& str) -> std::optional<Distribution>
+{
+    Distribution distribution;
+    auto sep = str.find(':');
+    if (sep == std::string::npos) {
+        return {};
+    }
+    auto name = str.substr(0, sep);
+    char* end = nullptr;
+    auto args = str.substr(sep + 1);
+    distribution.a = strtod(args.c_str(), &end);
+    if (end == args.c_str()) {
+        return {};
+    }
+    bool hasSecond = *end == ':';
+    if (hasSecond) {
+        char const* second = end + 1;
+        distribution.b = strtod(second, &end);
+        if (end == second) {
+            return {};
+        }
+    }
+    if (*end != '\0' || distribution.a < 0 || distribution.b < 0) {
+        return {};
+    }
+
+    if (name == "const" && !hasSecond) {
+        distribution.type = Type::Constant;
+    } else if (name == "uniform" && hasSecond && distribution.a <= distribution.b) {
+        distribution.type = Type::Uniform;
+    } else if (name == "exp" && !hasSecond) {
+        distribution.type = Type::Exponential;
+    } else if (name == "lognormal" && hasSecond) {
+        distribution.type = Type::LogNormal;
+    } else {
+        return {};
+    }
+    return distribution;
+}
+
+auto Distribution::sample(double u1, double u2) const -> uint32_t
+{
+    double value = a;
+    switch (type) {
+    case Type::Constant:
+        break;
+    case Type::Uniform:
+        value = a + u1 * (b - a);
+        break;
+    case Type::Exponential:
+        value = -a * std::log(u1);
+        break;
+    case Type::LogNormal:
+        // Box-Muller
+        value = a * std::exp(b * std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2));
+        break;
+    }
+    return static_cast<uint32_t>(std::clamp(std::lround(value), 0L, long(UINT32_MAX / 1000)));
+}
+
+auto ExactHistogram::addPoint(uint32_t ms) -> void
+{
+    if (ms >= counts.size()) {
+        counts.resize(ms + 1);
+    }
+    counts[ms]++;
+    count++;
+}
+
+auto ExactHistogram::getPercentile(float p) const -> uint32_t
+{
+    if (count == 0) {
+        return 0;
+    }
+    auto rank = std::max(static_cast<uint64_t>(floor(count * std::clamp(p, 0.0f, 1.0f) + 0.5)), uint64_t(1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return i;
+        }
+    }
+    return counts.size() - 1;
+}
+
+static auto appendHistogram(fmt::memory_buffer* out, char const* name,
+    ExactHistogram const& histogram, bool last = false) -> void
+{
+    fmt::format_to(std::back_inserter(*out),
+        "    \"{}\": {{ \"count\": {}, \"p50\": {}, \"p95\": {}, \"p99\": {}, \"max\": {} }}{}\n",
+        name, histogram.getCount(), histogram.getPercentile(0.5),
+        histogram.getPercentile(0.95), histogram.getPercentile(0.99),
+        histogram.getPercentile(1), last ? "" : ",");
+}
+
+auto GroundTruth::toJson(size_t numberTopFqdns) const -> std::string
+{
+    fmt::memory_buffer out;
+    fmt::format_to(std::back_inserter(out),
+        "{{\n  \"packets\": {},\n  \"bytes\": {},\n"
+        "  \"tcp\": {{\n    \"connections\": {},\n    \"closes\": {},\n",
+        packets, bytes, tcpConnections, tcpCloses);
+    appendHistogram(&out, "connectTime", connectTimes);
+    appendHistogram(&out, "srt", srts, true);
+    fmt::format_to(std::back_inserter(out),
+        "  }},\n  \"tls\": {{\n    \"clientHellos\": {},\n", tlsClientHellos);
+    appendHistogram(&out, "handshake", tlsHandshakes, true);
+    fmt::format_to(std::back_inserter(out),
+        "  }},\n  \"dns\": {{\n    \"queries\": {},\n    \"responses\": {},\n"
+        "    \"timeouts\": {},\n    \"a\": {},\n    \"aaaa\": {},\n    \"udp\": {},\n    \"tcp\": {},\n",
+        dnsQueries, dnsResponses, dnsQueries - dnsResponses, dnsA, dnsAaaa, dnsUdp, dnsTcp);
+    appendHistogram(&out, "srt", dnsSrts, true);
+
+    std::vector<uint32_t> topFqdns(fqdnConnections.size());
+    std::iota(topFqdns.begin(), topFqdns.end(), 0);
+    numberTopFqdns = std::min(numberTopFqdns, topFqdns.size());
+    std::partial_sort(topFqdns.begin(), topFqdns.begin() + numberTopFqdns, topFqdns.end(),
+        [this](uint32_t a, uint32_t b) {
+            return std::tie(fqdnConnections[b], a) < std::tie(fqdnConnections[a], b);
+        });
+    fmt::format_to(std::back_inserter(out), "  }},\n  \"topFqdns\": [\n");
+    for (size_t i = 0; i < numberTopFqdns; ++i) {
+        fmt::format_to(std::back_inserter(out),
+            "    {{ \"fqdn\": \"{}\", \"connections\": {} }}{}\n",
+            TrafficGenerator::getFqdn(topFqdns[i]), fqdnConnections[topFqdns[i]],
+            i + 1 < numberTopFqdns ? "," : "");
+    }
+    fmt::format_to(std::back_inserter(out), "  ]\n}}\n");
+    return to_string(out);
+}
+
+auto TrafficGenerator::Event::operator>(Event const& other) const -> bool
+{
+    // Every frame has its own kind, index and step, the order of
+    // frames with the same timestamp is fixed
+    return std::tie(timeUs, kind, index, step) > std::tie(other.timeUs, other.kind, other.index, other.step);
+}
+
+TrafficGenerator::TrafficGenerator(TrafficProfile inProfile)
+    : profile(std::move(inProfile))
+{
+    profile.numberFqdns = std::max(profile.numberFqdns, 1u);
+    profile.numberClients = std::max(profile.numberClients, 1u);
+    profile.requestSize = std::clamp(profile.requestSize, 16u, maxMessageSize);
+    profile.responseSize = std::clamp(profile.responseSize, 16u, maxMessageSize);
+    endUs = uint64_t(profile.durationSeconds) * 1000000;
+    resolvedFqdns.resize(profile.numberFqdns);
+    groundTruth.fqdnConnections.resize(profile.numberFqdns);
+
+    if (profile.connectionRate > 0) {
+        schedule(0, EventKind::ConnectionArrival, 0, 0);
+    }
+    if (profile.dnsRate > 0) {
+        schedule(0, EventKind::DnsArrival, 0, 0);
+    }
+}
+
+auto TrafficGenerator::getFqdn(uint32_t fqdnIndex) -> std::string
+{
+    return fmt::format("host{}.flowgen.test", fqdnIndex);
+}
+
+auto TrafficGenerator::getFqdnSize(uint32_t fqdnIndex) -> uint32_t
+{
+    uint32_t digits = 1;
+    for (; fqdnIndex >= 10; fqdnIndex /= 10) {
+        digits++;
+    }
+    return digits + sizeof("host.flowgen.test") - 1;
+}
+
+auto TrafficGenerator::hash(EventKind kind, uint32_t index, uint32_t salt) const -> uint64_t
+{
+    return splitmix(profile.seed ^ splitmix((uint64_t(kind) << 56) ^ (uint64_t(salt) << 32) ^ index));
+}
+
+auto TrafficGenerator::random(EventKind kind, uint32_t index, uint32_t salt) const -> double
+{
+    // 53 bits in ]0, 1[
+    return (double(hash(kind, index, salt) >> 11) + 0.5) / double(uint64_t(1) << 53);
+}
+
+auto TrafficGenerator::sample(Distribution const& distribution,
+    EventKind kind, uint32_t index, uint32_t salt) const -> uint32_t
+{
+    // Separate from the salts of plain random values
+    uint32_t sampleSalt = 0x80000000 | (salt << 1);
+    return distribution.sample(random(kind, index, sampleSalt), random(kind, index, sampleSalt | 1));
+}
+
+auto TrafficGenerator::getConnectionParams(uint32_t index) const -> TcpParams
+{
+    auto const kind = EventKind::Connection;
+    TcpParams params = {};
+    params.clientIp = connectionClientNet + index % profile.numberClients;
+    params.clientPort = 1024 + (index / profile.numberClients) % 64000;
+    params.fqdn = std::min(uint32_t(random(kind, index, 0) * profile.numberFqdns), profile.numberFqdns - 1);
+    params.serverIp = serverNet + params.fqdn;
+    params.tls = random(kind, index, 1) < profile.tlsFraction;
+    params.serverPort = params.tls ? 443 : 80;
+    params.connectTime = sample(profile.connectTime, kind, index, 2);
+    params.requests = std::clamp(sample(profile.requestsPerFlow, kind, index, 3), 1u, maxRequests);
+    params.responses = params.requests;
+    params.thinkTime = std::max(sample(profile.flowDuration, kind, index, 4) / params.requests, 1u);
+    params.clientIsn = uint32_t(hash(kind, index, 5));
+    params.serverIsn = uint32_t(hash(kind, index, 6));
+    return params;
+}
+
+auto TrafficGenerator::isDnsTcp(uint32_t index) const -> bool
+{
+    return random(EventKind::Dns, index, 2) < profile.dnsTcpFraction;
+}
+
+auto TrafficGenerator::isDnsTimeout(uint32_t index) const -> bool
+{
+    return random(EventKind::Dns, index, 3) < profile.dnsTimeoutFraction;
+}
+
+auto TrafficGenerator::getDnsParams(uint32_t index) const -> TcpParams
+{
+    auto const kind = EventKind::Dns;
+    TcpParams params = {};
+    params.clientIp = dnsClientNet + index % profile.numberClients;
+    params.clientPort = 1024 + (index / profile.numberClients) % 64000;
+    params.fqdn = std::min(uint32_t(random(kind, index, 0) * profile.numberFqdns), profile.numberFqdns - 1);
+    params.aaaa = random(kind, index, 1) < profile.aaaaFraction;
+    params.serverIp = resolverIp;
+    params.serverPort = 53;
+    params.connectTime = sample(profile.connectTime, kind, index, 4);
+    params.requests = 1;
+    params.responses = isDnsTimeout(index) ? 0 : 1;
+    params.thinkTime = 1;
+    params.clientIsn = uint32_t(hash(kind, index, 5));
+    params.serverIsn = uint32_t(hash(kind, index, 6));
+    return params;
+}
+
+auto TrafficGenerator::getSrt(TcpParams const& params, EventKind kind,
+    uint32_t index, uint32_t request) const -> uint32_t
+{
+    if (kind == EventKind::Connection) {
+        return sample(profile.srt, kind, index, 100 + request);
+    }
+    return sample(profile.dnsResponseTime, kind, index, 7);
+}
+
+auto TrafficGenerator::schedule(uint64_t timeUs, EventKind kind, uint32_t index,
+    uint16_t step, uint16_t dnsId) -> void
+{
+    if (timeUs >= endUs) {
+        return;
+    }
+    events.push({ timeUs, index, step, dnsId, kind });
+}
+
+auto TrafficGenerator::next(pcap_pkthdr* header, uint8_t const** data) -> bool
+{
+    while (!events.empty()) {
+        auto event = events.top();
+        events.pop();
+        frameHeader.ts.tv_sec = profile.startTime + event.timeUs / 1000000;
+        frameHeader.ts.tv_usec = event.timeUs % 1000000;
+        if (processEvent(event)) {
+            *header = frameHeader;
+            *data = frame.data();
+            groundTruth.packets++;
+            groundTruth.bytes += frameHeader.caplen;
+            return true;
+        }
+    }
+    return false;
+}
+
+auto TrafficGenerator::processEvent(Event const& event) -> bool
+{
+    switch (event.kind) {
+    case EventKind::ConnectionArrival:
+    case EventKind::DnsArrival:
+        processArrival(event);
+        return false;
+    case EventKind::Resolve:
+        return processResolve(event);
+    case EventKind::Connection:
+        return processTcp(event, getConnectionParams(event.index));
+    case EventKind::Dns:
+        return processDns(event);
+    }
+    return false;
+}
+
+/**
+ * Start a flow on a whole millisecond, so measured durations do not
+ * depend on rounding, and schedule the next arrival
+ */
+auto TrafficGenerator::processArrival(Event const& event) -> void
+{
+    uint64_t startUs = usToMs(event.timeUs + 999);
+    if (event.kind == EventKind::ConnectionArrival) {
+        auto fqdn = getConnectionParams(event.index).fqdn;
+        if (resolvedFqdns[fqdn]) {
+            schedule(startUs, EventKind::Connection, event.index, 0);
+        } else {
+            schedule(startUs, EventKind::Resolve, event.index, 0, nextDnsId++);
+        }
+    } else {
+        schedule(startUs, EventKind::Dns, event.index, 0, nextDnsId++);
+    }
+
+    double rate = event.kind == EventKind::ConnectionArrival ? profile.connectionRate : profile.dnsRate;
+    auto delayUs = uint64_t(-std::log(random(event.kind, event.index, 0)) / rate * 1000000);
+    schedule(event.timeUs + delayUs, event.kind, event.index + 1, 0);
+}
+
+auto TrafficGenerator::accountDnsQuery(bool aaaa, bool tcp) -> void
+{
+    groundTruth.dnsQueries++;
+    groundTruth.dnsA += !aaaa;
+    groundTruth.dnsAaaa += aaaa;
+    groundTruth.dnsUdp += !tcp;
+    groundTruth.dnsTcp += tcp;
+}
+
+auto TrafficGenerator::processResolve(Event const& event) -> bool
+{
+    auto params = getConnectionParams(event.index);
+    size_t offset = ethernetSize + ipSize + udpSize;
+    auto responseTime = sample(profile.dnsResponseTime, EventKind::Resolve, event.index, 0);
+    if (event.step == 0) {
+        auto size = writeDns(&frame[offset], event.dnsId, params.fqdn, false, false);
+        writeFrame(params.clientIp, params.clientPort, resolverIp, 53, false, 0, 0, 0, size);
+        accountDnsQuery(false, false);
+        schedule(event.timeUs + responseTime * 1000 + 1, event.kind, event.index, 1, event.dnsId);
+        return true;
+    }
+    auto size = writeDns(&frame[offset], event.dnsId, params.fqdn, false, true);
+    writeFrame(resolverIp, 53, params.clientIp, params.clientPort, false, 0, 0, 0, size);
+    groundTruth.dnsResponses++;
+    groundTruth.dnsSrts.addPoint(responseTime);
+    resolvedFqdns[params.fqdn] = true;
+    schedule(usToMs(event.timeUs) + 1000, EventKind::Connection, event.index, 0);
+    return true;
+}
+
+auto TrafficGenerator::processDns(Event const& event) -> bool
+{
+    auto params = getDnsParams(event.index);
+    if (isDnsTcp(event.index)) {
+        return processTcp(event, params);
+    }
+
+    size_t offset = ethernetSize + ipSize + udpSize;
+    if (event.step == 0) {
+        auto size = writeDns(&frame[offset], event.dnsId, params.fqdn, params.aaaa, false);
+        writeFrame(params.clientIp, params.clientPort, resolverIp, 53, false, 0, 0, 0, size);
+        accountDnsQuery(params.aaaa, false);
+        if (params.responses > 0) {
+            auto responseTime = getSrt(params, event.kind, event.index, 0);
+            schedule(event.timeUs + responseTime * 1000 + 1, event.kind, event.index, 1, event.dnsId);
+        }
+        return true;
+    }
+    auto size = writeDns(&frame[offset], event.dnsId, params.fqdn, params.aaaa, true);
+    writeFrame(resolverIp, 53, params.clientIp, params.clientPort, false, 0, 0, 0, size);
+    groundTruth.dnsResponses++;
+    groundTruth.dnsSrts.addPoint(getSrt(params, event.kind, event.index, 0));
+    if (!params.aaaa) {
+        resolvedFqdns[params.fqdn] = true;
+    }
+    return true;
+}
+
+/**
+ * Steps of a tcp conversation: handshake, then each request and its
+ * response, then both fins and the last ack. Requests and measured
+ * responses are sent on whole milliseconds so measured durations match
+ * the sampled ones.
+ */
+auto TrafficGenerator::processTcp(Event const& event, TcpParams const& params) -> bool
+{
+    bool isConnection = event.kind == EventKind::Connection;
+    uint32_t const step = event.step;
+    uint32_t const finStep = 3 + 2 * params.requests;
+    size_t const offset = ethernetSize + ipSize + tcpSize;
+    uint32_t const clientSeq = params.clientIsn + 1;
+    uint32_t const serverSeq = params.serverIsn + 1;
+
+    if (step == 0) {
+        writeFrame(params.clientIp, params.clientPort, params.serverIp, params.serverPort,
+            true, params.clientIsn, 0, tcpSyn, 0);
+        schedule(event.timeUs + params.connectTime * 1000 + 1, event.kind, event.index, 1, event.dnsId);
+    } else if (step == 1) {
+        writeFrame(params.serverIp, params.serverPort, params.clientIp, params.clientPort,
+            true, params.serverIsn, clientSeq, tcpSyn | tcpAck, 0);
+        schedule(event.timeUs + 1, event.kind, event.index, 2, event.dnsId);
+    } else if (step == 2) {
+        writeFrame(params.clientIp, params.clientPort, params.serverIp, params.serverPort,
+            true, clientSeq, serverSeq, tcpAck, 0);
+        if (isConnection) {
+            groundTruth.tcpConnections++;
+            groundTruth.connectTimes.addPoint(params.connectTime);
+            groundTruth.fqdnConnections[params.fqdn]++;
+        }
+        schedule(usToMs(event.timeUs) + 1000, event.kind, event.index, 3, event.dnsId);
+    } else if (step < finStep && (step - 3) % 2 == 0) {
+        uint32_t request = (step - 3) / 2;
+        auto size = writePayload(params, true, request, event.dnsId, &frame[offset]);
+        writeFrame(params.clientIp, params.clientPort, params.serverIp, params.serverPort,
+            true, clientSeq + sentBytes(params, true, request),
+            serverSeq + sentBytes(params, false, request), tcpPsh | tcpAck, size);
+        if (isConnection && params.tls && request == 0) {
+            groundTruth.tlsClientHellos++;
+        }
+        if (!isConnection) {
+            accountDnsQuery(params.aaaa, true);
+        }
+        if (request < params.responses) {
+            auto srt = getSrt(params, event.kind, event.index, request);
+            schedule(event.timeUs + srt * 1000 + 1, event.kind, event.index, step + 1, event.dnsId);
+        } else {
+            schedule(event.timeUs + dnsTimeoutMs * 1000, event.kind, event.index, finStep, event.dnsId);
+        }
+    } else if (step < finStep) {
+        uint32_t response = (step - 3) / 2;
+        auto size = writePayload(params, false, response, event.dnsId, &frame[offset]);
+        writeFrame(params.serverIp, params.serverPort, params.clientIp, params.clientPort,
+            true, serverSeq + sentBytes(params, false, response),
+            clientSeq + sentBytes(params, true, response + 1), tcpPsh | tcpAck, size);
+        auto srt = getSrt(params, event.kind, event.index, response);
+        if (isConnection) {
+            groundTruth.srts.addPoint(srt);
+            if (params.tls && response == 0) {
+                groundTruth.tlsHandshakes.addPoint(srt);
+            }
+        } else {
+            groundTruth.dnsResponses++;
+            groundTruth.dnsSrts.addPoint(srt);
+            if (!params.aaaa) {
+                resolvedFqdns[params.fqdn] = true;
+            }
+        }
+        schedule(usToMs(event.timeUs) + params.thinkTime * 1000, event.kind, event.index,
+            step + 1, event.dnsId);
+    } else {
+        uint32_t clientFin = clientSeq + sentBytes(params, true, params.requests);
+        uint32_t serverFin = serverSeq + sentBytes(params, false, params.responses);
+        if (step == finStep) {
+            writeFrame(params.clientIp, params.clientPort, params.serverIp, params.serverPort,
+                true, clientFin, serverFin, tcpFin | tcpAck, 0);
+            schedule(event.timeUs + 1, event.kind, event.index, step + 1, event.dnsId);
+        } else if (step == finStep + 1) {
+            writeFrame(params.serverIp, params.serverPort, params.clientIp, params.clientPort,
+                true, serverFin, clientFin + 1, tcpFin | tcpAck, 0);
+            schedule(event.timeUs + 1, event.kind, event.index, step + 1, event.dnsId);
+        } else {
+            writeFrame(params.clientIp, params.clientPort, params.serverIp, params.serverPort,
+                true, clientFin + 1, serverFin + 1, tcpAck, 0);
+            groundTruth.tcpCloses += isConnection;
+        }
+    }
+    return true;
+}
+
+auto TrafficGenerator::payloadSize(TcpParams const& params, bool fromClient,
+    uint32_t message) const -> uint32_t
+{
+    if (params.serverPort == 53) {
+        // Length prefixed dns message
+        uint32_t querySize = 12 + getFqdnSize(params.fqdn) + 2 + 4;
+        uint32_t answerSize = 12 + (params.aaaa ? 16 : 4);
+        return 2 + querySize + (fromClient ? 0 : answerSize);
+    }
+    if (params.tls && message == 0) {
+        return fromClient ? 61 + getFqdnSize(params.fqdn) : serverHandshakeSize;
+    }
+    return fromClient ? profile.requestSize : profile.responseSize;
+}
+
+auto TrafficGenerator::sentBytes(TcpParams const& params, bool fromClient,
+    uint32_t messages) const -> uint32_t
+{
+    if (messages == 0) {
+        return 0;
+    }
+    return payloadSize(params, fromClient, 0) + (messages - 1) * payloadSize(params, fromClient, 1);
+}
+
+auto TrafficGenerator::writePayload(TcpParams const& params, bool fromClient,
+    uint32_t message, uint16_t dnsId, uint8_t* out) const -> uint32_t
+{
+    auto size = payloadSize(params, fromClient, message);
+    if (params.serverPort == 53) {
+        write16(out, size - 2);
+        writeDns(out + 2, dnsId, params.fqdn, params.aaaa, !fromClient);
+        return size;
+    }
+
+    if (params.tls) {
+        if (message == 0 && fromClient) {
+            return writeClientHello(out, params.fqdn);
+        }
+        uint8_t* record = out;
+        if (message == 0) {
+            uint8_t const changeCipherSpec[] = { 0x14, 0x03, 0x03, 0x00, 0x01, 0x01 };
+            memcpy(out, changeCipherSpec, sizeof(changeCipherSpec));
+            record = out + sizeof(changeCipherSpec);
+            record[0] = 0x16;
+        } else {
+            record[0] = 0x17;
+        }
+        write16(record + 1, 0x0303);
+        uint32_t recordSize = size - (record - out) - 5;
+        write16(record + 3, recordSize);
+        memset(record + 5, 0xaa, recordSize);
+        return size;
+    }
+
+    auto text = fromClient
+        ? fmt::format("GET /{} HTTP/1.1\r\nHost: {}\r\n", message, getFqdn(params.fqdn))
+        : fmt::format("HTTP/1.1 200 OK\r\nServer: flowgen\r\n");
+    auto textSize = std::min<size_t>(text.size(), size);
+    memcpy(out, text.data(), textSize);
+    memset(out + textSize, '.', size - textSize);
+    return size;
+}
+
+auto TrafficGenerator::writeDns(uint8_t* out, uint16_t dnsId, uint32_t fqdn,
+    bool aaaa, bool response) const -> uint32_t
+{
+    uint16_t const type = aaaa ? 28 : 1;
+    write16(out, dnsId);
+    write16(out + 2, response ? 0x8180 : 0x0100);
+    write16(out + 4, 1);
+    write16(out + 6, response ? 1 : 0);
+    write16(out + 8, 0);
+    write16(out + 10, 0);
+    uint8_t* pos = out + 12;
+
+    auto name = getFqdn(fqdn);
+    size_t labelStart = 0;
+    while (labelStart <= name.size()) {
+        auto labelEnd = std::min(name.find('.', labelStart), name.size());
+        *pos++ = labelEnd - labelStart;
+        memcpy(pos, name.data() + labelStart, labelEnd - labelStart);
+        pos += labelEnd - labelStart;
+        labelStart = labelEnd + 1;
+    }
+    *pos++ = 0;
+    write16(pos, type);
+    write16(pos + 2, 1);
+    pos += 4;
+    if (!response) {
+        return pos - out;
+    }
+
+    // Compressed name pointing to the question
+    write16(pos, 0xc00c);
+    write16(pos + 2, type);
+    write16(pos + 4, 1);
+    write32(pos + 6, dnsTtl);
+    pos += 10;
+    if (aaaa) {
+        write16(pos, 16);
+        memset(pos + 2, 0, 16);
+        pos[2] = 0xfd;
+        write32(pos + 14, fqdn + 1);
+        pos += 18;
+    } else {
+        write16(pos, 4);
+        write32(pos + 2, serverNet + fqdn);
+        pos += 6;
+    }
+    return pos - out;
+}
+
+auto TrafficGenerator::writeClientHello(uint8_t* out, uint32_t fqdn) const -> uint32_t
+{
+    auto name = getFqdn(fqdn);
+    uint16_t nameSize = name.size();
+    uint32_t bodySize = 52 + nameSize;
+
+    // Record and handshake headers
+    out[0] = 0x16;
+    write16(out + 1, 0x0301);
+    write16(out + 3, 4 + bodySize);
+    out[5] = 0x01;
+    out[6] = 0;
+    write16(out + 7, bodySize);
+    uint8_t* pos = out + 9;
+
+    write16(pos, 0x0303);
+    for (int i = 0; i < 32; ++i) {
+        pos[2 + i] = uint8_t(hash(EventKind::Connection, fqdn, 1000 + i));
+    }
+    pos += 34;
+    // Empty session id, one cipher suite, null compression
+    *pos++ = 0;
+    write16(pos, 2);
+    write16(pos + 2, 0xc02f);
+    pos += 4;
+    *pos++ = 1;
+    *pos++ = 0;
+
+    // Server name extension
+    write16(pos, 9 + nameSize);
+    write16(pos + 2, 0);
+    write16(pos + 4, 5 + nameSize);
+    write16(pos + 6, 3 + nameSize);
+    pos[8] = 0;
+    write16(pos + 9, nameSize);
+    memcpy(pos + 11, name.data(), nameSize);
+    pos += 11 + nameSize;
+    return pos - out;
+}
+
+auto TrafficGenerator::writeFrame(uint32_t srcIp, uint16_t srcPort, uint32_t dstIp,
+    uint16_t dstPort, bool tcp, uint32_t seq, uint32_t ack, uint8_t flags,
+    uint32_t payloadSize) -> void
+{
+    uint8_t* pos = frame.data();
+    uint8_t const macs[] = { 0x02, 0, 0, 0, 0, 0x02, 0x02, 0, 0, 0, 0, 0x01 };
+    memcpy(pos, macs, sizeof(macs));
+    write16(pos + 12, 0x0800);
+
+    size_t transportSize = (tcp ? tcpSize : udpSize) + payloadSize;
+    uint8_t* ip = pos + ethernetSize;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    write16(ip + 2, ipSize + transportSize);
+    write32(ip + 4, 0x00004000); // Don't fragment
+    ip[8] = 64;
+    ip[9] = tcp ? 6 : 17;
+    write16(ip + 10, 0);
+    write32(ip + 12, srcIp);
+    write32(ip + 16, dstIp);
+    write16(ip + 10, checksumFold(checksumAdd(0, ip, ipSize)));
+
+    uint8_t* transport = ip + ipSize;
+    write16(transport, srcPort);
+    write16(transport + 2, dstPort);
+    size_t checksumOffset = 6;
+    if (tcp) {
+        write32(transport + 4, seq);
+        write32(transport + 8, ack);
+        transport[12] = (tcpSize / 4) << 4;
+        transport[13] = flags;
+        write16(transport + 14, 65535);
+        write16(transport + 18, 0);
+        checksumOffset = 16;
+    } else {
+        write16(transport + 4, transportSize);
+    }
+    write16(transport + checksumOffset, 0);
+    // Pseudo header
+    uint32_t sum = checksumAdd(0, ip + 12, 8) + ip[9] + transportSize;
+    auto checksum = checksumFold(checksumAdd(sum, transport, transportSize));
+    write16(transport + checksumOffset, (!tcp && checksum == 0) ? 0xffff : checksum);
+
+    frameHeader.caplen = ethernetSize + ipSize + transportSize;
+    frameHeader.len = frameHeader.caplen;
+}
+
+} // namespace flowstats
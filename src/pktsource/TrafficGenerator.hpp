@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <pcap/pcap.h>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace flowstats {
+
+/**
+ * Distribution of generated durations in milliseconds, parsed from
+ * "const:10", "uniform:5:50", "exp:20" or "lognormal:20:0.5", where
+ * exp takes the mean and lognormal the median and the sigma
+ */
+struct Distribution {
+    enum class Type {
+        Constant,
+        Uniform,
+        Exponential,
+        LogNormal,
+    };
+
+    static auto parse(std::string const& str) -> std::optional<Distribution>;
+    /**
+     * Sample from two independent uniform values in ]0, 1[
+     */
+    [[nodiscard]] auto sample(double u1, double u2) const -> uint32_t;
+
+    Type type = Type::Constant;
+    double a = 0;
+    double b = 0;
+};
+
+/**
+ * Parameters of the generated traffic. Connections and standalone dns
+ * queries arrive as two poisson processes.
+ */
+struct TrafficProfile {
+    uint64_t seed = 1;
+    time_t startTime = 1600000000;
+    uint32_t durationSeconds = 60;
+
+    // New tcp connections per second
+    double connectionRate = 1000;
+    // Connections opened with a tls ClientHello carrying the fqdn as sni
+    double tlsFraction = 0.5;
+    uint32_t numberFqdns = 1000;
+    uint32_t numberClients = 1000;
+    Distribution flowDuration = { Distribution::Type::Exponential, 10000, 0 };
+    Distribution requestsPerFlow = { Distribution::Type::Uniform, 1, 8 };
+    Distribution connectTime = { Distribution::Type::LogNormal, 20, 0.5 };
+    Distribution srt = { Distribution::Type::LogNormal, 50, 0.8 };
+    uint32_t requestSize = 200;
+    uint32_t responseSize = 1000;
+
+    // Standalone dns queries per second, on top of the resolution
+    // done before the first connection to each fqdn
+    double dnsRate = 100;
+    double aaaaFraction = 0.3;
+    double dnsTcpFraction = 0.05;
+    double dnsTimeoutFraction = 0.01;
+    Distribution dnsResponseTime = { Distribution::Type::Exponential, 5, 0 };
+};
+
+/**
+ * Exact distribution of generated millisecond values
+ */
+class ExactHistogram {
+public:
+    auto addPoint(uint32_t ms) -> void;
+    [[nodiscard]] auto getCount() const -> uint64_t { return count; }
+    /**
+     * Value at the same nearest rank as Percentile::getPercentile
+     */
+    [[nodiscard]] auto getPercentile(float p) const -> uint32_t;
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+};
+
+/**
+ * What the collectors should measure on the generated traffic, only
+ * frames emitted before the end of the profile are accounted
+ */
+struct GroundTruth {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+
+    // Connections to fqdns, tcp dns connections are only counted in dns
+    uint64_t tcpConnections = 0;
+    uint64_t tcpCloses = 0;
+    ExactHistogram connectTimes;
+    ExactHistogram srts;
+
+    uint64_t tlsClientHellos = 0;
+    // ClientHello to ChangeCipherSpec
+    ExactHistogram tlsHandshakes;
+
+    uint64_t dnsQueries = 0;
+    uint64_t dnsResponses = 0;
+    uint64_t dnsA = 0;
+    uint64_t dnsAaaa = 0;
+    uint64_t dnsUdp = 0;
+    uint64_t dnsTcp = 0;
+    ExactHistogram dnsSrts;
+
+    std::vector<uint64_t> fqdnConnections;
+
+    [[nodiscard]] auto toJson(size_t numberTopFqdns) const -> std::string;
+};
+
+/**
+ * Deterministic generator of tcp, tls and dns traffic as ethernet
+ * frames. Parameters of every flow are derived from the seed and the
+ * flow index, only pending packets are kept in memory so the number of
+ * concurrent flows is bounded by memory at 24 bytes per flow.
+ *
+ * Frames are returned in timestamp order, like a capture file, and are
+ * only valid until the next call to next.
+ */
+class TrafficGenerator {
+public:
+    explicit TrafficGenerator(TrafficProfile profile);
+
+    /**
+     * Fill the header and data of the next frame, return false once
+     * the end of the profile is reached
+     */
+    auto next(pcap_pkthdr* header, uint8_t const** data) -> bool;
+
+    [[nodiscard]] auto getGroundTruth() const -> GroundTruth const& { return groundTruth; }
+    [[nodiscard]] static auto getFqdn(uint32_t fqdnIndex) -> std::string;
+    [[nodiscard]] static auto getFqdnSize(uint32_t fqdnIndex) -> uint32_t;
+
+private:
+    enum class EventKind : uint8_t {
+        ConnectionArrival,
+        DnsArrival,
+        // Dns lookup before a connection to an unresolved fqdn
+        Resolve,
+        Connection,
+        Dns,
+    };
+
+    struct Event {
+        uint64_t timeUs;
+        uint32_t index;
+        uint16_t step;
+        uint16_t dnsId;
+        EventKind kind;
+
+        auto operator>(Event const& other) const -> bool;
+    };
+
+    /**
+     * Tcp conversation of a connection or of a dns query over tcp
+     */
+    struct TcpParams {
+        uint32_t clientIp;
+        uint16_t clientPort;
+        uint32_t serverIp;
+        uint16_t serverPort;
+        uint32_t clientIsn;
+        uint32_t serverIsn;
+        uint32_t connectTime;
+        uint32_t requests;
+        uint32_t responses;
+        // Between a response and the next request or the close
+        uint32_t thinkTime;
+        uint32_t fqdn;
+        bool tls;
+        bool aaaa;
+    };
+
+    [[nodiscard]] auto hash(EventKind kind, uint32_t index, uint32_t salt) const -> uint64_t;
+    [[nodiscard]] auto random(EventKind kind, uint32_t index, uint32_t salt) const -> double;
+    [[nodiscard]] auto sample(Distribution const& distribution,
+        EventKind kind, uint32_t index, uint32_t salt) const -> uint32_t;
+    [[nodiscard]] auto getConnectionParams(uint32_t index) const -> TcpParams;
+    [[nodiscard]] auto getDnsParams(uint32_t index) const -> TcpParams;
+    [[nodiscard]] auto isDnsTcp(uint32_t index) const -> bool;
+    [[nodiscard]] auto isDnsTimeout(uint32_t index) const -> bool;
+    [[nodiscard]] auto getSrt(TcpParams const& params, EventKind kind,
+        uint32_t index, uint32_t request) const -> uint32_t;
+
+    auto schedule(uint64_t timeUs, EventKind kind, uint32_t index,
+        uint16_t step, uint16_t dnsId = 0) -> void;
+    auto processEvent(Event const& event) -> bool;
+    auto processArrival(Event const& event) -> void;
+    auto processResolve(Event const& event) -> bool;
+    auto processDns(Event const& event) -> bool;
+    auto processTcp(Event const& event, TcpParams const& params) -> bool;
+
+    [[nodiscard]] auto payloadSize(TcpParams const& params, bool fromClient,
+        uint32_t message) const -> uint32_t;
+    [[nodiscard]] auto sentBytes(TcpParams const& params, bool fromClient,
+        uint32_t messages) const -> uint32_t;
+    auto writePayload(TcpParams const& params, bool fromClient,
+        uint32_t message, uint16_t dnsId, uint8_t* out) const -> uint32_t;
+    auto writeDns(uint8_t* out, uint16_t dnsId, uint32_t fqdn,
+        bool aaaa, bool response) const -> uint32_t;
+    auto writeClientHello(uint8_t* out, uint32_t fqdn) const -> uint32_t;
+
+    auto writeFrame(uint32_t srcIp, uint16_t srcPort, uint32_t dstIp,
+        uint16_t dstPort, bool tcp, uint32_t seq, uint32_t ack, uint8_t flags,
+        uint32_t payloadSize) -> void;
+    auto accountDnsQuery(bool aaaa, bool tcp) -> void;
+
+    TrafficProfile profile;
+    uint64_t endUs;
+    std::priority_queue<Event, std::vector<Event>, std::greater<>> events;
+    std::vector<bool> resolvedFqdns;
+    uint16_t nextDnsId = 0;
+
+    GroundTruth groundTruth;
+    pcap_pkthdr frameHeader = {};
+    std::array<uint8_t, 2048> frame = {};
+};
+
+} // namespace flowstats
@@ -1,4 +1,5 @@
 #include "Screen.hpp"
+#include "InternalStats.hpp"
 #include "Utils.hpp"
 #include <fmt/format.h>
 #include <tins/dns.h>
@@ -23,7 +24,7 @@
 #define KEY_NUM(n) (KEY_0 + (n))
 
 // Sizes
-#define STATUS_LINES 5
+#define STATUS_LINES 6
 #define STATUS_COLUMNS 120
 
 #define HEADER_LINES 1
@@ -55,6 +56,8 @@ int lastKey = 0;
 std::array<CollectorProtocol, 3> protocols = { DNS, TCP, SSL };
 std::array<int, 3> protocolToDisplayIndex = { 0, 0, 0 };
 std::array<int, 3> protocolToSortIndex = { 0, 0, 0 };
+// Last view after the protocols, showing the pipeline internal stats
+unsigned int const internalsViewIndex = protocols.size();
 
 auto Screen::updateDisplay(timeval tv, bool updateOutput,
     std::optional<CaptureStat> captureStat) -> void
@@ -72,13 +75,17 @@ auto Screen::updateDisplay(timeval tv, bool updateOutput,
     updateSortSelection();
     updateMenu();
 
-    if (shouldFreeze == true) {
-        refreshPads();
-        return;
+    // A frozen display keeps its snapshot, it can still be scrolled
+    if ((updateOutput && !shouldFreeze) || displayedSnapshot == nullptr) {
+        displayedSnapshot = activeCollector->getSnapshot();
     }
-
-    if (updateOutput) {
-        collectorOutput = activeCollector->outputStatus(tv.tv_sec);
+    updateViewport();
+    if (isInternalsView()) {
+        internalStats().outputStatus(&collectorOutput);
+    } else {
+        StageTimer timer(Stage::OutputStatus, activeCollector->getProtocol(), true);
+        activeCollector->outputStatus(*displayedSnapshot, tv.tv_sec, &collectorOutput,
+            verticalScroll, maxElements);
     }
 
     updateHeaders();
@@ -87,30 +94,63 @@ auto Screen::updateDisplay(timeval tv, bool updateOutput,
     refreshPads();
 }
 
+/**
+ * The total is pinned on the first two lines, followed by maxElements
+ * flows starting at verticalScroll
+ */
+auto Screen::updateViewport() -> void
+{
+    maxElements = std::max((LINES - (STATUS_LINES + HEADER_LINES + MENU_LINES)) / 2 - 1, 1);
+    maxElements = std::min(maxElements, KEY_LINES / 2 - 1);
+    selectedLine = std::max(std::min(selectedLine, numberElements - 1), 0);
+    if (selectedLine < verticalScroll) {
+        verticalScroll = selectedLine;
+    } else if (selectedLine >= verticalScroll + maxElements) {
+        verticalScroll = selectedLine - maxElements + 1;
+    }
+}
+
+/**
+ * Lines are only repainted when their text or highlight changed since
+ * the last draw
+ */
+auto Screen::drawLine(int line, std::string_view key, std::string_view value, bool selected) -> void
+{
+    auto& drawn = drawnLines[line];
+    if (drawn.valid && drawn.selected == selected && drawn.key == key && drawn.value == value) {
+        return;
+    }
+    if (selected) {
+        wattron(keyWin, COLOR_PAIR(SELECTED_LINE_COLOR));
+        wattron(valueWin, COLOR_PAIR(SELECTED_LINE_COLOR));
+    }
+    mvwprintw(keyWin, line, 0, "%-" STR(KEY_COLUMNS) ".*s", int(key.size()), key.data());
+    mvwprintw(valueWin, line, 0, "%-" STR(VALUE_COLUMNS) ".*s", int(value.size()), value.data());
+    if (selected) {
+        wattroff(keyWin, COLOR_PAIR(SELECTED_LINE_COLOR));
+        wattroff(valueWin, COLOR_PAIR(SELECTED_LINE_COLOR));
+    }
+    drawn.key = key;
+    drawn.value = value;
+    drawn.selected = selected;
+    drawn.valid = true;
+}
+
 auto Screen::updateValues() -> void
 {
-    werase(keyWin);
-    werase(valueWin);
-
-    numberElements = int(collectorOutput.getKeys().size() / 2);
-    for (unsigned int i = 0; i < collectorOutput.getKeys().size(); ++i) {
-        int line = i / 2;
-        if (line == selectedLine) {
-            wattron(keyWin, COLOR_PAIR(SELECTED_LINE_COLOR));
-            wattron(valueWin, COLOR_PAIR(SELECTED_LINE_COLOR));
-        }
-        mvwprintw(keyWin, i, 0,
-            fmt::format("{:<" STR(KEY_COLUMNS) "}",
-                collectorOutput.getKeys()[i].c_str())
-                .c_str());
-        mvwprintw(valueWin, i, 0,
-            fmt::format("{:<" STR(VALUE_COLUMNS) "}",
-                collectorOutput.getValues()[i].c_str())
-                .c_str());
-        if (line == selectedLine) {
-            wattroff(keyWin, COLOR_PAIR(SELECTED_LINE_COLOR));
-            wattroff(valueWin, COLOR_PAIR(SELECTED_LINE_COLOR));
+    numberElements = int(collectorOutput.getFlowCount());
+    size_t lines = 2 * size_t(maxElements + 1);
+    drawnLines.resize(std::max(drawnLines.size(), lines));
+    for (size_t line = 0; line < lines; ++line) {
+        std::string_view key;
+        std::string_view value;
+        if (line < collectorOutput.getRowCount()) {
+            key = collectorOutput.getKey(line);
+            value = collectorOutput.getValue(line);
         }
+        bool selected = line >= 2 && numberElements > 0
+            && collectorOutput.getFirstFlow() + (line - 2) / 2 == size_t(selectedLine);
+        drawLine(int(line), key, value, selected);
     }
 }
 
@@ -159,20 +199,24 @@ auto Screen::updateStatus(std::optional<CaptureStat> captureStat) -> void
 
     waddstr(statusWin, currentCaptureStat.getTotal().c_str());
     waddstr(statusWin, currentCaptureStat.getRate(previousCaptureStat).c_str());
+    waddstr(statusWin, currentCaptureStat.getRingStatus().c_str());
 
     waddstr(statusWin, fmt::format("{:<10} ", "Protocol:").c_str());
-    for (unsigned int i = 0; i < ARRAY_SIZE(protocols); ++i) {
-        auto proto = protocols[i];
+    for (unsigned int i = 0; i <= internalsViewIndex; ++i) {
+        auto viewName = i == internalsViewIndex ? "Internals" : collectorProtocolToString(protocols[i]);
         if (displayConf->protocolIndex == i) {
             wattron(statusWin, COLOR_PAIR(SELECTED_STATUS_COLOR));
         }
-        waddstr(statusWin, fmt::format("{}: {:<10} ", i + 1, collectorProtocolToString(proto)).c_str());
+        waddstr(statusWin, fmt::format("{}: {:<10} ", i + 1, viewName).c_str());
         if (displayConf->protocolIndex == i) {
             wattroff(statusWin, COLOR_PAIR(SELECTED_STATUS_COLOR));
         }
     }
     waddstr(statusWin, "\n");
 
+    if (isInternalsView()) {
+        return;
+    }
     waddstr(statusWin, fmt::format("{:<10} ", "Display:").c_str());
     int i = 0;
     int displayIndex = protocolToDisplayIndex[displayConf->protocolIndex];
@@ -233,6 +277,11 @@ auto Screen::updateMenu() -> void
     }
 }
 
+auto Screen::isInternalsView() const -> bool
+{
+    return displayConf->protocolIndex == internalsViewIndex;
+}
+
 auto Screen::getActiveCollector() -> Collector*
 {
     for (auto& collector : collectors) {
@@ -304,7 +353,7 @@ auto Screen::refreshPads() -> void
         STATUS_LINES + HEADER_LINES, KEY_COLUMNS + deltaValues);
 
     pnoutrefresh(keyWin,
-        verticalScroll, 0,
+        0, 0,
         STATUS_LINES + HEADER_LINES, deltaValues,
         LINES - (HEADER_LINES + MENU_LINES), KEY_COLUMNS + deltaValues);
 
@@ -314,7 +363,7 @@ auto Screen::refreshPads() -> void
         STATUS_LINES + HEADER_LINES, COLS - deltaValues - 1);
 
     pnoutrefresh(valueWin,
-        verticalScroll, 0,
+        0, 0,
         STATUS_LINES + HEADER_LINES, KEY_COLUMNS + deltaValues,
         LINES - (HEADER_LINES + MENU_LINES), COLS - deltaValues - 1);
 
@@ -365,11 +414,25 @@ auto Screen::refreshableAction(int c) -> bool
         }
     }
 
-    if (c >= KEY_NUM(1) && c <= KEY_NUM(3)) {
+    if (c >= KEY_NUM(1) && c <= KEY_NUM(1 + int(internalsViewIndex))) {
         displayConf->protocolIndex = c - KEY_NUM(1);
-        activeCollector = getActiveCollector();
+        const std::lock_guard<std::mutex> lock(screenMutex);
+        // The internals view keeps the last collector active
+        if (!isInternalsView()) {
+            activeCollector = getActiveCollector();
+        }
+        displayedSnapshot = nullptr;
+        selectedLine = 0;
+        verticalScroll = 0;
         return true;
-    } else if (c == KEY_F(4)) {
+    }
+
+    // Internal stats can't be filtered, sorted or displayed differently
+    if (isInternalsView()) {
+        return false;
+    }
+
+    if (c == KEY_F(4)) {
         editFilter = true;
         return true;
     } else if (c == KEY_LEFT) {
@@ -426,7 +489,6 @@ auto Screen::displayLoop() -> void
             continue;
         }
 
-        maxElements = (LINES - (STATUS_LINES + HEADER_LINES + MENU_LINES)) / 2 - 1;
         switch (c) {
         case KEY_LETTER_F:
             shouldFreeze = !shouldFreeze;
@@ -448,11 +510,6 @@ auto Screen::displayLoop() -> void
             selectedLine = std::min(selectedLine, numberElements - 1);
             break;
         }
-        if (selectedLine * 2 < verticalScroll) {
-            verticalScroll = selectedLine * 2;
-        } else if (selectedLine * 2 > (maxElements * 2 + verticalScroll)) {
-            verticalScroll += selectedLine * 2 - (maxElements * 2 + verticalScroll);
-        }
         updateDisplay(lastTv, false, {});
     }
 }
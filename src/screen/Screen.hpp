@@ -36,10 +36,13 @@ private:
     auto displayLoop() -> void;
     auto refreshPads() -> void;
     auto getActiveCollector() -> Collector*;
+    [[nodiscard]] auto isInternalsView() const -> bool;
 
     auto refreshableAction(int c) -> bool;
     auto updateHeaders() -> void;
     auto updateValues() -> void;
+    auto updateViewport() -> void;
+    auto drawLine(int line, std::string_view key, std::string_view value, bool selected) -> void;
     auto updateStatus(std::optional<CaptureStat> captureStat) -> void;
     auto updateMenu() -> void;
     auto updateSortSelection() -> void;
@@ -55,10 +58,19 @@ private:
 
     WINDOW* sortSelectionWin = nullptr;
 
+    struct DrawnLine {
+        std::string key;
+        std::string value;
+        bool selected = false;
+        bool valid = false;
+    };
+
+    // Visible flows, total flows, selected and first visible flow indexes
     int maxElements = 0;
     int numberElements = 0;
     int selectedLine = 0;
     int verticalScroll = 0;
+    std::vector<DrawnLine> drawnLines;
 
     std::thread screenThread;
     std::atomic_bool* shouldStop;
@@ -69,6 +81,7 @@ private:
     std::vector<Collector*> collectors;
     Collector* activeCollector;
     CollectorOutput collectorOutput;
+    std::shared_ptr<AggregatedSnapshot const> displayedSnapshot;
 
     timeval lastCaptureStatUpdate = {};
     CaptureStat stagingCaptureStat;
@@ -6,9 +6,46 @@ namespace flowstats {
 auto CollectorOutput::print() const -> void
 {
     fmt::print("{} {}s\n", name, delta);
-    for (unsigned int i = 0; i < keys.size(); ++i) {
-        fmt::print("{} {}\n", keys[i], values[i]);
+    for (size_t i = 0; i < getRowCount(); ++i) {
+        fmt::print("{} {}\n", getKey(i), getValue(i));
     }
     fmt::print("\n");
 }
+
+auto CollectorOutput::clear(std::string_view newName, int newDelta) -> void
+{
+    name = newName;
+    delta = newDelta;
+    keys.clear();
+    values.clear();
+    keyEnds.clear();
+    valueEnds.clear();
+    firstFlow = 0;
+    flowCount = 0;
+}
+
+auto CollectorOutput::setHeaders(std::string_view newKeyHeaders,
+    std::string_view newValueHeaders) -> void
+{
+    keyHeaders = newKeyHeaders;
+    valueHeaders = newValueHeaders;
+}
+
+auto CollectorOutput::endRow() -> void
+{
+    keyEnds.push_back(keys.size());
+    valueEnds.push_back(values.size());
+}
+
+auto CollectorOutput::getKey(size_t row) const -> std::string_view
+{
+    size_t start = row == 0 ? 0 : keyEnds[row - 1];
+    return std::string_view(keys).substr(start, keyEnds[row] - start);
+}
+
+auto CollectorOutput::getValue(size_t row) const -> std::string_view
+{
+    size_t start = row == 0 ? 0 : valueEnds[row - 1];
+    return std::string_view(values).substr(start, valueEnds[row] - start);
+}
 } // namespace flowstats
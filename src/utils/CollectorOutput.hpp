@@ -2,38 +2,60 @@
 
 #include "Configuration.hpp"
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace flowstats {
+
+/**
+ * Formatted rows of a collector. Rows are appended to a single key and
+ * a single value text and delimited by their end offsets, clearing the
+ * output keeps the buffers so a reused output doesn't allocate.
+ */
 struct CollectorOutput {
 
     CollectorOutput() = default;
-    CollectorOutput(std::string name,
-        std::vector<std::string> keys,
-        std::vector<std::string> values,
-        std::string keyHeaders,
-        std::string valueHeaders,
-        int delta)
-        : name(std::move(name))
-        , keys(std::move(keys))
-        , values(std::move(values))
-        , keyHeaders(std::move(keyHeaders))
-        , valueHeaders(std::move(valueHeaders))
-        , delta(delta) {};
 
     auto print() const -> void;
 
-    [[nodiscard]] auto getKeys() const { return keys; };
-    [[nodiscard]] auto getKeyHeaders() const { return keyHeaders; };
-    [[nodiscard]] auto getValues() const { return values; };
-    [[nodiscard]] auto getValueHeaders() const { return valueHeaders; };
+    /**
+     * Drop the rows, keeping the allocated buffers
+     */
+    auto clear(std::string_view newName, int newDelta) -> void;
+    auto setHeaders(std::string_view newKeyHeaders, std::string_view newValueHeaders) -> void;
+
+    [[nodiscard]] auto getKeyBuffer() -> std::string* { return &keys; };
+    [[nodiscard]] auto getValueBuffer() -> std::string* { return &values; };
+    auto endRow() -> void;
+
+    /**
+     * Rows after the total cover the flows from firstFlow, out of
+     * flowCount flows which could be displayed
+     */
+    auto setFlowWindow(size_t newFirstFlow, size_t newFlowCount) -> void
+    {
+        firstFlow = newFirstFlow;
+        flowCount = newFlowCount;
+    };
+    [[nodiscard]] auto getFirstFlow() const { return firstFlow; };
+    [[nodiscard]] auto getFlowCount() const { return flowCount; };
+
+    [[nodiscard]] auto getRowCount() const { return keyEnds.size(); };
+    [[nodiscard]] auto getKey(size_t row) const -> std::string_view;
+    [[nodiscard]] auto getValue(size_t row) const -> std::string_view;
+    [[nodiscard]] auto getKeyHeaders() const -> std::string const& { return keyHeaders; };
+    [[nodiscard]] auto getValueHeaders() const -> std::string const& { return valueHeaders; };
 
 private:
     std::string name;
-    std::vector<std::string> keys;
-    std::vector<std::string> values;
+    std::string keys;
+    std::string values;
+    std::vector<size_t> keyEnds;
+    std::vector<size_t> valueEnds;
     std::string keyHeaders;
     std::string valueHeaders;
+    size_t firstFlow = 0;
+    size_t flowCount = 0;
     int delta = 0;
 };
 } // namespace flowstats
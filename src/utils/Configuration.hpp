@@ -22,6 +22,15 @@ enum DisplayType {
 
 auto displayTypeToString(enum DisplayType displayType) -> std::string;
 
+enum StatsdMode {
+    // Distinct values sent with their sample rate, the agent computes
+    // the distribution
+    StatsdHistogram,
+    // Count, avg, p50, p95, p99 and max computed locally, a fixed number
+    // of metrics per aggregated flow whatever the request rate
+    StatsdSummary,
+};
+
 struct DisplayConfiguration {
     unsigned int protocolIndex = 0;
     int maxResults = 1000;
@@ -31,6 +40,16 @@ struct DisplayConfiguration {
     bool pcapReplay = false;
 };
 
+struct MmapRingConfiguration {
+    uint32_t blockSize = 1 << 22;
+    uint32_t blockCount = 64;
+    uint32_t frameSize = 2048;
+    // Milliseconds before the kernel hands over a partially filled block
+    uint32_t blockTimeout = 100;
+    // Fanout group shared with other flowstats processes, 0 to disable
+    uint16_t fanoutGroup = 0;
+};
+
 class FlowstatsConfiguration {
 public:
     FlowstatsConfiguration();
@@ -43,7 +62,12 @@ public:
     [[nodiscard]] auto getPerIpAggr() const -> bool const& { return perIpAggr; };
     [[nodiscard]] auto getDisplayUnknownFqdn() const -> bool const& { return displayUnknownFqdn; };
     [[nodiscard]] auto getAgentConf() const -> std::optional<DogFood::Configuration> const& { return agentConf; };
+    [[nodiscard]] auto getStatsdMode() const -> StatsdMode { return statsdMode; };
     [[nodiscard]] auto getTimeoutFlow() const -> int const& { return timeoutFlow; };
+    [[nodiscard]] auto getWorkerThreads() const -> int const& { return workerThreads; };
+    [[nodiscard]] auto getUseMmapRing() const -> bool const& { return useMmapRing; };
+    [[nodiscard]] auto getMmapRingConf() const -> MmapRingConfiguration const& { return mmapRingConf; };
+    [[nodiscard]] auto getDnsTableBytes() const -> size_t { return dnsTableBytes; };
 
     auto setBpfFilter(std::string b) { bpfFilter = std::move(b); };
     auto setPcapFileName(std::string p) { pcapFileName = std::move(p); };
@@ -51,7 +75,14 @@ public:
     auto setDisplayUnknownFqdn(bool d) { displayUnknownFqdn = d; };
     auto setPerIpAggr(bool p) { perIpAggr = p; };
     auto setAgentConf(std::optional<DogFood::Configuration> a) { agentConf = std::move(a); };
+    auto setStatsdMode(StatsdMode s) { statsdMode = s; };
     auto setDomainToServerPort(std::map<std::string, uint16_t> d) { domainToServerPort = std::move(d); };
+    auto setWorkerThreads(int w) { workerThreads = w; };
+    auto setUseMmapRing(bool u) { useMmapRing = u; };
+    auto setRingBlockSize(uint32_t s) { mmapRingConf.blockSize = s; };
+    auto setRingBlockCount(uint32_t c) { mmapRingConf.blockCount = c; };
+    auto setFanoutGroup(uint16_t f) { mmapRingConf.fanoutGroup = f; };
+    auto setDnsTableBytes(size_t d) { dnsTableBytes = d; };
 
 private:
     std::string iface = "";
@@ -63,7 +94,14 @@ private:
 
     bool displayUnknownFqdn = false;
     std::optional<DogFood::Configuration> agentConf;
+    StatsdMode statsdMode = StatsdHistogram;
     int timeoutFlow = 15;
+    int workerThreads = 1;
+    bool useMmapRing = false;
+    MmapRingConfiguration mmapRingConf;
+    // Memory of the pending dns queries table of each capture worker,
+    // enough for 1.5M queries with the transient of the last growth
+    size_t dnsTableBytes = size_t(600) << 20;
 };
 
 class FlowReplayConfiguration {
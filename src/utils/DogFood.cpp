@@ -369,7 +369,7 @@ auto Metric(
     //     `|@sample_rate`
     //
     if (_rate != 1.0) {
-        _datagram += "|@" + std::to_string(_rate);
+        _datagram += fmt::format("|@{:.9g}", _rate);
     }
 
     ////////////////////////////////////////////////////////////
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace flowstats {
+
+/**
+ * Read mostly hash index from a key to a 32 bits value with an expiry.
+ *
+ * Lookups take no lock. Slots are published with a single atomic
+ * entry packing the expiry and the value, the key of a slot is written
+ * before its entry and never changes afterwards. Updates are serialised
+ * by a mutex, only writers wait on each other.
+ *
+ * Expired entries are treated as missing by lookups and dropped when
+ * the table is rebuilt. A rebuilt table is published atomically and
+ * the previous one is freed once the readers which could see it are
+ * gone: readers register on the counter of the current epoch in their
+ * own cache line, writers flip the epoch and wait for the old counters
+ * of every reader slot to drain.
+ */
+template <typename Key, typename Hash = std::hash<Key>>
+class ExpiringIndex {
+public:
+    static uint32_t const neverExpire = UINT32_MAX;
+
+    ExpiringIndex()
+        : table(new Table(minCapacity))
+    {
+    }
+    ExpiringIndex(ExpiringIndex const&) = delete;
+    auto operator=(ExpiringIndex const&) -> ExpiringIndex& = delete;
+    ~ExpiringIndex() { delete table.load(); }
+
+    auto find(Key const& key, time_t now) const -> std::optional<uint32_t>
+    {
+        auto* readCounter = enterRead();
+        Table const* current = table.load(std::memory_order_acquire);
+        std::optional<uint32_t> res;
+        size_t index = hasher(key) & current->mask;
+        for (size_t probe = 0; probe <= current->mask; ++probe) {
+            Slot const& slot = current->slots[index];
+            uint64_t entry = slot.entry.load(std::memory_order_acquire);
+            if (entry == 0) {
+                break;
+            }
+            if (slot.key == key) {
+                if (entryExpiry(entry) >= now) {
+                    res = entryValue(entry);
+                }
+                break;
+            }
+            index = (index + 1) & current->mask;
+        }
+        leaveRead(readCounter);
+        return res;
+    }
+
+    /**
+     * Return true when the key maps to value with exactly this expiry,
+     * updating it with them would change nothing
+     */
+    auto hasEntry(Key const& key, uint32_t value, uint32_t expiry) const -> bool
+    {
+        auto* readCounter = enterRead();
+        Table const* current = table.load(std::memory_order_acquire);
+        bool res = false;
+        size_t index = hasher(key) & current->mask;
+        for (size_t probe = 0; probe <= current->mask; ++probe) {
+            Slot const& slot = current->slots[index];
+            uint64_t entry = slot.entry.load(std::memory_order_acquire);
+            if (entry == 0) {
+                break;
+            }
+            if (slot.key == key) {
+                res = entry == makeEntry(value, expiry);
+                break;
+            }
+            index = (index + 1) & current->mask;
+        }
+        leaveRead(readCounter);
+        return res;
+    }
+
+    /**
+     * Return true when the key had no live entry before
+     */
+    auto update(Key const& key, uint32_t value, uint32_t expiry, time_t now) -> bool
+    {
+        const std::lock_guard<std::mutex> lock(writeMutex);
+        uint64_t entry = makeEntry(value, expiry);
+        Table* current = table.load(std::memory_order_relaxed);
+        Slot* slot = findSlot(current, key);
+        uint64_t previous = slot->entry.load(std::memory_order_relaxed);
+        if (previous != 0) {
+            slot->entry.store(entry, std::memory_order_release);
+            return entryExpiry(previous) < now;
+        }
+        // Keep at least a quarter of the slots empty to bound probing
+        if ((current->used + 1) * 4 > (current->mask + 1) * 3) {
+            current = rebuild(current, now);
+            slot = findSlot(current, key);
+        }
+        slot->key = key;
+        slot->entry.store(entry, std::memory_order_release);
+        current->used++;
+        return true;
+    }
+
+    [[nodiscard]] auto size() const
+    {
+        const std::lock_guard<std::mutex> lock(writeMutex);
+        return table.load(std::memory_order_relaxed)->used;
+    }
+
+private:
+    static size_t const minCapacity = 1024;
+    static size_t const maxReaderSlots = 64;
+
+    /**
+     * Epoch counters of the readers of one thread, alone in their cache
+     * line so readers never write a line shared with other threads
+     */
+    struct alignas(64) ReaderSlot {
+        std::array<std::atomic<uint64_t>, 2> readers = {};
+    };
+
+    struct Slot {
+        Key key = {};
+        // Expiry in the high 32 bits, value in the low ones, 0 when empty
+        std::atomic<uint64_t> entry = 0;
+    };
+
+    struct Table {
+        explicit Table(size_t capacity)
+            : mask(capacity - 1)
+            , slots(new Slot[capacity])
+        {
+        }
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        size_t used = 0;
+    };
+
+    static auto makeEntry(uint32_t value, uint32_t expiry) -> uint64_t
+    {
+        // An expiry of 0 would look like an empty slot
+        return (uint64_t(expiry == 0 ? 1 : expiry) << 32) | value;
+    }
+    static auto entryExpiry(uint64_t entry) -> time_t { return time_t(entry >> 32); }
+    static auto entryValue(uint64_t entry) -> uint32_t { return uint32_t(entry); }
+
+    /**
+     * Slot holding the key or the empty slot ending its probe sequence
+     */
+    auto findSlot(Table* current, Key const& key) const -> Slot*
+    {
+        size_t index = hasher(key) & current->mask;
+        while (true) {
+            Slot* slot = &current->slots[index];
+            if (slot->entry.load(std::memory_order_relaxed) == 0 || slot->key == key) {
+                return slot;
+            }
+            index = (index + 1) & current->mask;
+        }
+    }
+
+    /**
+     * Copy the live entries in a table sized for twice their number,
+     * publish it and free the previous table
+     */
+    auto rebuild(Table* current, time_t now) -> Table*
+    {
+        size_t live = 0;
+        for (size_t i = 0; i <= current->mask; ++i) {
+            uint64_t entry = current->slots[i].entry.load(std::memory_order_relaxed);
+            live += entry != 0 && entryExpiry(entry) >= now;
+        }
+        size_t capacity = minCapacity;
+        while (capacity < (live + 1) * 2) {
+            capacity *= 2;
+        }
+
+        auto* rebuilt = new Table(capacity);
+        for (size_t i = 0; i <= current->mask; ++i) {
+            Slot const& slot = current->slots[i];
+            uint64_t entry = slot.entry.load(std::memory_order_relaxed);
+            if (entry == 0 || entryExpiry(entry) < now) {
+                continue;
+            }
+            Slot* dst = findSlot(rebuilt, slot.key);
+            dst->key = slot.key;
+            dst->entry.store(entry, std::memory_order_relaxed);
+            rebuilt->used++;
+        }
+
+        table.store(rebuilt);
+        uint64_t oldEpoch = epoch.fetch_add(1);
+        for (auto const& readerSlot : readerSlots) {
+            while (readerSlot.readers[oldEpoch & 1].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+        delete current;
+        return rebuilt;
+    }
+
+    /**
+     * Reader slot of the calling thread. Threads past the number of
+     * slots share them, their counters stay exact.
+     */
+    static auto getReaderSlot() -> size_t
+    {
+        static std::atomic<size_t> numberThreads = 0;
+        thread_local size_t readerSlot = numberThreads.fetch_add(1, std::memory_order_relaxed) % maxReaderSlots;
+        return readerSlot;
+    }
+
+    /**
+     * Register the reader on the current epoch and return its counter.
+     * Retry if the epoch was flipped before the registration was visible
+     * to writers.
+     */
+    auto enterRead() const -> std::atomic<uint64_t>*
+    {
+        auto& readerSlot = readerSlots[getReaderSlot()];
+        while (true) {
+            uint64_t current = epoch.load();
+            auto* counter = &readerSlot.readers[current & 1];
+            counter->fetch_add(1);
+            if (epoch.load() == current) {
+                return counter;
+            }
+            counter->fetch_sub(1);
+        }
+    }
+
+    auto leaveRead(std::atomic<uint64_t>* counter) const -> void
+    {
+        counter->fetch_sub(1, std::memory_order_release);
+    }
+
+    Hash hasher;
+    std::atomic<Table*> table;
+    mutable std::atomic<uint64_t> epoch = 0;
+    mutable std::array<ReaderSlot, maxReaderSlots> readerSlots = {};
+    mutable std::mutex writeMutex;
+};
+
+} // namespace flowstats
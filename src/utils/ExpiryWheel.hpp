@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <ctime>
+#include <vector>
+
+namespace flowstats {
+
+/**
+ * Per second bucketed expiry list. Keys are checked when their
+ * deadline's second is reached, a tick only touches due keys.
+ *
+ * Deadlines are not moved on each packet. When a key is due, the
+ * callback checks the real deadline of the entry and returns either 0
+ * to drop the key or a new deadline to reschedule it.
+ */
+template <typename Key, size_t WheelSize = 64>
+class ExpiryWheel {
+public:
+    auto schedule(Key const& key, time_t deadline) -> void
+    {
+        if (deadline <= currentTick) {
+            deadline = currentTick + 1;
+        }
+        // Too far ahead, the key will be rescheduled when its slot comes
+        if (deadline - currentTick >= time_t(WheelSize)) {
+            deadline = currentTick + WheelSize - 1;
+        }
+        slots[deadline % WheelSize].push_back(key);
+        numberKeys++;
+    }
+
+    template <typename Fun>
+    auto advance(time_t now, Fun onDeadline) -> void
+    {
+        if (now <= currentTick) {
+            return;
+        }
+        // After a jump of a full turn, every slot is due
+        time_t first = currentTick + 1;
+        if (now - currentTick > time_t(WheelSize)) {
+            first = now - WheelSize + 1;
+        }
+        currentTick = now;
+        time_t numberTicks = now - first + 1;
+        for (time_t i = 0; i < numberTicks; ++i) {
+            due.clear();
+            due.swap(slots[(first + i) % WheelSize]);
+            numberKeys -= due.size();
+            for (auto const& key : due) {
+                time_t deadline = onDeadline(key);
+                if (deadline != 0) {
+                    schedule(key, deadline);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] auto size() const { return numberKeys; };
+
+private:
+    std::array<std::vector<Key>, WheelSize> slots;
+    std::vector<Key> due;
+    time_t currentTick = 0;
+    size_t numberKeys = 0;
+};
+
+} // namespace flowstats
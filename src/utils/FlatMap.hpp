@@ -0,0 +1,349 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace flowstats {
+
+/**
+ * Open addressing hash map with SwissTable style control bytes.
+ *
+ * Entries are stored inline in a single array, without allocation per
+ * node. Each slot has a control byte holding either empty, deleted or
+ * the low 7 bits of the hash. A lookup compares the 16 control bytes
+ * of a group at once and only touches the slots whose 7 bits match.
+ *
+ * The hash is used as is, it needs to be well mixed on all bits.
+ * Iterators and pointers are invalidated by insertion.
+ */
+template <typename Key, typename Value,
+    typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatMap {
+public:
+    using value_type = std::pair<Key, Value>;
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        using MapPtr = std::conditional_t<IsConst, FlatMap const*, FlatMap*>;
+        using Ref = std::conditional_t<IsConst, value_type const&, value_type&>;
+        using Ptr = std::conditional_t<IsConst, value_type const*, value_type*>;
+
+        Iterator(MapPtr map, size_t index)
+            : map(map)
+            , index(index)
+        {
+            skipEmpty();
+        }
+
+        auto operator*() const -> Ref { return map->slots[index]; }
+        auto operator->() const -> Ptr { return &map->slots[index]; }
+        auto operator++() -> Iterator&
+        {
+            ++index;
+            skipEmpty();
+            return *this;
+        }
+        auto operator==(Iterator const& b) const { return index == b.index; }
+        auto operator!=(Iterator const& b) const { return index != b.index; }
+
+    private:
+        friend class FlatMap;
+        auto skipEmpty() -> void
+        {
+            while (index < map->capacity && !isFull(map->ctrl[index])) {
+                ++index;
+            }
+        }
+
+        MapPtr map;
+        size_t index;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatMap() = default;
+    FlatMap(FlatMap const& other) { *this = other; }
+    FlatMap(FlatMap&& other) noexcept { *this = std::move(other); }
+    ~FlatMap() { release(); }
+
+    auto operator=(FlatMap const& other) -> FlatMap&
+    {
+        if (this == &other) {
+            return *this;
+        }
+        release();
+        reserve(other.numberEntries);
+        for (auto const& entry : other) {
+            insertUnique(hasher(entry.first), entry.first, entry.second);
+        }
+        return *this;
+    }
+
+    auto operator=(FlatMap&& other) noexcept -> FlatMap&
+    {
+        if (this == &other) {
+            return *this;
+        }
+        release();
+        std::swap(ctrl, other.ctrl);
+        std::swap(slots, other.slots);
+        std::swap(capacity, other.capacity);
+        std::swap(numberEntries, other.numberEntries);
+        std::swap(numberDeleted, other.numberDeleted);
+        return *this;
+    }
+
+    auto begin() { return iterator(this, 0); }
+    auto end() { return iterator(this, capacity); }
+    auto begin() const { return const_iterator(this, 0); }
+    auto end() const { return const_iterator(this, capacity); }
+
+    [[nodiscard]] auto size() const { return numberEntries; }
+    [[nodiscard]] auto empty() const { return numberEntries == 0; }
+    [[nodiscard]] auto getCapacity() const { return capacity; }
+    [[nodiscard]] auto getDeleted() const { return numberDeleted; }
+
+    auto find(Key const& key) -> iterator
+    {
+        return iterator(this, findIndex(key));
+    }
+
+    auto find(Key const& key) const -> const_iterator
+    {
+        return const_iterator(this, findIndex(key));
+    }
+
+    template <typename... Args>
+    auto emplace(Key const& key, Args&&... args) -> std::pair<iterator, bool>
+    {
+        size_t hash = hasher(key);
+        size_t index = findIndex(key, hash);
+        if (index != capacity) {
+            return { iterator(this, index), false };
+        }
+        index = insertUnique(hash, key, std::forward<Args>(args)...);
+        return { iterator(this, index), true };
+    }
+
+    auto insert(value_type const& entry) -> std::pair<iterator, bool>
+    {
+        return emplace(entry.first, entry.second);
+    }
+
+    auto erase(iterator it) -> void
+    {
+        slots[it.index].~value_type();
+        // A slot in a group that never overflowed can go back to empty
+        size_t group = it.index & ~(groupSize - 1);
+        ctrl[it.index] = matchEmpty(group) ? ctrlEmpty : ctrlDeleted;
+        if (ctrl[it.index] == ctrlDeleted) {
+            numberDeleted++;
+        }
+        numberEntries--;
+    }
+
+    auto erase(Key const& key) -> size_t
+    {
+        auto it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    auto clear() -> void
+    {
+        for (size_t i = 0; i < capacity; ++i) {
+            if (isFull(ctrl[i])) {
+                slots[i].~value_type();
+            }
+        }
+        if (ctrl != nullptr) {
+            memset(ctrl, ctrlEmpty, capacity);
+        }
+        numberEntries = 0;
+        numberDeleted = 0;
+    }
+
+    auto reserve(size_t count) -> void
+    {
+        size_t newCapacity = groupSize;
+        while (newCapacity * 7 < count * 8) {
+            newCapacity *= 2;
+        }
+        if (newCapacity > capacity) {
+            rehash(newCapacity);
+        }
+    }
+
+private:
+    static constexpr size_t groupSize = 16;
+    static constexpr int8_t ctrlEmpty = -128;
+    static constexpr int8_t ctrlDeleted = -2;
+
+    static auto isFull(int8_t ctrlByte) -> bool { return ctrlByte >= 0; }
+    static auto h1(size_t hash) -> size_t { return hash >> 7; }
+    static auto h2(size_t hash) -> int8_t { return hash & 0x7f; }
+
+    /**
+     * Bitmask of the slots of the group whose control byte is value
+     */
+    [[nodiscard]] auto matchByte(size_t group, int8_t value) const -> uint32_t
+    {
+#ifdef __SSE2__
+        auto ctrlBytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ctrl + group));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrlBytes, _mm_set1_epi8(value)));
+#else
+        uint32_t res = 0;
+        for (size_t i = 0; i < groupSize; ++i) {
+            res |= uint32_t(ctrl[group + i] == value) << i;
+        }
+        return res;
+#endif
+    }
+
+    [[nodiscard]] auto matchEmpty(size_t group) const -> uint32_t
+    {
+        return matchByte(group, ctrlEmpty);
+    }
+
+    /**
+     * Bitmask of the empty and deleted slots, the only control bytes
+     * with the sign bit set
+     */
+    [[nodiscard]] auto matchFree(size_t group) const -> uint32_t
+    {
+#ifdef __SSE2__
+        auto ctrlBytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ctrl + group));
+        return _mm_movemask_epi8(ctrlBytes);
+#else
+        uint32_t res = 0;
+        for (size_t i = 0; i < groupSize; ++i) {
+            res |= uint32_t(!isFull(ctrl[group + i])) << i;
+        }
+        return res;
+#endif
+    }
+
+    [[nodiscard]] auto findIndex(Key const& key) const -> size_t
+    {
+        return findIndex(key, hasher(key));
+    }
+
+    /**
+     * Return the slot of the key, capacity when missing. Groups are
+     * probed in triangular order which visits all of them.
+     */
+    [[nodiscard]] auto findIndex(Key const& key, size_t hash) const -> size_t
+    {
+        if (capacity == 0) {
+            return capacity;
+        }
+        size_t mask = capacity - 1;
+        size_t group = (h1(hash) * groupSize) & mask;
+        for (size_t probe = 1;; ++probe) {
+            uint32_t matches = matchByte(group, h2(hash));
+            while (matches != 0) {
+                size_t index = group + __builtin_ctz(matches);
+                if (keyEqual(slots[index].first, key)) {
+                    return index;
+                }
+                matches &= matches - 1;
+            }
+            if (matchEmpty(group) != 0 || probe * groupSize > capacity) {
+                return capacity;
+            }
+            group = (group + probe * groupSize) & mask;
+        }
+    }
+
+    template <typename... Args>
+    auto insertUnique(size_t hash, Key const& key, Args&&... args) -> size_t
+    {
+        if ((numberEntries + numberDeleted + 1) * 8 > capacity * 7) {
+            if (capacity == 0) {
+                rehash(groupSize);
+            } else {
+                // With mostly tombstones, cleaning them is enough
+                rehash(numberEntries * 2 >= capacity ? capacity * 2 : capacity);
+            }
+        }
+        size_t mask = capacity - 1;
+        size_t group = (h1(hash) * groupSize) & mask;
+        for (size_t probe = 1;; ++probe) {
+            uint32_t freeSlots = matchFree(group);
+            if (freeSlots != 0) {
+                size_t index = group + __builtin_ctz(freeSlots);
+                if (ctrl[index] == ctrlDeleted) {
+                    numberDeleted--;
+                }
+                ctrl[index] = h2(hash);
+                new (&slots[index]) value_type(std::piecewise_construct,
+                    std::forward_as_tuple(key),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+                numberEntries++;
+                return index;
+            }
+            group = (group + probe * groupSize) & mask;
+        }
+    }
+
+    auto rehash(size_t newCapacity) -> void
+    {
+        int8_t* oldCtrl = ctrl;
+        value_type* oldSlots = slots;
+        size_t oldCapacity = capacity;
+
+        ctrl = static_cast<int8_t*>(::operator new(newCapacity));
+        memset(ctrl, ctrlEmpty, newCapacity);
+        slots = static_cast<value_type*>(::operator new(newCapacity * sizeof(value_type),
+            std::align_val_t(alignof(value_type))));
+        capacity = newCapacity;
+        numberEntries = 0;
+        numberDeleted = 0;
+
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (isFull(oldCtrl[i])) {
+                insertUnique(hasher(oldSlots[i].first), oldSlots[i].first,
+                    std::move(oldSlots[i].second));
+                oldSlots[i].~value_type();
+            }
+        }
+        if (oldCtrl != nullptr) {
+            ::operator delete(oldCtrl);
+            ::operator delete(oldSlots, std::align_val_t(alignof(value_type)));
+        }
+    }
+
+    auto release() -> void
+    {
+        clear();
+        if (ctrl != nullptr) {
+            ::operator delete(ctrl);
+            ::operator delete(slots, std::align_val_t(alignof(value_type)));
+        }
+        ctrl = nullptr;
+        slots = nullptr;
+        capacity = 0;
+    }
+
+    Hash hasher;
+    KeyEqual keyEqual;
+    int8_t* ctrl = nullptr;
+    value_type* slots = nullptr;
+    size_t capacity = 0;
+    size_t numberEntries = 0;
+    size_t numberDeleted = 0;
+};
+
+} // namespace flowstats
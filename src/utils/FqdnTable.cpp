@@ -0,0 +1,112 @@
+#include "FqdnTable.hpp"
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace flowstats {
+
+/**
+ * Fqdns are stored in chunks which are never moved, chunk k holds
+ * 2^(k + firstChunkBits) fqdns so 32 bits ids fit in a fixed chunk
+ * directory. Readers only load the published size and the chunk
+ * pointer.
+ *
+ * Existing fqdns are looked up in one of several shards picked on their
+ * hash, a new fqdn is appended under a mutex shared by all shards.
+ */
+class FqdnTable {
+public:
+    FqdnTable() { intern(""); }
+    FqdnTable(FqdnTable const&) = delete;
+    auto operator=(FqdnTable const&) -> FqdnTable& = delete;
+    ~FqdnTable()
+    {
+        for (auto& chunk : chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    auto intern(std::string_view fqdn) -> FqdnId
+    {
+        auto hash = std::hash<std::string_view>()(fqdn);
+        auto& shard = shards[hash % numberShards];
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.fqdnToId.find(fqdn);
+        if (it != shard.fqdnToId.end()) {
+            return it->second;
+        }
+        auto fqdnId = append(fqdn);
+        shard.fqdnToId.emplace(toString(fqdnId), fqdnId);
+        return fqdnId;
+    }
+
+    auto toString(FqdnId fqdnId) const -> std::string const&
+    {
+        // Pairs with the release of append, the string is complete
+        [[maybe_unused]] auto size = numberFqdns.load(std::memory_order_acquire);
+        assert(fqdnId < size);
+        auto [chunkIndex, offset] = locate(fqdnId);
+        return chunks[chunkIndex].load(std::memory_order_acquire)[offset];
+    }
+
+private:
+    static size_t const numberShards = 16;
+    static size_t const firstChunkBits = 10;
+    static size_t const numberChunks = 32 - firstChunkBits + 1;
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string_view, FqdnId> fqdnToId;
+    };
+
+    static auto locate(FqdnId fqdnId) -> std::pair<size_t, size_t>
+    {
+        uint64_t position = uint64_t(fqdnId) + (uint64_t(1) << firstChunkBits);
+        size_t msb = 63 - __builtin_clzll(position);
+        return { msb - firstChunkBits, position - (uint64_t(1) << msb) };
+    }
+
+    /**
+     * Store the fqdn in the next id and publish it
+     */
+    auto append(std::string_view fqdn) -> FqdnId
+    {
+        const std::lock_guard<std::mutex> lock(appendMutex);
+        auto fqdnId = numberFqdns.load(std::memory_order_relaxed);
+        auto [chunkIndex, offset] = locate(fqdnId);
+        auto* chunk = chunks[chunkIndex].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            chunk = new std::string[size_t(1) << (chunkIndex + firstChunkBits)];
+            chunks[chunkIndex].store(chunk, std::memory_order_release);
+        }
+        chunk[offset] = fqdn;
+        numberFqdns.store(fqdnId + 1, std::memory_order_release);
+        return fqdnId;
+    }
+
+    std::array<Shard, numberShards> shards;
+    std::mutex appendMutex;
+    std::atomic<FqdnId> numberFqdns = 0;
+    std::array<std::atomic<std::string*>, numberChunks> chunks = {};
+};
+
+static auto getFqdnTable() -> FqdnTable&
+{
+    static FqdnTable fqdnTable;
+    return fqdnTable;
+}
+
+auto internFqdn(std::string_view fqdn) -> FqdnId
+{
+    return getFqdnTable().intern(fqdn);
+}
+
+auto fqdnToString(FqdnId fqdnId) -> std::string const&
+{
+    return getFqdnTable().toString(fqdnId);
+}
+
+} // namespace flowstats
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace flowstats {
+
+using FqdnId = uint32_t;
+
+/**
+ * Id of the empty fqdn, default of flows without fqdn
+ */
+FqdnId const emptyFqdnId = 0;
+
+/**
+ * Process wide table of interned fqdns. Flows, aggregation keys and
+ * ip mappings refer to an fqdn with its 32 bits id and the text is only
+ * looked up for display and statsd tags.
+ *
+ * Ids are never released, the returned strings stay valid until exit.
+ * Reading the text of an id takes no lock, interning an existing fqdn
+ * only locks the shard of its hash.
+ */
+auto internFqdn(std::string_view fqdn) -> FqdnId;
+auto fqdnToString(FqdnId fqdnId) -> std::string const&;
+
+} // namespace flowstats
@@ -0,0 +1,231 @@
+#include "InternalStats.hpp"
+#include "DogFood.hpp"
+#include <fmt/format.h>
+
+namespace flowstats {
+
+static std::array<char const*, numberStages> const stageNames = {
+    "decode",
+    "classify",
+    "processPacket",
+    "advanceTick",
+    "lockWait",
+    "lockHold",
+    "publishSnapshot",
+    "resetMetrics",
+    "statsdMetrics",
+    "outputStatus",
+    "sendMetrics",
+};
+
+// Same order as CollectorProtocol
+static std::array<char const*, numberComponents> const componentNames = {
+    "tcp",
+    "dns",
+    "ssl",
+    "pipeline",
+};
+
+auto stageToString(Stage stage) -> char const*
+{
+    return stageNames[size_t(stage)];
+}
+
+auto componentToString(uint8_t component) -> char const*
+{
+    return componentNames[component];
+}
+
+auto internalStats() -> InternalStats&
+{
+    static InternalStats stats;
+    return stats;
+}
+
+auto LatencyHistogram::bucketIndex(uint64_t cycles) -> size_t
+{
+    if (cycles < 8) {
+        return cycles;
+    }
+    int msb = 63 - __builtin_clzll(cycles);
+    return size_t(8 * (msb - 2)) + ((cycles >> (msb - 3)) & 7);
+}
+
+auto LatencyHistogram::bucketUpperBound(size_t index) -> uint64_t
+{
+    if (index < 8) {
+        return index;
+    }
+    int shift = int(index / 8) - 1;
+    uint64_t lower = (8 + index % 8) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+static auto monotonicNow() -> timespec
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now;
+}
+
+static auto elapsedNs(timespec start, timespec end) -> double
+{
+    return double(end.tv_sec - start.tv_sec) * 1e9 + double(end.tv_nsec - start.tv_nsec);
+}
+
+InternalStats::InternalStats()
+    : previousBuckets(histograms.size() * LatencyHistogram::numberBuckets)
+    , startCycles(readCycles())
+    , startTime(monotonicNow())
+{
+    previousPublish = startTime;
+}
+
+auto InternalStats::shouldSample(Stage stage, uint8_t component) -> bool
+{
+    thread_local std::array<uint32_t, numberStages * numberComponents> calls = {};
+    return calls[histogramIndex(stage, component)]++ % internalSampleRate == 0;
+}
+
+/**
+ * Value at the nearest rank of the interval counts
+ */
+static auto nearestRankBucket(std::vector<uint64_t> const& counts, uint64_t total, double p) -> size_t
+{
+    auto rank = std::max(uint64_t(double(total) * p + 0.5), uint64_t(1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return i;
+        }
+    }
+    return counts.size() - 1;
+}
+
+auto InternalStats::publish() -> void
+{
+    auto now = monotonicNow();
+    double intervalNs = elapsedNs(previousPublish, now);
+    if (intervalNs < 1e9) {
+        return;
+    }
+    previousPublish = now;
+
+    // Cycles are calibrated against the monotonic clock since startup
+    double nsPerCycle = elapsedNs(startTime, now) / double(readCycles() - startCycles);
+    double intervalS = intervalNs / 1e9;
+
+    std::vector<StageStat> stats;
+    std::vector<uint64_t> counts(LatencyHistogram::numberBuckets);
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        auto const& histogram = histograms[i];
+        uint64_t total = 0;
+        size_t last = 0;
+        for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+            auto& previous = previousBuckets[i * LatencyHistogram::numberBuckets + bucket];
+            auto current = histogram.getBucket(bucket);
+            counts[bucket] = current - previous;
+            previous = current;
+            if (counts[bucket] > 0) {
+                total += counts[bucket];
+                last = bucket;
+            }
+        }
+        auto sum = histogram.getSum();
+        auto intervalCycles = sum - previousSums[i];
+        previousSums[i] = sum;
+        if (total == 0) {
+            continue;
+        }
+
+        auto toNs = [&](size_t bucket) {
+            return double(LatencyHistogram::bucketUpperBound(bucket)) * nsPerCycle;
+        };
+        StageStat stat;
+        stat.stage = Stage(i / numberComponents);
+        stat.component = uint8_t(i % numberComponents);
+        stat.callsPerSecond = double(total) / intervalS;
+        stat.busyPercent = 100 * double(intervalCycles) * nsPerCycle / intervalNs;
+        stat.p50Ns = toNs(nearestRankBucket(counts, total, 0.5));
+        stat.p95Ns = toNs(nearestRankBucket(counts, total, 0.95));
+        stat.p99Ns = toNs(nearestRankBucket(counts, total, 0.99));
+        stat.maxNs = toNs(last);
+        stats.push_back(stat);
+    }
+
+    auto currentPackets = packets.load(std::memory_order_relaxed);
+    double packetsPerSecond = double(currentPackets - previousPackets) / intervalS;
+    previousPackets = currentPackets;
+
+    const std::lock_guard<std::mutex> lock(publishedMutex);
+    publishedStats = std::move(stats);
+    publishedPacketsPerSecond = packetsPerSecond;
+}
+
+auto InternalStats::getStageStats() const -> std::vector<StageStat>
+{
+    const std::lock_guard<std::mutex> lock(publishedMutex);
+    return publishedStats;
+}
+
+auto InternalStats::getPacketsPerSecond() const -> double
+{
+    const std::lock_guard<std::mutex> lock(publishedMutex);
+    return publishedPacketsPerSecond;
+}
+
+static auto formatNs(double ns) -> std::string
+{
+    if (ns < 1000) {
+        return fmt::format("{:.0f}ns", ns);
+    }
+    if (ns < 1e6) {
+        return fmt::format("{:.1f}us", ns / 1e3);
+    }
+    return fmt::format("{:.1f}ms", ns / 1e6);
+}
+
+auto InternalStats::outputStatus(CollectorOutput* output) const -> void
+{
+    auto stats = getStageStats();
+    output->clear("Internals", 0);
+    output->setHeaders(fmt::format("{:<20} {:<10}", "Stage", "Collector"),
+        fmt::format("{:<12} {:<8} {:<10} {:<10} {:<10} {:<10}",
+            "Calls/s", "Busy", "p50", "p95", "p99", "Max"));
+
+    fmt::format_to(std::back_inserter(*output->getKeyBuffer()), "{:<20} {:<10}",
+        "packets", componentToString(pipelineComponent));
+    fmt::format_to(std::back_inserter(*output->getValueBuffer()), "{:<12.0f}", getPacketsPerSecond());
+    output->endRow();
+    output->endRow();
+
+    for (auto const& stat : stats) {
+        fmt::format_to(std::back_inserter(*output->getKeyBuffer()), "{:<20} {:<10}",
+            stageToString(stat.stage), componentToString(stat.component));
+        fmt::format_to(std::back_inserter(*output->getValueBuffer()),
+            "{:<12.0f} {:<8} {:<10} {:<10} {:<10} {:<10}",
+            stat.callsPerSecond, fmt::format("{:.1f}%", stat.busyPercent),
+            formatNs(stat.p50Ns), formatNs(stat.p95Ns), formatNs(stat.p99Ns), formatNs(stat.maxNs));
+        output->endRow();
+    }
+}
+
+auto InternalStats::getStatsdMetrics() const -> std::vector<std::string>
+{
+    std::vector<std::string> res;
+    res.push_back(DogFood::Metric("flowstats.internal.packets", getPacketsPerSecond(), DogFood::Gauge));
+    for (auto const& stat : getStageStats()) {
+        DogFood::Tags tags = DogFood::Tags({ { "stage", stageToString(stat.stage) },
+            { "collector", componentToString(stat.component) } });
+        res.push_back(DogFood::Metric("flowstats.internal.calls", stat.callsPerSecond, DogFood::Gauge, 1, tags));
+        res.push_back(DogFood::Metric("flowstats.internal.busy", stat.busyPercent, DogFood::Gauge, 1, tags));
+        res.push_back(DogFood::Metric("flowstats.internal.latency.p50", stat.p50Ns, DogFood::Gauge, 1, tags));
+        res.push_back(DogFood::Metric("flowstats.internal.latency.p95", stat.p95Ns, DogFood::Gauge, 1, tags));
+        res.push_back(DogFood::Metric("flowstats.internal.latency.p99", stat.p99Ns, DogFood::Gauge, 1, tags));
+        res.push_back(DogFood::Metric("flowstats.internal.latency.max", stat.maxNs, DogFood::Gauge, 1, tags));
+    }
+    return res;
+}
+
+} // namespace flowstats
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "CollectorOutput.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace flowstats {
+
+/**
+ * Stages of the packet pipeline timed by the internal stats
+ */
+enum class Stage : uint8_t {
+    Decode,
+    Classify,
+    ProcessPacket,
+    AdvanceTick,
+    LockWait,
+    LockHold,
+    PublishSnapshot,
+    ResetMetrics,
+    StatsdMetrics,
+    OutputStatus,
+    SendMetrics,
+};
+size_t const numberStages = 11;
+
+/**
+ * Stages are timed per collector, components follow the CollectorProtocol
+ * values. Stages outside of collectors use the pipeline component.
+ */
+uint8_t const pipelineComponent = 3;
+size_t const numberComponents = 4;
+
+/**
+ * Only one in sampleRate calls of a stage is timed, the sample counts
+ * for sampleRate calls
+ */
+uint32_t const internalSampleRate = 64;
+
+/**
+ * Cheapest monotonic counter, cycles of the tsc on x86 and nanoseconds
+ * elsewhere. The ratio to nanoseconds is measured at runtime.
+ */
+inline auto readCycles() -> uint64_t
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Log linear histogram of cycles, values below 8 have their own
+ * bucket and each power of 2 above is split in 8 buckets, bounding the
+ * relative error to 12.5%. Points are added with relaxed atomics from
+ * any thread.
+ */
+class LatencyHistogram {
+public:
+    static size_t const numberBuckets = 496;
+
+    auto addPoint(uint64_t cycles, uint32_t weight) -> void
+    {
+        buckets[bucketIndex(cycles)].fetch_add(weight, std::memory_order_relaxed);
+        sum.fetch_add(cycles * weight, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto getBucket(size_t index) const -> uint64_t
+    {
+        return buckets[index].load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] auto getSum() const -> uint64_t { return sum.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] static auto bucketIndex(uint64_t cycles) -> size_t;
+    /**
+     * Highest value falling in the bucket
+     */
+    [[nodiscard]] static auto bucketUpperBound(size_t index) -> uint64_t;
+
+private:
+    std::array<std::atomic<uint64_t>, numberBuckets> buckets = {};
+    std::atomic<uint64_t> sum = 0;
+};
+
+/**
+ * Stage latencies of the last published interval
+ */
+struct StageStat {
+    Stage stage;
+    uint8_t component;
+    double callsPerSecond;
+    // Share of the interval spent in the stage, summed over threads
+    double busyPercent;
+    double p50Ns;
+    double p95Ns;
+    double p99Ns;
+    double maxNs;
+};
+
+/**
+ * Process wide latencies of the pipeline stages, packet rate and time
+ * spent in collector locks. Recording is lock free, interval deltas
+ * are computed on publish.
+ */
+class InternalStats {
+public:
+    InternalStats();
+
+    auto addPoint(Stage stage, uint8_t component, uint64_t cycles, uint32_t weight) -> void
+    {
+        histograms[histogramIndex(stage, component)].addPoint(cycles, weight);
+    }
+    auto addPackets(uint64_t number) -> void { packets.fetch_add(number, std::memory_order_relaxed); }
+
+    /**
+     * Decide if the current call of the stage is sampled, the decision
+     * is taken per thread
+     */
+    [[nodiscard]] static auto shouldSample(Stage stage, uint8_t component) -> bool;
+
+    /**
+     * Compute the stats of the interval since the last publish, calls
+     * less than a second after the last publish are ignored
+     */
+    auto publish() -> void;
+
+    [[nodiscard]] auto getStageStats() const -> std::vector<StageStat>;
+    [[nodiscard]] auto getPacketsPerSecond() const -> double;
+
+    auto outputStatus(CollectorOutput* output) const -> void;
+    [[nodiscard]] auto getStatsdMetrics() const -> std::vector<std::string>;
+
+private:
+    [[nodiscard]] static auto histogramIndex(Stage stage, uint8_t component) -> size_t
+    {
+        return size_t(stage) * numberComponents + component;
+    }
+
+    std::array<LatencyHistogram, numberStages * numberComponents> histograms;
+    std::atomic<uint64_t> packets = 0;
+
+    // Only touched by publish
+    std::vector<uint64_t> previousBuckets;
+    std::array<uint64_t, numberStages * numberComponents> previousSums = {};
+    uint64_t previousPackets = 0;
+    timespec previousPublish = {};
+    uint64_t startCycles;
+    timespec startTime = {};
+
+    mutable std::mutex publishedMutex;
+    std::vector<StageStat> publishedStats;
+    double publishedPacketsPerSecond = 0;
+};
+
+auto internalStats() -> InternalStats&;
+auto stageToString(Stage stage) -> char const*;
+auto componentToString(uint8_t component) -> char const*;
+
+/**
+ * Time the scope as one call of the stage, either sampled or only
+ * when enabled
+ */
+class StageTimer {
+public:
+    StageTimer(Stage stage, uint8_t component)
+        : StageTimer(stage, component, InternalStats::shouldSample(stage, component), internalSampleRate)
+    {
+    }
+    StageTimer(Stage stage, uint8_t component, bool enabled)
+        : StageTimer(stage, component, enabled, 1)
+    {
+    }
+    ~StageTimer()
+    {
+        if (start != 0) {
+            internalStats().addPoint(stage, component, readCycles() - start, weight);
+        }
+    }
+    StageTimer(StageTimer const&) = delete;
+    auto operator=(StageTimer const&) -> StageTimer& = delete;
+
+private:
+    StageTimer(Stage stage, uint8_t component, bool enabled, uint32_t weight)
+        : stage(stage)
+        , component(component)
+        , weight(weight)
+        , start(enabled ? readCycles() : 0)
+    {
+    }
+
+    Stage stage;
+    uint8_t component;
+    uint32_t weight;
+    uint64_t start;
+};
+
+/**
+ * Lock guard timing, on sampled calls, the wait for the mutex and the
+ * time it is held
+ */
+class TimedLock {
+public:
+    TimedLock(std::mutex* mutex, uint8_t component)
+        : mutex(mutex)
+        , component(component)
+    {
+        if (!InternalStats::shouldSample(Stage::LockWait, component)) {
+            mutex->lock();
+            return;
+        }
+        auto waitStart = readCycles();
+        mutex->lock();
+        lockedAt = readCycles();
+        internalStats().addPoint(Stage::LockWait, component, lockedAt - waitStart, internalSampleRate);
+    }
+    ~TimedLock()
+    {
+        if (lockedAt != 0) {
+            internalStats().addPoint(Stage::LockHold, component, readCycles() - lockedAt, internalSampleRate);
+        }
+        mutex->unlock();
+    }
+    TimedLock(TimedLock const&) = delete;
+    auto operator=(TimedLock const&) -> TimedLock& = delete;
+
+private:
+    std::mutex* mutex;
+    uint8_t component;
+    uint64_t lockedAt = 0;
+};
+
+} // namespace flowstats
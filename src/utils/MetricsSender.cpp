@@ -0,0 +1,247 @@
+#include "MetricsSender.hpp"
+#include "InternalStats.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace flowstats {
+
+/**
+ * Maximum number of metric batches waiting for the sender. One batch is
+ * queued per second, past this the agent is considered stuck.
+ */
+size_t const maxQueuedBatches = 8;
+
+/**
+ * Datagram sizes recommended by DogStatsD: udp datagrams fit a 1500
+ * bytes mtu, unix sockets don't fragment and take larger ones.
+ */
+size_t const maxUdpDatagramSize = 1432;
+size_t const maxUdsDatagramSize = 8192;
+
+/**
+ * Sends block until the agent drains its socket, bounded so a stuck
+ * agent can't hold the sender thread forever.
+ */
+timeval const sendTimeout = { 1, 0 };
+
+auto MetricsSender::packDatagrams(std::vector<std::string> const& metrics,
+    size_t maxSize) -> std::vector<std::string>
+{
+    std::vector<std::string> res;
+    std::string current;
+    for (auto const& metric : metrics) {
+        // DogFood returns an empty string for invalid metrics
+        if (metric.empty()) {
+            continue;
+        }
+        if (!current.empty() && current.size() + 1 + metric.size() > maxSize) {
+            res.push_back(std::move(current));
+            current.clear();
+        }
+        if (!current.empty()) {
+            current += '\n';
+        }
+        current += metric;
+    }
+    if (!current.empty()) {
+        res.push_back(std::move(current));
+    }
+    return res;
+}
+
+auto MetricsSender::getMaxDatagramSize() const -> size_t
+{
+    if (std::get<0>(agentConf) == DogFood::Mode::UDP) {
+        return maxUdpDatagramSize;
+    }
+    return maxUdsDatagramSize;
+}
+
+auto MetricsSender::openSocket() -> bool
+{
+    if (!connectSocket()) {
+        return false;
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout)) == -1) {
+        closeSocket();
+        return false;
+    }
+    return true;
+}
+
+auto MetricsSender::connectSocket() -> bool
+{
+    auto const& [mode, path, port] = agentConf;
+    if (mode == DogFood::Mode::UDP) {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, path.c_str(), &addr.sin_addr) != 1) {
+            spdlog::error("Invalid agent address {}", path);
+            return false;
+        }
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd == -1) {
+            return false;
+        }
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+            closeSocket();
+            return false;
+        }
+        return true;
+    }
+#if defined(_DOGFOOD_UDS_SUPPORT)
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        spdlog::error("Agent socket path {} is too long", path);
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        return false;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1) {
+        closeSocket();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+auto MetricsSender::closeSocket() -> void
+{
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+/**
+ * Count datagrams that could not be sent, only the first drop is logged
+ * to not flood the logs while the agent is down.
+ */
+auto MetricsSender::dropDatagrams(size_t count, int error) -> void
+{
+    if (droppedDatagrams == 0) {
+        spdlog::warn("Dropped {} metric datagrams: \"{}\"", count, strerror(error));
+    } else {
+        SPDLOG_DEBUG("Dropped {} metric datagrams: {}", count, strerror(error));
+    }
+    droppedDatagrams += count;
+}
+
+/**
+ * Send blocking up to the send timeout, datagrams the socket still can't
+ * take are dropped. On other errors the socket is reopened for the next
+ * batch.
+ */
+auto MetricsSender::sendDatagrams(std::vector<std::string> const& datagrams) -> void
+{
+    if (fd == -1 && !openSocket()) {
+        dropDatagrams(datagrams.size(), errno);
+        return;
+    }
+    size_t sent = 0;
+#if defined(__linux__)
+    std::vector<iovec> iovecs(datagrams.size());
+    std::vector<mmsghdr> messages(datagrams.size());
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        iovecs[i].iov_base = const_cast<char*>(datagrams[i].data());
+        iovecs[i].iov_len = datagrams[i].size();
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < messages.size()) {
+        int res = sendmmsg(fd, &messages[sent], messages.size() - sent, 0);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            break;
+        }
+        sent += res;
+    }
+#else
+    for (auto const& datagram : datagrams) {
+        if (send(fd, datagram.data(), datagram.size(), 0) == -1) {
+            break;
+        }
+        sent++;
+    }
+#endif
+    sentDatagrams += sent;
+    if (sent < datagrams.size()) {
+        int error = errno;
+        dropDatagrams(datagrams.size() - sent, error);
+        if (error != EAGAIN && error != EWOULDBLOCK) {
+            closeSocket();
+        }
+    }
+}
+
+auto MetricsSender::start() -> void
+{
+    senderThread = std::thread(&MetricsSender::senderLoop, this);
+}
+
+auto MetricsSender::stop() -> void
+{
+    {
+        const std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_one();
+    if (senderThread.joinable()) {
+        senderThread.join();
+    }
+}
+
+auto MetricsSender::enqueue(MetricsBatch&& batch) -> void
+{
+    {
+        const std::lock_guard<std::mutex> lock(queueMutex);
+        if (queue.size() >= maxQueuedBatches) {
+            droppedBatches++;
+            return;
+        }
+        queue.push_back(std::move(batch));
+    }
+    queueCondition.notify_one();
+}
+
+auto MetricsSender::senderLoop() -> void
+{
+    std::deque<MetricsBatch> batches;
+    size_t maxDatagramSize = getMaxDatagramSize();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty() && stopping) {
+                return;
+            }
+            batches.swap(queue);
+        }
+        for (auto const& batch : batches) {
+            auto metrics = batch();
+            StageTimer timer(Stage::SendMetrics, pipelineComponent, true);
+            sendDatagrams(packDatagrams(metrics, maxDatagramSize));
+        }
+        batches.clear();
+    }
+}
+
+MetricsSender::~MetricsSender()
+{
+    stop();
+    closeSocket();
+}
+
+} // namespace flowstats
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "DogFood.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flowstats {
+
+/**
+ * Ship statsd metrics to the agent from a dedicated thread. Metrics are
+ * packed in newline separated datagrams and sent on a single connected
+ * socket. The queue is bounded: when the agent can't keep up, batches
+ * are dropped instead of blocking the capture thread. Sends block, up to
+ * a timeout, so a slow agent doesn't lose datagrams.
+ *
+ * Batches are formatted by the sender thread, out of the capture path.
+ */
+using MetricsBatch = std::function<std::vector<std::string>()>;
+
+class MetricsSender {
+public:
+    explicit MetricsSender(DogFood::Configuration agentConf)
+        : agentConf(std::move(agentConf)) {};
+    virtual ~MetricsSender();
+
+    auto start() -> void;
+    auto stop() -> void;
+    auto enqueue(MetricsBatch&& batch) -> void;
+
+    [[nodiscard]] auto getDroppedBatches() const -> uint64_t { return droppedBatches; };
+    [[nodiscard]] auto getSentDatagrams() const -> uint64_t { return sentDatagrams; };
+    [[nodiscard]] auto getDroppedDatagrams() const -> uint64_t { return droppedDatagrams; };
+
+    /**
+     * Pack metrics in datagrams of at most maxSize bytes. A metric
+     * larger than maxSize is sent alone.
+     */
+    [[nodiscard]] static auto packDatagrams(std::vector<std::string> const& metrics,
+        size_t maxSize) -> std::vector<std::string>;
+
+private:
+    auto senderLoop() -> void;
+    auto openSocket() -> bool;
+    auto connectSocket() -> bool;
+    auto closeSocket() -> void;
+    auto sendDatagrams(std::vector<std::string> const& datagrams) -> void;
+    auto dropDatagrams(size_t count, int error) -> void;
+    [[nodiscard]] auto getMaxDatagramSize() const -> size_t;
+
+    DogFood::Configuration agentConf;
+    int fd = -1;
+    std::thread senderThread;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<MetricsBatch> queue;
+    bool stopping = false;
+    std::atomic<uint64_t> droppedBatches = 0;
+    std::atomic<uint64_t> sentDatagrams = 0;
+    std::atomic<uint64_t> droppedDatagrams = 0;
+};
+
+} // namespace flowstats
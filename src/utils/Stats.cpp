@@ -5,54 +5,188 @@
 
 namespace flowstats {
 
+/**
+ * Past this number of points, exact points are folded in buckets
+ */
+size_t const maxExactPoints = 256;
+
+/**
+ * Bucket i covers ]gamma^(i-1), gamma^i], shared by all sketches so
+ * they can be merged
+ */
+static double sketchGamma = 1.01 / 0.99;
+static double sketchLogGamma = std::log(sketchGamma);
+
+auto Percentile::setRelativeError(double relativeError) -> void
+{
+    relativeError = std::clamp(relativeError, 0.0001, 0.5);
+    sketchGamma = (1 + relativeError) / (1 - relativeError);
+    sketchLogGamma = std::log(sketchGamma);
+}
+
+auto Percentile::bucketValue(size_t index) const -> uint32_t
+{
+    // Middle of [gamma^(i-1), gamma^i], within relative error of both ends
+    double value = 2 * std::pow(sketchGamma, index) / (sketchGamma + 1);
+    return std::clamp(static_cast<uint32_t>(std::lround(value)), min, max);
+}
+
+auto Percentile::addToBucket(uint32_t point, uint32_t pointCount) -> void
+{
+    if (point == 0) {
+        zeroCount += pointCount;
+        return;
+    }
+    auto index = static_cast<size_t>(std::ceil(std::log(point) / sketchLogGamma));
+    if (index >= buckets.size()) {
+        buckets.resize(index + 1);
+    }
+    buckets[index] += pointCount;
+}
+
+auto Percentile::fold() -> void
+{
+    if (folded) {
+        return;
+    }
+    folded = true;
+    for (auto point : points) {
+        addToBucket(point, 1);
+    }
+    points.clear();
+    points.shrink_to_fit();
+}
+
 auto Percentile::merge() -> void
 {
-    std::sort(points.begin(), points.end());
+    if (!folded) {
+        std::sort(points.begin(), points.end());
+    }
 }
 
 auto Percentile::addPoint(uint32_t point) -> void
 {
-    return points.push_back(point);
+    if (count == 0 || point < min) {
+        min = point;
+    }
+    max = std::max(max, point);
+    count++;
+    sum += point;
+    if (folded) {
+        addToBucket(point, 1);
+        return;
+    }
+    points.push_back(point);
+    if (points.size() > maxExactPoints) {
+        fold();
+    }
 }
 
 auto Percentile::addPoints(Percentile const& perc) -> void
 {
-    points.insert(points.end(), perc.points.begin(), perc.points.end());
+    if (perc.count == 0) {
+        return;
+    }
+    if (count == 0 || perc.min < min) {
+        min = perc.min;
+    }
+    max = std::max(max, perc.max);
+    count += perc.count;
+    sum += perc.sum;
+
+    if (!folded && !perc.folded && points.size() + perc.points.size() <= maxExactPoints) {
+        points.insert(points.end(), perc.points.begin(), perc.points.end());
+        return;
+    }
+    fold();
+    if (!perc.folded) {
+        for (auto point : perc.points) {
+            addToBucket(point, 1);
+        }
+        return;
+    }
+    zeroCount += perc.zeroCount;
+    if (perc.buckets.size() > buckets.size()) {
+        buckets.resize(perc.buckets.size());
+    }
+    for (size_t i = 0; i < perc.buckets.size(); ++i) {
+        buckets[i] += perc.buckets[i];
+    }
 }
 
 auto Percentile::getCount() const -> int
 {
-    return points.size();
+    return count;
+}
+
+auto Percentile::getMean() const -> double
+{
+    if (count == 0) {
+        return 0;
+    }
+    return double(sum) / count;
 }
 
 auto Percentile::getPercentile(float p) const -> uint32_t
 {
-    if (points.size() == 0) {
+    if (count == 0) {
         return 0;
     }
-    if (p == 0) {
-        return points[0];
+    if (p <= 0) {
+        return min;
     }
-    return points[floor(points.size() * p + 0.5) - 1];
+    if (p >= 1) {
+        return max;
+    }
+    auto rank = std::max(static_cast<uint32_t>(floor(count * p + 0.5)), 1u);
+    if (!folded) {
+        return points[rank - 1];
+    }
+    if (rank <= zeroCount) {
+        return 0;
+    }
+    uint32_t seen = zeroCount;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return bucketValue(i);
+        }
+    }
+    return max;
 }
 
-auto Percentile::getPercentileStr(float p) const -> std::string
+auto Percentile::formatPercentile(float p, fmt::memory_buffer* out) const -> void
 {
-    if (points.size() == 0) {
-        return "-";
+    if (count == 0) {
+        out->push_back('-');
+        return;
     }
-    uint32_t res = getPercentile(p);
-    return fmt::format("{}ms", res);
+    fmt::format_to(std::back_inserter(*out), "{}ms", getPercentile(p));
+}
+
+auto Percentile::getPercentileStr(float p) const -> std::string
+{
+    fmt::memory_buffer out;
+    formatPercentile(p, &out);
+    return to_string(out);
 }
 
 auto Percentile::reset() -> void
 {
     points.clear();
+    buckets.clear();
+    folded = false;
+    zeroCount = 0;
+    count = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
 }
 
 auto Percentile::resetAndShrink() -> void
 {
-    points.clear();
+    reset();
     points.shrink_to_fit();
+    buckets.shrink_to_fit();
 }
 } // namespace flowstats
@@ -7,11 +7,23 @@
 
 namespace flowstats {
 
+/**
+ * Mergeable quantile sketch with bounded memory. Points are kept
+ * exactly until maxExactPoints, then folded in logarithmic buckets
+ * (DDSketch style) which guarantee the configured relative error on
+ * any percentile. Min and max are always exact.
+ */
 class Percentile {
 public:
     Percentile() = default;
     virtual ~Percentile() = default;
 
+    /**
+     * Set the relative error of all sketches, needs to be called
+     * before any point is added.
+     */
+    static auto setRelativeError(double relativeError) -> void;
+
     auto addPoint(uint32_t point) -> void;
     auto addPoints(Percentile const& perc) -> void;
     auto merge() -> void;
@@ -20,11 +32,47 @@ public:
 
     [[nodiscard]] auto getPercentile(float percentile) const -> uint32_t;
     [[nodiscard]] auto getPercentileStr(float p) const -> std::string;
+    auto formatPercentile(float p, fmt::memory_buffer* out) const -> void;
     [[nodiscard]] auto getCount() const -> int;
-    [[nodiscard]] auto getPoints() const -> std::vector<uint32_t> { return points; };
+    [[nodiscard]] auto getMean() const -> double;
+
+    /**
+     * Call fun with each distinct value and its number of occurrences
+     */
+    template <typename Fun>
+    auto forEachBucket(Fun fun) const -> void
+    {
+        if (!folded) {
+            for (auto point : points) {
+                fun(point, 1);
+            }
+            return;
+        }
+        if (zeroCount > 0) {
+            fun(0, zeroCount);
+        }
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            if (buckets[i] > 0) {
+                fun(bucketValue(i), buckets[i]);
+            }
+        }
+    }
 
 private:
+    auto fold() -> void;
+    auto addToBucket(uint32_t point, uint32_t count) -> void;
+    [[nodiscard]] auto bucketValue(size_t index) const -> uint32_t;
+
+    // Raw points, only used until the sketch is folded
     std::vector<uint32_t> points;
+    bool folded = false;
+
+    std::vector<uint32_t> buckets;
+    uint32_t zeroCount = 0;
+    uint32_t count = 0;
+    uint64_t sum = 0;
+    uint32_t min = 0;
+    uint32_t max = 0;
 };
 
 class CaptureStat {
@@ -58,10 +106,36 @@ public:
         return stats;
     }
 
+    /**
+     * Occupancy of the ring between the capture and the processing
+     * threads, its drops are caused by userspace and not the kernel
+     */
+    auto setRingStat(size_t used, size_t highWater, size_t capacity, uint64_t drops) -> void
+    {
+        ringUsed = used;
+        ringHighWater = highWater;
+        ringCapacity = capacity;
+        ringDrop = drops;
+    }
+
+    [[nodiscard]] auto getRingStatus() const -> std::string
+    {
+        if (ringCapacity == 0) {
+            return "\n";
+        }
+        return fmt::format("Capture ring used: {:>3}%, high: {:>3}%, drop: {:>6}\n",
+            ringUsed * 100 / ringCapacity, ringHighWater * 100 / ringCapacity, ringDrop);
+    }
+
 private:
     unsigned int recv = 0;
     unsigned int drop = 0;
     unsigned int ifDrop = 0;
+
+    size_t ringUsed = 0;
+    size_t ringHighWater = 0;
+    size_t ringCapacity = 0;
+    uint64_t ringDrop = 0;
 };
 
 } // namespace flowstats
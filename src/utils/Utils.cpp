@@ -101,56 +101,72 @@ auto getDomainToServerPort(const std::vector<std::string>& initialServerPorts) -
     return res;
 }
 
-static auto prettyFormatGeneric(int num, std::vector<std::string> suffixes) -> std::string
+template <std::size_t N>
+static auto prettyFormatGeneric(int num, std::array<char const*, N> const& suffixes,
+    fmt::memory_buffer* out) -> void
 {
     unsigned int unit = 0;
     double currentCount = num;
-    while (currentCount >= 1000 && unit < suffixes.size()) {
+    while (currentCount >= 1000 && unit + 1 < suffixes.size()) {
         unit++;
         currentCount /= 1000;
     }
     if (currentCount - floor(currentCount) == 0.0) {
-        return fmt::format("{}{}", static_cast<int>(currentCount), suffixes[unit]);
+        fmt::format_to(std::back_inserter(*out), "{}{}", static_cast<int>(currentCount), suffixes[unit]);
     } else {
-        return fmt::format("{:.1f}{}", currentCount, suffixes[unit]);
+        fmt::format_to(std::back_inserter(*out), "{:.1f}{}", currentCount, suffixes[unit]);
     }
 }
 
+auto prettyFormatNumber(int num, fmt::memory_buffer* out) -> void
+{
+    prettyFormatGeneric<2>(num, { "", "K" }, out);
+}
+
 auto prettyFormatNumber(int num) -> std::string
 {
-    std::vector<std::string> suffixes = { "", "K" };
-    return prettyFormatGeneric(num, suffixes);
+    fmt::memory_buffer out;
+    prettyFormatNumber(num, &out);
+    return to_string(out);
 }
 
 auto prettyFormatMs(int ms) -> std::string
 {
-    std::vector<std::string> suffixes = { "ms", "s" };
-    return prettyFormatGeneric(ms, suffixes);
+    fmt::memory_buffer out;
+    prettyFormatGeneric<2>(ms, { "ms", "s" }, &out);
+    return to_string(out);
 }
 
-auto prettyFormatBytes(int bytes) -> std::string
+auto prettyFormatBytes(int bytes, fmt::memory_buffer* out) -> void
 {
-    std::vector<std::string> suffixes = { "B", "KB", "MB", "GB", "TB", "PB", "EB" };
+    static std::array<char const*, 7> const suffixes = { "B", "KB", "MB", "GB", "TB", "PB", "EB" };
     unsigned int unit = 0;
     double currentCount = bytes;
-    while (currentCount >= 1024 && unit < suffixes.size()) {
+    while (currentCount >= 1024 && unit + 1 < suffixes.size()) {
         unit++;
         currentCount /= 1024;
     }
     if (currentCount - floor(currentCount) == 0.0) {
-        return fmt::format("{} {}", static_cast<int>(currentCount), suffixes[unit]);
+        fmt::format_to(std::back_inserter(*out), "{} {}", static_cast<int>(currentCount), suffixes[unit]);
     } else {
-        return fmt::format("{:.1f} {}", currentCount, suffixes[unit]);
+        fmt::format_to(std::back_inserter(*out), "{:.1f} {}", currentCount, suffixes[unit]);
     }
 }
 
+auto prettyFormatBytes(int bytes) -> std::string
+{
+    fmt::memory_buffer out;
+    prettyFormatBytes(bytes, &out);
+    return to_string(out);
+}
+
 auto packetToTimeval(const Tins::Packet& packet) -> timeval
 {
     auto ts = packet.timestamp();
     return { ts.seconds(), ts.microseconds() };
 }
 
-auto ipv4ToString(uint32_t ipv4) -> std::string
+auto formatIpv4(uint32_t ipv4, fmt::memory_buffer* out) -> void
 {
     std::array<uint8_t, 4> ipParts = {
         uint8_t(ipv4 & 0xff),
@@ -158,7 +174,27 @@ auto ipv4ToString(uint32_t ipv4) -> std::string
         uint8_t((ipv4 >> 16) & 0xff),
         uint8_t((ipv4 >> 24) & 0xff),
     };
-    return fmt::format("{}.{}.{}.{}", ipParts[0], ipParts[1], ipParts[2], ipParts[3]);
+    fmt::format_to(std::back_inserter(*out), "{}.{}.{}.{}", ipParts[0], ipParts[1], ipParts[2], ipParts[3]);
+}
+
+auto ipv4ToString(uint32_t ipv4) -> std::string
+{
+    fmt::memory_buffer out;
+    formatIpv4(ipv4, &out);
+    return to_string(out);
+}
+
+/**
+ * Murmur3 finalizer, spreads weak hashes over all bits
+ */
+auto mixHash(uint64_t hash) -> uint64_t
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
 }
 
 } // namespace flowstats
@@ -3,12 +3,14 @@
 #include "Configuration.hpp"
 #include <cstdint>
 #include <ctime> // for time_t, timeval
+#include <fmt/format.h>
 #include <iosfwd> // for size_t
 #include <limits>
 #include <map>
 #include <optional> // for optional
 #include <set>
 #include <string>
+#include <string_view>
 #include <tins/ip.h>
 #include <tins/ip_address.h>
 #include <tins/packet.h>
@@ -49,9 +51,39 @@ auto prettyFormatBytes(int bytes) -> std::string;
 auto prettyFormatNumber(int num) -> std::string;
 auto prettyFormatMs(int ms) -> std::string;
 
+/**
+ * Buffer flavours of the formatting helpers, they append to the buffer
+ * and don't allocate for short values
+ */
+auto prettyFormatBytes(int bytes, fmt::memory_buffer* out) -> void;
+auto prettyFormatNumber(int num, fmt::memory_buffer* out) -> void;
+auto formatIpv4(uint32_t ipv4, fmt::memory_buffer* out) -> void;
+
+template <typename T>
+auto appendValue(fmt::memory_buffer* out, T const& value) -> void
+{
+    fmt::format_to(std::back_inserter(*out), "{}", value);
+}
+
+inline auto appendString(fmt::memory_buffer* out, std::string_view str) -> void
+{
+    out->append(str.data(), str.data() + str.size());
+}
+
+/**
+ * Pad the buffer with spaces up to size
+ */
+inline auto padTo(fmt::memory_buffer* out, size_t size) -> void
+{
+    while (out->size() < size) {
+        out->push_back(' ');
+    }
+}
+
 auto getIpToFqdn(std::vector<std::string> const& initialDomains) -> std::map<uint32_t, std::string>;
 auto getDomainToServerPort(std::vector<std::string> const& initialServerPorts) -> std::map<std::string, uint16_t>;
 
 auto packetToTimeval(Tins::Packet const& packet) -> timeval;
 auto ipv4ToString(uint32_t ipv4) -> std::string;
+auto mixHash(uint64_t hash) -> uint64_t;
 } // namespace flowstats
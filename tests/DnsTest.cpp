@@ -1,5 +1,7 @@
 #include "Collector.hpp"
+#include "DnsProto.hpp"
 #include "DnsStatsCollector.hpp"
+#include "DnsTransactionTable.hpp"
 #include "MainTest.hpp"
 #include <catch2/catch.hpp>
 
@@ -20,6 +22,11 @@ TEST_CASE("Dns queries timeout", "[dns]")
     auto aggregatedFlows = dnsStatsCollector.getAggregatedMap();
     REQUIRE(aggregatedFlows->size() == 3);
 
+    CHECK(dnsStatsCollector.getSnapshot()->getFlows().empty());
+    dnsStatsCollector.publishSnapshot();
+    dnsStatsCollector.resetMetrics();
+    CHECK(dnsStatsCollector.getSnapshot()->getFlows().size() == 3);
+
     auto firstKey = AggregatedKey::aggregatedDnsKey("test.com", Tins::DNS::A, Transport::UDP);
     auto firstFlow = aggregatedFlows->at(firstKey);
     std::map<Field, std::string> cltValues;
@@ -52,3 +59,207 @@ TEST_CASE("Dns rcrd/rsps", "[dns]")
     CHECK(cltValues[Field::REQ] == "1");
     CHECK(cltValues[Field::RCRD_AVG] == "48");
 }
+
+TEST_CASE("Dns wire parser", "[dns]")
+{
+    // Response to test.com A with a compressed answer name
+    std::vector<uint8_t> message = {
+        0x12, 0x34, 0x83, 0x83, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+        4, 't', 'e', 's', 't', 3, 'c', 'o', 'm', 0, 0x00, 0x01, 0x00, 0x01,
+        0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x04, 10, 0, 0, 1,
+        0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x10,
+        0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+    };
+    DnsMessage dns;
+    REQUIRE(dns.parse(message.data(), message.size()));
+    CHECK(dns.getId() == 0x1234);
+    CHECK(dns.isResponse());
+    CHECK(dns.isTruncated());
+    CHECK(dns.getRcode() == 3);
+    CHECK(dns.getQname() == "test.com");
+    CHECK(dns.getQtype() == Tins::DNS::A);
+    CHECK(dns.getAnswerCount() == 2);
+
+    DnsAnswer answer;
+    REQUIRE(dns.nextAnswer(&answer));
+    CHECK(answer.type == Tins::DNS::A);
+    CHECK(answer.ttl == 3600);
+    REQUIRE(answer.rdataSize == 4);
+    CHECK(answer.rdata[0] == 10);
+    REQUIRE(dns.nextAnswer(&answer));
+    CHECK(answer.type == Tins::DNS::AAAA);
+    CHECK(answer.rdataSize == 16);
+    CHECK_FALSE(dns.nextAnswer(&answer));
+
+    // A truncated record ends the answers
+    auto truncated = message;
+    truncated.resize(message.size() - 4);
+    REQUIRE(dns.parse(truncated.data(), truncated.size()));
+    CHECK(dns.nextAnswer(&answer));
+    CHECK_FALSE(dns.nextAnswer(&answer));
+
+    // Question names pointing forward or to themselves are rejected
+    auto looping = message;
+    looping[12] = 0xc0;
+    looping[13] = 0x0c;
+    CHECK_FALSE(dns.parse(looping.data(), looping.size()));
+    looping[13] = 0x1a;
+    CHECK_FALSE(dns.parse(looping.data(), looping.size()));
+
+    std::vector<uint8_t> longName(message.begin(), message.begin() + 12);
+    for (int i = 0; i < 5; ++i) {
+        longName.push_back(63);
+        longName.insert(longName.end(), 63, 'a');
+    }
+    longName.insert(longName.end(), { 0, 0x00, 0x01, 0x00, 0x01 });
+    CHECK_FALSE(dns.parse(longName.data(), longName.size()));
+    CHECK_FALSE(dns.parse(message.data(), 11));
+}
+
+/**
+ * Test.com A query, or its response with a single answer
+ */
+static auto testComMessage(uint16_t id, bool response) -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> message = {
+        uint8_t(id >> 8), uint8_t(id), uint8_t(response ? 0x81 : 0x01), uint8_t(response ? 0x80 : 0x00),
+        0x00, 0x01, 0x00, uint8_t(response ? 1 : 0), 0x00, 0x00, 0x00, 0x00,
+        4, 't', 'e', 's', 't', 3, 'c', 'o', 'm', 0, 0x00, 0x01, 0x00, 0x01
+    };
+    if (response) {
+        message.insert(message.end(), { 0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01,
+                                          0x00, 0x00, 0x0e, 0x10, 0x00, 0x04, 10, 0, 0, 1 });
+    }
+    return message;
+}
+
+static auto dnsPacket(std::vector<uint8_t> const& message, uint32_t clientIp,
+    uint16_t clientPort, bool response, time_t ts) -> PacketView
+{
+    PacketView packet;
+    packet.ts = { ts, 0 };
+    packet.transport = Transport::UDP;
+    packet.ips = { IPv4(clientIp), IPv4(0x35000000) };
+    packet.ports = { clientPort, 53 };
+    if (response) {
+        std::swap(packet.ips[0], packet.ips[1]);
+        std::swap(packet.ports[0], packet.ports[1]);
+    }
+    packet.payload = message.data();
+    packet.payloadSize = message.size();
+    packet.frameSize = message.size() + 28;
+    return packet;
+}
+
+TEST_CASE("Dns transactions are matched on client and id", "[dns]")
+{
+    auto tester = Tester();
+    auto& dnsStatsCollector = tester.getDnsStatsCollector();
+    auto query = testComMessage(7, false);
+    auto response = testComMessage(7, true);
+
+    // Two clients use the same transaction id, responses come in reverse order
+    std::vector<PacketView> packets = {
+        dnsPacket(query, 1, 1000, false, 1),
+        dnsPacket(query, 2, 1000, false, 1),
+        dnsPacket(response, 2, 1000, true, 1),
+        dnsPacket(response, 1, 1000, true, 1),
+    };
+    for (auto const& packet : packets) {
+        dnsStatsCollector.advanceTick(packet.ts);
+        dnsStatsCollector.processPacket(packet, packet.getFlowId());
+    }
+    CHECK(dnsStatsCollector.getTransactions().size() == 0);
+    dnsStatsCollector.advanceTick({ 10, 0 });
+
+    auto key = AggregatedKey::aggregatedDnsKey("test.com", Tins::DNS::A, Transport::UDP);
+    auto const* flow = dnsStatsCollector.getAggregatedMap()->at(key);
+    std::map<Field, std::string> values;
+    flow->fillValues(&values, FROM_CLIENT);
+    CHECK(values[Field::REQ] == "2");
+    CHECK(values[Field::TIMEOUTS] == "0");
+    CHECK(values[Field::SRT] == "2");
+}
+
+TEST_CASE("Dns responses changing the ip mapping", "[dns]")
+{
+    auto tester = Tester();
+    auto& dnsStatsCollector = tester.getDnsStatsCollector();
+    auto query = testComMessage(7, false);
+    auto response = testComMessage(7, true);
+
+    CHECK_FALSE(dnsStatsCollector.mayUpdateIpToFqdn(dnsPacket(query, 1, 1000, false, 1)));
+    CHECK(dnsStatsCollector.mayUpdateIpToFqdn(dnsPacket(response, 1, 1000, true, 1)));
+    for (auto const& packet : { dnsPacket(query, 1, 1000, false, 1), dnsPacket(response, 1, 1000, true, 1) }) {
+        dnsStatsCollector.processPacket(packet, packet.getFlowId());
+    }
+
+    // The same answer at the same time is already mapped, a later one
+    // extends the expiry
+    CHECK_FALSE(dnsStatsCollector.mayUpdateIpToFqdn(dnsPacket(response, 2, 1000, true, 1)));
+    CHECK(dnsStatsCollector.mayUpdateIpToFqdn(dnsPacket(response, 2, 1000, true, 2)));
+}
+
+TEST_CASE("Dns transaction table", "[dns]")
+{
+    auto query = testComMessage(7, false);
+    DnsMessage dns;
+    REQUIRE(dns.parse(query.data(), query.size()));
+    auto makeFlow = [&](uint16_t clientPort, time_t ts) {
+        auto packet = dnsPacket(query, 1, clientPort, false, ts);
+        return DnsFlow(packet, packet.getFlowId(), dns);
+    };
+    auto flowIdOf = [&](uint16_t clientPort) {
+        return dnsPacket(query, 1, clientPort, false, 0).getFlowId();
+    };
+
+    SECTION("Entries grow and expire in insertion order")
+    {
+        DnsTransactionTable table(1 << 20);
+        for (uint16_t i = 0; i < 1000; ++i) {
+            table.insert(i, makeFlow(i, i));
+        }
+        CHECK(table.size() == 1000);
+        for (uint16_t i = 0; i < 1000; i += 2) {
+            table.erase(flowIdOf(i), i);
+        }
+        for (uint16_t i = 0; i < 1000; ++i) {
+            CHECK((table.find(flowIdOf(i), i) != nullptr) == (i % 2 == 1));
+        }
+        // Same flow and id replaces the pending query
+        table.insert(1, makeFlow(1, 2000));
+        CHECK(table.size() == 500);
+
+        std::vector<time_t> expired;
+        table.expire(3000, [&](DnsFlow* flow) { expired.push_back(flow->getStartTv().tv_sec); });
+        REQUIRE(expired.size() == 500);
+        CHECK(std::is_sorted(expired.begin(), expired.end()));
+        CHECK(expired.back() == 2000);
+        CHECK(table.size() == 0);
+        CHECK(table.getEvicted() == 0);
+    }
+
+    SECTION("Default memory limit fits a million pending queries")
+    {
+        DnsTransactionTable table(FlowstatsConfiguration().getDnsTableBytes());
+        CHECK(table.getMaxEntries() >= 1000000);
+    }
+
+    SECTION("Oldest queries are evicted past the memory limit")
+    {
+        DnsTransactionTable table(0);
+        auto maxEntries = table.getMaxEntries();
+        for (uint16_t i = 0; i < 100; ++i) {
+            table.insert(i, makeFlow(i, i));
+        }
+        CHECK(table.size() == maxEntries);
+        CHECK(table.getEvicted() == 100 - maxEntries);
+        CHECK(table.find(flowIdOf(0), 0) == nullptr);
+        CHECK(table.find(flowIdOf(99), 99) != nullptr);
+
+        size_t numberExpired = 0;
+        table.expire(99, [&](DnsFlow* flow) { numberExpired++; });
+        CHECK(numberExpired == maxEntries - 1);
+        CHECK(table.size() == 1);
+    }
+}
@@ -13,6 +13,8 @@ Tester::Tester(bool perIpAggr)
     , dnsStatsCollector(conf, displayConf, &ipToFqdn)
     , sslStatsCollector(conf, displayConf, &ipToFqdn)
     , tcpStatsCollector(conf, displayConf, &ipToFqdn)
+    , collectors({ &dnsStatsCollector, &sslStatsCollector, &tcpStatsCollector })
+    , dispatcher(collectors)
 {
     auto logger = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
     spdlog::default_logger()->sinks().push_back(logger);
@@ -20,9 +22,6 @@ Tester::Tester(bool perIpAggr)
     spdlog::set_level(spdlog::level::debug);
     conf.setDisplayUnknownFqdn(true);
     conf.setPerIpAggr(perIpAggr);
-    collectors.push_back(&dnsStatsCollector);
-    collectors.push_back(&sslStatsCollector);
-    collectors.push_back(&tcpStatsCollector);
 }
 
 auto Tester::readPcap(std::string pcap, std::string bpf, bool advanceTick) -> int
@@ -33,38 +32,24 @@ auto Tester::readPcap(std::string pcap, std::string bpf, bool advanceTick) -> in
     REQUIRE(stat(fullPath.c_str(), &buffer) == 0);
 
     auto reader = Tins::FileSniffer(fullPath, bpf);
+    auto* handle = reader.get_pcap_handle();
+    auto decoder = PacketDecoder(pcap_datalink(handle));
 
     int i = 0;
-    while (true) {
-        Tins::Packet packet = reader.next_packet();
-        if (packet.timestamp().seconds() == 0) {
+    pcap_pkthdr* header;
+    uint8_t const* data;
+    while (pcap_next_ex(handle, &header, &data) == 1) {
+        if (header->ts.tv_sec == 0) {
             break;
         }
         i++;
 
-        auto const* pdu = packet.pdu();
-        auto const* ip = pdu->find_pdu<Tins::IP>();
-        auto const* ipv6 = pdu->find_pdu<Tins::IPv6>();
-        if (ip == nullptr && ipv6 == nullptr) {
+        PacketView view;
+        if (!decoder.decode(*header, data, &view)) {
             continue;
         }
-        Tins::PDU const* ipPdu = ip;
-        if (ip == nullptr) {
-            ipPdu = ipv6;
-        }
-        auto const* tcp = ipPdu->find_pdu<Tins::TCP>();
-        Tins::UDP const* udp = nullptr;
-        if (tcp == nullptr) {
-            udp = ipPdu->find_pdu<Tins::UDP>();
-        }
 
-        auto flowId = FlowId(ip, ipv6, tcp, udp);
-        for (auto collector : collectors) {
-            try {
-                collector->processPacket(packet, flowId, ip, ipv6, tcp, udp);
-            } catch (Tins::malformed_packet const&) {
-            }
-        }
+        dispatcher.processPacket(view, view.getFlowId());
     }
     SPDLOG_INFO("Processed {} packets", i);
 
@@ -75,3 +60,24 @@ auto Tester::readPcap(std::string pcap, std::string bpf, bool advanceTick) -> in
     }
     return 0;
 }
+
+auto Tester::readGenerator(TrafficGenerator* generator) -> int
+{
+    auto decoder = PacketDecoder();
+    int i = 0;
+    pcap_pkthdr header;
+    uint8_t const* data;
+    while (generator->next(&header, &data)) {
+        i++;
+        PacketView view;
+        if (!decoder.decode(header, data, &view)) {
+            continue;
+        }
+        dispatcher.dispatch(view, view.getFlowId());
+    }
+
+    for (auto collector : collectors) {
+        collector->advanceTick(maxTimeval);
+    }
+    return i;
+}
@@ -1,7 +1,9 @@
 #include "Collector.hpp"
 #include "DnsStatsCollector.hpp"
+#include "PacketClassifier.hpp"
 #include "SslStatsCollector.hpp"
 #include "TcpStatsCollector.hpp"
+#include "TrafficGenerator.hpp"
 
 using namespace flowstats;
 
@@ -15,6 +17,7 @@ public:
 
     auto readPcap(std::string pcap, std::string bpf = "",
         bool advanceTick = true) -> int;
+    auto readGenerator(TrafficGenerator* generator) -> int;
 
     auto getDnsStatsCollector() const -> DnsStatsCollector const& { return dnsStatsCollector; }
     auto getDnsStatsCollector() -> DnsStatsCollector& { return dnsStatsCollector; }
@@ -35,4 +38,5 @@ private:
     SslStatsCollector sslStatsCollector;
     TcpStatsCollector tcpStatsCollector;
     std::vector<Collector*> collectors;
+    PacketDispatcher dispatcher;
 };
@@ -0,0 +1,295 @@
+#include "MainTest.hpp"
+#include "PacketClassifier.hpp"
+#include "PcapAnalyzer.hpp"
+#include "PcapFileReader.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+
+using namespace flowstats;
+
+static std::vector<std::string> const testPcaps = {
+    "0_win.pcap", "6_sec_srt_extract.pcap", "dns_rcrds.pcap",
+    "dns_simple.pcap", "https.pcap", "inversed_srv.pcap", "ipv6.pcap",
+    "port_detection.pcap", "reuse_port.pcap", "rst_close.pcap",
+    "ssl_ack_srt.pcap", "ssl_alt_port.pcap", "ssl_simple.pcap",
+    "tcp_double.pcap", "tcp_gap.pcap", "tcp_mtu.pcap", "tcp_simple.pcap",
+    "testcom.pcap", "tls_stream_extract.pcap"
+};
+
+static auto pcapPath(std::string const& pcap) -> std::string
+{
+    return fmt::format("{}/pcaps/{}", TEST_PATH, pcap);
+}
+
+/**
+ * Collectors with one shard per worker, created like the command line
+ * does
+ */
+struct ShardedCollectors {
+    explicit ShardedCollectors(int numberWorkers)
+        : ipToFqdn(conf)
+    {
+        conf.setDisplayUnknownFqdn(true);
+        collectors = createCollectors();
+        for (int i = 1; i < numberWorkers; ++i) {
+            auto shards = createCollectors();
+            for (size_t j = 0; j < collectors.size(); ++j) {
+                collectors[j]->addShard(shards[j]);
+            }
+        }
+    }
+
+    ~ShardedCollectors()
+    {
+        for (auto* collector : collectors) {
+            delete collector;
+        }
+    }
+
+    auto createCollectors() -> std::vector<Collector*>
+    {
+        return { new DnsStatsCollector(conf, displayConf, &ipToFqdn),
+            new SslStatsCollector(conf, displayConf, &ipToFqdn),
+            new TcpStatsCollector(conf, displayConf, &ipToFqdn) };
+    }
+
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn;
+    std::vector<Collector*> collectors;
+};
+
+/**
+ * Append every displayed row of the published snapshot of a collector
+ */
+static auto appendRows(Collector* collector, std::string const& prefix,
+    std::vector<std::string>* rows) -> void
+{
+    for (size_t display = 0; display < collector->getDisplayPairs().size(); ++display) {
+        collector->updateDisplayType(display);
+        auto output = collector->outputStatus(0);
+        for (size_t row = 0; row < output.getRowCount(); ++row) {
+            rows->push_back(fmt::format("{}{} {} {}", prefix, collector->toString(),
+                output.getKey(row), output.getValue(row)));
+        }
+    }
+}
+
+/**
+ * Every displayed row of every collector, sorted to ignore the order
+ * of rows with the same sort key
+ */
+static auto analyzeRows(std::string const& pcap, int numberWorkers) -> std::vector<std::string>
+{
+    ShardedCollectors sharded(numberWorkers);
+    PcapFileReader reader(pcapPath(pcap));
+    REQUIRE(reader.open(""));
+    PcapAnalyzer analyzer(sharded.collectors, numberWorkers);
+    analyzer.analyze(&reader, [](timeval) {});
+
+    std::vector<std::string> rows;
+    for (auto* collector : sharded.collectors) {
+        for (int i = 0; i < numberWorkers; ++i) {
+            collector->getShard(i)->advanceTick(maxTimeval);
+        }
+        collector->publishSnapshot();
+        appendRows(collector, "", &rows);
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+/**
+ * Rows published by the callback at each second of the capture, like
+ * the screen refresh does
+ */
+static auto analyzeRowsPerSecond(std::string const& pcap, int numberWorkers) -> std::vector<std::string>
+{
+    ShardedCollectors sharded(numberWorkers);
+    PcapFileReader reader(pcapPath(pcap));
+    REQUIRE(reader.open(""));
+    PcapAnalyzer analyzer(sharded.collectors, numberWorkers);
+
+    std::vector<std::string> rows;
+    analyzer.analyze(&reader, [&](timeval ts) {
+        for (auto* collector : sharded.collectors) {
+            collector->publishSnapshot();
+            collector->resetMetrics();
+            appendRows(collector, fmt::format("{} ", ts.tv_sec), &rows);
+        }
+    });
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+TEST_CASE("Pcap file reader", "[pcap]")
+{
+    for (auto const& bpf : { std::string(), std::string("tcp") }) {
+        for (auto const& pcap : testPcaps) {
+            INFO("Reading " << pcap << " with filter '" << bpf << "'");
+            auto sniffer = Tins::FileSniffer(pcapPath(pcap), bpf);
+            auto* handle = sniffer.get_pcap_handle();
+            PcapFileReader reader(pcapPath(pcap));
+            REQUIRE(reader.open(bpf));
+            CHECK(reader.getLinkType() == pcap_datalink(handle));
+
+            pcap_pkthdr* expectedHeader;
+            uint8_t const* expectedData;
+            pcap_pkthdr header;
+            uint8_t const* data;
+            while (pcap_next_ex(handle, &expectedHeader, &expectedData) == 1) {
+                REQUIRE(reader.next(&header, &data));
+                CHECK(header.ts.tv_sec == expectedHeader->ts.tv_sec);
+                CHECK(header.ts.tv_usec == expectedHeader->ts.tv_usec);
+                CHECK(header.len == expectedHeader->len);
+                REQUIRE(header.caplen == expectedHeader->caplen);
+                CHECK(memcmp(data, expectedData, header.caplen) == 0);
+                CHECK(reader.contains(data));
+            }
+            CHECK_FALSE(reader.next(&header, &data));
+        }
+    }
+}
+
+TEST_CASE("Compressed pcap file reader", "[pcap]")
+{
+    std::vector<std::pair<std::string, std::string>> const compressedPcaps = {
+        { "testcom.pcap", "testcom.pcap.zst" },
+        { "dns_simple.pcap", "dns_simple.pcap.gz" },
+    };
+    for (auto const& [pcap, compressed] : compressedPcaps) {
+        INFO("Reading " << compressed);
+        PcapFileReader expectedReader(pcapPath(pcap));
+        REQUIRE(expectedReader.open(""));
+        // Small chunks to split records between them
+        PcapFileReader reader(pcapPath(compressed), 4096);
+        REQUIRE(reader.open(""));
+        CHECK(reader.getLinkType() == expectedReader.getLinkType());
+
+        pcap_pkthdr expectedHeader;
+        uint8_t const* expectedData;
+        pcap_pkthdr header;
+        uint8_t const* data;
+        while (expectedReader.next(&expectedHeader, &expectedData)) {
+            REQUIRE(reader.next(&header, &data));
+            CHECK(header.ts.tv_sec == expectedHeader.ts.tv_sec);
+            CHECK(header.ts.tv_usec == expectedHeader.ts.tv_usec);
+            REQUIRE(header.caplen == expectedHeader.caplen);
+            CHECK(memcmp(data, expectedData, header.caplen) == 0);
+            CHECK_FALSE(reader.contains(data));
+        }
+        CHECK_FALSE(reader.next(&header, &data));
+
+        CHECK(analyzeRows(compressed, 4) == analyzeRows(pcap, 1));
+    }
+}
+
+TEST_CASE("Parallel pcap analysis", "[pcap]")
+{
+    for (auto const& pcap : testPcaps) {
+        INFO("Analyzing " << pcap);
+        auto expected = analyzeRows(pcap, 1);
+        CHECK_FALSE(expected.empty());
+        CHECK(analyzeRows(pcap, 4) == expected);
+    }
+}
+
+TEST_CASE("Parallel pcap analysis callback", "[pcap]")
+{
+    for (auto const& pcap : testPcaps) {
+        INFO("Analyzing " << pcap);
+        auto expected = analyzeRowsPerSecond(pcap, 1);
+        CHECK_FALSE(expected.empty());
+        CHECK(analyzeRowsPerSecond(pcap, 4) == expected);
+    }
+}
+
+static auto tcpSegment(std::vector<uint8_t> const& payload, uint8_t flags, time_t ts) -> PacketView
+{
+    PacketView packet;
+    packet.ts = { ts, 0 };
+    packet.transport = Transport::TCP;
+    packet.ips = { IPv4("10.0.0.1"), IPv4("10.0.0.2") };
+    packet.ports = { 40000, 443 };
+    packet.flags = flags;
+    packet.payload = payload.data();
+    packet.payloadSize = uint32_t(payload.size());
+    packet.advertisedPayloadSize = packet.payloadSize;
+    return packet;
+}
+
+TEST_CASE("Packet classifier", "[pcap]")
+{
+    PacketClassifier classifier;
+    std::vector<uint8_t> const noPayload;
+    std::vector<uint8_t> const clientHello = { 0x16, 0x03, 0x01, 0x02, 0x00, 0x01, 0x00, 0x01, 0xfc, 0x03 };
+    std::vector<uint8_t> const request = { 'G', 'E', 'T', ' ', '/', ' ', 'H', 'T', 'T', 'P' };
+    auto const tcp = protocolBit(TCP);
+    auto const tcpSsl = ProtocolMask(protocolBit(TCP) | protocolBit(SSL));
+    auto classify = [&](PacketView const& packet) {
+        return classifier.classify(packet, packet.getFlowId());
+    };
+
+    SECTION("Dns ports")
+    {
+        auto packet = tcpSegment(request, 0, 1);
+        packet.transport = Transport::UDP;
+        CHECK(classify(packet) == 0);
+        packet.ports[1] = 53;
+        CHECK(classify(packet) == protocolBit(DNS));
+        packet.transport = Transport::TCP;
+        CHECK(classify(packet) == (protocolBit(DNS) | tcp));
+    }
+
+    SECTION("Tls flows are classified on their first record")
+    {
+        CHECK(classify(tcpSegment(noPayload, Tins::TCP::SYN, 1)) == tcp);
+        CHECK(classifier.getClassifiedFlows() == 0);
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 1)) == tcpSsl);
+        // Segments in the middle of a record stay in the tls flow
+        CHECK(classify(tcpSegment(request, Tins::TCP::ACK, 1)) == tcpSsl);
+        CHECK(classify(tcpSegment(noPayload, Tins::TCP::ACK, 1)) == tcp);
+        CHECK(classifier.getClassifiedFlows() == 1);
+    }
+
+    SECTION("Other flows are not probed after the first segments")
+    {
+        for (uint8_t i = 0; i < sslProbeSegments; ++i) {
+            CHECK(classify(tcpSegment(request, Tins::TCP::ACK, 1)) == tcp);
+        }
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 1)) == tcp);
+
+        // A new connection reusing the ports is probed again
+        CHECK(classify(tcpSegment(noPayload, Tins::TCP::SYN, 2)) == tcp);
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 2)) == tcpSsl);
+    }
+
+    SECTION("Tls flows are demoted after their handshake")
+    {
+        std::vector<uint8_t> const changeCipherSpec = { 0x14, 0x03, 0x03, 0x00, 0x01, 0x01 };
+        auto fromServer = [](PacketView packet) {
+            std::swap(packet.ips[0], packet.ips[1]);
+            std::swap(packet.ports[0], packet.ports[1]);
+            return packet;
+        };
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 1)) == tcpSsl);
+        CHECK(classify(fromServer(tcpSegment(clientHello, Tins::TCP::ACK, 1))) == tcpSsl);
+        CHECK(classify(fromServer(tcpSegment(changeCipherSpec, Tins::TCP::ACK, 1))) == tcpSsl);
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 1)) == tcp);
+        CHECK(classify(fromServer(tcpSegment(request, Tins::TCP::ACK, 1))) == tcp);
+        CHECK(classifier.getClassifiedFlows() == 1);
+
+        // A new connection reusing the ports is probed again
+        CHECK(classify(tcpSegment(noPayload, Tins::TCP::SYN, 2)) == tcp);
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 2)) == tcpSsl);
+    }
+
+    SECTION("Idle flows are dropped")
+    {
+        CHECK(classify(tcpSegment(clientHello, Tins::TCP::ACK, 10)) == tcpSsl);
+        classifier.advanceTick(10 + classifiedFlowTimeout);
+        CHECK(classifier.getClassifiedFlows() == 1);
+        classifier.advanceTick(11 + classifiedFlowTimeout);
+        CHECK(classifier.getClassifiedFlows() == 0);
+    }
+}
@@ -17,7 +17,7 @@ TEST_CASE("Ssl connection time", "[ssl]")
 
     auto ipFlows = tester.getSslStatsCollector().getAggregatedMap();
     REQUIRE(ipFlows.size() == 1);
-    AggregatedKey key("google.com", 0, {}, 443);
+    AggregatedKey key(internFqdn("google.com"), 0, {}, 443);
     auto flow = ipFlows[key];
     REQUIRE(flow != nullptr);
 
@@ -28,8 +28,9 @@ TEST_CASE("Ssl connection time", "[ssl]")
     flow->fillValues(&srvValues, FROM_SERVER);
 
     CHECK(cltValues[Field::DOMAIN] == "google.com");
-    CHECK(cltValues[Field::PKTS] == "8");
-    CHECK(srvValues[Field::PKTS] == "7");
+    // Only the handshake is dispatched to the ssl collector
+    CHECK(cltValues[Field::PKTS] == "2");
+    CHECK(srvValues[Field::PKTS] == "2");
     CHECK(cltValues[Field::CONN] == "1");
     CHECK(cltValues[Field::CT_P95] == "38ms");
 }
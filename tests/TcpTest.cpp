@@ -1,6 +1,7 @@
 #include "Collector.hpp"
 #include "DnsStatsCollector.hpp"
 #include "MainTest.hpp"
+#include "PktWorker.hpp"
 #include "TcpStatsCollector.hpp"
 #include "Utils.hpp"
 #include <catch2/catch.hpp>
@@ -42,7 +43,7 @@ TEST_CASE("Tcp simple", "[tcp]")
 
         auto flows = tcpStatsCollector.getTcpFlow();
         CHECK(flows.size() == 1);
-        CHECK(flows.begin()->second.getGap() == 0);
+        CHECK(flows.getIpv4Flows().begin()->second.getGap() == 0);
 
         AggregatedKey totalKey = AggregatedKey::aggregatedIpv4TcpKey("Total", 0, 0);
         std::map<Field, std::string> totalValues;
@@ -62,25 +63,46 @@ TEST_CASE("Tcp sort", "[tcp]")
         auto aggregatedMap = tcpStatsCollector.getAggregatedMap();
         REQUIRE(aggregatedMap->size() == 4);
 
-        auto flows = tcpStatsCollector.getAggregatedFlows();
+        tcpStatsCollector.publishSnapshot();
+        auto snapshot = tcpStatsCollector.getSnapshot();
+        auto flows = tcpStatsCollector.getAggregatedFlows(*snapshot);
         CHECK(flows[0]->getFqdn() == "news.ycombinator.com");
         CHECK(flows[1]->getFqdn() == "Unknown");
         CHECK(flows[2]->getFqdn() == "www.test.com");
         CHECK(flows[3]->getFqdn() == "www.test.com");
 
         tcpStatsCollector.setSortField(Field::FQDN, true);
-        flows = tcpStatsCollector.getAggregatedFlows();
+        flows = tcpStatsCollector.getAggregatedFlows(*snapshot);
         CHECK(flows[0]->getFqdn() == "www.test.com");
         CHECK(flows[1]->getFqdn() == "www.test.com");
         CHECK(flows[2]->getFqdn() == "Unknown");
         CHECK(flows[3]->getFqdn() == "news.ycombinator.com");
 
         tcpStatsCollector.setSortField(Field::PORT, false);
-        flows = tcpStatsCollector.getAggregatedFlows();
+        flows = tcpStatsCollector.getAggregatedFlows(*snapshot);
         CHECK(flows[0]->getSrvPort() == 80);
         CHECK(flows[1]->getSrvPort() == 443);
         CHECK(flows[2]->getSrvPort() == 443);
         CHECK(flows[3]->getSrvPort() == 443);
+
+        tcpStatsCollector.setSortField(Field::PORT, true);
+        flows = snapshot->getFlows();
+        tcpStatsCollector.sortFlows(&flows, 1);
+        CHECK(flows[0]->getSrvPort() == 443);
+        tcpStatsCollector.setSortField(Field::PORT, false);
+        tcpStatsCollector.sortFlows(&flows, 1);
+        CHECK(flows[0]->getSrvPort() == 80);
+
+        flows = snapshot->getFlows();
+        tcpStatsCollector.setSortField(Field::FQDN, true);
+        tcpStatsCollector.sortFlows(&flows, 2, 3);
+        CHECK(flows[2]->getFqdn() == "Unknown");
+
+        CollectorOutput output;
+        tcpStatsCollector.outputStatus(*snapshot, 0, &output, 3, 10);
+        CHECK(output.getFirstFlow() == 3);
+        CHECK(output.getFlowCount() == 4);
+        CHECK(output.getRowCount() == 4);
     }
 }
 
@@ -110,7 +132,7 @@ TEST_CASE("https pcap", "[tcp]")
 
         auto flows = tcpStatsCollector.getTcpFlow();
         REQUIRE(flows.size() == 1);
-        CHECK(flows.begin()->second.getGap() == 0);
+        CHECK(flows.getIpv4Flows().begin()->second.getGap() == 0);
     }
 }
 
@@ -243,7 +265,7 @@ TEST_CASE("Tcp rst", "[tcp]")
 
     auto& ipToFqdn = tester.getIpToFqdn();
     Tins::IPv4Address ip("10.142.226.42");
-    ipToFqdn.updateFqdn("whatever", { ip }, {});
+    ipToFqdn.updateFqdn(internFqdn("whatever"), { ip }, {});
 
     SECTION("Rst only close once")
     {
@@ -352,7 +374,7 @@ TEST_CASE("Gap in capture", "[tcp]")
 
         auto flows = tcpStatsCollector.getTcpFlow();
         CHECK(flows.size() == 1);
-        CHECK(flows.begin()->second.getGap() == 1);
+        CHECK(flows.getIpv4Flows().begin()->second.getGap() == 1);
     }
 }
 
@@ -416,3 +438,217 @@ TEST_CASE("Ipv6", "[tcp]")
         CHECK(srvValues[Field::BYTES] == "886 B");
     }
 }
+
+/**
+ * Ethernet frame of a 10.0.0.1:40000 <-> 10.0.0.2:80 tcp segment whose
+ * payload is truncated to capturedPayload bytes.
+ */
+static auto tcpFrame(bool fromClient, uint32_t seq, uint32_t ack, uint8_t flags,
+    uint16_t payloadSize, uint16_t capturedPayload) -> std::vector<uint8_t>
+{
+    std::array<uint8_t, 4> clientIp = { 10, 0, 0, 1 };
+    std::array<uint8_t, 4> serverIp = { 10, 0, 0, 2 };
+    uint16_t clientPort = 40000;
+    uint16_t serverPort = 80;
+    uint16_t totalLength = 20 + 20 + payloadSize;
+
+    std::vector<uint8_t> frame(12, 0);
+    frame.insert(frame.end(), { 0x08, 0x00 });
+    frame.insert(frame.end(), { 0x45, 0, uint8_t(totalLength >> 8), uint8_t(totalLength), 0, 0, 0, 0, 64, 6, 0, 0 });
+    auto const& src = fromClient ? clientIp : serverIp;
+    auto const& dst = fromClient ? serverIp : clientIp;
+    frame.insert(frame.end(), src.begin(), src.end());
+    frame.insert(frame.end(), dst.begin(), dst.end());
+    for (uint32_t value : { uint32_t(fromClient ? clientPort : serverPort) << 16 | (fromClient ? serverPort : clientPort), seq, ack }) {
+        frame.insert(frame.end(), { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) });
+    }
+    frame.insert(frame.end(), { 0x50, flags, 0xff, 0xff, 0, 0, 0, 0 });
+    frame.insert(frame.end(), capturedPayload, 'a');
+    return frame;
+}
+
+TEST_CASE("Truncated capture", "[tcp]")
+{
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn(conf);
+    TcpStatsCollector tcpStatsCollector(conf, displayConf, &ipToFqdn);
+    ipToFqdn.updateFqdn(internFqdn("example.com"), Tins::IPv4Address("10.0.0.2"), 10, 300);
+
+    PacketDecoder decoder;
+    auto process = [&](std::vector<uint8_t> const& frame) {
+        pcap_pkthdr header = {};
+        header.ts = { 10, 0 };
+        header.caplen = uint32_t(frame.size());
+        header.len = header.caplen;
+        PacketView view;
+        REQUIRE(decoder.decode(header, frame.data(), &view));
+        tcpStatsCollector.processPacket(view, view.getFlowId());
+        return view;
+    };
+
+    process(tcpFrame(true, 999, 0, Tins::TCP::SYN, 0, 0));
+    process(tcpFrame(false, 4999, 1000, Tins::TCP::SYN | Tins::TCP::ACK, 0, 0));
+    process(tcpFrame(true, 1000, 5000, Tins::TCP::ACK, 0, 0));
+    auto view = process(tcpFrame(true, 1000, 5000, Tins::TCP::PSH | Tins::TCP::ACK, 100, 10));
+    CHECK(view.payloadSize == 10);
+    CHECK(view.advertisedPayloadSize == 100);
+    process(tcpFrame(false, 5000, 1100, Tins::TCP::ACK, 0, 0));
+
+    SECTION("Sequence numbers use the advertised payload size")
+    {
+        auto const& flows = tcpStatsCollector.getTcpFlow();
+        REQUIRE(flows.size() == 1);
+        CHECK(flows.getIpv4Flows().begin()->second.getGap() == 0);
+    }
+}
+
+TEST_CASE("Capture worker decodes frames from its ring", "[tcp]")
+{
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn(conf);
+    TcpStatsCollector tcpStatsCollector(conf, displayConf, &ipToFqdn);
+    ipToFqdn.updateFqdn(internFqdn("example.com"), Tins::IPv4Address("10.0.0.2"), 10, 300);
+
+    PktWorker worker({ &tcpStatsCollector }, DLT_EN10MB);
+    worker.start();
+    auto enqueue = [&](std::vector<uint8_t> const& frame) {
+        pcap_pkthdr header = {};
+        header.ts = { 10, 0 };
+        header.caplen = uint32_t(frame.size());
+        header.len = header.caplen;
+        worker.enqueue(header, frame.data());
+    };
+    enqueue(tcpFrame(true, 999, 0, Tins::TCP::SYN, 0, 0));
+    enqueue(tcpFrame(false, 4999, 1000, Tins::TCP::SYN | Tins::TCP::ACK, 0, 0));
+    enqueue(tcpFrame(true, 1000, 5000, Tins::TCP::PSH | Tins::TCP::ACK, 100, 100));
+    worker.stop();
+
+    CHECK(worker.getDroppedPackets() == 0);
+    auto const& flows = tcpStatsCollector.getTcpFlow();
+    REQUIRE(flows.size() == 1);
+    auto const& flow = flows.getIpv4Flows().begin()->second;
+    CHECK(flow.getTotalPackets()[FROM_CLIENT] == 2);
+    CHECK(flow.getTotalBytes()[FROM_CLIENT] >= 100);
+}
+
+TEST_CASE("Capture worker expires flows on queued ticks", "[tcp]")
+{
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn(conf);
+    TcpStatsCollector tcpStatsCollector(conf, displayConf, &ipToFqdn);
+    ipToFqdn.updateFqdn(internFqdn("example.com"), Tins::IPv4Address("10.0.0.2"), 10, 300);
+
+    PktWorker worker({ &tcpStatsCollector }, DLT_EN10MB);
+    worker.start();
+    auto frame = tcpFrame(true, 999, 0, Tins::TCP::SYN, 0, 0);
+    pcap_pkthdr header = {};
+    header.ts = { 10, 0 };
+    header.caplen = uint32_t(frame.size());
+    header.len = header.caplen;
+    worker.enqueue(header, frame.data());
+    // No other packet reaches this worker, only the ticks sent to all
+    for (time_t second = 11; second <= 12 + conf.getTimeoutFlow(); ++second) {
+        worker.enqueueTick({ second, 0 });
+    }
+    worker.stop();
+
+    CHECK(worker.getDroppedPackets() == 0);
+    CHECK(tcpStatsCollector.getTcpFlow().size() == 0);
+}
+
+TEST_CASE("Tcp flows without fqdn are cached", "[tcp]")
+{
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn(conf);
+    TcpStatsCollector tcpStatsCollector(conf, displayConf, &ipToFqdn);
+
+    Tins::IPv4Address srvIp("10.0.0.2");
+    PacketView packet;
+    packet.ts = { 10, 0 };
+    packet.ips = { Tins::IPv4Address("10.0.0.1"), srvIp };
+    packet.ports = { 40000, 443 };
+    packet.flags = Tins::TCP::SYN;
+    auto flowId = packet.getFlowId();
+
+    tcpStatsCollector.processPacket(packet, flowId);
+    tcpStatsCollector.processPacket(packet, flowId);
+    CHECK(tcpStatsCollector.getTcpFlow().size() == 0);
+    CHECK(tcpStatsCollector.getUnknownFlows().size() == 1);
+
+    SECTION("Refreshing a mapping keeps cached lookups")
+    {
+        auto version = ipToFqdn.getMappingVersion(srvIp);
+        ipToFqdn.updateFqdn(internFqdn("example.com"), srvIp, 10, 300);
+        CHECK_FALSE(ipToFqdn.isCurrent(version));
+        version = ipToFqdn.getMappingVersion(srvIp);
+        ipToFqdn.updateFqdn(internFqdn("example.com"), srvIp, 20, 300);
+        CHECK(ipToFqdn.isCurrent(version));
+    }
+
+    SECTION("A dns answer for the server invalidates the flow")
+    {
+        ipToFqdn.updateFqdn(internFqdn("example.com"), srvIp, 10, 300);
+        tcpStatsCollector.processPacket(packet, flowId);
+        CHECK(tcpStatsCollector.getTcpFlow().size() == 1);
+    }
+
+    SECTION("Idle flows are dropped")
+    {
+        tcpStatsCollector.advanceTick({ 10 + conf.getTimeoutFlow() + 1, 0 });
+        CHECK(tcpStatsCollector.getUnknownFlows().size() == 0);
+    }
+}
+
+TEST_CASE("Only modified aggregated flows are published", "[tcp]")
+{
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn(conf);
+    TcpStatsCollector tcpStatsCollector(conf, displayConf, &ipToFqdn);
+    ipToFqdn.updateFqdn(internFqdn("example.com"), Tins::IPv4Address("10.0.0.2"), 10, 300);
+    ipToFqdn.updateFqdn(internFqdn("example.org"), Tins::IPv4Address("10.0.0.3"), 10, 300);
+
+    auto sendSyn = [&](char const* srvIp) {
+        PacketView packet;
+        packet.ts = { 10, 0 };
+        packet.ips = { Tins::IPv4Address("10.0.0.1"), Tins::IPv4Address(srvIp) };
+        packet.ports = { 40000, 443 };
+        packet.flags = Tins::TCP::SYN;
+        tcpStatsCollector.processPacket(packet, packet.getFlowId());
+    };
+    auto publish = [&]() {
+        tcpStatsCollector.publishSnapshot();
+        tcpStatsCollector.resetMetrics();
+        auto snapshot = tcpStatsCollector.getSnapshot();
+        std::map<std::string, Flow const*> flows;
+        for (auto const* flow : snapshot->getFlows()) {
+            flows[flow->getFqdn()] = flow;
+        }
+        return std::make_pair(snapshot, flows);
+    };
+
+    sendSyn("10.0.0.2");
+    sendSyn("10.0.0.3");
+    auto [firstSnapshot, first] = publish();
+    REQUIRE(first.size() == 2);
+    CHECK(first["example.com"]->getPackets()[FROM_CLIENT] == 1);
+
+    // The reset values are published once
+    auto [secondSnapshot, second] = publish();
+    REQUIRE(second.size() == 2);
+    CHECK(second["example.com"] != first["example.com"]);
+    CHECK(second["example.com"]->getPackets()[FROM_CLIENT] == 0);
+    CHECK(second["example.com"]->getTotalPackets()[FROM_CLIENT] == 1);
+
+    sendSyn("10.0.0.3");
+    auto [thirdSnapshot, third] = publish();
+    REQUIRE(third.size() == 2);
+    CHECK(third["example.com"] == second["example.com"]);
+    CHECK(third["example.org"] != second["example.org"]);
+    CHECK(third["example.org"]->getPackets()[FROM_CLIENT] == 1);
+    CHECK(third["example.org"]->getTotalPackets()[FROM_CLIENT] == 2);
+}
@@ -0,0 +1,128 @@
+#include "MainTest.hpp"
+#include "TrafficGenerator.hpp"
+#include "Utils.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+
+using namespace flowstats;
+
+/**
+ * Few enough points for percentiles to stay exact
+ */
+static auto smallProfile() -> TrafficProfile
+{
+    TrafficProfile profile;
+    profile.durationSeconds = 20;
+    profile.connectionRate = 10;
+    profile.numberFqdns = 1;
+    profile.flowDuration = *Distribution::parse("const:1000");
+    profile.requestsPerFlow = *Distribution::parse("const:1");
+    profile.dnsRate = 5;
+    profile.dnsTcpFraction = 0;
+    profile.dnsTimeoutFraction = 0.2;
+    return profile;
+}
+
+static auto formatMs(uint32_t ms) -> std::string
+{
+    return fmt::format("{}ms", ms);
+}
+
+TEST_CASE("Distribution parsing", "[generator]")
+{
+    CHECK(Distribution::parse("const:10")->sample(0.5, 0.5) == 10);
+    CHECK(Distribution::parse("uniform:10:20")->sample(0.5, 0.5) == 15);
+    CHECK(Distribution::parse("lognormal:20:0.5")->sample(0.5, 0.25) == 20);
+    CHECK(Distribution::parse("exp:10").has_value());
+    CHECK_FALSE(Distribution::parse("exp").has_value());
+    CHECK_FALSE(Distribution::parse("uniform:20:10").has_value());
+    CHECK_FALSE(Distribution::parse("const:10:20").has_value());
+    CHECK_FALSE(Distribution::parse("pareto:1").has_value());
+}
+
+TEST_CASE("Generated traffic is deterministic", "[generator]")
+{
+    auto profile = smallProfile();
+    profile.dnsTcpFraction = 0.5;
+    TrafficGenerator first(profile);
+    TrafficGenerator second(profile);
+    pcap_pkthdr firstHeader;
+    pcap_pkthdr secondHeader;
+    uint8_t const* firstData;
+    uint8_t const* secondData;
+    uint64_t packets = 0;
+    while (first.next(&firstHeader, &firstData)) {
+        REQUIRE(second.next(&secondHeader, &secondData));
+        REQUIRE(firstHeader.caplen == secondHeader.caplen);
+        CHECK(timevalInMs(firstHeader.ts) == timevalInMs(secondHeader.ts));
+        CHECK(memcmp(firstData, secondData, firstHeader.caplen) == 0);
+        packets++;
+    }
+    CHECK_FALSE(second.next(&secondHeader, &secondData));
+    CHECK(first.getGroundTruth().packets == packets);
+    CHECK(first.getGroundTruth().dnsTcp > 0);
+}
+
+TEST_CASE("Generated traffic ground truth", "[generator]")
+{
+    auto tester = Tester();
+    auto profile = smallProfile();
+
+    SECTION("Tcp and dns collectors match the ground truth")
+    {
+        profile.tlsFraction = 0;
+        TrafficGenerator generator(profile);
+        tester.readGenerator(&generator);
+        auto const& truth = generator.getGroundTruth();
+        REQUIRE(truth.tcpConnections > 100);
+        REQUIRE(truth.srts.getCount() < 256);
+
+        auto const& tcpStatsCollector = tester.getTcpStatsCollector();
+        auto tcpKey = AggregatedKey::aggregatedIpv4TcpKey(TrafficGenerator::getFqdn(0), 0, 80);
+        auto const& aggregatedMap = tcpStatsCollector.getAggregatedMap();
+        REQUIRE(aggregatedMap.size() == 1);
+        auto it = aggregatedMap.find(tcpKey);
+        REQUIRE(it != aggregatedMap.end());
+        // Percentiles are only sorted when merged on publication
+        it->second->mergePercentiles();
+        std::map<Field, std::string> values;
+        it->second->fillValues(&values, FROM_CLIENT);
+        CHECK(values[Field::CONN] == prettyFormatNumber(truth.tcpConnections));
+        CHECK(values[Field::CT_P95] == formatMs(truth.connectTimes.getPercentile(0.95)));
+        CHECK(values[Field::CT_P99] == formatMs(truth.connectTimes.getPercentile(0.99)));
+        CHECK(values[Field::SRT] == prettyFormatNumber(truth.srts.getCount()));
+        CHECK(values[Field::SRT_P95] == formatMs(truth.srts.getPercentile(0.95)));
+        CHECK(values[Field::SRT_P99] == formatMs(truth.srts.getPercentile(0.99)));
+
+        uint64_t queries = 0;
+        uint64_t timeouts = 0;
+        for (auto const& [key, flow] : *tester.getDnsStatsCollector().getAggregatedMap()) {
+            std::map<Field, std::string> dnsValues;
+            flow->fillValues(&dnsValues, FROM_CLIENT);
+            queries += std::stoi(dnsValues[Field::REQ]);
+            timeouts += std::stoi(dnsValues[Field::TIMEOUTS]);
+        }
+        CHECK(queries == truth.dnsQueries);
+        CHECK(timeouts == truth.dnsQueries - truth.dnsResponses);
+    }
+
+    SECTION("Ssl collector matches the ground truth")
+    {
+        profile.tlsFraction = 1;
+        TrafficGenerator generator(profile);
+        tester.readGenerator(&generator);
+        auto const& truth = generator.getGroundTruth();
+        REQUIRE(truth.tlsHandshakes.getCount() > 100);
+
+        auto sslKey = AggregatedKey::aggregatedIpv4TcpKey(TrafficGenerator::getFqdn(0), 0, 443);
+        auto const& aggregatedMap = tester.getSslStatsCollector().getAggregatedMap();
+        auto it = aggregatedMap.find(sslKey);
+        REQUIRE(it != aggregatedMap.end());
+        it->second->mergePercentiles();
+        std::map<Field, std::string> values;
+        it->second->fillValues(&values, FROM_CLIENT);
+        CHECK(values[Field::CONN] == prettyFormatNumber(truth.tlsHandshakes.getCount()));
+        CHECK(values[Field::CT_P95] == formatMs(truth.tlsHandshakes.getPercentile(0.95)));
+        CHECK(values[Field::CT_P99] == formatMs(truth.tlsHandshakes.getPercentile(0.99)));
+    }
+}
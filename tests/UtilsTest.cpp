@@ -1,9 +1,19 @@
 #include "Utils.hpp"
 #include "Collector.hpp"
 #include "DnsStatsCollector.hpp"
+#include "ExpiringIndex.hpp"
+#include "ExpiryWheel.hpp"
+#include "FlatMap.hpp"
+#include "InternalStats.hpp"
+#include "MetricsSender.hpp"
+#include "PacketRing.hpp"
 #include "MainTest.hpp"
 #include "TcpStatsCollector.hpp"
 #include <catch2/catch.hpp>
+#include <map>
+#include <set>
+#include <thread>
+#include <unordered_map>
 
 using namespace flowstats;
 
@@ -23,3 +33,570 @@ TEST_CASE("Fqdn sort", "[sort]")
     CHECK(vec1[4]->getFqdn() == "z1");
 }
 
+TEST_CASE("Sorted windows page through tied flows", "[sort]")
+{
+    DisplayConfiguration displayConf;
+    FlowstatsConfiguration conf;
+    IpToFqdn ipToFqdn(conf);
+    TcpStatsCollector tcpStatsCollector(conf, displayConf, &ipToFqdn);
+
+    // 200 flows on 3 sort key values
+    std::vector<Flow> flows;
+    flows.reserve(200);
+    PacketView packet;
+    for (int i = 0; i < 200; ++i) {
+        auto& flow = flows.emplace_back(fmt::format("fqdn{}", i % 3));
+        for (int j = 0; j < i % 3; ++j) {
+            flow.addPacket(packet, FROM_CLIENT);
+        }
+    }
+
+    size_t const pageSize = 20;
+    for (auto field : { Field::PKTS, Field::FQDN }) {
+        for (bool reversed : { false, true }) {
+            tcpStatsCollector.setSortField(field, reversed);
+            std::set<Flow const*> shown;
+            for (size_t begin = 0; begin < flows.size(); begin += pageSize) {
+                std::vector<Flow const*> sorted;
+                for (auto const& flow : flows) {
+                    sorted.push_back(&flow);
+                }
+                tcpStatsCollector.sortFlows(&sorted, begin, begin + pageSize);
+                shown.insert(sorted.begin() + begin, sorted.begin() + begin + pageSize);
+            }
+            CHECK(shown.size() == flows.size());
+        }
+    }
+}
+
+TEST_CASE("Percentile sketch", "[percentile]")
+{
+    SECTION("Small sets are exact")
+    {
+        Percentile perc;
+        for (uint32_t i = 1; i <= 100; ++i) {
+            perc.addPoint(i);
+        }
+        perc.merge();
+        CHECK(perc.getCount() == 100);
+        CHECK(perc.getPercentile(0.95) == 95);
+        CHECK(perc.getPercentile(0.99) == 99);
+        CHECK(perc.getPercentile(1) == 100);
+        CHECK(perc.getMean() == Approx(50.5));
+    }
+
+    SECTION("Large sets stay within relative error")
+    {
+        Percentile perc;
+        Percentile other;
+        for (uint32_t i = 1; i <= 50000; ++i) {
+            perc.addPoint(i);
+            other.addPoint(i + 50000);
+        }
+        perc.addPoints(other);
+        perc.merge();
+        CHECK(perc.getCount() == 100000);
+        CHECK(perc.getPercentile(0.95) == Approx(95000).epsilon(0.01));
+        CHECK(perc.getPercentile(0.99) == Approx(99000).epsilon(0.01));
+        CHECK(perc.getPercentile(1) == 100000);
+        CHECK(perc.getPercentile(0) == 1);
+        CHECK(perc.getMean() == Approx(50000.5));
+    }
+}
+
+TEST_CASE("Flow id canonical order", "[flowid]")
+{
+    std::array<IPv4, 2> ips = { IPv4("10.0.0.1"), IPv4("10.0.0.2") };
+    std::array<IPv4, 2> reversedIps = { ips[1], ips[0] };
+
+    SECTION("Both directions share the same key")
+    {
+        std::array<Port, 2> ports = { 43210, 443 };
+        std::array<Port, 2> reversedPorts = { 443, 43210 };
+        auto flowId = FlowId(ports, ips, Transport::TCP);
+        auto reversedFlowId = FlowId(reversedPorts, reversedIps, Transport::TCP);
+        CHECK(flowId == reversedFlowId);
+        CHECK(flowId.hash() == reversedFlowId.hash());
+        CHECK(flowId.getPort(0) == 43210);
+        CHECK(FlowId::packetDirection(ports, ips) == FROM_CLIENT);
+        CHECK(FlowId::packetDirection(reversedPorts, reversedIps) == FROM_SERVER);
+    }
+
+    SECTION("Same ports are ordered by ip")
+    {
+        std::array<Port, 2> ports = { 53, 53 };
+        auto flowId = FlowId(ports, ips, Transport::UDP);
+        auto reversedFlowId = FlowId(ports, reversedIps, Transport::UDP);
+        CHECK(flowId == reversedFlowId);
+        CHECK(FlowId::packetDirection(ports, ips) != FlowId::packetDirection(ports, reversedIps));
+    }
+}
+
+TEST_CASE("Fqdn interning", "[fqdn]")
+{
+    auto fqdnId = internFqdn("www.example.com");
+    CHECK(internFqdn(std::string("www.example.com")) == fqdnId);
+    CHECK(internFqdn("example.com") != fqdnId);
+    CHECK(fqdnToString(fqdnId) == "www.example.com");
+    CHECK(fqdnToString(emptyFqdnId).empty());
+
+    // Concurrent interning spans several chunks and agrees on the ids
+    size_t const numberFqdns = 5000;
+    std::vector<std::vector<FqdnId>> threadIds(4);
+    std::vector<std::thread> threads;
+    for (auto& ids : threadIds) {
+        threads.emplace_back([&ids, numberFqdns] {
+            for (size_t i = 0; i < numberFqdns; ++i) {
+                ids.push_back(internFqdn(fmt::format("host{}.example.com", i)));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto const& ids : threadIds) {
+        CHECK(ids == threadIds[0]);
+    }
+    for (size_t i = 0; i < numberFqdns; ++i) {
+        CHECK(fqdnToString(threadIds[0][i]) == fmt::format("host{}.example.com", i));
+    }
+}
+
+TEST_CASE("Expiring index", "[index]")
+{
+    ExpiringIndex<uint32_t> index;
+
+    SECTION("Entries expire")
+    {
+        CHECK(index.update(1, 10, 100, 0));
+        CHECK(index.find(1, 100) == 10);
+        CHECK(!index.find(1, 101).has_value());
+        CHECK(!index.find(2, 0).has_value());
+
+        // Refreshing a live entry is not a new mapping
+        CHECK_FALSE(index.update(1, 10, 150, 50));
+        CHECK(index.update(1, 11, 200, 151));
+        CHECK(index.find(1, 150) == 11);
+        CHECK(index.size() == 1);
+    }
+
+    SECTION("Rebuild drops expired entries")
+    {
+        for (uint32_t i = 0; i < 2000; ++i) {
+            index.update(i, i, i < 1000 ? 10 : index.neverExpire, 0);
+        }
+        CHECK(index.find(1500, 20) == 1500);
+        CHECK(!index.find(500, 20).has_value());
+
+        for (uint32_t i = 2000; i < 4000; ++i) {
+            index.update(i, i, index.neverExpire, 20);
+        }
+        CHECK(index.find(3999, 20) == 3999);
+        CHECK(index.find(1000, 20) == 1000);
+        CHECK(index.size() < 4000);
+    }
+
+    SECTION("Readers see live entries across rebuilds")
+    {
+        for (uint32_t i = 0; i < 100; ++i) {
+            index.update(i, i, index.neverExpire, 0);
+        }
+        std::atomic_bool stopping = false;
+        std::atomic<int> mismatches = 0;
+        std::vector<std::thread> readers;
+        for (int reader = 0; reader < 4; ++reader) {
+            readers.emplace_back([&] {
+                while (!stopping.load()) {
+                    for (uint32_t i = 0; i < 100; ++i) {
+                        mismatches += index.find(i, 0) != i;
+                    }
+                }
+            });
+        }
+        for (uint32_t i = 100; i < 20000; ++i) {
+            index.update(i, i, index.neverExpire, 0);
+        }
+        stopping = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        CHECK(mismatches == 0);
+        CHECK(index.size() == 20000);
+    }
+}
+
+/**
+ * Value counting its live instances to check slots are destroyed
+ */
+struct CountedValue {
+    static inline int live = 0;
+    int value;
+
+    CountedValue(int value)
+        : value(value)
+    {
+        live++;
+    }
+    CountedValue(CountedValue const& other)
+        : value(other.value)
+    {
+        live++;
+    }
+    CountedValue(CountedValue&& other) noexcept
+        : value(other.value)
+    {
+        live++;
+    }
+    ~CountedValue() { live--; }
+};
+
+struct MixedHash {
+    auto operator()(uint32_t key) const -> size_t { return mixHash(key); }
+};
+
+/**
+ * Keys below 128 start probing at the first group, the next 128 keys at
+ * the second one of a 32 slots map
+ */
+struct GroupHash {
+    auto operator()(uint32_t key) const -> size_t { return key; }
+};
+
+TEST_CASE("Flat map", "[flatmap]")
+{
+    SECTION("Insert and erase churn matches a reference map")
+    {
+        {
+            FlatMap<uint32_t, CountedValue, MixedHash> map;
+            std::unordered_map<uint32_t, int> reference;
+            uint64_t state = 1;
+            for (int i = 0; i < 100000; ++i) {
+                state = mixHash(state + i);
+                auto key = uint32_t(state % 2000);
+                if (state & (1 << 20)) {
+                    auto inserted = map.emplace(key, i).second;
+                    CHECK(inserted == reference.emplace(key, i).second);
+                } else {
+                    CHECK(map.erase(key) == reference.erase(key));
+                }
+            }
+            CHECK(map.size() == reference.size());
+            CHECK(CountedValue::live == int(map.size()));
+            size_t seen = 0;
+            for (auto const& [key, value] : map) {
+                REQUIRE(reference.count(key) == 1);
+                CHECK(value.value == reference[key]);
+                seen++;
+            }
+            CHECK(seen == reference.size());
+        }
+        CHECK(CountedValue::live == 0);
+    }
+
+    SECTION("Tombstones are reused and cleaned on rehash")
+    {
+        FlatMap<uint32_t, CountedValue, GroupHash> map;
+        // The first group is full, the overflow goes to the second one
+        for (uint32_t key = 0; key < 27; ++key) {
+            map.emplace(key, key);
+        }
+        REQUIRE(map.getCapacity() == 32);
+
+        // A slot of a full group leaves a tombstone, reused by an insert
+        CHECK(map.erase(3) == 1);
+        CHECK(map.getDeleted() == 1);
+        map.emplace(100, 100);
+        CHECK(map.getDeleted() == 0);
+        CHECK(map.getCapacity() == 32);
+        CHECK(map.find(100) != map.end());
+        CHECK(map.find(4) != map.end());
+
+        for (uint32_t key : { 0, 1, 2, 100 }) {
+            CHECK(map.erase(key) == 1);
+        }
+        for (uint32_t key = 4; key < 16; ++key) {
+            CHECK(map.erase(key) == 1);
+        }
+        CHECK(map.getDeleted() == 16);
+        map.emplace(128, 128);
+        CHECK(map.getDeleted() == 16);
+        map.emplace(129, 129);
+        // Mostly tombstones, they are dropped without growing
+        CHECK(map.getDeleted() == 0);
+        CHECK(map.getCapacity() == 32);
+        CHECK(map.size() == 13);
+        for (uint32_t key = 16; key < 27; ++key) {
+            CHECK(map.find(key)->second.value == int(key));
+        }
+
+        // The second group has empty slots again
+        CHECK(map.erase(129) == 1);
+        CHECK(map.getDeleted() == 0);
+        CHECK(CountedValue::live == int(map.size()));
+    }
+
+    SECTION("Iteration skips erased entries")
+    {
+        FlatMap<uint32_t, CountedValue, MixedHash> map;
+        for (uint32_t key = 0; key < 1000; ++key) {
+            map.emplace(key, key);
+        }
+        for (auto it = map.begin(); it != map.end(); ++it) {
+            if (it->first % 2 == 1) {
+                map.erase(it);
+            }
+        }
+        CHECK(map.size() == 500);
+        size_t seen = 0;
+        for (auto const& [key, value] : map) {
+            CHECK(key % 2 == 0);
+            CHECK(value.value == int(key));
+            seen++;
+        }
+        CHECK(seen == 500);
+        CHECK(CountedValue::live == 500);
+    }
+
+    SECTION("Copy and move")
+    {
+        {
+            FlatMap<uint32_t, CountedValue, MixedHash> map;
+            for (uint32_t key = 0; key < 100; ++key) {
+                map.emplace(key, key);
+            }
+            auto copy = map;
+            copy.erase(uint32_t(0));
+            CHECK(map.size() == 100);
+            CHECK(copy.size() == 99);
+            CHECK(copy.find(99)->second.value == 99);
+            CHECK(CountedValue::live == 199);
+
+            auto moved = std::move(map);
+            CHECK(map.empty());
+            CHECK(map.find(1) == map.end());
+            CHECK(moved.size() == 100);
+            CHECK(CountedValue::live == 199);
+
+            copy = moved;
+            CHECK(copy.size() == 100);
+            CHECK(copy.find(0) != copy.end());
+            moved = std::move(copy);
+            CHECK(moved.size() == 100);
+            CHECK(CountedValue::live == 100);
+
+            // A moved from map can be used again
+            map.emplace(7, 7);
+            CHECK(map.find(7)->second.value == 7);
+        }
+        CHECK(CountedValue::live == 0);
+    }
+}
+
+TEST_CASE("Expiry wheel", "[wheel]")
+{
+    ExpiryWheel<int, 8> wheel;
+    std::vector<std::pair<int, time_t>> calls;
+
+    SECTION("Keys are due on their deadline second")
+    {
+        wheel.schedule(1, 3);
+        wheel.schedule(2, 5);
+        // Past deadlines are due on the next tick
+        wheel.schedule(3, 0);
+        auto drop = [&](int key) {
+            calls.emplace_back(key, 0);
+            return time_t(0);
+        };
+        wheel.advance(1, drop);
+        CHECK(calls == std::vector<std::pair<int, time_t>> { { 3, 0 } });
+        wheel.advance(2, drop);
+        CHECK(calls.size() == 1);
+        wheel.advance(4, drop);
+        CHECK(calls.size() == 2);
+        CHECK(calls.back().first == 1);
+        CHECK(wheel.size() == 1);
+        wheel.advance(5, drop);
+        CHECK(calls.back().first == 2);
+        CHECK(wheel.size() == 0);
+    }
+
+    SECTION("Rescheduled keys are due again")
+    {
+        // Deadlines past the wheel are reached in several turns
+        std::map<int, time_t> deadlines = { { 1, 30 }, { 2, 4 } };
+        for (auto const& [key, deadline] : deadlines) {
+            wheel.schedule(key, deadline);
+        }
+        auto check = [&](int key, time_t now) {
+            calls.emplace_back(key, now);
+            if (key == 2 && deadlines[key] == 4) {
+                deadlines[key] = 6;
+            }
+            return deadlines[key] <= now ? 0 : deadlines[key];
+        };
+        for (time_t now = 1; now <= 40; ++now) {
+            wheel.advance(now, [&](int key) { return check(key, now); });
+        }
+        CHECK(calls == std::vector<std::pair<int, time_t>> { { 2, 4 }, { 2, 6 }, { 1, 7 }, { 1, 14 }, { 1, 21 }, { 1, 28 }, { 1, 30 } });
+        CHECK(wheel.size() == 0);
+    }
+
+    SECTION("A jump past a full turn drains every slot")
+    {
+        for (int key = 1; key < 8; ++key) {
+            wheel.schedule(key, key);
+        }
+        CHECK(wheel.size() == 7);
+        std::set<int> seen;
+        wheel.advance(100, [&](int key) {
+            CHECK(seen.insert(key).second);
+            // Rescheduled keys wait for the next tick
+            return key == 1 ? time_t(50) : time_t(0);
+        });
+        CHECK(seen.size() == 7);
+        CHECK(wheel.size() == 1);
+
+        seen.clear();
+        wheel.advance(101, [&](int key) {
+            seen.insert(key);
+            return time_t(0);
+        });
+        CHECK(seen == std::set<int> { 1 });
+        CHECK(wheel.size() == 0);
+    }
+}
+
+TEST_CASE("Metrics datagram packing", "[metrics]")
+{
+    std::vector<std::string> metrics = { "a:1|c", "", "b:2|c", "c:3|c" };
+    auto datagrams = MetricsSender::packDatagrams(metrics, 11);
+    REQUIRE(datagrams.size() == 2);
+    CHECK(datagrams[0] == "a:1|c\nb:2|c");
+    CHECK(datagrams[1] == "c:3|c");
+
+    datagrams = MetricsSender::packDatagrams({ "toolong:1|c", "a:1|c" }, 5);
+    REQUIRE(datagrams.size() == 2);
+    CHECK(datagrams[0] == "toolong:1|c");
+}
+
+TEST_CASE("Metrics sender counts dropped datagrams", "[metrics]")
+{
+    MetricsSender sender({ DogFood::Mode::UDP, "invalid address", 8125 });
+    sender.start();
+    sender.enqueue([] { return std::vector<std::string> { "a:1|c", "b:2|c" }; });
+    sender.stop();
+    CHECK(sender.getSentDatagrams() == 0);
+    CHECK(sender.getDroppedDatagrams() == 1);
+}
+
+TEST_CASE("Metric sample rate", "[metrics]")
+{
+    auto tags = DogFood::Tags({ { "fqdn", "example.com" } });
+    CHECK(DogFood::Metric("a", 1, DogFood::Histogram, 0.5, tags) == "a:1.000000|h|@0.5|#fqdn:example.com");
+    // Rates of large histograms must not be rounded down to 0
+    CHECK(DogFood::Metric("a", 1, DogFood::Histogram, 1.0 / 3000000, tags) == "a:1.000000|h|@3.33333333e-07|#fqdn:example.com");
+}
+
+TEST_CASE("Row formatting", "[format]")
+{
+    CHECK(prettyFormatBytes(1536) == "1.5 KB");
+    CHECK(prettyFormatNumber(2000) == "2K");
+    CHECK(ipv4ToString(0x0100007f) == "127.0.0.1");
+
+    auto flow = AggregatedTcpFlow(FlowId(), internFqdn("a.very.long.fully.qualified.domain.name.test"));
+    FlowFormatter formatter;
+    formatter.setDisplayKeys({ Field::FQDN, Field::DIR });
+    formatter.setDisplayValues({ Field::PKTS, Field::SRT });
+
+    CollectorOutput output;
+    for (int i = 0; i < 2; ++i) {
+        output.clear("test", 0);
+        formatter.outputHeaders(&output);
+        formatter.outputRow(&flow, FROM_CLIENT, &output);
+        formatter.outputRow(&flow, FROM_SERVER, &output);
+        REQUIRE(output.getRowCount() == 2);
+    }
+    CHECK(output.getKeyHeaders() == fmt::format("{:<42} {:<6} ", "Fqdn", "Dir"));
+    CHECK(output.getKey(0) == fmt::format("{:<42.42} {:<6} ", flow.getFqdn(), "C->S"));
+    CHECK(output.getKey(1) == fmt::format("{:<42} {:<6} ", "", "S->C"));
+    CHECK(output.getValue(0) == fmt::format("{:<8} {:<8} ", "0", "0"));
+    CHECK(output.getValue(1) == fmt::format("{:<8} {:<8} ", "0", ""));
+}
+
+TEST_CASE("Packet ring", "[ring]")
+{
+    PacketRing ring(4096);
+    std::array<uint8_t, 900> frame = {};
+    pcap_pkthdr header = {};
+    header.caplen = frame.size();
+    header.len = frame.size();
+
+    int pushed = 0;
+    for (int i = 0; i < 10; ++i) {
+        frame[0] = uint8_t(i);
+        header.ts.tv_sec = i;
+        pushed += ring.push(header, frame.data());
+    }
+    CHECK(pushed == 4);
+    CHECK(ring.getDroppedPackets() == 6);
+    // Records are 8 bytes aligned with a 24 bytes header
+    size_t recordSize = 928;
+    CHECK(ring.getHighWater() == 4 * recordSize);
+
+    // Drained space is reused, records wrap at the end of the buffer
+    std::vector<int> seen;
+    auto collect = [&](pcap_pkthdr const& h, uint8_t const* data) {
+        CHECK(h.caplen == frame.size());
+        CHECK(data[0] == h.ts.tv_sec);
+        seen.push_back(h.ts.tv_sec);
+    };
+    CHECK(ring.drain(3, collect) == 3);
+    for (int i = 10; i < 13; ++i) {
+        frame[0] = uint8_t(i);
+        header.ts.tv_sec = i;
+        CHECK(ring.push(header, frame.data()));
+    }
+    CHECK(ring.drain(100, collect) == 4);
+    CHECK(seen == std::vector<int> { 0, 1, 2, 3, 10, 11, 12 });
+    CHECK(ring.getUsedBytes() == 0);
+
+    // Record 3, the wrap padding and records 10 to 12 filled the buffer
+    CHECK(ring.takeHighWater() == ring.getCapacity());
+    CHECK(ring.getHighWater() == 0);
+
+    // A new interval only sees the occupancy reached since the last one,
+    // 1000 bytes frames fill 1024 bytes records which never need a wrap
+    PacketRing steadyRing(4096);
+    std::array<uint8_t, 1000> largeFrame = {};
+    header.caplen = largeFrame.size();
+    for (int i = 0; i < 20; ++i) {
+        CHECK(steadyRing.push(header, largeFrame.data()));
+        CHECK(steadyRing.drain(100, [](pcap_pkthdr const&, uint8_t const*) {}) == 1);
+    }
+    CHECK(steadyRing.takeHighWater() == 1024);
+    CHECK(steadyRing.takeHighWater() == 0);
+}
+
+TEST_CASE("Latency histogram buckets", "[internal]")
+{
+    for (uint64_t value = 0; value < 16; ++value) {
+        CHECK(LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketIndex(value)) == value);
+    }
+    // Buckets are contiguous and cover their values within 12.5%
+    for (uint64_t value : { 17, 100, 1000, 123456, 1 << 30 }) {
+        auto index = LatencyHistogram::bucketIndex(value);
+        auto upper = LatencyHistogram::bucketUpperBound(index);
+        CHECK(upper >= value);
+        CHECK(upper - value <= value / 8);
+        CHECK(LatencyHistogram::bucketIndex(upper + 1) == index + 1);
+    }
+    CHECK(LatencyHistogram::bucketIndex(UINT64_MAX) == LatencyHistogram::numberBuckets - 1);
+    CHECK(LatencyHistogram::bucketUpperBound(LatencyHistogram::numberBuckets - 1) == UINT64_MAX);
+
+    LatencyHistogram histogram;
+    histogram.addPoint(100, 64);
+    histogram.addPoint(3, 1);
+    CHECK(histogram.getBucket(LatencyHistogram::bucketIndex(100)) == 64);
+    CHECK(histogram.getBucket(3) == 1);
+    CHECK(histogram.getSum() == 6403);
+}